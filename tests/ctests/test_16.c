@@ -0,0 +1,120 @@
+#include "types.h"
+#include "user.h"
+#include "stat.h"
+#include "mmap.h"
+#include "fcntl.h"
+
+int my_strcmp(const char *a, const char *b, int n) {
+    for (int i = 0; i < n; i++) {
+        if (a[i] != b[i]) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int main() {
+    char *filename = "test_file.txt";
+    int len = 100;
+    char buff[len];
+    char new_buff[len];
+    int prot = PROT_READ | PROT_WRITE;
+    int flags = MAP_SHARED;
+
+    /* Open a file */
+    int fd = open(filename, O_CREATE | O_RDWR);
+    if (fd < 0) {
+        printf(1, "Error opening file\n");
+	goto failed;
+    }
+
+    /* Write some data to the file */
+    for (int i = 0; i < len; i++) {
+        buff[i] = 'x';
+    }
+    if (write(fd, buff, len) != len) {
+        printf(1, "Error: Write to file FAILED\n");
+	goto failed;
+    }
+
+    /* mmap the file */
+    void *mem = mmap(0, len, prot, flags, fd, 0);
+    if (mem == (void *)-1) {
+        printf(1, "mmap FAILED\n");
+	goto failed;
+    }
+
+    /* modify the mapping and flush it synchronously */
+    char *mem_buff = (char *)mem;
+    for (int i = 0; i < len; i++) {
+        mem_buff[i] = 'a';
+        buff[i] = mem_buff[i];
+    }
+    if (msync(mem, len, MS_SYNC) < 0) {
+        printf(1, "msync FAILED\n");
+	goto failed;
+    }
+
+    /* The file should have the changes while the mapping is still there */
+    int fd2 = open(filename, O_RDWR);
+    if (fd2 < 0 || read(fd2, new_buff, len) != len) {
+        printf(1, "Read from file FAILED\n");
+	goto failed;
+    }
+    close(fd2);
+    if (my_strcmp(new_buff, buff, len) != 0) {
+        printf(1, "MS_SYNC writes not reflected in file\n");
+	goto failed;
+    }
+
+    /* modify it again and hand the pages to the flusher */
+    for (int i = 0; i < len; i++) {
+        mem_buff[i] = 'b';
+        buff[i] = mem_buff[i];
+    }
+    if (msync(mem, len, MS_ASYNC) < 0) {
+        printf(1, "msync FAILED\n");
+	goto failed;
+    }
+
+    /* Give the flusher a while to get to them */
+    int tries;
+    for (tries = 0; tries < 100; tries++) {
+        fd2 = open(filename, O_RDWR);
+        if (fd2 < 0 || read(fd2, new_buff, len) != len) {
+            printf(1, "Read from file FAILED\n");
+	    goto failed;
+        }
+        close(fd2);
+        if (my_strcmp(new_buff, buff, len) == 0) {
+            break;
+        }
+        sleep(1);
+    }
+    if (tries == 100) {
+        printf(1, "MS_ASYNC writes never reached the file\n");
+	goto failed;
+    }
+
+    /* Bad flags are rejected */
+    if (msync(mem, len, MS_SYNC | MS_ASYNC) != -1) {
+        printf(1, "msync accepted MS_SYNC | MS_ASYNC\n");
+	goto failed;
+    }
+
+    if (munmap(mem, len) < 0) {
+        printf(1, "munmap FAILED\n");
+	goto failed;
+    }
+
+    /* Clean and return */
+    close(fd);
+
+// success:
+    printf(1, "MMAP\t SUCCESS\n");
+    exit();
+
+failed:
+    printf(1, "MMAP\t FAILED\n");
+    exit();
+}
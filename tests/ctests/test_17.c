@@ -0,0 +1,68 @@
+#include "types.h"
+#include "user.h"
+#include "stat.h"
+#include "mmap.h"
+#include "fcntl.h"
+
+#define HUGE (4 * 1024 * 1024)
+
+int main() {
+    int len = 2 * HUGE;
+    int prot = PROT_READ | PROT_WRITE;
+    int flags = MAP_ANONYMOUS | MAP_PRIVATE | MAP_HUGE;
+
+    /* mmap two huge pages worth of anonymous memory */
+    void *mem = mmap(0, len, prot, flags, -1, 0);
+    if (mem == (void *)-1) {
+        printf(1, "mmap FAILED\n");
+        goto failed;
+    }
+    if ((uint)mem % HUGE != 0) {
+        printf(1, "MAP_HUGE mapping not 4MB aligned\n");
+        goto failed;
+    }
+
+    /* Touch one byte per page; every page should start zeroed */
+    char *charmem = (char *)mem;
+    for (int i = 0; i < len; i += 4096) {
+        if (charmem[i] != 0) {
+            printf(1, "Anonymous memory not zeroed\n");
+            goto failed;
+        }
+        charmem[i] = (char)(i / 4096);
+    }
+
+    /* Fork: the child sees the data and its writes stay private */
+    int pid = fork();
+    if (pid == 0) {
+        for (int i = 0; i < len; i += 4096) {
+            if (charmem[i] != (char)(i / 4096)) {
+                printf(1, "Data mismatch in child\n");
+                goto failed;
+            }
+            charmem[i] = 'b';
+        }
+        exit();
+    } else {
+        wait();
+        for (int i = 0; i < len; i += 4096) {
+            if (charmem[i] != (char)(i / 4096)) {
+                printf(1, "Parent data corrupted by child\n");
+                goto failed;
+            }
+        }
+    }
+
+    if (munmap(mem, len) < 0) {
+        printf(1, "munmap FAILED\n");
+        goto failed;
+    }
+
+// success:
+    printf(1, "MMAP\t SUCCESS\n");
+    exit();
+
+failed:
+    printf(1, "MMAP\t FAILED\n");
+    exit();
+}
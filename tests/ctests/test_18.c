@@ -0,0 +1,56 @@
+#include "types.h"
+#include "user.h"
+#include "stat.h"
+#include "mmap.h"
+#include "fcntl.h"
+
+int main() {
+    int len = 1024 * 1024;
+    int rounds = 300; /* 300MB in total: more than the machine has */
+    int prot = PROT_READ | PROT_WRITE;
+    int flags = MAP_ANONYMOUS | MAP_PRIVATE;
+
+    /* munmap must give the pages back, or this runs out of memory */
+    for (int r = 0; r < rounds; r++) {
+        void *mem = mmap(0, len, prot, flags, -1, 0);
+        if (mem == (void *)-1) {
+            printf(1, "mmap FAILED in round %d\n", r);
+            goto failed;
+        }
+
+        char *charmem = (char *)mem;
+        for (int i = 0; i < len; i += 4096) {
+            charmem[i] = (char)r;
+        }
+
+        if (munmap(mem, len) < 0) {
+            printf(1, "munmap FAILED in round %d\n", r);
+            goto failed;
+        }
+    }
+
+    /* The same goes for a mapping left behind by an exiting child */
+    for (int r = 0; r < 4; r++) {
+        int pid = fork();
+        if (pid == 0) {
+            char *charmem = (char *)mmap(0, len * 64, prot, flags, -1, 0);
+            if (charmem == (char *)-1) {
+                printf(1, "mmap FAILED in child\n");
+                goto failed;
+            }
+            for (int i = 0; i < len * 64; i += 4096) {
+                charmem[i] = 'c';
+            }
+            exit();
+        }
+        wait();
+    }
+
+// success:
+    printf(1, "MMAP\t SUCCESS\n");
+    exit();
+
+failed:
+    printf(1, "MMAP\t FAILED\n");
+    exit();
+}
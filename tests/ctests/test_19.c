@@ -0,0 +1,67 @@
+#include "types.h"
+#include "user.h"
+#include "stat.h"
+#include "mmap.h"
+#include "fcntl.h"
+
+#define PG 4096
+
+int main() {
+    int prot = PROT_READ | PROT_WRITE;
+    int flags = MAP_ANONYMOUS | MAP_PRIVATE;
+
+    /* Map four pages and fill them */
+    char *mem = (char *)mmap(0, 4 * PG, prot, flags, -1, 0);
+    if (mem == (char *)-1) {
+        printf(1, "mmap FAILED\n");
+        goto failed;
+    }
+    for (int i = 0; i < 4; i++) {
+        mem[i * PG] = 'a' + i;
+    }
+
+    /* Punch out the middle two pages */
+    if (munmap(mem + PG, 2 * PG) < 0) {
+        printf(1, "partial munmap FAILED\n");
+        goto failed;
+    }
+    if (mem[0] != 'a' || mem[3 * PG] != 'd') {
+        printf(1, "Pages around the hole lost their data\n");
+        goto failed;
+    }
+
+    /* The hole can be mapped again at a fixed address */
+    char *hole = (char *)mmap(mem + PG, 2 * PG, prot, flags | MAP_FIXED, -1, 0);
+    if (hole != mem + PG) {
+        printf(1, "mmap into the hole FAILED\n");
+        goto failed;
+    }
+    if (hole[0] != 0 || hole[PG] != 0) {
+        printf(1, "Remapped hole not zeroed\n");
+        goto failed;
+    }
+
+    /* The outer pages are untouched */
+    if (mem[0] != 'a' || mem[3 * PG] != 'd') {
+        printf(1, "Pages around the hole lost their data\n");
+        goto failed;
+    }
+
+    /* One munmap takes the whole range, however many pieces it was */
+    if (munmap(mem, 4 * PG) < 0) {
+        printf(1, "munmap FAILED\n");
+        goto failed;
+    }
+    if (munmap(mem, 4 * PG) != -1) {
+        printf(1, "munmap of an unmapped range succeeded\n");
+        goto failed;
+    }
+
+// success:
+    printf(1, "MMAP\t SUCCESS\n");
+    exit();
+
+failed:
+    printf(1, "MMAP\t FAILED\n");
+    exit();
+}
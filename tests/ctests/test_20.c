@@ -0,0 +1,88 @@
+#include "types.h"
+#include "user.h"
+#include "stat.h"
+#include "mmap.h"
+#include "fcntl.h"
+
+#define PG 4096
+
+int main() {
+    char *filename = "test_file.txt";
+    int prot = PROT_READ | PROT_WRITE;
+    char buff[PG];
+
+    /* Open a file */
+    int fd = open(filename, O_CREATE | O_RDWR);
+    if (fd < 0) {
+        printf(1, "Error opening file\n");
+        goto failed;
+    }
+
+    /* Write three pages, each filled with its own letter */
+    for (int p = 0; p < 3; p++) {
+        for (int i = 0; i < PG; i++) {
+            buff[i] = 'a' + p;
+        }
+        if (write(fd, buff, PG) != PG) {
+            printf(1, "Error: Write to file FAILED\n");
+            goto failed;
+        }
+    }
+
+    /* Unaligned offsets are rejected */
+    if (mmap(0, PG, prot, MAP_SHARED, fd, 100) != (void *)-1) {
+        printf(1, "mmap with an unaligned offset succeeded\n");
+        goto failed;
+    }
+
+    /* Map just the middle page */
+    char *mem = (char *)mmap(0, PG, prot, MAP_SHARED, fd, PG);
+    if (mem == (char *)-1) {
+        printf(1, "mmap FAILED\n");
+        goto failed;
+    }
+    for (int i = 0; i < PG; i++) {
+        if (mem[i] != 'b') {
+            printf(1, "Mapping does not start at the offset\n");
+            goto failed;
+        }
+    }
+
+    /* Write through the mapping; only the middle page should change */
+    for (int i = 0; i < PG; i++) {
+        mem[i] = 'x';
+    }
+    if (munmap(mem, PG) < 0) {
+        printf(1, "munmap FAILED\n");
+        goto failed;
+    }
+    close(fd);
+
+    fd = open(filename, O_RDWR);
+    if (fd < 0) {
+        printf(1, "Error reopening file\n");
+        goto failed;
+    }
+    for (int p = 0; p < 3; p++) {
+        char want = p == 1 ? 'x' : 'a' + p;
+        if (read(fd, buff, PG) != PG) {
+            printf(1, "Read from file FAILED\n");
+            goto failed;
+        }
+        for (int i = 0; i < PG; i++) {
+            if (buff[i] != want) {
+                printf(1, "Page %d of the file has the wrong data\n", p);
+                goto failed;
+            }
+        }
+    }
+    close(fd);
+
+// success:
+    printf(1, "MMAP\t SUCCESS\n");
+    exit();
+
+failed:
+    printf(1, "MMAP\t FAILED\n");
+    exit();
+}
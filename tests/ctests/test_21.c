@@ -0,0 +1,69 @@
+#include "types.h"
+#include "user.h"
+#include "stat.h"
+#include "mmap.h"
+#include "fcntl.h"
+
+int main() {
+    char *filename = "test_file.txt";
+    int len = 100;
+    char buff[len];
+    int prot = PROT_READ | PROT_WRITE;
+
+    /* Free up fd 0, so the file lands there */
+    close(0);
+    int fd = open(filename, O_CREATE | O_RDWR);
+    if (fd != 0) {
+        printf(1, "Error opening file as fd 0\n");
+        goto failed;
+    }
+    for (int i = 0; i < len; i++) {
+        buff[i] = 'x';
+    }
+    if (write(fd, buff, len) != len) {
+        printf(1, "Error: Write to file FAILED\n");
+        goto failed;
+    }
+
+    /* mmap the file, then close it: the mapping keeps it open */
+    char *mem = (char *)mmap(0, len, prot, MAP_SHARED, fd, 0);
+    if (mem == (char *)-1) {
+        printf(1, "mmap FAILED\n");
+        goto failed;
+    }
+    close(fd);
+
+    for (int i = 0; i < len; i++) {
+        if (mem[i] != 'x') {
+            printf(1, "Mapped data does not match the file\n");
+            goto failed;
+        }
+        mem[i] = 'y';
+    }
+    if (munmap(mem, len) < 0) {
+        printf(1, "munmap FAILED\n");
+        goto failed;
+    }
+
+    /* The changes reached the file */
+    fd = open(filename, O_RDWR);
+    if (fd < 0 || read(fd, buff, len) != len) {
+        printf(1, "Read from file FAILED\n");
+        goto failed;
+    }
+    for (int i = 0; i < len; i++) {
+        if (buff[i] != 'y') {
+            printf(1, "Writes to mmaped memory not reflected in file\n");
+            goto failed;
+        }
+    }
+    close(fd);
+
+// success:
+    printf(1, "MMAP\t SUCCESS\n");
+    exit();
+
+failed:
+    printf(1, "MMAP\t FAILED\n");
+    exit();
+}
@@ -0,0 +1,88 @@
+#include "types.h"
+#include "user.h"
+#include "stat.h"
+#include "mmap.h"
+#include "fcntl.h"
+
+#define PG 4096
+
+int main() {
+    int flags = MAP_ANONYMOUS | MAP_PRIVATE;
+
+    /* Map three writable pages and fill them */
+    char *mem = (char *)mmap(0, 3 * PG, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (mem == (char *)-1) {
+        printf(1, "mmap FAILED\n");
+        goto failed;
+    }
+    for (int i = 0; i < 3; i++) {
+        mem[i * PG] = 'a' + i;
+    }
+
+    /* Bad arguments are rejected */
+    if (mprotect(mem + 1, PG, PROT_READ) != -1 || mprotect(mem, 4 * PG, PROT_READ) != -1) {
+        printf(1, "mprotect accepted a bad range\n");
+        goto failed;
+    }
+
+    /* Make the middle page read-only: it still reads back */
+    if (mprotect(mem + PG, PG, PROT_READ) < 0) {
+        printf(1, "mprotect FAILED\n");
+        goto failed;
+    }
+    if (mem[PG] != 'b') {
+        printf(1, "Read-only page lost its data\n");
+        goto failed;
+    }
+
+    /* A write to it kills the writer */
+    int pid = fork();
+    if (pid == 0) {
+        mem[PG] = 'x';
+        printf(1, "Write to a read-only page succeeded\n");
+        goto failed;
+    }
+    wait();
+
+    /* The pages around it are still writable */
+    mem[0] = 'A';
+    mem[2 * PG] = 'C';
+
+    /* The same goes for reads under PROT_NONE */
+    if (mprotect(mem + PG, PG, PROT_NONE) < 0) {
+        printf(1, "mprotect FAILED\n");
+        goto failed;
+    }
+    pid = fork();
+    if (pid == 0) {
+        if (mem[PG] == 'b') {
+            printf(1, "Read from a PROT_NONE page succeeded\n");
+        }
+        goto failed;
+    }
+    wait();
+
+    /* Writable again, with the data intact */
+    if (mprotect(mem, 3 * PG, PROT_READ | PROT_WRITE) < 0) {
+        printf(1, "mprotect FAILED\n");
+        goto failed;
+    }
+    mem[PG] = 'B';
+    if (mem[0] != 'A' || mem[PG] != 'B' || mem[2 * PG] != 'C') {
+        printf(1, "Data corrupted across mprotect\n");
+        goto failed;
+    }
+
+    if (munmap(mem, 3 * PG) < 0) {
+        printf(1, "munmap FAILED\n");
+        goto failed;
+    }
+
+// success:
+    printf(1, "MMAP\t SUCCESS\n");
+    exit();
+
+failed:
+    printf(1, "MMAP\t FAILED\n");
+    exit();
+}
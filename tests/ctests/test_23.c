@@ -0,0 +1,86 @@
+#include "types.h"
+#include "user.h"
+#include "stat.h"
+#include "mmap.h"
+#include "fcntl.h"
+
+#define PG 4096
+
+int main() {
+    char *filename = "test_file.txt";
+    int prot = PROT_READ | PROT_WRITE;
+    char buff[PG];
+    struct stat st;
+
+    /* A populated anonymous mapping reads as zeros and is writable */
+    char *anon = (char *)mmap(0, 4 * PG, prot, MAP_ANONYMOUS | MAP_PRIVATE | MAP_POPULATE, -1, 0);
+    if (anon == (char *)-1) {
+        printf(1, "anonymous mmap FAILED\n");
+        goto failed;
+    }
+    for (int i = 0; i < 4 * PG; i++) {
+        if (anon[i] != 0) {
+            printf(1, "Populated anonymous page is not zeroed\n");
+            goto failed;
+        }
+        anon[i] = 'z';
+    }
+    if (munmap(anon, 4 * PG) < 0) {
+        printf(1, "munmap FAILED\n");
+        goto failed;
+    }
+
+    /* A file of a page and a half */
+    int fd = open(filename, O_CREATE | O_RDWR);
+    if (fd < 0) {
+        printf(1, "Error opening file\n");
+        goto failed;
+    }
+    for (int i = 0; i < PG; i++) {
+        buff[i] = 'a';
+    }
+    if (write(fd, buff, PG) != PG || write(fd, buff, PG / 2) != PG / 2) {
+        printf(1, "Error: Write to file FAILED\n");
+        goto failed;
+    }
+
+    /* Map three pages of it; the file's data is there up front */
+    char *mem = (char *)mmap(0, 3 * PG, prot, MAP_SHARED | MAP_POPULATE, fd, 0);
+    if (mem == (char *)-1) {
+        printf(1, "file mmap FAILED\n");
+        goto failed;
+    }
+    for (int i = 0; i < PG + PG / 2; i++) {
+        if (mem[i] != 'a') {
+            printf(1, "Populated file page has the wrong data\n");
+            goto failed;
+        }
+    }
+    mem[0] = 'b';
+
+    /* Populating must not make munmap extend the file */
+    if (munmap(mem, 3 * PG) < 0) {
+        printf(1, "munmap FAILED\n");
+        goto failed;
+    }
+    if (fstat(fd, &st) < 0 || st.size != PG + PG / 2) {
+        printf(1, "File size changed to %d\n", st.size);
+        goto failed;
+    }
+    close(fd);
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0 || read(fd, buff, 1) != 1 || buff[0] != 'b') {
+        printf(1, "Store through the mapping was not written back\n");
+        goto failed;
+    }
+    close(fd);
+
+// success:
+    printf(1, "MMAP\t SUCCESS\n");
+    exit();
+
+failed:
+    printf(1, "MMAP\t FAILED\n");
+    exit();
+}
@@ -0,0 +1,107 @@
+#include "types.h"
+#include "user.h"
+#include "stat.h"
+#include "mmap.h"
+#include "fcntl.h"
+
+#define PG 4096
+
+int main() {
+    char *filename = "test_file.txt";
+    int prot = PROT_READ | PROT_WRITE;
+    char buff[PG];
+
+    /* Bad advice and unmapped ranges are rejected */
+    char *anon = (char *)mmap(0, 4 * PG, prot, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (anon == (char *)-1) {
+        printf(1, "anonymous mmap FAILED\n");
+        goto failed;
+    }
+    if (madvise(anon, PG, 99) != -1 || madvise(anon + PG, 8 * PG, MADV_NORMAL) != -1) {
+        printf(1, "madvise accepted a bad request\n");
+        goto failed;
+    }
+
+    /* MADV_DONTNEED drops private anonymous pages: they come back zeroed */
+    for (int i = 0; i < 4 * PG; i++) {
+        anon[i] = 'z';
+    }
+    if (madvise(anon + PG, 2 * PG, MADV_DONTNEED) < 0) {
+        printf(1, "madvise(MADV_DONTNEED) FAILED\n");
+        goto failed;
+    }
+    for (int i = 0; i < 4 * PG; i++) {
+        char want = (i >= PG && i < 3 * PG) ? 0 : 'z';
+        if (anon[i] != want) {
+            printf(1, "Wrong data at %d after MADV_DONTNEED\n", i);
+            goto failed;
+        }
+    }
+
+    /* Advice on part of a mapping leaves the rest usable */
+    if (madvise(anon + PG, PG, MADV_RANDOM) < 0 || madvise(anon, 4 * PG, MADV_SEQUENTIAL) < 0) {
+        printf(1, "madvise on an anonymous mapping FAILED\n");
+        goto failed;
+    }
+    if (munmap(anon, 4 * PG) < 0) {
+        printf(1, "munmap FAILED\n");
+        goto failed;
+    }
+
+    /* A four-page file */
+    int fd = open(filename, O_CREATE | O_RDWR);
+    if (fd < 0) {
+        printf(1, "Error opening file\n");
+        goto failed;
+    }
+    for (int p = 0; p < 4; p++) {
+        for (int i = 0; i < PG; i++) {
+            buff[i] = 'a' + p;
+        }
+        if (write(fd, buff, PG) != PG) {
+            printf(1, "Error: Write to file FAILED\n");
+            goto failed;
+        }
+    }
+
+    /* Prefetched and sequentially read pages hold the file's data */
+    char *mem = (char *)mmap(0, 4 * PG, prot, MAP_SHARED, fd, 0);
+    if (mem == (char *)-1) {
+        printf(1, "file mmap FAILED\n");
+        goto failed;
+    }
+    if (madvise(mem, 4 * PG, MADV_WILLNEED) < 0 || madvise(mem, 4 * PG, MADV_SEQUENTIAL) < 0) {
+        printf(1, "madvise on a file mapping FAILED\n");
+        goto failed;
+    }
+    for (int i = 0; i < 4 * PG; i++) {
+        if (mem[i] != 'a' + i / PG) {
+            printf(1, "Wrong file data at %d\n", i);
+            goto failed;
+        }
+    }
+
+    /* MADV_DONTNEED on a shared mapping keeps the stores */
+    mem[2 * PG] = 'x';
+    if (madvise(mem + 2 * PG, PG, MADV_DONTNEED) < 0) {
+        printf(1, "madvise(MADV_DONTNEED) FAILED\n");
+        goto failed;
+    }
+    if (mem[2 * PG] != 'x' || mem[2 * PG + 1] != 'c') {
+        printf(1, "Shared store lost by MADV_DONTNEED\n");
+        goto failed;
+    }
+    if (munmap(mem, 4 * PG) < 0) {
+        printf(1, "munmap FAILED\n");
+        goto failed;
+    }
+    close(fd);
+
+// success:
+    printf(1, "MMAP\t SUCCESS\n");
+    exit();
+
+failed:
+    printf(1, "MMAP\t FAILED\n");
+    exit();
+}
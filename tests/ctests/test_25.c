@@ -0,0 +1,86 @@
+#include "types.h"
+#include "user.h"
+#include "stat.h"
+#include "mmap.h"
+#include "fcntl.h"
+
+#define PG 4096
+#define NPAGES 20  // 160 blocks, past the single-indirect ones
+
+int main() {
+    char *filename = "test_file.txt";
+    int prot = PROT_READ | PROT_WRITE;
+    char buff[PG];
+    struct stat st;
+
+    /* A file too big for direct and single-indirect blocks alone */
+    int fd = open(filename, O_CREATE | O_RDWR);
+    if (fd < 0) {
+        printf(1, "Error opening file\n");
+        goto failed;
+    }
+    for (int p = 0; p < NPAGES; p++) {
+        for (int i = 0; i < PG; i++) {
+            buff[i] = 'a' + p;
+        }
+        if (write(fd, buff, PG) != PG) {
+            printf(1, "Error: Write of page %d FAILED\n", p);
+            goto failed;
+        }
+    }
+    if (fstat(fd, &st) < 0 || st.size != NPAGES * PG) {
+        printf(1, "File size is %d\n", st.size);
+        goto failed;
+    }
+
+    /* Map it all; the pages at the end are double-indirect */
+    char *mem = (char *)mmap(0, NPAGES * PG, prot, MAP_SHARED, fd, 0);
+    if (mem == (char *)-1) {
+        printf(1, "mmap FAILED\n");
+        goto failed;
+    }
+    for (int p = 0; p < NPAGES; p++) {
+        if (mem[p * PG] != 'a' + p || mem[p * PG + PG - 1] != 'a' + p) {
+            printf(1, "Page %d has the wrong data\n", p);
+            goto failed;
+        }
+    }
+    mem[(NPAGES - 1) * PG] = 'Z';
+    if (munmap(mem, NPAGES * PG) < 0) {
+        printf(1, "munmap FAILED\n");
+        goto failed;
+    }
+    close(fd);
+
+    /* The store reached the last block */
+    fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        printf(1, "Error reopening file\n");
+        goto failed;
+    }
+    for (int p = 0; p < NPAGES; p++) {
+        if (read(fd, buff, PG) != PG) {
+            printf(1, "Error: Read of page %d FAILED\n", p);
+            goto failed;
+        }
+        if (buff[0] != (p == NPAGES - 1 ? 'Z' : 'a' + p) || buff[1] != 'a' + p) {
+            printf(1, "Read of page %d has the wrong data\n", p);
+            goto failed;
+        }
+    }
+    close(fd);
+
+    /* Freeing it gives every block back */
+    if (unlink(filename) < 0) {
+        printf(1, "unlink FAILED\n");
+        goto failed;
+    }
+
+// success:
+    printf(1, "MMAP\t SUCCESS\n");
+    exit();
+
+failed:
+    printf(1, "MMAP\t FAILED\n");
+    exit();
+}
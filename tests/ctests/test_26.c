@@ -0,0 +1,112 @@
+#include "types.h"
+#include "user.h"
+#include "stat.h"
+#include "mmap.h"
+#include "fcntl.h"
+
+#define PG 4096
+#define LEN (3 * PG + 100)  // more than the pipe holds at once
+
+int main() {
+    char *infile = "test_file.txt";
+    char *outfile = "test_file2.txt";
+    char buff[PG];
+    int fds[2];
+    struct stat st;
+
+    /* A file to send through a pipe */
+    int fd = open(infile, O_CREATE | O_RDWR);
+    if (fd < 0) {
+        printf(1, "Error opening file\n");
+        goto failed;
+    }
+    for (int off = 0; off < LEN; off += PG) {
+        int n = LEN - off < PG ? LEN - off : PG;
+        for (int i = 0; i < n; i++) {
+            buff[i] = 'a' + (off + i) % 26;
+        }
+        if (write(fd, buff, n) != n) {
+            printf(1, "Error: Write to file FAILED\n");
+            goto failed;
+        }
+    }
+    close(fd);
+
+    if (pipe(fds) < 0) {
+        printf(1, "pipe FAILED\n");
+        goto failed;
+    }
+    int pid = fork();
+    if (pid < 0) {
+        printf(1, "fork FAILED\n");
+        goto failed;
+    }
+    if (pid == 0) {
+        /* The child splices the file into the pipe */
+        close(fds[0]);
+        fd = open(infile, O_RDONLY);
+        int n = splice(fd, fds[1], LEN + 1000);
+        if (n != LEN) {
+            printf(1, "splice from the file moved %d bytes\n", n);
+        }
+        close(fds[1]);
+        exit();
+    }
+
+    /* The parent splices the pipe into a second file */
+    close(fds[1]);
+    int out = open(outfile, O_CREATE | O_RDWR);
+    if (out < 0) {
+        printf(1, "Error opening second file\n");
+        goto failed;
+    }
+    int moved = 0, n;
+    while ((n = splice(fds[0], out, PG)) > 0) {
+        moved += n;
+    }
+    wait();
+    close(fds[0]);
+    if (n < 0 || moved != LEN) {
+        printf(1, "splice into the file moved %d bytes\n", moved);
+        goto failed;
+    }
+    if (fstat(out, &st) < 0 || st.size != LEN) {
+        printf(1, "Second file has size %d\n", st.size);
+        goto failed;
+    }
+    close(out);
+
+    /* Both files agree, as seen through a mapping */
+    out = open(outfile, O_RDONLY);
+    char *mem = (char *)mmap(0, LEN, PROT_READ, MAP_PRIVATE, out, 0);
+    if (mem == (char *)-1) {
+        printf(1, "mmap FAILED\n");
+        goto failed;
+    }
+    for (int i = 0; i < LEN; i++) {
+        if (mem[i] != 'a' + i % 26) {
+            printf(1, "Byte %d came through as %c\n", i, mem[i]);
+            goto failed;
+        }
+    }
+    munmap(mem, LEN);
+    close(out);
+
+    /* Splicing needs a pipe on one side */
+    fd = open(infile, O_RDONLY);
+    out = open(outfile, O_RDWR);
+    if (splice(fd, out, 10) != -1) {
+        printf(1, "splice between two files did not fail\n");
+        goto failed;
+    }
+    close(fd);
+    close(out);
+
+// success:
+    printf(1, "MMAP\t SUCCESS\n");
+    exit();
+
+failed:
+    printf(1, "MMAP\t FAILED\n");
+    exit();
+}
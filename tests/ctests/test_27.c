@@ -0,0 +1,68 @@
+#include "types.h"
+#include "user.h"
+#include "stat.h"
+#include "mmap.h"
+#include "fcntl.h"
+
+#define NSPIN 2
+#define NPRIO 4
+
+int main() {
+    int pids[NSPIN];
+    int i, n, old, start;
+
+    /* Levels outside 0..NPRIO-1 and unknown pids are refused */
+    if (setpriority(getpid(), NPRIO) != -1 || setpriority(getpid(), -1) != -1) {
+        printf(1, "setpriority accepted a bad level\n");
+        goto failed;
+    }
+    if (setpriority(-1, 0) != -1) {
+        printf(1, "setpriority accepted a bad pid\n");
+        goto failed;
+    }
+    old = setpriority(getpid(), 0);
+    if (old < 0 || old >= NPRIO) {
+        printf(1, "setpriority returned %d\n", old);
+        goto failed;
+    }
+
+    /* CPU-bound children at the lowest level */
+    for (i = 0; i < NSPIN; i++) {
+        pids[i] = fork();
+        if (pids[i] < 0) {
+            printf(1, "fork FAILED\n");
+            goto failed;
+        }
+        if (pids[i] == 0) {
+            for (;;)
+                ;
+        }
+        old = setpriority(pids[i], NPRIO - 1);
+        if (old < 0 || old >= NPRIO) {
+            printf(1, "setpriority of child returned %d\n", old);
+            goto failed;
+        }
+    }
+
+    /* An interactive process still gets the CPU promptly */
+    start = uptime();
+    for (n = 0; n < 10; n++)
+        sleep(1);
+    if (uptime() - start > 100) {
+        printf(1, "10 sleeps took %d ticks\n", uptime() - start);
+        goto failed;
+    }
+
+    for (i = 0; i < NSPIN; i++) {
+        kill(pids[i]);
+        wait();
+    }
+
+// success:
+    printf(1, "MMAP\t SUCCESS\n");
+    exit();
+
+failed:
+    printf(1, "MMAP\t FAILED\n");
+    exit();
+}
@@ -0,0 +1,57 @@
+#include "types.h"
+#include "user.h"
+#include "stat.h"
+#include "mmap.h"
+#include "fcntl.h"
+
+int main() {
+    int i, start, took;
+
+    if (usleep(-1) != -1) {
+        printf(1, "usleep accepted a negative time\n");
+        goto failed;
+    }
+
+    /* 50ms, five clock ticks */
+    start = uptime();
+    if (usleep(50000) < 0) {
+        printf(1, "usleep FAILED\n");
+        goto failed;
+    }
+    took = uptime() - start;
+    if (took < 4 || took > 50) {
+        printf(1, "usleep(50000) took %d ticks\n", took);
+        goto failed;
+    }
+
+    /* Sleeps shorter than a tick add up to about the same */
+    start = uptime();
+    for (i = 0; i < 50; i++) {
+        if (usleep(1000) < 0) {
+            printf(1, "usleep FAILED\n");
+            goto failed;
+        }
+    }
+    took = uptime() - start;
+    if (took < 4 || took > 50) {
+        printf(1, "50 x usleep(1000) took %d ticks\n", took);
+        goto failed;
+    }
+
+    /* sleep() still counts ticks */
+    start = uptime();
+    sleep(5);
+    took = uptime() - start;
+    if (took < 5 || took > 50) {
+        printf(1, "sleep(5) took %d ticks\n", took);
+        goto failed;
+    }
+
+// success:
+    printf(1, "MMAP\t SUCCESS\n");
+    exit();
+
+failed:
+    printf(1, "MMAP\t FAILED\n");
+    exit();
+}
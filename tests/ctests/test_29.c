@@ -0,0 +1,78 @@
+#include "types.h"
+#include "user.h"
+#include "stat.h"
+#include "mmap.h"
+#include "fcntl.h"
+
+#define PG 4096
+#define NTHREAD 4
+
+volatile int counts[NTHREAD];
+volatile char *shared;
+
+void worker(void *arg) {
+    int id = (int)arg;
+
+    /* Globals and mappings made before clone are shared */
+    counts[id] = id + 1;
+    shared[id] = 'a' + id;
+    exit();
+}
+
+int main() {
+    void *stacks[NTHREAD], *stack;
+    int pids[NTHREAD];
+    int i, j, pid;
+
+    shared = (char *)mmap(0, PG, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (shared == (char *)-1) {
+        printf(1, "mmap FAILED\n");
+        goto failed;
+    }
+
+    for (i = 0; i < NTHREAD; i++) {
+        stacks[i] = malloc(PG);
+        pids[i] = clone(worker, (void *)i, stacks[i]);
+        if (pids[i] < 0) {
+            printf(1, "clone FAILED\n");
+            goto failed;
+        }
+    }
+
+    /* join hands back each thread with the stack it was given */
+    for (i = 0; i < NTHREAD; i++) {
+        pid = join(&stack);
+        for (j = 0; j < NTHREAD && pids[j] != pid; j++)
+            ;
+        if (j == NTHREAD || stack != stacks[j]) {
+            printf(1, "join returned pid %d stack %p\n", pid, stack);
+            goto failed;
+        }
+        free(stack);
+    }
+    if (join(&stack) != -1 || wait() != -1) {
+        printf(1, "threads left over\n");
+        goto failed;
+    }
+
+    for (i = 0; i < NTHREAD; i++) {
+        if (counts[i] != i + 1 || shared[i] != 'a' + i) {
+            printf(1, "thread %d's stores are missing\n", i);
+            goto failed;
+        }
+    }
+
+    /* The mapping outlives the threads, and munmap still works */
+    if (munmap((void *)shared, PG) < 0) {
+        printf(1, "munmap FAILED\n");
+        goto failed;
+    }
+
+// success:
+    printf(1, "MMAP\t SUCCESS\n");
+    exit();
+
+failed:
+    printf(1, "MMAP\t FAILED\n");
+    exit();
+}
@@ -0,0 +1,72 @@
+#include "types.h"
+#include "user.h"
+#include "stat.h"
+#include "mmap.h"
+#include "fcntl.h"
+
+int main() {
+    char *filename = "test_file.txt";
+    char *argv[] = {"echo", "spawned", 0};
+    char *bad[] = {"no_such_program", 0};
+    char buff[64];
+    int fds[3];
+    int fd, pid, n;
+
+    if (spawn("no_such_program", bad, 0) != -1) {
+        printf(1, "spawn of a missing program didn't fail\n");
+        goto failed;
+    }
+
+    /* echo's output goes where fds[1] says */
+    fd = open(filename, O_CREATE | O_RDWR);
+    if (fd < 0) {
+        printf(1, "Error opening file\n");
+        goto failed;
+    }
+    fds[0] = 0;
+    fds[1] = fd;
+    fds[2] = 2;
+    pid = spawn("echo", argv, fds);
+    close(fd);
+    if (pid < 0) {
+        printf(1, "spawn FAILED\n");
+        goto failed;
+    }
+    if (wait() != pid) {
+        printf(1, "wait didn't return the spawned child\n");
+        goto failed;
+    }
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        printf(1, "Error reopening file\n");
+        goto failed;
+    }
+    n = read(fd, buff, sizeof(buff) - 1);
+    close(fd);
+    if (n < 0) {
+        printf(1, "read FAILED\n");
+        goto failed;
+    }
+    buff[n] = 0;
+    if (strcmp(buff, "spawned\n") != 0) {
+        printf(1, "echo wrote \"%s\"\n", buff);
+        goto failed;
+    }
+
+    /* A descriptor the parent doesn't have is refused */
+    fds[1] = 15;
+    if (spawn("echo", argv, fds) != -1) {
+        printf(1, "spawn with a bad descriptor didn't fail\n");
+        goto failed;
+    }
+    unlink(filename);
+
+// success:
+    printf(1, "MMAP\t SUCCESS\n");
+    exit();
+
+failed:
+    printf(1, "MMAP\t FAILED\n");
+    exit();
+}
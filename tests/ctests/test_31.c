@@ -0,0 +1,82 @@
+#include "types.h"
+#include "user.h"
+#include "stat.h"
+#include "mmap.h"
+#include "fcntl.h"
+
+#define PG 4096
+#define NPAGES 16
+
+/* The program's own data and bss are only paged in when touched */
+char data[2 * PG] = {[PG] = 'x', [PG + 1] = 'y'};
+char bss[NPAGES * PG];
+
+int main() {
+    char *argv[] = {"echo", "exec", "still", "works", 0};
+    int p[2];
+    int pid;
+
+    /* The kernel copies from and to untouched pages under the pipe's lock */
+    if (pipe(p) < 0) {
+        printf(1, "pipe FAILED\n");
+        goto failed;
+    }
+    if (write(p[1], &data[PG], 2) != 2) {
+        printf(1, "write from data FAILED\n");
+        goto failed;
+    }
+    if (read(p[0], &bss[NPAGES * PG - 2], 2) != 2) {
+        printf(1, "read into bss FAILED\n");
+        goto failed;
+    }
+    if (bss[NPAGES * PG - 2] != 'x' || bss[NPAGES * PG - 1] != 'y') {
+        printf(1, "the pipe carried the wrong data\n");
+        goto failed;
+    }
+    close(p[0]);
+    close(p[1]);
+    for (int i = 0; i < NPAGES; i++) {
+        if (bss[i * PG] != 0 || (i < NPAGES - 1 && bss[i * PG + PG - 1] != 0)) {
+            printf(1, "bss page %d isn't zero\n", i);
+            goto failed;
+        }
+    }
+
+    /* A child's stores to the image stay its own */
+    pid = fork();
+    if (pid < 0) {
+        printf(1, "fork FAILED\n");
+        goto failed;
+    }
+    if (pid == 0) {
+        data[PG] = 'c';
+        bss[0] = 'c';
+        exit();
+    }
+    wait();
+    if (data[PG] != 'x' || bss[0] != 0) {
+        printf(1, "the child's stores reached the parent\n");
+        goto failed;
+    }
+
+    /* And programs still run */
+    pid = fork();
+    if (pid < 0) {
+        printf(1, "fork FAILED\n");
+        goto failed;
+    }
+    if (pid == 0) {
+        exec("echo", argv);
+        printf(1, "exec FAILED\n");
+        exit();
+    }
+    wait();
+
+// success:
+    printf(1, "MMAP\t SUCCESS\n");
+    exit();
+
+failed:
+    printf(1, "MMAP\t FAILED\n");
+    exit();
+}
@@ -0,0 +1,85 @@
+#include "types.h"
+#include "user.h"
+#include "stat.h"
+#include "mmap.h"
+#include "fcntl.h"
+
+#define PG 4096
+#define HEAP (300 * 1024 * 1024)  // more than the machine has
+
+int main() {
+    char *filename = "test_file.txt";
+    char *heap, *last;
+    int fd, pid, p[2];
+    char ok;
+
+    /* Only the pages touched are backed, so this fits */
+    heap = sbrk(HEAP);
+    if (heap == (char *)-1) {
+        printf(1, "sbrk FAILED\n");
+        goto failed;
+    }
+    last = heap + HEAP - PG;
+    if (heap[0] != 0 || last[PG - 1] != 0) {
+        printf(1, "new heap isn't zero\n");
+        goto failed;
+    }
+    heap[0] = 'a';
+    last[PG - 1] = 'z';
+
+    /* The kernel can fill an untouched heap page */
+    fd = open(filename, O_CREATE | O_RDWR);
+    if (fd < 0 || write(fd, "hello", 5) != 5) {
+        printf(1, "Error writing file\n");
+        goto failed;
+    }
+    close(fd);
+    fd = open(filename, O_RDONLY);
+    if (fd < 0 || read(fd, heap + HEAP / 2, 5) != 5) {
+        printf(1, "read into the heap FAILED\n");
+        goto failed;
+    }
+    close(fd);
+    if (strcmp(heap + HEAP / 2, "hello") != 0) {
+        printf(1, "read the wrong data\n");
+        goto failed;
+    }
+
+    /* A child sees the touched pages, and untouched ones read as zero */
+    if (pipe(p) < 0) {
+        printf(1, "pipe FAILED\n");
+        goto failed;
+    }
+    pid = fork();
+    if (pid < 0) {
+        printf(1, "fork FAILED\n");
+        goto failed;
+    }
+    if (pid == 0) {
+        ok = heap[0] == 'a' && last[PG - 1] == 'z' && heap[PG] == 0;
+        write(p[1], &ok, 1);
+        exit();
+    }
+    wait();
+    if (read(p[0], &ok, 1) != 1 || !ok) {
+        printf(1, "child sees the wrong heap\n");
+        goto failed;
+    }
+    close(p[0]);
+    close(p[1]);
+
+    /* And the heap gives the pages back */
+    if (sbrk(-HEAP) != heap + HEAP || sbrk(0) != heap) {
+        printf(1, "shrinking sbrk FAILED\n");
+        goto failed;
+    }
+    unlink(filename);
+
+// success:
+    printf(1, "MMAP\t SUCCESS\n");
+    exit();
+
+failed:
+    printf(1, "MMAP\t FAILED\n");
+    exit();
+}
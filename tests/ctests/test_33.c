@@ -0,0 +1,93 @@
+#include "types.h"
+#include "user.h"
+#include "stat.h"
+#include "mmap.h"
+#include "fcntl.h"
+
+#define N 200
+#define BIG (128 * 1024)
+
+int main() {
+    char *filename = "test_file.txt";
+    char *small[N], *mid, *big, *p;
+    int fd, i;
+
+    /* Small blocks of one size class hold their contents */
+    for (i = 0; i < N; i++) {
+        if ((small[i] = malloc(24)) == 0) {
+            printf(1, "small malloc FAILED\n");
+            goto failed;
+        }
+        memset(small[i], i, 24);
+    }
+    for (i = 0; i < N; i++) {
+        if (small[i][0] != (char)i || small[i][23] != (char)i) {
+            printf(1, "small block %d was overwritten\n", i);
+            goto failed;
+        }
+    }
+
+    /* A freed small block is the next one handed out */
+    p = small[N / 2];
+    free(p);
+    if ((small[N / 2] = malloc(20)) != p) {
+        printf(1, "freed block wasn't reused\n");
+        goto failed;
+    }
+    for (i = 0; i < N; i++)
+        free(small[i]);
+
+    /* Blocks too big for a bin coalesce when freed */
+    mid = malloc(10000);
+    p = malloc(10000);
+    if (mid == 0 || p == 0) {
+        printf(1, "arena malloc FAILED\n");
+        goto failed;
+    }
+    free(mid);
+    free(p);
+    if ((p = malloc(19000)) == 0) {
+        printf(1, "arena malloc after free FAILED\n");
+        goto failed;
+    }
+    free(p);
+
+    /* The biggest get a mapping that system calls can use */
+    if ((big = malloc(BIG)) == 0) {
+        printf(1, "big malloc FAILED\n");
+        goto failed;
+    }
+    memset(big, 'b', BIG);
+    fd = open(filename, O_CREATE | O_RDWR);
+    if (fd < 0 || write(fd, big, BIG) != BIG) {
+        printf(1, "write from a big block FAILED\n");
+        goto failed;
+    }
+    close(fd);
+    memset(big, 0, BIG);
+    fd = open(filename, O_RDONLY);
+    if (fd < 0 || read(fd, big, BIG) != BIG) {
+        printf(1, "read into a big block FAILED\n");
+        goto failed;
+    }
+    close(fd);
+    if (big[0] != 'b' || big[BIG - 1] != 'b') {
+        printf(1, "big block has the wrong data\n");
+        goto failed;
+    }
+    free(big);
+    if ((big = malloc(BIG)) == 0) {
+        printf(1, "big malloc after free FAILED\n");
+        goto failed;
+    }
+    free(big);
+    unlink(filename);
+
+// success:
+    printf(1, "MMAP\t SUCCESS\n");
+    exit();
+
+failed:
+    printf(1, "MMAP\t FAILED\n");
+    exit();
+}
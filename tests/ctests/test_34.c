@@ -0,0 +1,44 @@
+#include "types.h"
+#include "user.h"
+#include "stat.h"
+#include "mmap.h"
+#include "fcntl.h"
+
+#define LIVE 20    // pipes open at once
+#define ROUNDS 50
+
+int main() {
+    int fds[LIVE][2];
+    char c;
+
+    /* Pipes come from a kernel object cache; churn through it */
+    for (int r = 0; r < ROUNDS; r++) {
+        for (int i = 0; i < LIVE; i++) {
+            if (pipe(fds[i]) < 0) {
+                printf(1, "pipe %d of round %d FAILED\n", i, r);
+                goto failed;
+            }
+            c = 'a' + i;
+            if (write(fds[i][1], &c, 1) != 1) {
+                printf(1, "write FAILED\n");
+                goto failed;
+            }
+        }
+        for (int i = LIVE - 1; i >= 0; i--) {
+            if (read(fds[i][0], &c, 1) != 1 || c != 'a' + i) {
+                printf(1, "pipe %d carried the wrong byte\n", i);
+                goto failed;
+            }
+            close(fds[i][0]);
+            close(fds[i][1]);
+        }
+    }
+
+// success:
+    printf(1, "MMAP\t SUCCESS\n");
+    exit();
+
+failed:
+    printf(1, "MMAP\t FAILED\n");
+    exit();
+}
@@ -0,0 +1,65 @@
+#include "types.h"
+#include "user.h"
+#include "stat.h"
+#include "mmap.h"
+#include "fcntl.h"
+#include "lockstat.h"
+
+#define NSTAT 64
+
+struct lockstat ls[NSTAT];
+
+// Acquires counted so far for locks called name, or -1.
+int acquires(char *name) {
+    int n = lockstat(ls, NSTAT);
+    if (n > NSTAT)
+        n = NSTAT;
+    for (int i = 0; i < n; i++)
+        if (strcmp(ls[i].name, name) == 0)
+            return ls[i].acquires;
+    return -1;
+}
+
+int main() {
+    int before, after, n;
+
+    /* Forks take the process table lock: its count must go up */
+    if ((before = acquires("ptable")) < 0) {
+        printf(1, "no counters for ptable\n");
+        goto failed;
+    }
+    for (int i = 0; i < 5; i++) {
+        int pid = fork();
+        if (pid < 0) {
+            printf(1, "fork FAILED\n");
+            goto failed;
+        }
+        if (pid == 0)
+            exit();
+        wait();
+    }
+    after = acquires("ptable");
+    if (after <= before) {
+        printf(1, "ptable acquires went from %d to %d\n", before, after);
+        goto failed;
+    }
+
+    /* With no room the count of names still comes back */
+    n = lockstat(ls, 0);
+    if (n <= 1 || lockstat(ls, 1) != n) {
+        printf(1, "lockstat returned %d names\n", n);
+        goto failed;
+    }
+    if (lockstat((struct lockstat *)0x7fff0000, NSTAT) != -1) {
+        printf(1, "bad buffer accepted\n");
+        goto failed;
+    }
+
+// success:
+    printf(1, "MMAP\t SUCCESS\n");
+    exit();
+
+failed:
+    printf(1, "MMAP\t FAILED\n");
+    exit();
+}
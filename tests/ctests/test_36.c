@@ -0,0 +1,85 @@
+#include "types.h"
+#include "user.h"
+#include "stat.h"
+#include "mmap.h"
+#include "fcntl.h"
+
+#define PG 4096
+#define NPAGES 8
+#define NCHILD 4
+#define ROUNDS 10
+
+char buf[PG];
+
+int main() {
+    char *file = "rwlock.txt";
+    int fd, p[2];
+    char c;
+
+    fd = open(file, O_CREATE | O_RDWR);
+    if (fd < 0) {
+        printf(1, "open FAILED\n");
+        goto failed;
+    }
+    for (int i = 0; i < NPAGES; i++) {
+        memset(buf, 'a' + i, PG);
+        if (write(fd, buf, PG) != PG) {
+            printf(1, "write FAILED\n");
+            goto failed;
+        }
+    }
+    close(fd);
+
+    /* Readers of one file hold its inode shared and all get on */
+    if (pipe(p) < 0) {
+        printf(1, "pipe FAILED\n");
+        goto failed;
+    }
+    for (int k = 0; k < NCHILD; k++) {
+        int pid = fork();
+        if (pid < 0) {
+            printf(1, "fork FAILED\n");
+            goto failed;
+        }
+        if (pid > 0)
+            continue;
+        close(p[0]);
+        for (int r = 0; r < ROUNDS; r++) {
+            struct stat st;
+            char *a;
+
+            if (stat(file, &st) < 0 || st.size != NPAGES * PG)
+                goto bad;
+            if ((fd = open(file, O_RDONLY)) < 0)
+                goto bad;
+            a = mmap(0, NPAGES * PG, PROT_READ, MAP_SHARED, fd, 0);
+            if (a == (char *)-1)
+                goto bad;
+            for (int i = 0; i < NPAGES; i++)
+                if (a[i * PG] != 'a' + i || a[i * PG + PG - 1] != 'a' + i)
+                    goto bad;
+            munmap(a, NPAGES * PG);
+            close(fd);
+        }
+        exit();
+    bad:
+        write(p[1], "x", 1);
+        exit();
+    }
+    close(p[1]);
+    for (int k = 0; k < NCHILD; k++)
+        wait();
+    if (read(p[0], &c, 1) != 0) {
+        printf(1, "a reader saw the wrong data\n");
+        goto failed;
+    }
+    unlink(file);
+
+// success:
+    printf(1, "MMAP\t SUCCESS\n");
+    exit();
+
+failed:
+    printf(1, "MMAP\t FAILED\n");
+    exit();
+}
@@ -0,0 +1,78 @@
+#include "types.h"
+#include "user.h"
+#include "stat.h"
+#include "mmap.h"
+#include "fcntl.h"
+
+#define CALLS 10000
+
+// Make a system call with values in the registers a C caller
+// expects to get back, and return 0 if it does.
+int saved_regs(void) {
+    int esi, edi, ebx;
+
+    asm volatile("movl $0x11111111, %%esi\n\t"
+                 "movl $0x22222222, %%edi\n\t"
+                 "movl $0x33333333, %%ebx\n\t"
+                 "call getpid\n\t"
+                 "movl %%ebx, %2"
+                 : "=S" (esi), "=D" (edi), "=m" (ebx)
+                 :
+                 : "eax", "ebx", "ecx", "edx", "memory", "cc");
+    return esi == 0x11111111 && edi == 0x22222222 && ebx == 0x33333333 ? 0 : -1;
+}
+
+int main() {
+    int pid = getpid();
+    int p[2];
+    char c;
+
+    /* Fast system calls come back to the caller with its state */
+    for (int i = 0; i < CALLS; i++) {
+        if (getpid() != pid) {
+            printf(1, "getpid changed\n");
+            goto failed;
+        }
+    }
+    if (saved_regs() < 0) {
+        printf(1, "registers not preserved\n");
+        goto failed;
+    }
+
+    /* Arguments still come off the stack */
+    if (pipe(p) < 0) {
+        printf(1, "pipe FAILED\n");
+        goto failed;
+    }
+    for (int i = 0; i < CALLS / 10; i++) {
+        c = i;
+        if (write(p[1], &c, 1) != 1 || read(p[0], &c, 1) != 1 || c != (char)i) {
+            printf(1, "pipe round trip %d FAILED\n", i);
+            goto failed;
+        }
+    }
+
+    /* A child of fork returns from the same call */
+    int child = fork();
+    if (child < 0) {
+        printf(1, "fork FAILED\n");
+        goto failed;
+    }
+    if (child == 0) {
+        c = saved_regs() == 0 ? 'y' : 'n';
+        write(p[1], &c, 1);
+        exit();
+    }
+    if (wait() != child || read(p[0], &c, 1) != 1 || c != 'y') {
+        printf(1, "child FAILED\n");
+        goto failed;
+    }
+
+// success:
+    printf(1, "MMAP\t SUCCESS\n");
+    exit();
+
+failed:
+    printf(1, "MMAP\t FAILED\n");
+    exit();
+}
@@ -0,0 +1,91 @@
+#include "types.h"
+#include "user.h"
+#include "stat.h"
+#include "mmap.h"
+#include "fcntl.h"
+#include "syscall.h"
+#include "ring.h"
+
+#define N 8
+
+void submit(struct ring *r, int op, int a0, int a1, int a2, uint data) {
+    struct ringsqe *e = &RING_SQ(r)[r->sqtail & (N - 1)];
+
+    e->op = op;
+    e->arg[0] = a0;
+    e->arg[1] = a1;
+    e->arg[2] = a2;
+    e->data = data;
+    r->sqtail++;
+}
+
+int main() {
+    struct ring *r;
+    struct ringcqe *c;
+    char *priv;
+    char out[] = "ring", in[8];
+    int p[2];
+
+    /* The ring must be shared anonymous memory */
+    priv = mmap(0, 4096, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (priv == (char *)-1 || ringsetup((struct ring *)priv, N) != -1) {
+        printf(1, "private ring accepted\n");
+        goto failed;
+    }
+    r = mmap(0, 4096, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (r == (struct ring *)-1 || ringsetup(r, N - 1) != -1 || ringsetup(r, N) != 0) {
+        printf(1, "ringsetup FAILED\n");
+        goto failed;
+    }
+    if (pipe(p) < 0) {
+        printf(1, "pipe FAILED\n");
+        goto failed;
+    }
+
+    /* Several calls, one trap; results come back in order */
+    submit(r, SYS_write, p[1], (int)out, 4, 1);
+    submit(r, SYS_read, p[0], (int)in, 4, 2);
+    submit(r, SYS_getpid, 0, 0, 0, 3);
+    submit(r, SYS_fork, 0, 0, 0, 4);
+    if (ringenter(N) != 4 || r->cqtail != 4) {
+        printf(1, "ringenter FAILED\n");
+        goto failed;
+    }
+    c = RING_CQ(r, N);
+    if (c[0].data != 1 || c[0].res != 4 || c[1].data != 2 || c[1].res != 4 ||
+        c[2].data != 3 || c[2].res != getpid() || c[3].data != 4 || c[3].res != -1) {
+        printf(1, "wrong completions\n");
+        goto failed;
+    }
+    in[4] = 0;
+    if (strcmp(in, out) != 0) {
+        printf(1, "read the wrong bytes\n");
+        goto failed;
+    }
+
+    /* No more runs than there is room to complete */
+    for (int i = 0; i < N; i++)
+        submit(r, SYS_getpid, 0, 0, 0, 10 + i);
+    if (ringenter(N) != N - 4 || ringenter(N) != 0) {
+        printf(1, "ran past a full completion queue\n");
+        goto failed;
+    }
+    r->cqhead = r->cqtail;
+    if (ringenter(N) != 4) {
+        printf(1, "didn't finish once there was room\n");
+        goto failed;
+    }
+    c = &RING_CQ(r, N)[(r->cqtail - 1) & (N - 1)];
+    if (c->data != 10 + N - 1) {
+        printf(1, "last completion is %d\n", c->data);
+        goto failed;
+    }
+
+// success:
+    printf(1, "MMAP\t SUCCESS\n");
+    exit();
+
+failed:
+    printf(1, "MMAP\t FAILED\n");
+    exit();
+}
@@ -0,0 +1,87 @@
+#include "types.h"
+#include "user.h"
+#include "stat.h"
+#include "mmap.h"
+#include "fcntl.h"
+
+#define PG 4096
+
+int p[2];
+
+void thread(void *arg) {
+    /* write's arguments are on a stack in a mapping */
+    write(p[1], (char *)arg, 1);
+    exit();
+}
+
+int main() {
+    char *m, *ro, *stack;
+    void *ustack;
+    char c;
+    int fd, i;
+
+    m = mmap(0, 2 * PG, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (m == (char *)-1) {
+        printf(1, "mmap FAILED\n");
+        goto failed;
+    }
+
+    /* A path in a mapping, straddling its two pages */
+    strcpy(m + PG - 4, "mapped.txt");
+    if ((fd = open(m + PG - 4, O_CREATE | O_RDWR)) < 0) {
+        printf(1, "open of a mapped path FAILED\n");
+        goto failed;
+    }
+    if (write(fd, m + PG - 4, 10) != 10) {
+        printf(1, "write FAILED\n");
+        goto failed;
+    }
+    close(fd);
+    if ((fd = open("mapped.txt", O_RDONLY)) < 0 || read(fd, m + 2 * PG - 10, 10) != 10) {
+        printf(1, "read into a mapping FAILED\n");
+        goto failed;
+    }
+    for (i = 0; i < 10; i++)
+        if (m[2 * PG - 10 + i] != "mapped.txt"[i]) {
+            printf(1, "read the wrong bytes\n");
+            goto failed;
+        }
+
+    /* A read into memory that can't be written fails, and only the call */
+    ro = mmap(0, PG, PROT_READ, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (ro == (char *)-1) {
+        printf(1, "mmap FAILED\n");
+        goto failed;
+    }
+    close(fd);
+    fd = open("mapped.txt", O_RDONLY);
+    if (read(fd, ro, 10) != -1) {
+        printf(1, "read into a read-only mapping succeeded\n");
+        goto failed;
+    }
+    close(fd);
+    unlink("mapped.txt");
+
+    /* A thread whose stack is in a mapping makes system calls */
+    stack = mmap(0, PG, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (stack == (char *)-1 || pipe(p) < 0) {
+        printf(1, "setup FAILED\n");
+        goto failed;
+    }
+    if (clone(thread, "t", stack) < 0 || join(&ustack) < 0 || ustack != stack) {
+        printf(1, "thread FAILED\n");
+        goto failed;
+    }
+    if (read(p[0], &c, 1) != 1 || c != 't') {
+        printf(1, "the thread's write didn't arrive\n");
+        goto failed;
+    }
+
+// success:
+    printf(1, "MMAP\t SUCCESS\n");
+    exit();
+
+failed:
+    printf(1, "MMAP\t FAILED\n");
+    exit();
+}
@@ -0,0 +1,111 @@
+#include "types.h"
+#include "user.h"
+#include "stat.h"
+#include "mmap.h"
+#include "fcntl.h"
+#include "uio.h"
+
+int main() {
+    struct iovec iov[3];
+    char a[8], b[8], c[8];
+    int fd, p[2];
+
+    if ((fd = open("vec.txt", O_CREATE | O_RDWR)) < 0) {
+        printf(1, "open FAILED\n");
+        goto failed;
+    }
+
+    /* writev gathers, and moves the offset past all of it */
+    iov[0].base = "hello, ";
+    iov[0].len = 7;
+    iov[1].base = "";
+    iov[1].len = 0;
+    iov[2].base = "world";
+    iov[2].len = 5;
+    if (writev(fd, iov, 3) != 12) {
+        printf(1, "writev FAILED\n");
+        goto failed;
+    }
+
+    /* pwrite and pread leave the offset alone */
+    if (pwrite(fd, "W", 1, 7) != 1 || pread(fd, a, 5, 7) != 5) {
+        printf(1, "pwrite/pread FAILED\n");
+        goto failed;
+    }
+    a[5] = 0;
+    if (strcmp(a, "World") != 0) {
+        printf(1, "pread read %s\n", a);
+        goto failed;
+    }
+    if (write(fd, "!", 1) != 1 || pread(fd, a, 8, 12) != 1 || a[0] != '!') {
+        printf(1, "the offset moved\n");
+        goto failed;
+    }
+    if (pread(fd, a, 8, 100) != -1) {
+        printf(1, "pread past the end didn't fail\n");
+        goto failed;
+    }
+    close(fd);
+
+    /* readv scatters, and stops at the end of the file */
+    fd = open("vec.txt", O_RDONLY);
+    memset(a, 0, sizeof(a));
+    memset(b, 0, sizeof(b));
+    memset(c, 0, sizeof(c));
+    iov[0].base = a;
+    iov[0].len = 7;
+    iov[1].base = b;
+    iov[1].len = 5;
+    iov[2].base = c;
+    iov[2].len = 7;
+    if (readv(fd, iov, 3) != 13) {
+        printf(1, "readv FAILED\n");
+        goto failed;
+    }
+    if (strcmp(a, "hello, ") != 0 || strcmp(b, "World") != 0 || strcmp(c, "!") != 0) {
+        printf(1, "readv read the wrong bytes\n");
+        goto failed;
+    }
+    if (readv(fd, iov, 17) != -1) {
+        printf(1, "readv of too many buffers didn't fail\n");
+        goto failed;
+    }
+    close(fd);
+    unlink("vec.txt");
+
+    /* On a pipe, readv takes what's there without waiting for more */
+    if (pipe(p) < 0) {
+        printf(1, "pipe FAILED\n");
+        goto failed;
+    }
+    iov[0].base = "abc";
+    iov[0].len = 3;
+    iov[1].base = "de";
+    iov[1].len = 2;
+    if (writev(p[1], iov, 2) != 5) {
+        printf(1, "writev to a pipe FAILED\n");
+        goto failed;
+    }
+    memset(a, 0, sizeof(a));
+    memset(b, 0, sizeof(b));
+    iov[0].base = a;
+    iov[0].len = 4;
+    iov[1].base = b;
+    iov[1].len = 4;
+    if (readv(p[0], iov, 2) != 5 || strcmp(a, "abcd") != 0 || strcmp(b, "e") != 0) {
+        printf(1, "readv from a pipe FAILED\n");
+        goto failed;
+    }
+    if (pread(p[0], a, 1, 0) != -1 || pwrite(p[1], a, 1, 0) != -1) {
+        printf(1, "positioned I/O on a pipe didn't fail\n");
+        goto failed;
+    }
+
+// success:
+    printf(1, "MMAP\t SUCCESS\n");
+    exit();
+
+failed:
+    printf(1, "MMAP\t FAILED\n");
+    exit();
+}
@@ -0,0 +1,68 @@
+#include "types.h"
+#include "user.h"
+#include "stat.h"
+#include "mmap.h"
+#include "fcntl.h"
+
+#define NPIPE 80
+
+int main() {
+    int p[NPIPE][2];
+    int i, fd, last, pid;
+    char c, r[1];
+
+    /* More open files than there used to be in the whole system */
+    for (i = 0; i < NPIPE; i++) {
+        if (pipe(p[i]) < 0) {
+            printf(1, "pipe %d FAILED\n", i);
+            goto failed;
+        }
+    }
+    for (i = 0; i < NPIPE; i++) {
+        c = i;
+        if (write(p[i][1], &c, 1) != 1 || read(p[i][0], &c, 1) != 1 || c != i) {
+            printf(1, "pipe %d lost its byte\n", i);
+            goto failed;
+        }
+    }
+
+    /* Descriptors past the first few go on until the table's page is full */
+    for (last = -1; (fd = dup(0)) >= 0; last = fd)
+        ;
+    if (last != 1023) {
+        printf(1, "the last descriptor was %d\n", last);
+        goto failed;
+    }
+    close(last);
+
+    /* The child gets all of them and can use the high ones */
+    if ((pid = fork()) < 0) {
+        printf(1, "fork FAILED\n");
+        goto failed;
+    }
+    if (pid == 0) {
+        c = 'k';
+        write(p[NPIPE - 1][1], &c, 1);
+        exit();
+    }
+    wait();
+    if (read(p[NPIPE - 1][0], r, 1) != 1 || r[0] != 'k') {
+        printf(1, "the child's write didn't arrive\n");
+        goto failed;
+    }
+
+    for (fd = 3; fd < 1023; fd++)
+        close(fd);
+    if ((fd = dup(0)) != 3) {
+        printf(1, "dup after closing gave %d\n", fd);
+        goto failed;
+    }
+
+// success:
+    printf(1, "MMAP\t SUCCESS\n");
+    exit();
+
+failed:
+    printf(1, "MMAP\t FAILED\n");
+    exit();
+}
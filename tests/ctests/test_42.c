@@ -0,0 +1,72 @@
+#include "types.h"
+#include "user.h"
+#include "stat.h"
+#include "mmap.h"
+#include "fcntl.h"
+
+#define PG 4096
+
+int main() {
+    char *shared, *private;
+    int pid, tochild[2], toparent[2];
+    char c, ok;
+
+    shared = mmap(0, 3 * PG, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    private = mmap(0, PG, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (shared == (char *)-1 || private == (char *)-1 || pipe(tochild) < 0 || pipe(toparent) < 0) {
+        printf(1, "setup FAILED\n");
+        goto failed;
+    }
+    shared[0] = 'a';   // page 1 and 2 untouched before the fork
+    private[0] = 'p';
+
+    if ((pid = fork()) < 0) {
+        printf(1, "fork FAILED\n");
+        goto failed;
+    }
+    if (pid == 0) {
+        ok = shared[0] == 'a' && private[0] == 'p';
+        shared[PG] = 'b';
+        private[0] = 'q';
+        write(toparent[1], &ok, 1);
+        // wait for the parent's write to page 2
+        read(tochild[0], &c, 1);
+        ok = shared[2 * PG] == 'c';
+        write(toparent[1], &ok, 1);
+        exit();
+    }
+
+    if (read(toparent[0], &ok, 1) != 1 || !ok) {
+        printf(1, "the child didn't see what was there before the fork\n");
+        goto failed;
+    }
+    if (shared[PG] != 'b') {
+        printf(1, "the child's store to a shared page didn't show\n");
+        goto failed;
+    }
+    if (private[0] != 'p') {
+        printf(1, "the child's store to a private page showed\n");
+        goto failed;
+    }
+    shared[2 * PG] = 'c';
+    write(tochild[1], "x", 1);
+    if (read(toparent[0], &ok, 1) != 1 || !ok) {
+        printf(1, "the parent's store after the fork didn't show\n");
+        goto failed;
+    }
+    wait();
+
+    // the shared pages are the only copy of their data
+    if (madvise(shared, 3 * PG, MADV_DONTNEED) < 0 || shared[PG] != 'b') {
+        printf(1, "MADV_DONTNEED dropped shared anonymous memory\n");
+        goto failed;
+    }
+
+// success:
+    printf(1, "MMAP\t SUCCESS\n");
+    exit();
+
+failed:
+    printf(1, "MMAP\t FAILED\n");
+    exit();
+}
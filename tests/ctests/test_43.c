@@ -0,0 +1,63 @@
+#include "types.h"
+#include "user.h"
+#include "stat.h"
+#include "mmap.h"
+#include "fcntl.h"
+
+int main() {
+    int *w;
+    int i, n, pid;
+
+    w = mmap(0, 4096, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (w == (int *)-1) {
+        printf(1, "mmap FAILED\n");
+        goto failed;
+    }
+
+    if (futex_wait(w, 1) != -1) {
+        printf(1, "futex_wait on a word that differs didn't return at once\n");
+        goto failed;
+    }
+    if (futex_wake(w, 1) != 0) {
+        printf(1, "futex_wake woke someone with nobody waiting\n");
+        goto failed;
+    }
+    if (futex_wait((int *)((char *)w + 1), 0) != -1) {
+        printf(1, "futex_wait on an unaligned word didn't fail\n");
+        goto failed;
+    }
+
+    /* Two children wait on the word in memory they share with us */
+    for (i = 0; i < 2; i++) {
+        if ((pid = fork()) < 0) {
+            printf(1, "fork FAILED\n");
+            goto failed;
+        }
+        if (pid == 0) {
+            while (*w == 0)
+                futex_wait(w, 0);
+            exit();
+        }
+    }
+    sleep(20);  // long enough for both to be asleep
+
+    *w = 1;
+    if ((n = futex_wake(w, 1)) != 1) {
+        printf(1, "futex_wake of one woke %d\n", n);
+        goto failed;
+    }
+    if ((n = futex_wake(w, 5)) != 1) {
+        printf(1, "futex_wake of the rest woke %d\n", n);
+        goto failed;
+    }
+    wait();
+    wait();
+
+// success:
+    printf(1, "MMAP\t SUCCESS\n");
+    exit();
+
+failed:
+    printf(1, "MMAP\t FAILED\n");
+    exit();
+}
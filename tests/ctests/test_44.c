@@ -0,0 +1,89 @@
+#include "types.h"
+#include "user.h"
+#include "stat.h"
+#include "mmap.h"
+#include "fcntl.h"
+
+#define PG 4096
+#define BIG (256 * 1024 * 1024)  // more than the machine's memory
+
+int main() {
+    char *big, *ro, *heap;
+    int i, sum, pid;
+
+    /* Reading all of a mapping bigger than memory costs no memory */
+    big = mmap(0, BIG, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (big == (char *)-1) {
+        printf(1, "mmap FAILED\n");
+        goto failed;
+    }
+    for (sum = 0, i = 0; i < BIG; i += PG)
+        sum += big[i];
+    if (sum != 0) {
+        printf(1, "anonymous memory wasn't zero\n");
+        goto failed;
+    }
+
+    /* Writes get pages of their own, and the others stay zero */
+    big[0] = 1;
+    big[5 * PG + 7] = 2;
+    if (big[0] != 1 || big[5 * PG + 7] != 2 || big[PG] != 0 || big[5 * PG] != 0) {
+        printf(1, "writes after reads FAILED\n");
+        goto failed;
+    }
+
+    /* A child's writes to pages it only read stay its own */
+    if ((pid = fork()) < 0) {
+        printf(1, "fork FAILED\n");
+        goto failed;
+    }
+    if (pid == 0) {
+        big[2 * PG] = 3;
+        exit();
+    }
+    wait();
+    if (big[2 * PG] != 0) {
+        printf(1, "the child's write showed in the parent\n");
+        goto failed;
+    }
+    if (munmap(big, BIG) < 0) {
+        printf(1, "munmap FAILED\n");
+        goto failed;
+    }
+
+    /* Read-only memory reads as zero, and can become writable */
+    ro = mmap(0, PG, PROT_READ, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (ro == (char *)-1 || ro[100] != 0) {
+        printf(1, "read-only mapping FAILED\n");
+        goto failed;
+    }
+    if (mprotect(ro, PG, PROT_READ | PROT_WRITE) < 0) {
+        printf(1, "mprotect FAILED\n");
+        goto failed;
+    }
+    ro[100] = 4;
+    if (ro[100] != 4 || ro[0] != 0) {
+        printf(1, "write after mprotect FAILED\n");
+        goto failed;
+    }
+
+    /* So does the heap */
+    heap = sbrk(2 * PG);
+    if (heap == (char *)-1 || heap[PG] != 0) {
+        printf(1, "sbrk FAILED\n");
+        goto failed;
+    }
+    heap[PG] = 5;
+    if (heap[PG] != 5 || heap[0] != 0) {
+        printf(1, "heap write FAILED\n");
+        goto failed;
+    }
+
+// success:
+    printf(1, "MMAP\t SUCCESS\n");
+    exit();
+
+failed:
+    printf(1, "MMAP\t FAILED\n");
+    exit();
+}
@@ -0,0 +1,65 @@
+#include "types.h"
+#include "user.h"
+#include "stat.h"
+#include "mmap.h"
+#include "fcntl.h"
+
+#define PG 4096
+#define BIG (240 * 1024 * 1024)  // more than the machine's free memory
+
+int main() {
+    int *big;
+    int i, pid, n = BIG / PG;
+
+    /* Touching more memory than there is pages some of it out */
+    big = mmap(0, BIG, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (big == (int *)-1) {
+        printf(1, "mmap FAILED\n");
+        goto failed;
+    }
+    for (i = 0; i < n; i++)
+        big[i * (PG / sizeof(int)) + i % 7] = i;
+
+    /* ... and it all reads back as written */
+    for (i = 0; i < n; i++) {
+        if (big[i * (PG / sizeof(int)) + i % 7] != i) {
+            printf(1, "page %d read back wrong\n", i);
+            goto failed;
+        }
+    }
+
+    /* A child sees the same, swapped out or not, and its writes stay its own */
+    if ((pid = fork()) < 0) {
+        printf(1, "fork FAILED\n");
+        goto failed;
+    }
+    if (pid == 0) {
+        for (i = 0; i < n; i += 13) {
+            if (big[i * (PG / sizeof(int)) + i % 7] != i) {
+                printf(1, "child: page %d read back wrong\n", i);
+                exit();
+            }
+            big[i * (PG / sizeof(int)) + i % 7] = -1;
+        }
+        exit();
+    }
+    wait();
+    for (i = 0; i < n; i++) {
+        if (big[i * (PG / sizeof(int)) + i % 7] != i) {
+            printf(1, "the child's write showed in the parent\n");
+            goto failed;
+        }
+    }
+    if (munmap(big, BIG) < 0) {
+        printf(1, "munmap FAILED\n");
+        goto failed;
+    }
+
+// success:
+    printf(1, "MMAP\t SUCCESS\n");
+    exit();
+
+failed:
+    printf(1, "MMAP\t FAILED\n");
+    exit();
+}
@@ -0,0 +1,84 @@
+#include "types.h"
+#include "user.h"
+#include "stat.h"
+#include "mmap.h"
+#include "fcntl.h"
+
+#define PG 4096
+#define LEN (3 * PG + 100)
+
+char buff[LEN], got[LEN];
+
+int main() {
+    char *filename = "test_file.txt";
+    int fd, i, n, off;
+    char *mem;
+
+    /* A file of a few pages and a bit */
+    fd = open(filename, O_CREATE | O_RDWR);
+    if (fd < 0) {
+        printf(1, "Error opening file\n");
+        goto failed;
+    }
+    for (i = 0; i < LEN; i++)
+        buff[i] = (char)(i * 7 + i / PG);
+    if (write(fd, buff, LEN) != LEN) {
+        printf(1, "Error: Write to file FAILED\n");
+        goto failed;
+    }
+    close(fd);
+
+    /* read() in pieces that straddle pages and blocks */
+    fd = open(filename, O_RDWR);
+    for (off = 0; off < LEN; off += n) {
+        if ((n = read(fd, got + off, 1000)) <= 0) {
+            printf(1, "read FAILED at %d\n", off);
+            goto failed;
+        }
+    }
+    for (i = 0; i < LEN; i++) {
+        if (got[i] != buff[i]) {
+            printf(1, "read returned wrong data at %d\n", i);
+            goto failed;
+        }
+    }
+
+    /* Stores to a shared mapping are what read() sees, at once */
+    mem = mmap(0, LEN, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mem == (char *)-1) {
+        printf(1, "mmap FAILED\n");
+        goto failed;
+    }
+    for (i = 0; i < LEN; i += 1001) {
+        if (mem[i] != buff[i]) {
+            printf(1, "mapping holds wrong data at %d\n", i);
+            goto failed;
+        }
+        mem[i] = buff[i] = ~buff[i];
+    }
+    if (pread(fd, got, LEN, 0) != LEN) {
+        printf(1, "pread FAILED\n");
+        goto failed;
+    }
+    for (i = 0; i < LEN; i++) {
+        if (got[i] != buff[i]) {
+            printf(1, "pread missed the store at %d\n", i);
+            goto failed;
+        }
+    }
+
+    if (munmap(mem, LEN) < 0) {
+        printf(1, "munmap FAILED\n");
+        goto failed;
+    }
+    close(fd);
+    unlink(filename);
+
+// success:
+    printf(1, "MMAP\t SUCCESS\n");
+    exit();
+
+failed:
+    printf(1, "MMAP\t FAILED\n");
+    exit();
+}
@@ -0,0 +1,40 @@
+#include "types.h"
+#include "user.h"
+#include "stat.h"
+#include "mmap.h"
+#include "fcntl.h"
+
+#define PG 4096
+#define BIG (384 * 1024 * 1024)  // more than the old 224MB limit and swap together
+
+int main() {
+    int *big;
+    int i, n = BIG / PG;
+
+    /* Touch more memory than the kernel used to be able to map */
+    big = mmap(0, BIG, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (big == (int *)-1) {
+        printf(1, "mmap FAILED\n");
+        goto failed;
+    }
+    for (i = 0; i < n; i++)
+        big[i * (PG / sizeof(int))] = i;
+    for (i = 0; i < n; i++) {
+        if (big[i * (PG / sizeof(int))] != i) {
+            printf(1, "page %d read back wrong\n", i);
+            goto failed;
+        }
+    }
+    if (munmap(big, BIG) < 0) {
+        printf(1, "munmap FAILED\n");
+        goto failed;
+    }
+
+// success:
+    printf(1, "MMAP\t SUCCESS\n");
+    exit();
+
+failed:
+    printf(1, "MMAP\t FAILED\n");
+    exit();
+}
@@ -0,0 +1,92 @@
+#include "types.h"
+#include "user.h"
+#include "stat.h"
+#include "mmap.h"
+#include "fcntl.h"
+
+#define PG 4096
+#define LEN (20 * PG + 100)  // reaches into the indirect pages
+
+char buff[LEN], got[LEN];
+
+int main() {
+    char *filename = "/tmp/test_file.txt";
+    struct stat root, tmp, up, st;
+    int fd, i;
+    char *mem;
+
+    /* /tmp is another file system, and its ".." leads back to / */
+    if (stat("/", &root) < 0 || stat("/tmp", &tmp) < 0 || stat("/tmp/..", &up) < 0) {
+        printf(1, "stat FAILED\n");
+        goto failed;
+    }
+    if (tmp.dev == root.dev || up.dev != root.dev || up.ino != root.ino) {
+        printf(1, "/tmp is not mounted\n");
+        goto failed;
+    }
+
+    fd = open(filename, O_CREATE | O_RDWR);
+    if (fd < 0) {
+        printf(1, "Error opening file\n");
+        goto failed;
+    }
+    for (i = 0; i < LEN; i++)
+        buff[i] = (char)(i * 7 + i / PG);
+    if (write(fd, buff, LEN) != LEN) {
+        printf(1, "Error: Write to file FAILED\n");
+        goto failed;
+    }
+    if (pread(fd, got, LEN, 0) != LEN) {
+        printf(1, "pread FAILED\n");
+        goto failed;
+    }
+    for (i = 0; i < LEN; i++) {
+        if (got[i] != buff[i]) {
+            printf(1, "read returned wrong data at %d\n", i);
+            goto failed;
+        }
+    }
+
+    /* A shared mapping is the file itself */
+    mem = mmap(0, LEN, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mem == (char *)-1) {
+        printf(1, "mmap FAILED\n");
+        goto failed;
+    }
+    for (i = 0; i < LEN; i += 1001) {
+        if (mem[i] != buff[i]) {
+            printf(1, "mapping holds wrong data at %d\n", i);
+            goto failed;
+        }
+        mem[i] = buff[i] = ~buff[i];
+    }
+    if (pread(fd, got, LEN, 0) != LEN) {
+        printf(1, "pread FAILED\n");
+        goto failed;
+    }
+    for (i = 0; i < LEN; i++) {
+        if (got[i] != buff[i]) {
+            printf(1, "pread missed the store at %d\n", i);
+            goto failed;
+        }
+    }
+    if (munmap(mem, LEN) < 0) {
+        printf(1, "munmap FAILED\n");
+        goto failed;
+    }
+    close(fd);
+
+    /* Unlinked, it is gone */
+    if (unlink(filename) < 0 || stat(filename, &st) == 0) {
+        printf(1, "unlink FAILED\n");
+        goto failed;
+    }
+
+// success:
+    printf(1, "MMAP\t SUCCESS\n");
+    exit();
+
+failed:
+    printf(1, "MMAP\t FAILED\n");
+    exit();
+}
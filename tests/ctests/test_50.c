@@ -0,0 +1,60 @@
+#include "types.h"
+#include "user.h"
+#include "stat.h"
+#include "mmap.h"
+#include "fcntl.h"
+#include "syscall.h"
+#include "kstats.h"
+
+#define PG 4096
+#define N 16
+
+int main() {
+    struct kstats a, b;
+    char *p;
+    int i;
+
+    if (kstats(&a) < 0) {
+        printf(1, "kstats FAILED\n");
+        goto failed;
+    }
+
+    /* Faults on fresh anonymous memory, and the pages they take */
+    p = mmap(0, N * PG, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (p == (char *)-1) {
+        printf(1, "mmap FAILED\n");
+        goto failed;
+    }
+    for (i = 0; i < N; i++)
+        p[i * PG] = i;
+    getpid();
+    getpid();
+
+    if (kstats(&b) < 0) {
+        printf(1, "kstats FAILED\n");
+        goto failed;
+    }
+    if (b.count[KS_FAULTANON] - a.count[KS_FAULTANON] < N) {
+        printf(1, "anonymous faults went uncounted\n");
+        goto failed;
+    }
+    if (b.count[KS_KALLOC] - a.count[KS_KALLOC] < N) {
+        printf(1, "page allocations went uncounted\n");
+        goto failed;
+    }
+    if (b.syscall[SYS_getpid] - a.syscall[SYS_getpid] < 2 ||
+        b.syscall[SYS_mmap] - a.syscall[SYS_mmap] < 1 ||
+        b.count[KS_SYSCALL] - a.count[KS_SYSCALL] < 4) {
+        printf(1, "system calls went uncounted\n");
+        goto failed;
+    }
+    munmap(p, N * PG);
+
+// success:
+    printf(1, "MMAP\t SUCCESS\n");
+    exit();
+
+failed:
+    printf(1, "MMAP\t FAILED\n");
+    exit();
+}
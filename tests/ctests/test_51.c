@@ -0,0 +1,82 @@
+#include "types.h"
+#include "user.h"
+#include "stat.h"
+#include "mmap.h"
+#include "fcntl.h"
+#include "syscall.h"
+#include "trace.h"
+
+#define PG 4096
+#define NREC 512
+
+struct tracerec rec[NREC];
+
+int main() {
+    char *p;
+    int i, n, pid, call, ret, fault, faultdone;
+
+    pid = getpid();
+    if (trace(1) < 0) {
+        printf(1, "trace FAILED\n");
+        goto failed;
+    }
+    getpid();
+    p = mmap(0, PG, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (p == (char *)-1) {
+        printf(1, "mmap FAILED\n");
+        goto failed;
+    }
+    p[0] = 1;
+    trace(0);
+
+    n = traceread(rec, NREC);
+    if (n <= 0) {
+        printf(1, "traceread returned %d\n", n);
+        goto failed;
+    }
+
+    /* getpid's enter and exit, in order, with its result */
+    call = ret = fault = faultdone = -1;
+    for (i = 0; i < n; i++) {
+        if (rec[i].pid != pid)
+            continue;
+        if (call < 0 && rec[i].ev == TR_SYSCALL && rec[i].arg == SYS_getpid)
+            call = i;
+        else if (call >= 0 && ret < 0 && rec[i].ev == TR_SYSRET)
+            ret = i;
+        else if (rec[i].ev == TR_FAULT && rec[i].arg == (uint)p)
+            fault = i;
+        else if (fault >= 0 && faultdone < 0 && rec[i].ev == TR_FAULTDONE)
+            faultdone = i;
+    }
+    if (call < 0 || ret < 0) {
+        printf(1, "getpid was not traced\n");
+        goto failed;
+    }
+    if (rec[ret].arg != pid || rec[ret].tsc < rec[call].tsc) {
+        printf(1, "getpid's return was traced wrong\n");
+        goto failed;
+    }
+    if (fault < 0 || faultdone < 0 || rec[faultdone].arg == (uint)-1) {
+        printf(1, "the page fault was not traced\n");
+        goto failed;
+    }
+
+    /* Nothing is recorded with tracing off */
+    while (traceread(rec, NREC) > 0)
+        ;
+    getpid();
+    if (traceread(rec, NREC) != 0) {
+        printf(1, "records made with tracing off\n");
+        goto failed;
+    }
+    munmap(p, PG);
+
+// success:
+    printf(1, "MMAP\t SUCCESS\n");
+    exit();
+
+failed:
+    printf(1, "MMAP\t FAILED\n");
+    exit();
+}
@@ -0,0 +1,109 @@
+#include "types.h"
+#include "user.h"
+#include "stat.h"
+#include "mmap.h"
+#include "fcntl.h"
+#include "param.h"
+#include "memstat.h"
+
+#define PG 4096
+#define N 16
+
+struct memstat ms[NPROC];
+char buf[PG];
+
+/* This process's memory use, or 0 */
+struct memstat *mine(void) {
+    int i, n, pid = getpid();
+
+    n = memstat(ms, NPROC);
+    for (i = 0; i < n && i < NPROC; i++)
+        if (ms[i].pid == pid)
+            return &ms[i];
+    return 0;
+}
+
+int main() {
+    struct memstat a, *m;
+    char *p, *f;
+    int fd, i, fds[2];
+    char ok;
+
+    if ((m = mine()) == 0) {
+        printf(1, "memstat FAILED\n");
+        goto failed;
+    }
+    a = *m;
+
+    /* Anonymous pages, once written */
+    p = mmap(0, N * PG, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (p == (char *)-1) {
+        printf(1, "mmap FAILED\n");
+        goto failed;
+    }
+    for (i = 0; i < N; i++)
+        p[i * PG] = i;
+
+    /* File pages, once read */
+    fd = open("memfile", O_CREATE | O_RDWR);
+    memset(buf, 'x', PG);
+    for (i = 0; i < N; i++)
+        write(fd, buf, PG);
+    f = mmap(0, N * PG, PROT_READ, MAP_SHARED, fd, 0);
+    if (f == (char *)-1) {
+        printf(1, "mmap FAILED\n");
+        goto failed;
+    }
+    for (i = 0; i < N; i++)
+        if (f[i * PG] != 'x') {
+            printf(1, "file mapping reads wrong\n");
+            goto failed;
+        }
+
+    m = mine();
+    if (m->mapped - a.mapped != 2 * N * PG) {
+        printf(1, "mapped went from %d to %d\n", a.mapped, m->mapped);
+        goto failed;
+    }
+    if (m->anon - a.anon < N || m->file - a.file < N) {
+        printf(1, "resident pages went uncounted\n");
+        goto failed;
+    }
+
+    /* A forked child shares the anonymous pages copy-on-write */
+    pipe(fds);
+    if (fork() == 0) {
+        m = mine();
+        if (m->cow < N) {
+            printf(1, "cow is %d\n", m->cow);
+            exit();
+        }
+        for (i = 0; i < N; i++)
+            p[i * PG] = i + 1;
+        if (mine()->cow > m->cow - N) {
+            printf(1, "written pages still counted as shared\n");
+            exit();
+        }
+        write(fds[1], "y", 1);
+        exit();
+    }
+    close(fds[1]);
+    if (read(fds[0], &ok, 1) != 1) {
+        printf(1, "copy-on-write sharing was not counted\n");
+        goto failed;
+    }
+    wait();
+
+    munmap(f, N * PG);
+    munmap(p, N * PG);
+    close(fd);
+    unlink("memfile");
+
+// success:
+    printf(1, "MMAP\t SUCCESS\n");
+    exit();
+
+failed:
+    printf(1, "MMAP\t FAILED\n");
+    exit();
+}
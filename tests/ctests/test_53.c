@@ -0,0 +1,73 @@
+#include "types.h"
+#include "user.h"
+#include "stat.h"
+#include "mmap.h"
+#include "fcntl.h"
+
+#define PG 4096
+
+int fds[2];
+
+/* Touch [from, to) in a child, which says 'y' if it got through */
+int touch(char *from, char *to) {
+    char c = 0;
+    char *p;
+
+    if (fork() == 0) {
+        close(fds[0]);
+        for (p = from; p < to; p += PG)
+            *p = 1;
+        write(fds[1], "y", 1);
+        exit();
+    }
+    wait();
+    write(fds[1], "n", 1);
+    read(fds[0], &c, 1);
+    if (c == 'y')
+        read(fds[0], &c, 1); /* the parent's 'n' */
+    else
+        return 0;
+    return 1;
+}
+
+int main() {
+    int prot = PROT_READ | PROT_WRITE;
+    int flags = MAP_ANON | MAP_FIXED | MAP_GROWSUP | MAP_PRIVATE;
+    char *a = (char *)0x60000000;
+    char *b = (char *)0x60000000 + 8 * PG;
+
+    pipe(fds);
+
+    /* A grows up to a guard page below B, however it grows */
+    if (mmap(a, PG, prot, flags, -1, 0) != a ||
+        mmap(b, PG, prot, MAP_ANON | MAP_FIXED | MAP_PRIVATE, -1, 0) != b) {
+        printf(1, "mmap FAILED\n");
+        goto failed;
+    }
+    if (!touch(a, b - PG)) {
+        printf(1, "growing up to the guard page failed\n");
+        goto failed;
+    }
+    if (touch(a, b)) {
+        printf(1, "grew into the guard page below the next mapping\n");
+        goto failed;
+    }
+
+    /* and a lone one grows past one chunk */
+    if (mmap(b + 8 * PG, PG, prot, flags, -1, 0) != b + 8 * PG) {
+        printf(1, "mmap FAILED\n");
+        goto failed;
+    }
+    if (!touch(b + 8 * PG, b + 8 * PG + 64 * PG)) {
+        printf(1, "growing by several chunks failed\n");
+        goto failed;
+    }
+
+// success:
+    printf(1, "MMAP\t SUCCESS\n");
+    exit();
+
+failed:
+    printf(1, "MMAP\t FAILED\n");
+    exit();
+}
@@ -0,0 +1,105 @@
+#include "types.h"
+#include "user.h"
+#include "stat.h"
+#include "mmap.h"
+#include "fcntl.h"
+
+#define PG 4096
+#define N (1024 * PG) /* a whole page table's worth, and more */
+
+int fds[2];
+
+/* Whether every page of [p, p + n) holds v */
+int holds(char *p, int n, char v) {
+    int i;
+
+    for (i = 0; i < n; i += PG)
+        if (p[i] != v || p[i + PG - 1] != v)
+            return 0;
+    return 1;
+}
+
+void fill(char *p, int n, char v) {
+    int i;
+
+    for (i = 0; i < n; i += PG)
+        p[i] = p[i + PG - 1] = v;
+}
+
+int main() {
+    char *heap, *anon, c;
+
+    pipe(fds);
+    heap = sbrk(N + 4 * PG);
+    anon = mmap(0, N, PROT_READ | PROT_WRITE, MAP_ANON | MAP_PRIVATE, -1, 0);
+    if (heap == (char *)-1 || anon == (char *)-1) {
+        printf(1, "sbrk or mmap FAILED\n");
+        goto failed;
+    }
+    fill(heap, N + 4 * PG, 'a');
+    fill(anon, N, 'a');
+
+    /* the child sees the parent's memory, and writes only its own */
+    if (fork() == 0) {
+        c = 'y';
+        if (!holds(heap, N + 4 * PG, 'a') || !holds(anon, N, 'a'))
+            c = 'n';
+        fill(heap, N / 2, 'b');
+        fill(anon + N / 2, N / 2, 'b');
+        if (!holds(heap, N / 2, 'b') || !holds(heap + N / 2, N / 2, 'a') ||
+            !holds(anon + N / 2, N / 2, 'b'))
+            c = 'n';
+        write(fds[1], &c, 1);
+        exit();
+    }
+    read(fds[0], &c, 1);
+    wait();
+    if (c != 'y') {
+        printf(1, "the child saw the wrong data\n");
+        goto failed;
+    }
+    if (!holds(heap, N + 4 * PG, 'a') || !holds(anon, N, 'a')) {
+        printf(1, "the child's writes showed in the parent\n");
+        goto failed;
+    }
+
+    /* the parent writes while the child still shares its tables */
+    if (fork() == 0) {
+        read(fds[0], &c, 1);
+        c = holds(heap, N + 4 * PG, 'a') && holds(anon, N, 'a') ? 'y' : 'n';
+        write(fds[1], &c, 1);
+        exit();
+    }
+    fill(heap, N + 4 * PG, 'c');
+    fill(anon, N, 'c');
+    write(fds[1], "go", 1);
+    wait();
+    read(fds[0], &c, 1);
+    if (c != 'y') {
+        printf(1, "the parent's writes showed in the child\n");
+        goto failed;
+    }
+    if (!holds(heap, N + 4 * PG, 'c') || !holds(anon, N, 'c')) {
+        printf(1, "the parent lost its writes\n");
+        goto failed;
+    }
+
+    /* and unmapping a shared table leaves the other process's alone */
+    if (fork() == 0) {
+        munmap(anon, N);
+        exit();
+    }
+    wait();
+    if (!holds(anon, N, 'c')) {
+        printf(1, "the child's munmap showed in the parent\n");
+        goto failed;
+    }
+
+// success:
+    printf(1, "MMAP\t SUCCESS\n");
+    exit();
+
+failed:
+    printf(1, "MMAP\t FAILED\n");
+    exit();
+}
@@ -0,0 +1,87 @@
+#include "types.h"
+#include "user.h"
+#include "stat.h"
+#include "fcntl.h"
+
+#define N (3 * 4096 + 1000)
+
+char buf[N];
+
+/* Whether fd's next n bytes are the source's from off on */
+int same(int fd, int off, int n) {
+    int i, r;
+
+    if ((r = read(fd, buf, n)) != n) {
+        printf(1, "read %d of %d bytes\n", r, n);
+        return 0;
+    }
+    for (i = 0; i < n; i++)
+        if (buf[i] != (char)((off + i) * 7)) {
+            printf(1, "byte %d is wrong\n", off + i);
+            return 0;
+        }
+    return 1;
+}
+
+int main() {
+    int in, out, fds[2], i;
+
+    for (i = 0; i < N; i++)
+        buf[i] = (i * 7);
+    in = open("copysrc", O_CREATE | O_RDWR);
+    if (in < 0 || write(in, buf, N) != N) {
+        printf(1, "creating the source FAILED\n");
+        goto failed;
+    }
+    close(in);
+
+    /* from in's offset, which moves, in uneven pieces */
+    in = open("copysrc", O_RDONLY);
+    out = open("copydst", O_CREATE | O_RDWR);
+    if (copyfile(out, in, -1, 100) != 100 ||
+        copyfile(out, in, -1, 5000) != 5000 ||
+        copyfile(out, in, -1, N) != N - 5100 ||
+        copyfile(out, in, -1, N) != 0) {
+        printf(1, "copying from the offset returned the wrong counts\n");
+        goto failed;
+    }
+    close(out);
+    out = open("copydst", O_RDONLY);
+    if (!same(out, 0, N))
+        goto failed;
+    close(out);
+
+    /* from a given offset, which leaves in's alone */
+    out = open("copydst2", O_CREATE | O_RDWR);
+    if (copyfile(out, in, 4000, 200) != 200 || copyfile(out, in, N - 10, 100) != 10) {
+        printf(1, "copying from an offset returned the wrong counts\n");
+        goto failed;
+    }
+    close(out);
+    out = open("copydst2", O_RDONLY);
+    if (!same(out, 4000, 200) || !same(out, N - 10, 10))
+        goto failed;
+    close(out);
+
+    /* and into a pipe */
+    pipe(fds);
+    if (copyfile(fds[1], in, 4090, 20) != 20 || !same(fds[0], 4090, 20)) {
+        printf(1, "copying into a pipe FAILED\n");
+        goto failed;
+    }
+
+    /* but not out of one */
+    out = open("copydst2", O_RDWR);
+    if (copyfile(out, fds[0], -1, 10) != -1) {
+        printf(1, "copying out of a pipe didn't fail\n");
+        goto failed;
+    }
+
+// success:
+    printf(1, "MMAP\t SUCCESS\n");
+    exit();
+
+failed:
+    printf(1, "MMAP\t FAILED\n");
+    exit();
+}
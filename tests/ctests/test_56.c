@@ -0,0 +1,65 @@
+#include "types.h"
+#include "user.h"
+#include "stat.h"
+#include "mmap.h"
+#include "fcntl.h"
+
+#define PG 4096
+
+char buf[100];
+
+int main() {
+    int prot = PROT_READ | PROT_WRITE;
+    struct stat st;
+    char *mem;
+    int fd, i;
+
+    for (i = 0; i < sizeof(buf); i++)
+        buf[i] = 'a';
+    fd = open("short", O_CREATE | O_RDWR);
+    if (fd < 0 || write(fd, buf, sizeof(buf)) != sizeof(buf)) {
+        printf(1, "creating the file FAILED\n");
+        goto failed;
+    }
+
+    /* stores past the end of a short file don't grow it */
+    mem = mmap(0, 2 * PG, prot, MAP_SHARED, fd, 0);
+    if (mem == (char *)-1) {
+        printf(1, "mmap FAILED\n");
+        goto failed;
+    }
+    mem[0] = 'b';
+    mem[200] = 'c';
+    if (msync(mem, PG, MS_ASYNC) < 0) {
+        printf(1, "msync FAILED\n");
+        goto failed;
+    }
+    mem[99] = 'd';
+    mem[300] = 'e';
+    if (munmap(mem, 2 * PG) < 0) {
+        printf(1, "munmap FAILED\n");
+        goto failed;
+    }
+    if (fstat(fd, &st) < 0 || st.size != sizeof(buf)) {
+        printf(1, "file size changed to %d\n", st.size);
+        goto failed;
+    }
+    close(fd);
+
+    /* and the stores inside it are there */
+    fd = open("short", O_RDONLY);
+    if (fd < 0 || read(fd, buf, PG) != sizeof(buf) || buf[0] != 'b' ||
+        buf[1] != 'a' || buf[99] != 'd') {
+        printf(1, "stores through the mapping were not written back\n");
+        goto failed;
+    }
+    close(fd);
+
+// success:
+    printf(1, "MMAP\t SUCCESS\n");
+    exit();
+
+failed:
+    printf(1, "MMAP\t FAILED\n");
+    exit();
+}
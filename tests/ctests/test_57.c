@@ -0,0 +1,65 @@
+#include "types.h"
+#include "user.h"
+#include "stat.h"
+
+int fds[2];
+
+/* Fork children that wait for the pipe to close until fork fails,
+   then let them go and reap them.  Returns how many there were. */
+int fill(void) {
+    char c;
+    int n, pid;
+
+    pipe(fds);
+    for (n = 0; (pid = fork()) > 0; n++)
+        ;
+    if (pid == 0) {
+        close(fds[1]);
+        read(fds[0], &c, 1);
+        exit();
+    }
+    close(fds[0]);
+    close(fds[1]);
+    while (wait() > 0)
+        ;
+    return n;
+}
+
+int main() {
+    int i, n, m, pid;
+
+    /* every slot a child took comes back when it is reaped */
+    n = fill();
+    if (n < 8) {
+        printf(1, "only %d children fit\n", n);
+        goto failed;
+    }
+    for (i = 0; i < 3; i++) {
+        if ((m = fill()) != n) {
+            printf(1, "%d children fit, then %d\n", n, m);
+            goto failed;
+        }
+    }
+
+    /* and many short-lived ones in a row get fresh ones */
+    for (i = 0; i < 1000; i++) {
+        if ((pid = fork()) < 0) {
+            printf(1, "fork %d FAILED\n", i);
+            goto failed;
+        }
+        if (pid == 0)
+            exit();
+        if (wait() != pid) {
+            printf(1, "wait FAILED\n");
+            goto failed;
+        }
+    }
+
+// success:
+    printf(1, "MMAP\t SUCCESS\n");
+    exit();
+
+failed:
+    printf(1, "MMAP\t FAILED\n");
+    exit();
+}
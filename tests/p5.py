@@ -110,7 +110,303 @@ class test15(Xv6Test):
    make_qemu_args = "CPUS=1"
    point_value = 1
 
+class test16(Xv6Test):
+   name = "test_16"
+   description = "msync with MS_SYNC and MS_ASYNC should write changes back without munmap"
+   tester = "ctests/" + name + ".c"
+   make_qemu_args = "CPUS=1"
+   point_value = 1
+
+class test17(Xv6Test):
+   name = "test_17"
+   description = "Huge-page anonymous mapping with MAP_HUGE, shared copy-on-write with a child"
+   tester = "ctests/" + name + ".c"
+   make_qemu_args = "CPUS=1"
+   point_value = 1
+
+class test18(Xv6Test):
+   name = "test_18"
+   description = "munmap and exit should give mapped pages back to the kernel"
+   tester = "ctests/" + name + ".c"
+   make_qemu_args = "CPUS=1"
+   point_value = 1
+
+class test19(Xv6Test):
+   name = "test_19"
+   description = "Partial munmap splits a mapping; the hole can be mapped again"
+   tester = "ctests/" + name + ".c"
+   make_qemu_args = "CPUS=1"
+   point_value = 1
+
+class test20(Xv6Test):
+   name = "test_20"
+   description = "mmap a file at a non-zero offset; munmap writes back to the same place"
+   tester = "ctests/" + name + ".c"
+   make_qemu_args = "CPUS=1"
+   point_value = 1
+
+class test21(Xv6Test):
+   name = "test_21"
+   description = "A file mapping keeps working after its fd (here fd 0) is closed"
+   tester = "ctests/" + name + ".c"
+   make_qemu_args = "CPUS=1"
+   point_value = 1
+
+class test22(Xv6Test):
+   name = "test_22"
+   description = "mprotect: read-only and PROT_NONE pages fault, and can be made writable again"
+   tester = "ctests/" + name + ".c"
+   make_qemu_args = "CPUS=1"
+   point_value = 1
+
+class test23(Xv6Test):
+   name = "test_23"
+   description = "MAP_POPULATE maps anonymous and file pages at mmap time"
+   tester = "ctests/" + name + ".c"
+   make_qemu_args = "CPUS=1"
+   point_value = 1
+
+class test24(Xv6Test):
+   name = "test_24"
+   description = "madvise: DONTNEED drops pages, WILLNEED and SEQUENTIAL keep data intact"
+   tester = "ctests/" + name + ".c"
+   make_qemu_args = "CPUS=1"
+   point_value = 1
+
+
+class test25(Xv6Test):
+   name = "test_25"
+   description = "files past the single-indirect blocks map and read back through double-indirect blocks"
+   tester = "ctests/" + name + ".c"
+   make_qemu_args = "CPUS=1"
+   point_value = 1
+
+
+class test26(Xv6Test):
+   name = "test_26"
+   description = "splice moves a file through a pipe into another file"
+   tester = "ctests/" + name + ".c"
+   make_qemu_args = "CPUS=1"
+   point_value = 1
+
+
+class test27(Xv6Test):
+   name = "test_27"
+   description = "setpriority levels; interactive process runs beside CPU-bound ones"
+   tester = "ctests/" + name + ".c"
+   make_qemu_args = "CPUS=1"
+   point_value = 1
+
+class test28(Xv6Test):
+   name = "test_28"
+   description = "usleep sleeps for sub-tick times without polling ticks"
+   tester = "ctests/" + name + ".c"
+   make_qemu_args = "CPUS=1"
+   point_value = 1
+
+class test29(Xv6Test):
+   name = "test_29"
+   description = "clone threads share memory and mappings; join reaps them"
+   tester = "ctests/" + name + ".c"
+   make_qemu_args = "CPUS=1"
+   point_value = 1
+
+class test30(Xv6Test):
+   name = "test_30"
+   description = "spawn runs a program with chosen descriptors, without fork"
+   tester = "ctests/" + name + ".c"
+   make_qemu_args = "CPUS=1"
+   point_value = 1
+
+class test31(Xv6Test):
+   name = "test_31"
+   description = "exec pages the program in as it is touched"
+   tester = "ctests/" + name + ".c"
+   make_qemu_args = "CPUS=1"
+   point_value = 1
+
+class test32(Xv6Test):
+   name = "test_32"
+   description = "sbrk grows the heap lazily, paging it in on first touch"
+   tester = "ctests/" + name + ".c"
+   make_qemu_args = "CPUS=1"
+   point_value = 1
+
+class test33(Xv6Test):
+   name = "test_33"
+   description = "malloc serves size classes from bins and big blocks from mmap"
+   tester = "ctests/" + name + ".c"
+   make_qemu_args = "CPUS=1"
+   point_value = 1
+
+class test34(Xv6Test):
+   name = "test_34"
+   description = "pipes allocated from the kernel slab cache survive churn"
+   tester = "ctests/" + name + ".c"
+   make_qemu_args = "CPUS=1"
+   point_value = 1
+
+class test35(Xv6Test):
+   name = "test_35"
+   description = "lockstat counts spin lock acquires by lock name"
+   tester = "ctests/" + name + ".c"
+   make_qemu_args = "CPUS=1"
+   point_value = 1
+
+class test36(Xv6Test):
+   name = "test_36"
+   description = "processes mapping and stating one file share its inode lock"
+   tester = "ctests/" + name + ".c"
+   make_qemu_args = "CPUS=1"
+   point_value = 1
+
+class test37(Xv6Test):
+   name = "test_37"
+   description = "system calls through sysenter keep the caller's registers"
+   tester = "ctests/" + name + ".c"
+   make_qemu_args = "CPUS=1"
+   point_value = 1
+
+class test38(Xv6Test):
+   name = "test_38"
+   description = "a submission ring runs several system calls per trap"
+   tester = "ctests/" + name + ".c"
+   make_qemu_args = "CPUS=1"
+   point_value = 1
+
+class test39(Xv6Test):
+   name = "test_39"
+   description = "system calls take paths, buffers and stacks in mappings"
+   tester = "ctests/" + name + ".c"
+   make_qemu_args = "CPUS=1"
+   point_value = 1
+
+class test40(Xv6Test):
+   name = "test_40"
+   description = "readv, writev, pread and pwrite"
+   tester = "ctests/" + name + ".c"
+   make_qemu_args = "CPUS=1"
+   point_value = 1
+
+class test41(Xv6Test):
+   name = "test_41"
+   description = "descriptor table grows past NOFILE, and open files past the old table"
+   tester = "ctests/" + name + ".c"
+   make_qemu_args = "CPUS=1"
+   point_value = 1
+
+class test42(Xv6Test):
+   name = "test_42"
+   description = "MAP_SHARED anonymous memory is shared with the child after fork"
+   tester = "ctests/" + name + ".c"
+   make_qemu_args = "CPUS=1"
+   point_value = 1
+
+class test43(Xv6Test):
+   name = "test_43"
+   description = "futex_wait and futex_wake across processes sharing memory"
+   tester = "ctests/" + name + ".c"
+   make_qemu_args = "CPUS=1"
+   point_value = 1
+
+class test44(Xv6Test):
+   name = "test_44"
+   description = "reads of untouched anonymous memory share the zero page"
+   tester = "ctests/" + name + ".c"
+   make_qemu_args = "CPUS=1"
+   point_value = 1
+
+class test45(Xv6Test):
+   name = "test_45"
+   description = "memory beyond what the machine has is paged out to swap"
+   tester = "ctests/" + name + ".c"
+   make_qemu_args = "CPUS=1 MEM=256"
+   point_value = 1
+
+class test46(Xv6Test):
+   name = "test_46"
+   description = "read() and MAP_SHARED mappings of a file share its page cache"
+   tester = "ctests/" + name + ".c"
+   make_qemu_args = "CPUS=1"
+   point_value = 1
+
+class test47(Xv6Test):
+   name = "test_47"
+   description = "all of a 512MB machine's memory can be used"
+   tester = "ctests/" + name + ".c"
+   make_qemu_args = "CPUS=1 MEM=512"
+   point_value = 1
+
+class test48(Xv6Test):
+   name = "test_48"
+   description = "files in /tmp live in memory and map without copies"
+   tester = "ctests/" + name + ".c"
+   make_qemu_args = "CPUS=1"
+   point_value = 1
+
+class test49(Xv6Test):
+   name = "test_49"
+   description = "the mmapbench microbenchmarks run to completion"
+   tester = "ctests/" + name + ".c"
+   make_qemu_args = "CPUS=1"
+   point_value = 1
+
+class test50(Xv6Test):
+   name = "test_50"
+   description = "kstats counts page faults, allocations and system calls"
+   tester = "ctests/" + name + ".c"
+   make_qemu_args = "CPUS=2"
+   point_value = 1
+
+class test51(Xv6Test):
+   name = "test_51"
+   description = "tracepoints record system calls and page faults"
+   tester = "ctests/" + name + ".c"
+   make_qemu_args = "CPUS=2"
+   point_value = 1
+
+class test52(Xv6Test):
+   name = "test_52"
+   description = "memstat counts anonymous, file and copy-on-write pages"
+   tester = "ctests/" + name + ".c"
+   make_qemu_args = "CPUS=1"
+   point_value = 1
+
+class test53(Xv6Test):
+   name = "test_53"
+   description = "MAP_GROWSUP grows in chunks but stops at the next mapping's guard page"
+   tester = "ctests/" + name + ".c"
+   make_qemu_args = "CPUS=1"
+   point_value = 1
+
+class test54(Xv6Test):
+   name = "test_54"
+   description = "fork shares page tables copy-on-write without the processes seeing each other's writes"
+   tester = "ctests/" + name + ".c"
+   make_qemu_args = "CPUS=2"
+   point_value = 1
+
+class test55(Xv6Test):
+   name = "test_55"
+   description = "copyfile copies between files and into pipes inside the kernel"
+   tester = "ctests/" + name + ".c"
+   make_qemu_args = "CPUS=1"
+   point_value = 1
+
+class test56(Xv6Test):
+   name = "test_56"
+   description = "writing back a MAP_SHARED mapping doesn't grow the file past its size"
+   tester = "ctests/" + name + ".c"
+   make_qemu_args = "CPUS=1"
+   point_value = 1
+
+class test57(Xv6Test):
+   name = "test_57"
+   description = "process slots and kernel stacks are recycled as processes come and go"
+   tester = "ctests/" + name + ".c"
+   make_qemu_args = "CPUS=2"
+   point_value = 1
 
 import toolspath
 from testing.runtests import main
-main(Xv6Build, all_tests=[test1, test2, test3, test4, test5, test6, test7, test8, test9, test10, test11, test12, test13, test14, test15])
+main(Xv6Build, all_tests=[test1, test2, test3, test4, test5, test6, test7, test8, test9, test10, test11, test12, test13, test14, test15, test16, test17, test18, test19, test20, test21, test22, test23, test24, test25, test26, test27, test28, test29, test30, test31, test32, test33, test34, test35, test36, test37, test38, test39, test40, test41, test42, test43, test44, test45, test46, test47, test48, test49, test50, test51, test52, test53, test54, test55, test56, test57])
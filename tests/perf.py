@@ -0,0 +1,48 @@
+import os
+from testing import Xv6Bench, Xv6Build
+
+# Performance runs: the benchmark programs under different CPUS
+# settings.  Each test saves the cycle counts it collects to
+# --results, and fails if any is more than --tolerance worse than
+# in --baseline.  To accept a run as the new baseline, copy the
+# results file over the baseline file.
+
+commands = ["mmapbench", "mmapbench /tmp", "fsbench", "schedbench"]
+
+class cpus1(Xv6Bench):
+   name = "cpus1"
+   description = "benchmarks on one CPU"
+   make_qemu_args = "CPUS=1"
+   commands = commands
+
+class cpus2(Xv6Bench):
+   name = "cpus2"
+   description = "benchmarks on two CPUs"
+   make_qemu_args = "CPUS=2"
+   commands = commands + ["fsbench -p 2"]
+
+class cpus4(Xv6Bench):
+   name = "cpus4"
+   description = "benchmarks on four CPUs"
+   make_qemu_args = "CPUS=4"
+   commands = commands + ["fsbench -p 4"]
+
+import toolspath
+from testing.runtests import main, parser
+
+here = os.path.dirname(os.path.abspath(__file__))
+parser.add_option("--results", dest="results",
+      default=os.path.join(here, "perf-results.json"),
+      help="Where to save the results (default: perf-results.json here)")
+parser.add_option("--baseline", dest="baseline",
+      default=os.path.join(here, "perf-baseline.json"),
+      help="Results to compare with (default: perf-baseline.json here, "
+      "if it exists)")
+parser.add_option("--tolerance", dest="tolerance", type="float", default=0.20,
+      help="How much worse than the baseline a result may be (default 0.20)")
+(options, args) = parser.parse_args()
+Xv6Bench.results_path = os.path.abspath(options.results)
+Xv6Bench.baseline_path = os.path.abspath(options.baseline)
+Xv6Bench.tolerance = options.tolerance
+
+main(Xv6Build, all_tests=[cpus1, cpus2, cpus4])
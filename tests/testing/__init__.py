@@ -2,3 +2,4 @@
 from .test import Test
 from .build import BuildTest
 from .xv6 import Xv6Test, Xv6Build
+from .perf import Xv6Bench
@@ -0,0 +1,89 @@
+import json, os, re
+from testing import Test, BuildTest, pexpect
+
+# A benchmark result line: "<metric>: <n> cycles/<unit>"
+result_line = re.compile(r"^(.+): (\d+) cycles/\w+$")
+
+def parse(output):
+   results = dict()
+   for line in output.replace("\r", "").split("\n"):
+      m = result_line.match(line.strip())
+      if m is not None:
+         results[m.group(1)] = int(m.group(2))
+   return results
+
+def load(path):
+   if path is None or not os.path.exists(path):
+      return dict()
+   with open(path) as f:
+      return json.load(f)
+
+class Xv6Bench(BuildTest, Test):
+   """Boot xv6 with make_qemu_args, run each of commands at the
+   shell and collect the cycle counts they print.  The results go
+   into results_path under the test's name, and any that are more
+   than tolerance worse (higher) than in baseline_path fail the
+   test."""
+   name = "bench"
+   description = "run benchmarks"
+   timeout = 600
+   make_qemu_args = ""
+   commands = []
+   point_value = 0
+
+   results_path = "perf-results.json"
+   baseline_path = None
+   tolerance = 0.20
+
+   def run(self):
+      if not self.make(["xv6.img", "fs.img"]):
+         return
+
+      target = "qemu-nox " + self.make_qemu_args
+      self.log("make " + target)
+      child = pexpect.spawn("make " + target,
+            cwd=self.project_path,
+            logfile=self.logfd,
+            timeout=self.timeout)
+      self.children.append(child)
+      child.expect_exact("init: starting sh")
+      child.expect_exact("$ ")
+
+      results = dict()
+      for cmd in self.commands:
+         prog = cmd.split()[0]
+         child.sendline(cmd)
+         child.expect_exact(cmd)
+         index = child.expect([prog + ": done", prog + ": .* failed",
+            r"cpu\d: panic: .*\n"])
+         if index == 1:
+            self.fail(cmd + " failed")
+         elif index == 2:
+            self.fail("xv6 kernel panic")
+         if index != 0:
+            break
+         for metric, cycles in parse(child.before).items():
+            results[cmd + ": " + metric] = cycles
+         child.expect_exact("$ ")
+      child.close()
+
+      self.save(results)
+      self.compare(results)
+      self.done()
+
+   def save(self, results):
+      saved = load(self.results_path)
+      saved[self.name] = results
+      with open(self.results_path, "w") as f:
+         json.dump(saved, f, indent=2, sort_keys=True)
+      self.log("results saved to " + self.results_path)
+
+   def compare(self, results):
+      baseline = load(self.baseline_path).get(self.name, dict())
+      for metric in sorted(results):
+         if metric not in baseline or baseline[metric] == 0:
+            continue
+         old, new = baseline[metric], results[metric]
+         if new > old * (1 + self.tolerance):
+            self.fail("regression in %s: %d -> %d cycles (+%d%%)" %
+                  (metric, old, new, (new - old) * 100 // old))
@@ -1,6 +1,6 @@
 // Buffer cache.
 //
-// The buffer cache is a linked list of buf structures holding
+// The buffer cache is a hash table of buf structures holding
 // cached copies of disk block contents.  Caching disk blocks
 // in memory reduces the number of disk reads and also provides
 // a synchronization point for disk blocks used by multiple processes.
@@ -21,38 +21,253 @@
 #include "types.h"
 #include "defs.h"
 #include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "kstats.h"
 
+#define NBUCKET 1021
+
+// Buffers live BPERPAGE to a kalloc'd page, with their data.
+#define BPERPAGE ((PGSIZE - sizeof(void*)) / (sizeof(struct buf) + BSIZE))
+
+struct bufpage {
+  struct bufpage *next;
+  struct buf buf[BPERPAGE];
+  uchar data[BPERPAGE][BSIZE];
+};
+
+// Buffers are found through a hash table on (dev, blockno) whose
+// buckets have locks of their own, so lookups of different blocks
+// don't contend.  A bucket's lock protects its chain and the dev,
+// blockno and refcnt of the buffers on it.
+//
+// The cache starts with NBUF buffers and grows a page of buffers
+// at a time while misses find it below its limit of BCACHEPCT
+// percent of physical memory; past that, misses recycle buffers,
+// sleeping until brelse frees one if all are busy.
+// When kalloc runs out of pages it calls bshrink, which gives
+// back a page of unused buffers.
+//
+// Recycling uses a clock: the hand sweeps the buffers, giving each
+// one used since its last visit a second chance.  evictlock lets
+// only one CPU at a time recycle, add or remove buffers, so a block
+// cannot end up cached twice.
 struct {
-  struct spinlock lock;
-  struct buf buf[NBUF];
+  struct spinlock evictlock;
+  struct bufpage *pages;
+  int npages;
+  int maxpages;
+  struct bufpage *hand;  // where the clock is: buffer handidx of hand
+  int handidx;
+  int waiting;  // misses looking for or sleeping for a free buffer
+  uint nwait;   // times a miss found every buffer busy and slept
 
-  // Linked list of all buffers, through prev/next.
-  // head.next is most recently used.
-  struct buf head;
+  struct spinlock lock[NBUCKET];
+  struct buf *bucket[NBUCKET];
 } bcache;
 
+// Buffers for I/O straight between the disk and pages (bpageio),
+// NPAGEIO pages at a time.  Their data points into the page, so
+// nothing is copied and nothing enters the cache.
+struct {
+  struct spinlock lock;
+  int busy[NPAGEIO];
+  struct buf buf[NPAGEIO][BPP];
+} pageio;
+
+static void bunref(struct buf*);
+
+static uint
+bhash(uint dev, uint blockno)
+{
+  return (dev * 31 + blockno) % NBUCKET;
+}
+
+// Add a page of buffers to the cache.  All start out as block 0
+// of device 0, which no one reads, so they go in that block's
+// bucket.  Returns -1 if out of memory.
+// Caller holds bcache.evictlock.
+static int
+bgrow(void)
+{
+  struct bufpage *pg;
+  struct buf *b;
+  uint h = bhash(0, 0);
+
+  if((pg = (struct bufpage*)kalloc()) == 0)
+    return -1;
+  memset(pg, 0, sizeof(*pg));
+  for(b = pg->buf; b < pg->buf+BPERPAGE; b++){
+    initsleeplock(&b->lock, "buffer");
+    b->data = pg->data[b - pg->buf];
+  }
+  acquire(&bcache.lock[h]);
+  for(b = pg->buf; b < pg->buf+BPERPAGE; b++){
+    b->next = bcache.bucket[h];
+    bcache.bucket[h] = b;
+  }
+  release(&bcache.lock[h]);
+  pg->next = bcache.pages;
+  bcache.pages = pg;
+  bcache.npages++;
+  return 0;
+}
+
 void
 binit(void)
 {
-  struct buf *b;
+  int i;
 
-  initlock(&bcache.lock, "bcache");
+  initlock(&bcache.evictlock, "bcache");
+  initlock(&pageio.lock, "pageio");
+  for(i = 0; i < NPAGEIO*BPP; i++)
+    initsleeplock(&pageio.buf[i / BPP][i % BPP].lock, "pageio");
+  for(i = 0; i < NBUCKET; i++)
+    initlock(&bcache.lock[i], "bcache.bucket");
 
 //PAGEBREAK!
-  // Create linked list of buffers
-  bcache.head.prev = &bcache.head;
-  bcache.head.next = &bcache.head;
-  for(b = bcache.buf; b < bcache.buf+NBUF; b++){
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    initsleeplock(&b->lock, "buffer");
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+  bcache.maxpages = physend / PGSIZE / 100 * BCACHEPCT;
+  while(bcache.npages * BPERPAGE < NBUF)
+    if(bgrow() < 0)
+      panic("binit");
+  bcache.hand = bcache.pages;
+}
+
+// Find block blockno of dev in bucket h and take a reference.
+// Caller holds bcache.lock[h].
+static struct buf*
+blookup(uint h, uint dev, uint blockno)
+{
+  struct buf *b;
+
+  for(b = bcache.bucket[h]; b; b = b->next){
+    if(b->dev == dev && b->blockno == blockno){
+      b->refcnt++;
+      return b;
+    }
+  }
+  return 0;
+}
+
+// Unlink b from bucket h.  Caller holds bcache.lock[h].
+static void
+bunhash(uint h, struct buf *b)
+{
+  struct buf **pp;
+
+  for(pp = &bcache.bucket[h]; *pp != b; pp = &(*pp)->next)
+    ;
+  *pp = b->next;
+}
+
+// Whether b holds nothing anyone needs.  Even if refcnt==0,
+// B_DIRTY indicates a buffer is in use because log.c has
+// modified it but not yet committed it.
+// Caller holds the lock of b's bucket.
+static int
+bidle(struct buf *b)
+{
+  return b->refcnt == 0 && (b->flags & B_DIRTY) == 0;
+}
+
+// Take an unused buffer off its bucket for reuse, or return 0 if
+// every buffer is busy.  Caller holds bcache.evictlock.
+static struct buf*
+bvictim(void)
+{
+  struct buf *b;
+  uint h;
+  int i;
+
+  // Two sweeps: the first may only clear used bits.
+  for(i = 0; i < 2*bcache.npages*BPERPAGE; i++){
+    b = &bcache.hand->buf[bcache.handidx];
+    if(++bcache.handidx == BPERPAGE){
+      bcache.handidx = 0;
+      if((bcache.hand = bcache.hand->next) == 0)
+        bcache.hand = bcache.pages;
+    }
+    // dev and blockno only change under evictlock, so h is stable.
+    h = bhash(b->dev, b->blockno);
+    acquire(&bcache.lock[h]);
+    if(!bidle(b)){
+      release(&bcache.lock[h]);
+      continue;
+    }
+    if(b->used){
+      b->used = 0;
+      release(&bcache.lock[h]);
+      continue;
+    }
+    bunhash(h, b);
+    b->refcnt = 1;  // nobody else can have it now
+    release(&bcache.lock[h]);
+    return b;
+  }
+  return 0;
+}
+
+// Free a page of buffers none of which is in use, if the cache
+// is bigger than NBUF buffers.  Called by kalloc when memory runs
+// out.  Returns 0 if it freed a page, -1 if not.
+int
+bshrink(void)
+{
+  struct bufpage *pg, **pp;
+  struct buf *b;
+  uint h;
+  int i;
+
+  // A kalloc on behalf of bgrow must not wait for itself.
+  if(holding(&bcache.evictlock))
+    return -1;
+  acquire(&bcache.evictlock);
+  if((bcache.npages - 1) * BPERPAGE < NBUF){
+    release(&bcache.evictlock);
+    return -1;
   }
+  for(pp = &bcache.pages; (pg = *pp) != 0; pp = &pg->next){
+    // Claim the page's buffers one by one; if one is busy,
+    // put the claimed ones back and try the next page.
+    for(i = 0; i < BPERPAGE; i++){
+      b = &pg->buf[i];
+      h = bhash(b->dev, b->blockno);
+      acquire(&bcache.lock[h]);
+      if(!bidle(b)){
+        release(&bcache.lock[h]);
+        break;
+      }
+      bunhash(h, b);
+      release(&bcache.lock[h]);
+    }
+    if(i == BPERPAGE)
+      break;
+    while(--i >= 0){
+      b = &pg->buf[i];
+      h = bhash(b->dev, b->blockno);
+      acquire(&bcache.lock[h]);
+      b->next = bcache.bucket[h];
+      bcache.bucket[h] = b;
+      release(&bcache.lock[h]);
+    }
+  }
+  if(pg == 0){
+    release(&bcache.evictlock);
+    return -1;
+  }
+  *pp = pg->next;
+  bcache.npages--;
+  if(bcache.hand == pg){
+    bcache.hand = pg->next ? pg->next : bcache.pages;
+    bcache.handidx = 0;
+  }
+  release(&bcache.evictlock);
+  kfree((char*)pg);
+  return 0;
 }
 
 // Look through buffer cache for block on device dev.
@@ -62,34 +277,62 @@ static struct buf*
 bget(uint dev, uint blockno)
 {
   struct buf *b;
-
-  acquire(&bcache.lock);
+  uint h = bhash(dev, blockno);
 
   // Is the block already cached?
-  for(b = bcache.head.next; b != &bcache.head; b = b->next){
-    if(b->dev == dev && b->blockno == blockno){
-      b->refcnt++;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
-      return b;
-    }
+  acquire(&bcache.lock[h]);
+  b = blookup(h, dev, blockno);
+  release(&bcache.lock[h]);
+  if(b){
+    kstat(KS_BHIT);
+    acquiresleep(&b->lock);
+    return b;
   }
+  kstat(KS_BMISS);
 
-  // Not cached; recycle an unused buffer.
-  // Even if refcnt==0, B_DIRTY indicates a buffer is in use
-  // because log.c has modified it but not yet committed it.
-  for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
-    if(b->refcnt == 0 && (b->flags & B_DIRTY) == 0) {
-      b->dev = dev;
-      b->blockno = blockno;
-      b->flags = 0;
-      b->refcnt = 1;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
-      return b;
+  // Not cached; recycle an unused buffer.  Look again once
+  // evictlock is held, in case another CPU just read the block in.
+  acquire(&bcache.evictlock);
+  acquire(&bcache.lock[h]);
+  b = blookup(h, dev, blockno);
+  release(&bcache.lock[h]);
+  if(b == 0){
+    if(bcache.npages < bcache.maxpages)
+      bgrow();
+    // Every buffer busy: wait for a brelse, then look yet again.
+    // waiting goes up before the sweep so a brelse of a buffer the
+    // sweep found busy knows to wake us.
+    for(;;){
+      bcache.waiting++;
+      b = bvictim();
+      if(b == 0){
+        bcache.nwait++;
+        sleep(&bcache.waiting, &bcache.evictlock);
+      }
+      bcache.waiting--;
+      if(b)
+        break;
+      acquire(&bcache.lock[h]);
+      b = blookup(h, dev, blockno);
+      release(&bcache.lock[h]);
+      if(b){
+        release(&bcache.evictlock);
+        acquiresleep(&b->lock);
+        return b;
+      }
     }
+    acquire(&bcache.lock[h]);
+    b->dev = dev;
+    b->blockno = blockno;
+    b->flags = 0;
+    b->logseq = 0;
+    b->next = bcache.bucket[h];
+    bcache.bucket[h] = b;
+    release(&bcache.lock[h]);
   }
-  panic("bget: no buffers");
+  release(&bcache.evictlock);
+  acquiresleep(&b->lock);
+  return b;
 }
 
 // Return a locked buf with the contents of the indicated block.
@@ -105,6 +348,103 @@ bread(uint dev, uint blockno)
   return b;
 }
 
+// Start reading the indicated block into the cache, if it isn't
+// there, without waiting for it.  The buffer stays locked until
+// the disk interrupt hands it to bdoneasync.
+void
+breadahead(uint dev, uint blockno)
+{
+  struct buf *b;
+
+  b = bget(dev, blockno);
+  if(b->flags & B_VALID){
+    brelse(b);
+    return;
+  }
+  b->flags |= B_ASYNC;
+  iderwstart(b);
+}
+
+// If block blockno of dev is in the cache, copy it to dst and
+// return 1; otherwise return 0 without reading it in.
+int
+bpeek(uint dev, uint blockno, char *dst)
+{
+  struct buf *b;
+  uint h = bhash(dev, blockno);
+  int ok;
+
+  acquire(&bcache.lock[h]);
+  b = blookup(h, dev, blockno);
+  release(&bcache.lock[h]);
+  if(b == 0)
+    return 0;
+  acquiresleep(&b->lock);
+  if((ok = (b->flags & (B_VALID|B_DIRTY)) != 0))
+    memmove(dst, b->data, BSIZE);
+  brelse(b);
+  return ok;
+}
+
+// Read or write the page at page, whose BPP blocks on dev are
+// blockno[0..BPP-1], directly rather than through the cache;
+// entries that are 0 are skipped.  The caller sees to it that
+// the cache holds no newer copy of the blocks read, and none at
+// all of the blocks written.
+void
+bpageio(uint dev, uint *blockno, char *page, int write)
+{
+  struct buf *b;
+  int i, s;
+
+  acquire(&pageio.lock);
+  for(;;){
+    for(s = 0; s < NPAGEIO && pageio.busy[s]; s++)
+      ;
+    if(s < NPAGEIO)
+      break;
+    sleep(&pageio, &pageio.lock);
+  }
+  pageio.busy[s] = 1;
+  release(&pageio.lock);
+
+  // Start all the blocks before waiting for any, so the disk
+  // moves the page in as few commands as it can.
+  for(i = 0; i < BPP; i++){
+    if(blockno[i] == 0)
+      continue;
+    b = &pageio.buf[s][i];
+    acquiresleep(&b->lock);
+    b->dev = dev;
+    b->blockno = blockno[i];
+    b->data = (uchar*)page + i*BSIZE;
+    b->flags = write ? B_DIRTY : 0;
+    iderwstart(b);
+  }
+  for(i = 0; i < BPP; i++){
+    if(blockno[i] == 0)
+      continue;
+    b = &pageio.buf[s][i];
+    iderwwait(b);
+    releasesleep(&b->lock);
+  }
+
+  acquire(&pageio.lock);
+  pageio.busy[s] = 0;
+  wakeup(&pageio);
+  release(&pageio.lock);
+}
+
+// Release a buffer that breadahead's read has filled.
+// Called from the disk interrupt, so it can't check whose lock
+// it is releasing.
+void
+bdoneasync(struct buf *b)
+{
+  releasesleep(&b->lock);
+  bunref(b);
+}
+
 // Write b's contents to disk.  Must be locked.
 void
 bwrite(struct buf *b)
@@ -115,8 +455,28 @@ bwrite(struct buf *b)
   iderw(b);
 }
 
+// Start writing b's contents to disk without waiting, so that
+// writes of neighbouring blocks can go out as one.  Must be
+// locked, and stay locked until bwritewait.
+void
+bwritestart(struct buf *b)
+{
+  if(!holdingsleep(&b->lock))
+    panic("bwritestart");
+  b->flags |= B_DIRTY;
+  iderwstart(b);
+}
+
+// Wait for a write started by bwritestart.
+void
+bwritewait(struct buf *b)
+{
+  iderwwait(b);
+}
+
 // Release a locked buffer.
-// Move to the head of the MRU list.
+// Mark it used, so the clock passes it over once, and wake
+// any bget waiting for a buffer to recycle.
 void
 brelse(struct buf *b)
 {
@@ -124,20 +484,28 @@ brelse(struct buf *b)
     panic("brelse");
 
   releasesleep(&b->lock);
+  bunref(b);
+}
 
-  acquire(&bcache.lock);
+// Drop a reference to b, which its holder has unlocked.
+static void
+bunref(struct buf *b)
+{
+  uint h;
+  int wake;
+
+  h = bhash(b->dev, b->blockno);
+  acquire(&bcache.lock[h]);
   b->refcnt--;
-  if (b->refcnt == 0) {
-    // no one is waiting for it.
-    b->next->prev = b->prev;
-    b->prev->next = b->next;
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
-  }
-  
-  release(&bcache.lock);
+  b->used = 1;
+  wake = b->refcnt == 0 && bcache.waiting > 0;
+  release(&bcache.lock[h]);
+
+  if(wake){
+    acquire(&bcache.evictlock);
+    wakeup(&bcache.waiting);
+    release(&bcache.evictlock);
+  }
 }
 //PAGEBREAK!
 // Blank page.
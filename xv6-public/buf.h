@@ -4,11 +4,16 @@ struct buf {
   uint blockno;
   struct sleeplock lock;
   uint refcnt;
-  struct buf *prev; // LRU cache list
-  struct buf *next;
+  uint used;        // referenced since the clock hand last passed
+  struct buf *next; // hash bucket chain
   struct buf *qnext; // disk queue
-  uchar data[BSIZE];
+  uint qage;         // times passed over in the disk queue
+  uint logseq;       // log group that last logged it
+  uchar *data;       // BSIZE bytes: the cache's own, or part of a page
 };
 #define B_VALID 0x2  // buffer has been read from disk
 #define B_DIRTY 0x4  // buffer needs to be written to disk
+#define B_ASYNC 0x8  // read ahead: released by the disk interrupt
+#define B_LOGGED 0x10   // a copy is in the log, not yet past its tail
+#define B_ORDERED 0x20  // file data the open log group writes home
 
@@ -1,20 +1,39 @@
+// cat.  A regular file is mapped and written out in one go; pipes
+// and devices are read in large chunks.
+
 #include "types.h"
 #include "stat.h"
 #include "user.h"
+#include "mmap.h"
+
+char buf[64*1024];
 
-char buf[512];
+void
+put(char *p, int n)
+{
+  if(write(1, p, n) != n){
+    printf(1, "cat: write error\n");
+    exit();
+  }
+}
 
 void
 cat(int fd)
 {
+  struct stat st;
+  char *p;
   int n;
 
-  while((n = read(fd, buf, sizeof(buf))) > 0) {
-    if (write(1, buf, n) != n) {
-      printf(1, "cat: write error\n");
-      exit();
-    }
+  if(fstat(fd, &st) == 0 && st.type == T_FILE && st.size > 0 &&
+     (p = mmap(0, st.size, PROT_READ, MAP_PRIVATE, fd, 0)) != (char*)-1){
+    madvise(p, st.size, MADV_SEQUENTIAL);
+    put(p, st.size);
+    munmap(p, st.size);
+    return;
   }
+
+  while((n = read(fd, buf, sizeof(buf))) > 0)
+    put(buf, n);
   if(n < 0){
     printf(1, "cat: read error\n");
     exit();
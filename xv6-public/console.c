@@ -111,6 +111,7 @@ panic(char *s)
 
   cli();
   cons.locking = 0;
+  uartpanic();
   // use lapiccpunum so that we can call panic from mycpu()
   cprintf("lapicid %d: panic: ", lapicid());
   cprintf(s);
@@ -128,16 +129,35 @@ panic(char *s)
 #define CRTPORT 0x3d4
 static ushort *crt = (ushort*)P2V(0xb8000);  // CGA memory
 
-static void
-cgaputc(int c)
+// Cursor position: col + 80*row.
+static int
+cgagetpos(void)
 {
   int pos;
 
-  // Cursor position: col + 80*row.
   outb(CRTPORT, 14);
   pos = inb(CRTPORT+1) << 8;
   outb(CRTPORT, 15);
   pos |= inb(CRTPORT+1);
+  return pos;
+}
+
+static void
+cgasetpos(int pos)
+{
+  outb(CRTPORT, 14);
+  outb(CRTPORT+1, pos>>8);
+  outb(CRTPORT, 15);
+  outb(CRTPORT+1, pos);
+  crt[pos] = ' ' | 0x0700;
+}
+
+static void
+cgaputc(int c)
+{
+  int pos;
+
+  pos = cgagetpos();
 
   if(c == '\n')
     pos += 80 - pos%80;
@@ -155,11 +175,49 @@ cgaputc(int c)
     memset(crt+pos, 0, sizeof(crt[0])*(24*80 - pos));
   }
 
-  outb(CRTPORT, 14);
-  outb(CRTPORT+1, pos>>8);
-  outb(CRTPORT, 15);
-  outb(CRTPORT+1, pos);
-  crt[pos] = ' ' | 0x0700;
+  cgasetpos(pos);
+}
+
+// Put n bytes on the screen as cgaputc would one by one, but
+// moving the cursor once, and scrolling once by however many
+// lines the bytes need, before drawing them.
+static void
+cgawrite(char *buf, int n)
+{
+  int i, pos, end, scroll;
+
+  if(n == 0)
+    return;
+
+  // Where would the bytes leave the cursor without scrolling?
+  pos = cgagetpos();
+  end = pos;
+  for(i = 0; i < n; i++)
+    end += buf[i] == '\n' ? 80 - end%80 : 1;
+  scroll = end/80 >= 24 ? end/80 - 23 : 0;
+
+  if(scroll >= 24)
+    memset(crt, 0, sizeof(crt[0])*24*80);
+  else if(scroll > 0){
+    memmove(crt, crt+80*scroll, sizeof(crt[0])*(24-scroll)*80);
+    memset(crt+(24-scroll)*80, 0, sizeof(crt[0])*scroll*80);
+  }
+
+  // Draw at pos as if unscrolled; what scrolls off isn't drawn.
+  // A newline leaves the cell the cursor was in blank, as
+  // cgaputc would have.
+  for(i = 0; i < n; i++){
+    if(buf[i] == '\n'){
+      if(i > 0 && pos >= 80*scroll)
+        crt[pos - 80*scroll] = ' ' | 0x0700;
+      pos += 80 - pos%80;
+    } else {
+      if(pos >= 80*scroll)
+        crt[pos - 80*scroll] = (buf[i]&0xff) | 0x0700;
+      pos++;
+    }
+  }
+  cgasetpos(end - 80*scroll);
 }
 
 void
@@ -232,14 +290,19 @@ consoleintr(int (*getc)(void))
   }
 }
 
+// Characters are gathered into run under cons.lock and copied to
+// dst with it released: a user page may have been swapped out,
+// and faulting it back in sleeps.
 int
 consoleread(struct inode *ip, char *dst, int n)
 {
+  char run[128];
   uint target;
-  int c;
+  int c, m;
 
   iunlock(ip);
   target = n;
+  m = 0;
   acquire(&cons.lock);
   while(n > 0){
     while(input.r == input.w){
@@ -259,12 +322,20 @@ consoleread(struct inode *ip, char *dst, int n)
       }
       break;
     }
-    *dst++ = c;
+    run[m++] = c;
     --n;
     if(c == '\n')
       break;
+    if(m == sizeof(run)){
+      release(&cons.lock);
+      memmove(dst, run, m);
+      dst += m;
+      m = 0;
+      acquire(&cons.lock);
+    }
   }
   release(&cons.lock);
+  memmove(dst, run, m);
   ilock(ip);
 
   return target - n;
@@ -273,13 +344,27 @@ consoleread(struct inode *ip, char *dst, int n)
 int
 consolewrite(struct inode *ip, char *buf, int n)
 {
-  int i;
+  char run[256];
+  int i, m;
 
   iunlock(ip);
-  acquire(&cons.lock);
-  for(i = 0; i < n; i++)
-    consputc(buf[i] & 0xff);
-  release(&cons.lock);
+  for(i = 0; i < n; i += m){
+    // a run at a time, copied first so that another thread
+    // changing buf can't make cgawrite's two passes disagree,
+    // and before taking cons.lock, since buf may have to be
+    // faulted back in from swap
+    m = n - i < sizeof(run) ? n - i : sizeof(run);
+    memmove(run, buf + i, m);
+    acquire(&cons.lock);
+    if(panicked){
+      cli();
+      for(;;)
+        ;
+    }
+    uartwrite(run, m);
+    cgawrite(run, m);
+    release(&cons.lock);
+  }
   ilock(ip);
 
   return n;
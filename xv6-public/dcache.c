@@ -0,0 +1,163 @@
+//
+// Directory name cache.
+//
+// Maps (device, directory inode, name) to the inode number the
+// name stands for and the offset of its entry in the directory,
+// so namex() can walk a path without reading and scanning each
+// directory on the way.  dirlookup() fills it; dirlink() and
+// unlink() keep it in step with the directories.
+//
+// Entries change only with the directory's sleep-lock held, so
+// that an entry is never older than what the directory says.
+// dcache.lock only protects the table.  A full table reuses the
+// entry the clock hand finds not looked up since it last passed.
+//
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+
+#define NDCHASH 61
+
+struct dentry {
+  uint dev;
+  uint dinum;        // directory
+  char name[DIRSIZ];
+  uint inum;         // 0 if the entry is free
+  uint off;          // of the directory entry
+  uint used;         // looked up since the clock hand last passed
+  struct dentry *next;  // hash chain
+};
+
+struct {
+  struct spinlock lock;
+  struct dentry entry[NDCACHE];
+  struct dentry *hash[NDCHASH];
+  int hand;
+} dcache;
+
+static uint
+dchash(uint dev, uint dinum, char *name)
+{
+  uint h;
+  int i;
+
+  h = dev * 31 + dinum * 17;
+  for(i = 0; i < DIRSIZ && name[i]; i++)
+    h = h * 33 + name[i];
+  return h % NDCHASH;
+}
+
+void
+dcacheinit(void)
+{
+  initlock(&dcache.lock, "dcache");
+}
+
+// Look up dp's entry for name.  Caller holds dcache.lock.
+static struct dentry*
+dclookup(struct inode *dp, char *name)
+{
+  struct dentry *d;
+
+  for(d = dcache.hash[dchash(dp->dev, dp->inum, name)]; d; d = d->next)
+    if(d->dev == dp->dev && d->dinum == dp->inum && namecmp(d->name, name) == 0)
+      return d;
+  return 0;
+}
+
+static void
+dcunhash(struct dentry *d)
+{
+  struct dentry **pp;
+
+  for(pp = &dcache.hash[dchash(d->dev, d->dinum, d->name)]; *pp; pp = &(*pp)->next)
+    if(*pp == d){
+      *pp = d->next;
+      break;
+    }
+  d->inum = 0;
+}
+
+// If name in directory dp is cached, set *inum and *off from it
+// and return 0, else return -1.
+// Caller must hold dp->lock.
+int
+dcache_lookup(struct inode *dp, char *name, uint *inum, uint *off)
+{
+  struct dentry *d;
+  int r = -1;
+
+  acquire(&dcache.lock);
+  if((d = dclookup(dp, name)) != 0){
+    d->used = 1;
+    *inum = d->inum;
+    *off = d->off;
+    r = 0;
+  }
+  release(&dcache.lock);
+  return r;
+}
+
+// Remember that name in directory dp is inode inum, in the
+// entry at off.
+// Caller must hold dp->lock.
+void
+dcache_enter(struct inode *dp, char *name, uint inum, uint off)
+{
+  struct dentry *d;
+
+  acquire(&dcache.lock);
+  if((d = dclookup(dp, name)) == 0){
+    for(;;){
+      d = &dcache.entry[dcache.hand];
+      dcache.hand = (dcache.hand + 1) % NDCACHE;
+      if(d->inum == 0)
+        break;
+      if(!d->used){
+        dcunhash(d);
+        break;
+      }
+      d->used = 0;
+    }
+    d->dev = dp->dev;
+    d->dinum = dp->inum;
+    strncpy(d->name, name, DIRSIZ);
+    d->next = dcache.hash[dchash(d->dev, d->dinum, d->name)];
+    dcache.hash[dchash(d->dev, d->dinum, d->name)] = d;
+  }
+  d->inum = inum;
+  d->off = off;
+  d->used = 1;
+  release(&dcache.lock);
+}
+
+// Forget name in directory dp.
+// Caller must hold dp->lock.
+void
+dcache_remove(struct inode *dp, char *name)
+{
+  struct dentry *d;
+
+  acquire(&dcache.lock);
+  if((d = dclookup(dp, name)) != 0)
+    dcunhash(d);
+  release(&dcache.lock);
+}
+
+// Forget all of directory dp's entries, as it is being freed.
+void
+dcache_purge(struct inode *dp)
+{
+  struct dentry *d;
+
+  acquire(&dcache.lock);
+  for(d = dcache.entry; d < &dcache.entry[NDCACHE]; d++)
+    if(d->inum != 0 && d->dev == dp->dev && d->dinum == dp->inum)
+      dcunhash(d);
+  release(&dcache.lock);
+}
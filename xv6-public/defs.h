@@ -2,19 +2,37 @@ struct buf;
 struct context;
 struct file;
 struct inode;
+struct iovec;
+struct kstats;
+struct lockstat;
+struct mem_mapping;
+struct memstat;
+struct mm;
 struct pipe;
 struct proc;
+struct profsample;
 struct rtcdate;
 struct spinlock;
 struct sleeplock;
+struct slabcache;
 struct stat;
 struct superblock;
+struct trapframe;
+struct tlbbatch;
+struct tracerec;
 
 // bio.c
 void            binit(void);
 struct buf*     bread(uint, uint);
 void            brelse(struct buf*);
+int             bshrink(void);
 void            bwrite(struct buf*);
+void            bwritestart(struct buf*);
+void            bwritewait(struct buf*);
+void            breadahead(uint, uint);
+void            bdoneasync(struct buf*);
+int             bpeek(uint, uint, char*);
+void            bpageio(uint, uint*, char*, int);
 
 // console.c
 void            consoleinit(void);
@@ -22,8 +40,16 @@ void            cprintf(char*, ...);
 void            consoleintr(int(*)(void));
 void            panic(char*) __attribute__((noreturn));
 
+// dcache.c
+void            dcacheinit(void);
+int             dcache_lookup(struct inode*, char*, uint*, uint*);
+void            dcache_enter(struct inode*, char*, uint, uint);
+void            dcache_remove(struct inode*, char*);
+void            dcache_purge(struct inode*);
+
 // exec.c
 int             exec(char*, char**);
+int             execproc(struct proc*, char*, char**);
 
 // file.c
 struct file*    filealloc(void);
@@ -31,8 +57,17 @@ void            fileclose(struct file*);
 struct file*    filedup(struct file*);
 void            fileinit(void);
 int             fileread(struct file*, char*, int n);
+int             filereadv(struct file*, struct iovec*, int, int);
 int             filestat(struct file*, struct stat*);
 int             filewrite(struct file*, char*, int n);
+int             filewritev(struct file*, struct iovec*, int, int);
+int             fdgrow(struct proc*);
+void            fdfree(struct proc*);
+int             filesplice(struct file*, struct file*, int n);
+int             filecopy(struct file*, struct file*, int, int);
+
+// futex.c
+void            futexinit(void);
 
 // fs.c
 void            readsb(int dev, struct superblock *sb);
@@ -40,8 +75,10 @@ int             dirlink(struct inode*, char*, uint);
 struct inode*   dirlookup(struct inode*, char*, uint*);
 struct inode*   ialloc(uint, short);
 struct inode*   idup(struct inode*);
+struct inode*   iget(uint, uint);
 void            iinit(int dev);
 void            ilock(struct inode*);
+void            ilockshared(struct inode*);
 void            iput(struct inode*);
 void            iunlock(struct inode*);
 void            iunlockput(struct inode*);
@@ -50,75 +87,146 @@ int             namecmp(const char*, const char*);
 struct inode*   namei(char*);
 struct inode*   nameiparent(char*, char*);
 int             readi(struct inode*, char*, uint, uint);
+int             readpage(struct inode*, char*, uint);
 void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, char*, uint, uint);
+int             writeiblocks(uint);
+uint            writeimax(int);
 
 // ide.c
 void            ideinit(void);
 void            ideintr(void);
 void            iderw(struct buf*);
+void            iderwstart(struct buf*);
+void            iderwwait(struct buf*);
 
 // ioapic.c
 void            ioapicenable(int irq, int cpu);
 extern uchar    ioapicid;
 void            ioapicinit(void);
+void            ioapicroute(int irq, int as, int cpu);
 
 // kalloc.c
 char*           kalloc(void);
 void            kfree(char*);
+char*           khugealloc(void);
+void            khugefree(char*);
+void            kref(char*);
+char*           kzalloc(void);
+char*           kzeropage(void);
+int             iszeropage(char*);
+int             kidlezero(void);
+int             kfreepages(void);
+int             krefcount(char*);
 void            kinit1(void*, void*);
 void            kinit2(void*, void*);
 
 // kbd.c
 void            kbdintr(void);
 
+// kstats.c
+void            kstat(int);
+void            kstats(struct kstats*);
+void            kstatsyscall(int);
+void            kstatfault(int, uint64);
+
 // lapic.c
 void            cmostime(struct rtcdate *r);
+uint            cmosmem(void);
 int             lapicid(void);
 extern volatile uint*    lapic;
 void            lapiceoi(void);
 void            lapicinit(void);
+void            lapicipi(uchar, int);
 void            lapicstartap(uchar, uint);
+void            lapictimer(uint);
 void            microdelay(int);
+uint            nowus(void);
+void            tlbshootdown(pde_t*, struct tlbbatch*);
+void            tlbshootintr(void);
 
 // log.c
 void            initlog(int dev);
 void            log_write(struct buf*);
+void            log_data(struct buf*);
 void            begin_op();
+void            begin_opn(int);
 void            end_op();
+void            end_opn(int);
+int             log_maxop(void);
+void            log_force(void);
+void            logtick(void);
 
 // mp.c
 extern int      ismp;
 void            mpinit(void);
 
+// pcache.c
+void            pcacheinit(void);
+char*           pcache_get(struct inode*, uint);
+int             pcache_holds(struct inode*, uint, char*);
+void            pcache_prefetch(struct inode*, uint, uint);
+void            pcache_write(struct inode*, char*, uint, uint);
+void            pcache_drop(struct inode*);
+int             pcache_shrink(void);
+
 // picirq.c
 void            picenable(int);
 void            picinit(void);
 
 // pipe.c
+void            pipeinit(void);
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
-int             piperead(struct pipe*, char*, int);
-int             pipewrite(struct pipe*, char*, int);
+int             piperead(struct pipe*, struct iovec*, int);
+int             pipewrite(struct pipe*, struct iovec*, int);
+int             pipewbegin(struct pipe*, char**, int);
+void            pipewend(struct pipe*, int);
+int             piperbegin(struct pipe*, char**, int);
+void            piperend(struct pipe*, int);
 
 //PAGEBREAK: 16
+// prof.c
+void            profinit(void);
+int             profile(int);
+extern int      profiling;
+int             profread(struct profsample*, int);
+void            profsample(struct trapframe*);
+
 // proc.c
 int             cpuid(void);
 void            exit(void);
 int             fork(void);
 int             growproc(int);
+int             clone(void(*)(void*), void*, void*);
+int             join(void**);
+int             spawn(char*, char**, struct file**);
+int             mmunshare(struct proc*, pde_t*);
+void            mmput(struct mm*);
+struct mm*      mmgrab(int);
+void            mmdrop(struct mm*);
+int             memstat(struct memstat*, int);
+int             chaninpage(char*);
+void            unmap_all(struct proc*);
+int             fault_in(uint, uint, int);
+uint            uend(uint);
+int             uaccess(uint, uint, int);
 int             kill(int);
+struct proc*    kthread(char*, void(*)(void));
 struct cpu*     mycpu(void);
 struct proc*    myproc();
 void            pinit(void);
 void            procdump(void);
 void            scheduler(void) __attribute__((noreturn));
 void            sched(void);
+void            schedtick(void);
 void            setproc(struct proc*);
+int             setpriority(int, int);
 void            sleep(void*, struct spinlock*);
 void            userinit(void);
 int             wait(void);
 void            wakeup(void*);
+int             wakeupn(void*, int);
 void            yield(void);
 
 // swtch.S
@@ -129,12 +237,20 @@ void            acquire(struct spinlock*);
 void            getcallerpcs(void*, uint*);
 int             holding(struct spinlock*);
 void            initlock(struct spinlock*, char*);
+int             lockstat(struct lockstat*, int);
 void            release(struct spinlock*);
 void            pushcli(void);
 void            popcli(void);
 
+// slab.c
+struct slabcache* slabcreate(char*, uint);
+void*           slaballoc(struct slabcache*);
+void            slabfree(struct slabcache*, void*);
+
 // sleeplock.c
 void            acquiresleep(struct sleeplock*);
+void            acquiresleepshared(struct sleeplock*);
+int             tryacquiresleep(struct sleeplock*);
 void            releasesleep(struct sleeplock*);
 int             holdingsleep(struct sleeplock*);
 void            initsleeplock(struct sleeplock*, char*);
@@ -148,16 +264,50 @@ int             strlen(const char*);
 int             strncmp(const char*, const char*, uint);
 char*           strncpy(char*, const char*, int);
 
+// swap.c
+void            swapinit(int);
+int             swapin(pte_t*, uint);
+void            swapdup(pte_t);
+void            swapfree(pte_t);
+int             reclaim(int);
+char*           kallocreclaim(int);
+
 // syscall.c
 int             argint(int, int*);
 int             argptr(int, char**, int);
+int             argoutptr(int, char**, int);
 int             argstr(int, char**);
 int             fetchint(uint, int*);
-int             fetchstr(uint, char**);
+int             fetchstr(uint, char*, int);
 void            syscall(void);
+int             syscallargs(int, int*);
+
+// sysproc.c
+int             unmap_mapping(struct proc*, struct mem_mapping*);
 
 // timer.c
 void            timerinit(void);
+int             timerintr(void);
+void            timerset(int);
+int             timersleep(uint);
+
+// tmpfs.c
+void            tmpfsinit(void);
+struct inode*   tmpfs_cross(struct inode*, struct inode*, char*);
+char*           tmpfs_getpage(struct inode*, uint);
+uint            tmpfs_ialloc(short);
+void            tmpfs_iload(struct inode*);
+void            tmpfs_iupdate(struct inode*);
+int             tmpfs_read(struct inode*, char*, uint, uint);
+void            tmpfs_trunc(struct inode*);
+int             tmpfs_write(struct inode*, char*, uint, uint);
+
+// trace.c
+void            traceinit(void);
+int             trace(int);
+extern int      tracing;
+int             traceread(struct tracerec*, int);
+void            tracepoint(int, uint);
 
 // trap.c
 void            idtinit(void);
@@ -169,10 +319,13 @@ extern struct spinlock tickslock;
 void            uartinit(void);
 void            uartintr(void);
 void            uartputc(int);
+void            uartwrite(char*, int);
+void            uartpanic(void);
 
 // vm.c
 void            seginit(void);
 void            kvmalloc(void);
+extern uint     physend;
 pde_t*          setupkvm(void);
 char*           uva2ka(pde_t*, char*);
 int             allocuvm(pde_t*, uint, uint);
@@ -180,15 +333,44 @@ int             deallocuvm(pde_t*, uint, uint);
 void            freevm(pde_t*);
 void            inituvm(pde_t*, char*, uint);
 int             loaduvm(pde_t*, char*, struct inode*, uint, uint);
-pde_t*          copyuvm(pde_t*, uint);
+pde_t*          copyuvm(struct mm*);
 void            switchuvm(struct proc*);
 void            switchkvm(void);
+int             copyin(void*, uint, uint);
 int             copyout(pde_t*, uint, void*, uint);
 void            clearpteu(pde_t *pgdir, char *uva);
+void            tlbinval(struct tlbbatch*, uint);
+void            tlbflushdone(pde_t*, struct tlbbatch*);
+int             unmapuvm(pde_t*, uint, uint);
+int             unhuge(pde_t*, uint);
+int             protectuvm(pde_t*, uint, uint, uint, int);
 int             mappages(pde_t *pgdir, void *va, uint size, uint pa, int perm);
 pte_t *         walkpgdir(pde_t *pgdir, const void *va, int alloc);
-uint            balloc(uint dev);
-pde_t*          copyuvmprivate(pde_t *pgdir, uint sz);
+uint            balloc(uint dev, uint goal, int data);
+
+// vma.c
+void            vmainit(void);
+struct mem_mapping* vma_alloc(void);
+void            vma_free(struct mem_mapping*);
+uint            vma_end(struct mem_mapping*);
+uint            vma_pteflags(struct mem_mapping*);
+void            vma_insert(struct mem_mapping**, struct mem_mapping*);
+void            vma_remove(struct mem_mapping**, struct mem_mapping*);
+void            vma_resized(struct mem_mapping*, struct mem_mapping*);
+struct mem_mapping* vma_lookup(struct mem_mapping*, uint);
+struct mem_mapping* vma_floor(struct mem_mapping*, uint);
+struct mem_mapping* vma_above(struct mem_mapping*, uint);
+struct mem_mapping* vma_first(struct mem_mapping*);
+int             vma_overlaps(struct mem_mapping*, uint, uint);
+uint            vma_findgap(struct mem_mapping*, uint, uint, uint, uint);
+struct mem_mapping* vma_split(struct mem_mapping**, struct mem_mapping*, uint);
+int             vma_merge(struct mem_mapping**, struct mem_mapping**);
+int             vma_copy(struct mem_mapping**, struct mem_mapping*);
+void            vma_clear(struct mem_mapping**);
+
+// writeback.c
+void            writebackinit(void);
+int             mmap_writeback(struct proc*, struct mem_mapping*, struct inode*, uint, uint, int);
 
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
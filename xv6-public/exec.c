@@ -6,9 +6,23 @@
 #include "defs.h"
 #include "x86.h"
 #include "elf.h"
+#include "mmap.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "mm.h"
+#include "fs.h"
+#include "file.h"
 
+// Replace process p's user image with the program at path.
+// p is the current process, or a new one spawn is setting up.
+//
+// A segment laid out for paging, at the same offset into its page
+// in the file as in memory, is not read in: it becomes a private
+// file mapping (MAP_IMAGE) that the page fault handler fills as the
+// program touches it, with its read-only pages shared through the
+// page cache.  Other segments are read in whole.
 int
-exec(char *path, char **argv)
+execproc(struct proc *p, char *path, char **argv)
 {
   char *s, *last;
   int i, off;
@@ -17,7 +31,11 @@ exec(char *path, char **argv)
   struct inode *ip;
   struct proghdr ph;
   pde_t *pgdir, *oldpgdir;
-  struct proc *curproc = myproc();
+  struct proc *curproc = p;
+  struct mm *oldmm;
+  struct mem_mapping *image, *m;
+  struct file *f;
+  int shared, nimage;
 
   begin_op();
 
@@ -26,8 +44,11 @@ exec(char *path, char **argv)
     cprintf("exec: fail\n");
     return -1;
   }
-  ilock(ip);
+  ilockshared(ip);
   pgdir = 0;
+  image = 0;
+  nimage = 0;
+  f = 0;
 
   // Check ELF header
   if(readi(ip, (char*)&elf, 0, sizeof(elf)) != sizeof(elf))
@@ -38,6 +59,15 @@ exec(char *path, char **argv)
   if((pgdir = setupkvm()) == 0)
     goto bad;
 
+  // The mappings share one open file for the program.
+  if((f = filealloc()) == 0)
+    goto bad;
+  f->type = FD_INODE;
+  f->ip = idup(ip);
+  f->readable = 1;
+  f->writable = 0;
+  f->off = 0;
+
   // Load program into memory.
   sz = 0;
   for(i=0, off=elf.phoff; i<elf.phnum; i++, off+=sizeof(ph)){
@@ -47,18 +77,39 @@ exec(char *path, char **argv)
       continue;
     if(ph.memsz < ph.filesz)
       goto bad;
-    if(ph.vaddr + ph.memsz < ph.vaddr)
-      goto bad;
-    if((sz = allocuvm(pgdir, sz, ph.vaddr + ph.memsz)) == 0)
+    if(ph.vaddr + ph.memsz < ph.vaddr || ph.vaddr + ph.memsz > KERNBASE)
       goto bad;
     if(ph.vaddr % PGSIZE != 0)
       goto bad;
-    if(loaduvm(pgdir, (char*)ph.vaddr, ip, ph.off, ph.filesz) < 0)
+    if(ph.off % PGSIZE != 0){
+      if((sz = allocuvm(pgdir, sz, ph.vaddr + ph.memsz)) == 0)
+        goto bad;
+      if(loaduvm(pgdir, (char*)ph.vaddr, ip, ph.off, ph.filesz) < 0)
+        goto bad;
+      continue;
+    }
+    if(ph.memsz == 0)
+      continue;
+    if(vma_overlaps(image, ph.vaddr, PGROUNDUP(ph.vaddr + ph.memsz)) ||
+       (m = vma_alloc()) == 0)
       goto bad;
+    m->addr = ph.vaddr;
+    m->length = m->originalLength = ph.memsz;
+    m->flags = MAP_PRIVATE | MAP_IMAGE;
+    m->prot = PROT_READ | ((ph.flags & ELF_PROG_FLAG_WRITE) ? PROT_WRITE : 0);
+    m->file = filedup(f);
+    m->offset = ph.off;
+    m->filesz = ph.filesz;
+    vma_insert(&image, m);
+    nimage++;
+    if(ph.vaddr + ph.memsz > sz)
+      sz = ph.vaddr + ph.memsz;
   }
   iunlockput(ip);
   end_op();
   ip = 0;
+  fileclose(f);
+  f = 0;
 
   // Allocate two pages at the next page boundary.
   // Make the first inaccessible.  Use the second as the user stack.
@@ -93,14 +144,33 @@ exec(char *path, char **argv)
       last = s+1;
   safestrcpy(curproc->name, last, sizeof(curproc->name));
 
+  // A thread leaves the old image to the others; a process alone
+  // in it unmaps the old mappings, as munmap would.  The page
+  // table and size change under the address space's lock, for
+  // the page reclaimer (see mmgrab).
+  oldmm = curproc->mm;
+  oldpgdir = curproc->mm->pgdir;
+  if((shared = mmunshare(curproc, pgdir)) < 0)
+    goto bad;
+  acquiresleep(&curproc->mm->lock);
+  if(!shared)
+    unmap_all(curproc);
+  curproc->mm->memoryMappings = image;
+  curproc->mm->num_mappings = nimage;
+  curproc->mm->pgdir = pgdir;
+  curproc->mm->sz = sz;
+  releasesleep(&curproc->mm->lock);
+  curproc->ring = 0;
+
   // Commit to the user image.
-  oldpgdir = curproc->pgdir;
-  curproc->pgdir = pgdir;
-  curproc->sz = sz;
   curproc->tf->eip = elf.entry;  // main
   curproc->tf->esp = sp;
-  switchuvm(curproc);
-  freevm(oldpgdir);
+  if(curproc == myproc())
+    switchuvm(curproc);
+  if(shared)
+    mmput(oldmm);
+  else if(oldpgdir)
+    freevm(oldpgdir);
   return 0;
 
  bad:
@@ -110,5 +180,14 @@ exec(char *path, char **argv)
     iunlockput(ip);
     end_op();
   }
+  vma_clear(&image);
+  if(f)
+    fileclose(f);
   return -1;
 }
+
+int
+exec(char *path, char **argv)
+{
+  return execproc(myproc(), path, argv);
+}
@@ -5,21 +5,29 @@
 #include "types.h"
 #include "defs.h"
 #include "param.h"
+#include "mmu.h"
+#include "proc.h"
 #include "fs.h"
+#include "stat.h"
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "uio.h"
 
 struct devsw devsw[NDEV];
+
+// Open files come from an object cache, so there are as many as
+// memory allows; ftable.lock guards their reference counts.
 struct {
   struct spinlock lock;
-  struct file file[NFILE];
+  struct slabcache *cache;
 } ftable;
 
 void
 fileinit(void)
 {
   initlock(&ftable.lock, "ftable");
+  ftable.cache = slabcreate("file", sizeof(struct file));
 }
 
 // Allocate a file structure.
@@ -28,16 +36,11 @@ filealloc(void)
 {
   struct file *f;
 
-  acquire(&ftable.lock);
-  for(f = ftable.file; f < ftable.file + NFILE; f++){
-    if(f->ref == 0){
-      f->ref = 1;
-      release(&ftable.lock);
-      return f;
-    }
-  }
-  release(&ftable.lock);
-  return 0;
+  if((f = slaballoc(ftable.cache)) == 0)
+    return 0;
+  memset(f, 0, sizeof(*f));
+  f->ref = 1;
+  return f;
 }
 
 // Increment ref count for file f.
@@ -69,6 +72,7 @@ fileclose(struct file *f)
   f->ref = 0;
   f->type = FD_NONE;
   release(&ftable.lock);
+  slabfree(ftable.cache, f);
 
   if(ff.type == FD_PIPE)
     pipeclose(ff.pipe, ff.writable);
@@ -79,12 +83,39 @@ fileclose(struct file *f)
   }
 }
 
+// Grow p's descriptor table from the NOFILE entries in struct
+// proc to a page of NOFILEMAX.  Returns -1 if it has grown
+// already or there is no memory for it.
+int
+fdgrow(struct proc *p)
+{
+  struct file **t;
+
+  if(p->nofile == NOFILEMAX || (t = (struct file**)kalloc()) == 0)
+    return -1;
+  memset(t, 0, PGSIZE);
+  memmove(t, p->ofile, p->nofile * sizeof(t[0]));
+  p->ofile = t;
+  p->nofile = NOFILEMAX;
+  return 0;
+}
+
+// Give back p's grown descriptor table; its files are closed.
+void
+fdfree(struct proc *p)
+{
+  if(p->ofile != p->ofile0)
+    kfree((char*)p->ofile);
+  p->ofile = p->ofile0;
+  p->nofile = NOFILE;
+}
+
 // Get metadata about file f.
 int
 filestat(struct file *f, struct stat *st)
 {
   if(f->type == FD_INODE){
-    ilock(f->ip);
+    ilockshared(f->ip);
     stati(f->ip, st);
     iunlock(f->ip);
     return 0;
@@ -96,18 +127,46 @@ filestat(struct file *f, struct stat *st)
 int
 fileread(struct file *f, char *addr, int n)
 {
-  int r;
+  struct iovec iov;
+
+  iov.base = addr;
+  iov.len = n;
+  return filereadv(f, &iov, 1, -1);
+}
+
+// Read from file f into the niov buffers of iov in turn: at
+// offset off, or at f's offset, which moves past what was read,
+// if off is -1.  Pipes have no offsets.  The inode is locked
+// once for the whole call, shared unless f->off moves.
+int
+filereadv(struct file *f, struct iovec *iov, int niov, int off)
+{
+  int i, r, tot;
+  uint o;
 
   if(f->readable == 0)
     return -1;
   if(f->type == FD_PIPE)
-    return piperead(f->pipe, addr, n);
+    return off == -1 ? piperead(f->pipe, iov, niov) : -1;
   if(f->type == FD_INODE){
-    ilock(f->ip);
-    if((r = readi(f->ip, addr, f->off, n)) > 0)
-      f->off += r;
+    if(off == -1)
+      ilock(f->ip);
+    else
+      ilockshared(f->ip);
+    o = off == -1 ? f->off : off;
+    r = tot = 0;
+    for(i = 0; i < niov; i++){
+      if((r = readi(f->ip, iov[i].base, o, iov[i].len)) < 0)
+        break;
+      o += r;
+      tot += r;
+      if(r < iov[i].len)
+        break;
+    }
+    if(off == -1)
+      f->off = o;
     iunlock(f->ip);
-    return r;
+    return r < 0 && tot == 0 ? -1 : tot;
   }
   panic("fileread");
 }
@@ -117,41 +176,180 @@ fileread(struct file *f, char *addr, int n)
 int
 filewrite(struct file *f, char *addr, int n)
 {
-  int r;
+  struct iovec iov;
+
+  iov.base = addr;
+  iov.len = n;
+  return filewritev(f, &iov, 1, -1);
+}
+
+// Write the niov buffers of iov to file f in turn, at offset off
+// or, if off is -1, at f's offset, which moves past them.
+int
+filewritev(struct file *f, struct iovec *iov, int niov, int off)
+{
+  int i, m, n, r;
 
   if(f->writable == 0)
     return -1;
   if(f->type == FD_PIPE)
-    return pipewrite(f->pipe, addr, n);
+    return off == -1 ? pipewrite(f->pipe, iov, niov) : -1;
   if(f->type == FD_INODE){
-    // write a few blocks at a time to avoid exceeding
-    // the maximum log transaction size, including
-    // i-node, indirect block, allocation blocks,
-    // and 2 blocks of slop for non-aligned writes.
+    // write as much at a time as one operation may log,
+    // reserving log space for what each piece needs
+    // (see writeiblocks), so a large write is only a few
+    // operations and small ones don't hold up the others.
+    // the buffers are gathered into the pieces, so the
+    // inode is locked once per piece, not per buffer.
     // this really belongs lower down, since writei()
     // might be writing a device like the console.
-    int max = ((MAXOPBLOCKS-1-1-2) / 2) * 512;
-    int i = 0;
+    int max = writeimax(log_maxop());
+    int v = 0, j = 0;  // next byte is iov[v].base + j
+    uint o = off;
+
+    for(n = i = 0; i < niov; i++)
+      n += iov[i].len;
+    i = 0;
+    r = 0;
     while(i < n){
       int n1 = n - i;
       if(n1 > max)
         n1 = max;
 
-      begin_op();
+      int nb = writeiblocks(n1);
+      begin_opn(nb);
       ilock(f->ip);
-      if ((r = writei(f->ip, addr + i, f->off, n1)) > 0)
-        f->off += r;
+      if(off == -1)
+        o = f->off;
+      for(m = 0; m < n1; m += r){
+        int len = iov[v].len - j;
+        if(len > n1 - m)
+          len = n1 - m;
+        if((r = writei(f->ip, (char*)iov[v].base + j, o, len)) < 0)
+          break;
+        if(r != len)
+          panic("short filewrite");
+        o += r;
+        if((j += r) == iov[v].len){
+          v++;
+          j = 0;
+        }
+      }
+      if(off == -1)
+        f->off = o;
       iunlock(f->ip);
-      end_op();
+      end_opn(nb);
 
       if(r < 0)
         break;
-      if(r != n1)
-        panic("short filewrite");
-      i += r;
+      i += n1;
     }
     return i == n ? n : -1;
   }
   panic("filewrite");
 }
 
+// Move up to n bytes from in to out, one of them a pipe and the
+// other a file, straight between the file and the pipe's buffer.
+int
+filesplice(struct file *in, struct file *out, int n)
+{
+  char *run;
+  int m, r, tot, nb;
+
+  if(in->readable == 0 || out->writable == 0)
+    return -1;
+  if(in->type == FD_INODE && out->type == FD_PIPE)
+    return filecopy(out, in, -1, n);
+  if(in->type == FD_PIPE && out->type == FD_INODE){
+    int max = writeimax(log_maxop());
+    for(tot = 0; tot < n; tot += r){
+      if((m = piperbegin(in->pipe, &run, n - tot < max ? n - tot : max)) <= 0)
+        return tot > 0 || m == 0 ? tot : -1;
+      nb = writeiblocks(m);
+      begin_opn(nb);
+      ilock(out->ip);
+      if((r = writei(out->ip, run, out->off, m)) > 0)
+        out->off += r;
+      iunlock(out->ip);
+      end_opn(nb);
+      piperend(in->pipe, r > 0 ? r : 0);
+      if(r < 0)
+        return tot > 0 ? tot : -1;
+      if(r != m)
+        return tot + r;
+    }
+    return tot;
+  }
+  return -1;
+}
+
+// Copy up to n bytes of file in, from offset off or, if off is -1,
+// from in's offset, which moves past them, to out at its offset.
+// Nothing passes through user memory: into a pipe the data is
+// read straight into the pipe's buffer, and into a file it is
+// written from in's page cache pages.  in's inode is unlocked
+// before out's is locked, so in and out may be the same file.
+int
+filecopy(struct file *out, struct file *in, int off, int n)
+{
+  char *run, *page;
+  uint o;
+  int m, r, tot, nb;
+
+  if(in->readable == 0 || out->writable == 0 || in->type != FD_INODE)
+    return -1;
+  if(out->type == FD_PIPE){
+    for(tot = 0; tot < n; tot += r){
+      if((m = pipewbegin(out->pipe, &run, n - tot)) < 0)
+        return tot > 0 ? tot : -1;
+      ilock(in->ip);
+      o = off == -1 ? in->off : off + tot;
+      if((r = readi(in->ip, run, o, m)) > 0 && off == -1)
+        in->off += r;
+      iunlock(in->ip);
+      pipewend(out->pipe, r > 0 ? r : 0);
+      if(r <= 0)
+        return tot > 0 || r == 0 ? tot : -1;
+    }
+    return tot;
+  }
+  if(out->type != FD_INODE || in->ip->type != T_FILE)
+    return -1;
+
+  for(tot = 0; tot < n; tot += r){
+    // a page of in at a time, as far as the file goes
+    if(off == -1)
+      ilock(in->ip);
+    else
+      ilockshared(in->ip);
+    o = off == -1 ? in->off : off + tot;
+    m = 0;
+    if(o < in->ip->size){
+      m = PGSIZE - o%PGSIZE;
+      if(m > n - tot)
+        m = n - tot;
+      if(m > in->ip->size - o)
+        m = in->ip->size - o;
+      if((page = pcache_get(in->ip, PGROUNDDOWN(o))) == 0)
+        m = -1;
+      else if(off == -1)
+        in->off += m;
+    }
+    iunlock(in->ip);
+    if(m <= 0)
+      return tot > 0 || m == 0 ? tot : -1;
+
+    nb = writeiblocks(m);
+    begin_opn(nb);
+    ilock(out->ip);
+    if((r = writei(out->ip, page + o%PGSIZE, out->off, m)) > 0)
+      out->off += r;
+    iunlock(out->ip);
+    end_opn(nb);
+    kfree(page);
+    if(r < 0)
+      return tot > 0 ? tot : -1;
+  }
+  return tot;
+}
@@ -14,15 +14,20 @@ struct inode {
   uint dev;           // Device number
   uint inum;          // Inode number
   int ref;            // Reference count
+  struct inode *next; // hash chain
+  struct inode *lprev, *lnext; // unreferenced list, while ref is 0
   struct sleeplock lock; // protects everything below here
   int valid;          // inode has been read from disk?
+  uint ra_last;       // last block readi read, for readahead
+  uint ra_ahead;      // last block read ahead so far
+  uint goal;          // disk block to allocate next, 0 if none yet
 
   short type;         // copy of disk inode
   short major;
   short minor;
   short nlink;
   uint size;
-  uint addrs[NDIRECT+1];
+  uint addrs[NDIRECT+2];
 };
 
 // table mapping major device number to
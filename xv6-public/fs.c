@@ -38,43 +38,107 @@ readsb(int dev, struct superblock *sb)
   brelse(bp);
 }
 
-// Zero a block.
+// Zero a block, a file data block if data is set.
 static void
-bzero(int dev, int bno)
+bzero(int dev, int bno, int data)
 {
   struct buf *bp;
 
   bp = bread(dev, bno);
   memset(bp->data, 0, BSIZE);
-  log_write(bp);
+  if(data)
+    log_data(bp);
+  else
+    log_write(bp);
   brelse(bp);
 }
 
 // Blocks.
 
-// Allocate a zeroed disk block.
-uint
-balloc(uint dev)
+// Allocation tries to keep each file's blocks in a row on disk,
+// where readahead and the disk driver can take many at a time.
+// A file asks for the block after the last one it got.  If that
+// is taken, or a file is new, it gets the first block of a whole
+// free bitmap byte, a run of 8 free blocks the next appends can
+// fill; only if there's none does it take any free block.  Runs
+// for new files are looked for from where the last one was found.
+
+static uint bnext;  // where to look for the next new file's run; only a hint
+
+// Mark block b in use if it's free; return 0 if it was, else -1.
+static int
+btake(uint dev, uint b)
 {
-  int b, bi, m;
   struct buf *bp;
+  int bi, m, r;
 
-  bp = 0;
-  for(b = 0; b < sb.size; b += BPB){
+  bp = bread(dev, BBLOCK(b, sb));
+  bi = b % BPB;
+  m = 1 << (bi % 8);
+  r = -1;
+  if((bp->data[bi/8] & m) == 0){  // Is block free?
+    bp->data[bi/8] |= m;  // Mark block in use.
+    log_write(bp);
+    r = 0;
+  }
+  brelse(bp);
+  return r;
+}
+
+// Take the first free block of the first bitmap byte at or
+// after the one holding block start, wrapping round, that is
+// wholly free if whole is set, else that has any free block.
+// Return the block, or -1 if there's no such byte.
+static int
+bscan(uint dev, uint start, int whole)
+{
+  int b, bi, i, n;
+  struct buf *bp;
+
+  b = start - start % 8;
+  for(n = 0; n < sb.size; ){
     bp = bread(dev, BBLOCK(b, sb));
-    for(bi = 0; bi < BPB && b + bi < sb.size; bi++){
-      m = 1 << (bi % 8);
-      if((bp->data[bi/8] & m) == 0){  // Is block free?
-        bp->data[bi/8] |= m;  // Mark block in use.
-        log_write(bp);
-        brelse(bp);
-        bzero(dev, b + bi);
-        return b + bi;
+    do {
+      bi = b % BPB;
+      if(whole ? bp->data[bi/8] == 0 && b + 8 <= sb.size : bp->data[bi/8] != 0xFF){
+        for(i = 0; i < 8 && b + i < sb.size; i++){
+          if((bp->data[bi/8] & (1 << i)) == 0){
+            bp->data[bi/8] |= 1 << i;  // Mark block in use.
+            log_write(bp);
+            brelse(bp);
+            return b + i;
+          }
+        }
       }
-    }
+      b += 8;
+      n += 8;
+      if(b >= sb.size)
+        b = 0;
+    } while(n < sb.size && b % BPB != 0);
     brelse(bp);
   }
-  panic("balloc: out of blocks");
+  return -1;
+}
+
+// Allocate a zeroed disk block, at goal if it's free
+// (0 for a new file).  data says it will hold file data.
+uint
+balloc(uint dev, uint goal, int data)
+{
+  int b;
+
+  if(goal > 0 && goal < sb.size && btake(dev, goal) == 0)
+    b = goal;
+  else {
+    if(goal == 0 || goal >= sb.size)
+      goal = bnext;
+    if((b = bscan(dev, goal, 1)) >= 0)
+      bnext = (b + 8) % sb.size;
+    else if((b = bscan(dev, goal, 0)) < 0)
+      panic("balloc: out of blocks");
+  }
+  bzero(dev, b, data);
+  return b;
 }
 
 // Free a disk block.
@@ -119,22 +183,25 @@ bfree(int dev, uint b)
 //   is non-zero. ialloc() allocates, and iput() frees if
 //   the reference and link counts have fallen to zero.
 //
-// * Referencing in cache: an entry in the inode cache
-//   is free if ip->ref is zero. Otherwise ip->ref tracks
-//   the number of in-memory pointers to the entry (open
-//   files and current directories). iget() finds or
-//   creates a cache entry and increments its ref; iput()
-//   decrements ref.
+// * Referencing in cache: ip->ref tracks the number of
+//   in-memory pointers to a cache entry (open files and
+//   current directories). iget() finds or creates a cache
+//   entry and increments its ref; iput() decrements ref.
+//   An entry whose ref is zero stays cached, so that using
+//   the inode again needn't read it, until iget() recycles
+//   it: the least recently used such entry goes first.
 //
 // * Valid: the information (type, size, &c) in an inode
 //   cache entry is only correct when ip->valid is 1.
 //   ilock() reads the inode from
 //   the disk and sets ip->valid, while iput() clears
-//   ip->valid if ip->ref has fallen to zero.
+//   ip->valid when it frees the inode.
 //
 // * Locked: file system code may only examine and modify
 //   the information in an inode and its content if it
-//   has first locked the inode.
+//   has first locked the inode.  Code that only examines
+//   them may lock it shared instead, with ilockshared(),
+//   so that readers of one inode don't wait for each other.
 //
 // Thus a typical sequence is:
 //   ip = iget(dev, inum)
@@ -158,25 +225,95 @@ bfree(int dev, uint b)
 // entries. Since ip->ref indicates whether an entry is free,
 // and ip->dev and ip->inum indicate which i-node an entry
 // holds, one must hold icache.lock while using any of those fields.
+// It also protects the hash chains entries are found by and the
+// list of unreferenced entries.
+//
+// The cache starts with NINODE entries and grows by a page of
+// entries whenever iget() finds them all referenced, so the
+// number of inodes in use is limited only by memory.
 //
 // An ip->lock sleep-lock protects all ip-> fields other than ref,
 // dev, and inum.  One must hold ip->lock in order to
 // read or write that inode's ip->valid, ip->size, ip->type, &c.
 
+#define NIHASH 127
+
+// Inodes live IPERPAGE to a kalloc'd page.
+#define IPERPAGE ((PGSIZE - sizeof(void*)) / sizeof(struct inode))
+
+struct inodepage {
+  struct inodepage *next;
+  struct inode inode[IPERPAGE];
+};
+
 struct {
   struct spinlock lock;
-  struct inode inode[NINODE];
+  struct inodepage *pages;
+  int ninode;
+  struct inode *hash[NIHASH];
+
+  // Unreferenced entries, through lprev/lnext.
+  // head.lnext is most recently used, head.lprev least.
+  struct inode head;
 } icache;
 
+static uint
+ihash(uint dev, uint inum)
+{
+  return (dev * 31 + inum) % NIHASH;
+}
+
+// Put ip at the recently used end of the unreferenced list.
+// Caller holds icache.lock.
+static void
+iunused(struct inode *ip)
+{
+  ip->lnext = icache.head.lnext;
+  ip->lprev = &icache.head;
+  icache.head.lnext->lprev = ip;
+  icache.head.lnext = ip;
+}
+
+// Take ip off the unreferenced list.  Caller holds icache.lock.
+static void
+iused(struct inode *ip)
+{
+  ip->lnext->lprev = ip->lprev;
+  ip->lprev->lnext = ip->lnext;
+}
+
+// Add a page of entries to the cache.  They hold no inode
+// (inum 0, which no file has), so they are on no hash chain.
+// Returns -1 if out of memory.  Caller holds icache.lock.
+static int
+igrow(void)
+{
+  struct inodepage *pg;
+  struct inode *ip;
+
+  if((pg = (struct inodepage*)kalloc()) == 0)
+    return -1;
+  memset(pg, 0, sizeof(*pg));
+  for(ip = pg->inode; ip < pg->inode+IPERPAGE; ip++){
+    initsleeplock(&ip->lock, "inode");
+    iunused(ip);
+  }
+  pg->next = icache.pages;
+  icache.pages = pg;
+  icache.ninode += IPERPAGE;
+  return 0;
+}
+
 void
 iinit(int dev)
 {
-  int i = 0;
-  
   initlock(&icache.lock, "icache");
-  for(i = 0; i < NINODE; i++) {
-    initsleeplock(&icache.inode[i].lock, "inode");
-  }
+  icache.head.lprev = icache.head.lnext = &icache.head;
+  acquire(&icache.lock);
+  while(icache.ninode < NINODE)
+    if(igrow() < 0)
+      panic("iinit");
+  release(&icache.lock);
 
   readsb(dev, &sb);
   cprintf("sb: size %d nblocks %d ninodes %d nlog %d logstart %d\
@@ -185,8 +322,6 @@ iinit(int dev)
           sb.bmapstart);
 }
 
-static struct inode* iget(uint dev, uint inum);
-
 //PAGEBREAK!
 // Allocate an inode on device dev.
 // Mark it as allocated by  giving it type type.
@@ -198,6 +333,8 @@ ialloc(uint dev, short type)
   struct buf *bp;
   struct dinode *dip;
 
+  if(dev == TMPDEV)
+    return iget(dev, tmpfs_ialloc(type));
   for(inum = 1; inum < sb.ninodes; inum++){
     bp = bread(dev, IBLOCK(inum, sb));
     dip = (struct dinode*)bp->data + inum%IPB;
@@ -223,6 +360,10 @@ iupdate(struct inode *ip)
   struct buf *bp;
   struct dinode *dip;
 
+  if(ip->dev == TMPDEV){
+    tmpfs_iupdate(ip);
+    return;
+  }
   bp = bread(ip->dev, IBLOCK(ip->inum, sb));
   dip = (struct dinode*)bp->data + ip->inum%IPB;
   dip->type = ip->type;
@@ -238,34 +379,44 @@ iupdate(struct inode *ip)
 // Find the inode with number inum on device dev
 // and return the in-memory copy. Does not lock
 // the inode and does not read it from disk.
-static struct inode*
+struct inode*
 iget(uint dev, uint inum)
 {
-  struct inode *ip, *empty;
+  struct inode *ip, **pp;
+  uint h = ihash(dev, inum);
 
   acquire(&icache.lock);
 
   // Is the inode already cached?
-  empty = 0;
-  for(ip = &icache.inode[0]; ip < &icache.inode[NINODE]; ip++){
-    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
-      ip->ref++;
+  for(ip = icache.hash[h]; ip; ip = ip->next){
+    if(ip->dev == dev && ip->inum == inum){
+      if(ip->ref++ == 0)
+        iused(ip);
       release(&icache.lock);
       return ip;
     }
-    if(empty == 0 && ip->ref == 0)    // Remember empty slot.
-      empty = ip;
   }
 
-  // Recycle an inode cache entry.
-  if(empty == 0)
+  // Recycle the least recently used unreferenced entry,
+  // growing the cache if there is none.
+  if(icache.head.lprev == &icache.head && igrow() < 0)
     panic("iget: no inodes");
+  ip = icache.head.lprev;
+  iused(ip);
+  if(ip->inum != 0){
+    for(pp = &icache.hash[ihash(ip->dev, ip->inum)]; *pp != ip; pp = &(*pp)->next)
+      ;
+    *pp = ip->next;
+  }
 
-  ip = empty;
   ip->dev = dev;
   ip->inum = inum;
+  ip->next = icache.hash[h];
+  icache.hash[h] = ip;
   ip->ref = 1;
   ip->valid = 0;
+  ip->ra_last = ip->ra_ahead = 0;
+  ip->goal = 0;
   release(&icache.lock);
 
   return ip;
@@ -295,7 +446,12 @@ ilock(struct inode *ip)
 
   acquiresleep(&ip->lock);
 
-  if(ip->valid == 0){
+  if(ip->valid == 0 && ip->dev == TMPDEV){
+    tmpfs_iload(ip);
+    ip->valid = 1;
+    if(ip->type == 0)
+      panic("ilock: no type");
+  } else if(ip->valid == 0){
     bp = bread(ip->dev, IBLOCK(ip->inum, sb));
     dip = (struct dinode*)bp->data + ip->inum%IPB;
     ip->type = dip->type;
@@ -311,11 +467,29 @@ ilock(struct inode *ip)
   }
 }
 
-// Unlock the given inode.
+// Lock the given inode shared, only to read it.
+// Reads the inode from disk first if necessary, which takes
+// the lock exclusively.
+void
+ilockshared(struct inode *ip)
+{
+  if(ip == 0 || ip->ref < 1)
+    panic("ilockshared");
+
+  acquiresleepshared(&ip->lock);
+  while(ip->valid == 0){
+    releasesleep(&ip->lock);
+    ilock(ip);
+    iunlock(ip);
+    acquiresleepshared(&ip->lock);
+  }
+}
+
+// Unlock the given inode, locked exclusively or shared.
 void
 iunlock(struct inode *ip)
 {
-  if(ip == 0 || !holdingsleep(&ip->lock) || ip->ref < 1)
+  if(ip == 0 || (!holdingsleep(&ip->lock) && ip->lock.readers == 0) || ip->ref < 1)
     panic("iunlock");
 
   releasesleep(&ip->lock);
@@ -347,7 +521,8 @@ iput(struct inode *ip)
   releasesleep(&ip->lock);
 
   acquire(&icache.lock);
-  ip->ref--;
+  if(--ip->ref == 0)
+    iunused(ip);
   release(&icache.lock);
 }
 
@@ -365,19 +540,50 @@ iunlockput(struct inode *ip)
 // The content (data) associated with each inode is stored
 // in blocks on the disk. The first NDIRECT block numbers
 // are listed in ip->addrs[].  The next NINDIRECT blocks are
-// listed in block ip->addrs[NDIRECT].
+// listed in block ip->addrs[NDIRECT].  The last NDINDIRECT are
+// listed in the indirect blocks listed in block ip->addrs[NDIRECT+1].
+
+// Allocate a block for ip, following on from its last one.
+// leaf says it will hold content rather than block numbers;
+// only a regular file's content is file data to balloc.
+static uint
+bmapalloc(struct inode *ip, int leaf)
+{
+  uint addr;
+
+  addr = balloc(ip->dev, ip->goal, leaf && ip->type == T_FILE);
+  ip->goal = addr + 1;
+  return addr;
+}
+
+// Return entry i of indirect block addr, allocating if necessary;
+// leaf is as for bmapalloc.
+static uint
+ientry(struct inode *ip, uint addr, uint i, int leaf)
+{
+  uint *a;
+  struct buf *bp;
+
+  bp = bread(ip->dev, addr);
+  a = (uint*)bp->data;
+  if((addr = a[i]) == 0){
+    a[i] = addr = bmapalloc(ip, leaf);
+    log_write(bp);
+  }
+  brelse(bp);
+  return addr;
+}
 
 // Return the disk block address of the nth block in inode ip.
 // If there is no such block, bmap allocates one.
 static uint
 bmap(struct inode *ip, uint bn)
 {
-  uint addr, *a;
-  struct buf *bp;
+  uint addr;
 
   if(bn < NDIRECT){
     if((addr = ip->addrs[bn]) == 0)
-      ip->addrs[bn] = addr = balloc(ip->dev);
+      ip->addrs[bn] = addr = bmapalloc(ip, 1);
     return addr;
   }
   bn -= NDIRECT;
@@ -385,18 +591,41 @@ bmap(struct inode *ip, uint bn)
   if(bn < NINDIRECT){
     // Load indirect block, allocating if necessary.
     if((addr = ip->addrs[NDIRECT]) == 0)
-      ip->addrs[NDIRECT] = addr = balloc(ip->dev);
+      ip->addrs[NDIRECT] = addr = bmapalloc(ip, 0);
+    return ientry(ip, addr, bn, 1);
+  }
+  bn -= NINDIRECT;
+
+  if(bn < NDINDIRECT){
+    // Load double-indirect block, then the indirect block in it.
+    if((addr = ip->addrs[NDIRECT+1]) == 0)
+      ip->addrs[NDIRECT+1] = addr = bmapalloc(ip, 0);
+    addr = ientry(ip, addr, bn / NINDIRECT, 0);
+    return ientry(ip, addr, bn % NINDIRECT, 1);
+  }
+
+  panic("bmap: out of range");
+}
+
+// Free indirect block addr and the blocks it lists, going
+// depth levels of indirection down.
+static void
+ifree(struct inode *ip, uint addr, int depth)
+{
+  int j;
+  struct buf *bp;
+  uint *a;
+
+  if(depth > 0){
     bp = bread(ip->dev, addr);
     a = (uint*)bp->data;
-    if((addr = a[bn]) == 0){
-      a[bn] = addr = balloc(ip->dev);
-      log_write(bp);
+    for(j = 0; j < NINDIRECT; j++){
+      if(a[j])
+        ifree(ip, a[j], depth-1);
     }
     brelse(bp);
-    return addr;
   }
-
-  panic("bmap: out of range");
+  bfree(ip->dev, addr);
 }
 
 // Truncate inode (discard contents).
@@ -407,31 +636,23 @@ bmap(struct inode *ip, uint bn)
 static void
 itrunc(struct inode *ip)
 {
-  int i, j;
-  struct buf *bp;
-  uint *a;
+  int i;
 
-  for(i = 0; i < NDIRECT; i++){
+  if(ip->dev == TMPDEV)
+    tmpfs_trunc(ip);
+  for(i = 0; i < NDIRECT+2; i++){
     if(ip->addrs[i]){
-      bfree(ip->dev, ip->addrs[i]);
+      ifree(ip, ip->addrs[i], i < NDIRECT ? 0 : i - NDIRECT + 1);
       ip->addrs[i] = 0;
     }
   }
 
-  if(ip->addrs[NDIRECT]){
-    bp = bread(ip->dev, ip->addrs[NDIRECT]);
-    a = (uint*)bp->data;
-    for(j = 0; j < NINDIRECT; j++){
-      if(a[j])
-        bfree(ip->dev, a[j]);
-    }
-    brelse(bp);
-    bfree(ip->dev, ip->addrs[NDIRECT]);
-    ip->addrs[NDIRECT] = 0;
-  }
-
+  if(ip->type == T_DIR)
+    dcache_purge(ip);
   ip->size = 0;
+  ip->goal = 0;
   iupdate(ip);
+  pcache_drop(ip);
 }
 
 // Copy stat information from inode.
@@ -448,30 +669,108 @@ stati(struct inode *ip, struct stat *st)
 
 //PAGEBREAK!
 // Read data from inode.
-// Caller must hold ip->lock.
+// A regular file's data is read from the page cache, so read(),
+// exec and mmap share one copy of it; other inodes', and a page
+// the cache has no memory for, go through the buffer cache.
+// tmpfs files are read from their own pages (tmpfs_read).
+// Caller must hold ip->lock, shared will do: the readahead
+// hints readi keeps in ip may then race, but are only hints.
+// Files have no holes, so the blocks below ip->size all exist and
+// bmap never allocates here: no log transaction is needed.
 int
 readi(struct inode *ip, char *dst, uint off, uint n)
 {
-  uint tot, m;
+  uint tot, m, bn, end;
   struct buf *bp;
+  char *page;
+  int seq;
 
   if(ip->type == T_DEV){
     if(ip->major < 0 || ip->major >= NDEV || !devsw[ip->major].read)
       return -1;
     return devsw[ip->major].read(ip, dst, n);
   }
+  if(ip->dev == TMPDEV)
+    return tmpfs_read(ip, dst, off, n);
 
   if(off > ip->size || off + n < off)
     return -1;
   if(off + n > ip->size)
     n = ip->size - off;
 
+  if(n == 0)
+    return 0;
+  seq = off/BSIZE == ip->ra_last || off/BSIZE == ip->ra_last + 1;
+
   for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
+    if(ip->type == T_FILE && (page = pcache_get(ip, PGROUNDDOWN(off))) != 0){
+      m = min(n - tot, PGSIZE - off%PGSIZE);
+      memmove(dst, page + off%PGSIZE, m);
+      kfree(page);
+      continue;
+    }
     bp = bread(ip->dev, bmap(ip, off/BSIZE));
     m = min(n - tot, BSIZE - off%BSIZE);
     memmove(dst, bp->data + off%BSIZE, m);
     brelse(bp);
   }
+  ip->ra_last = (off - 1)/BSIZE;
+
+  // Reading in order: keep the next READAHEAD blocks on their
+  // way.  For a file, keep the next READAHEAD pages on their way
+  // into the page cache instead, asking the prefetch thread for
+  // half of them or more at a time.
+  if(seq && ip->type == T_FILE){
+    bn = ip->ra_ahead > ip->ra_last ? ip->ra_ahead + 1 : ip->ra_last + 1;
+    end = PGROUNDUP(off) + READAHEAD*PGSIZE;
+    if(end > ip->size)
+      end = ip->size;
+    if(bn*BSIZE < end && (end == ip->size || end - bn*BSIZE >= READAHEAD/2*PGSIZE)){
+      pcache_prefetch(ip, PGROUNDDOWN(bn*BSIZE), end);
+      ip->ra_ahead = (end - 1)/BSIZE;
+    }
+  } else if(seq){
+    bn = ip->ra_ahead > ip->ra_last ? ip->ra_ahead + 1 : ip->ra_last + 1;
+    for(; bn <= ip->ra_last + READAHEAD && bn < (ip->size + BSIZE - 1)/BSIZE; bn++)
+      breadahead(ip->dev, bmap(ip, bn));
+    ip->ra_ahead = bn - 1;
+  } else
+    ip->ra_ahead = 0;
+  return n;
+}
+
+// Read the page of file ip at page-aligned off straight into the
+// page-sized buffer page (e.g. a freshly kalloc'd frame),
+// zero-filling whatever lies past the end of the file.  Blocks
+// the buffer cache holds are copied from there, as they may be
+// newer than the disk; the rest go from the disk into page
+// directly, without a copy in the buffer cache.  Nothing else
+// can write the file's blocks meanwhile, as that takes ip->lock
+// exclusively.
+// Returns the number of file bytes read.
+// Caller must hold ip->lock, shared will do.
+int
+readpage(struct inode *ip, char *page, uint off)
+{
+  uint blockno[BPP];
+  int i, n;
+
+  n = off < ip->size ? min(ip->size - off, PGSIZE) : 0;
+  if(ip->dev == TMPDEV){
+    tmpfs_read(ip, page, off, n);
+    memset(page + n, 0, PGSIZE - n);
+    return n;
+  }
+  for(i = 0; i < BPP; i++){
+    blockno[i] = 0;
+    if(i*BSIZE < n){
+      blockno[i] = bmap(ip, off/BSIZE + i);
+      if(bpeek(ip->dev, blockno[i], page + i*BSIZE))
+        blockno[i] = 0;
+    }
+  }
+  bpageio(ip->dev, blockno, page, 0);
+  memset(page + n, 0, PGSIZE - n);
   return n;
 }
 
@@ -489,17 +788,28 @@ writei(struct inode *ip, char *src, uint off, uint n)
       return -1;
     return devsw[ip->major].write(ip, src, n);
   }
+  if(ip->dev == TMPDEV)
+    return tmpfs_write(ip, src, off, n);
 
   if(off > ip->size || off + n < off)
     return -1;
   if(off + n > MAXFILE*BSIZE)
     return -1;
 
+  // Carry on after the file's last block.
+  if(ip->goal == 0 && off > 0)
+    ip->goal = bmap(ip, (off-1)/BSIZE) + 1;
+
   for(tot=0; tot<n; tot+=m, off+=m, src+=m){
     bp = bread(ip->dev, bmap(ip, off/BSIZE));
     m = min(n - tot, BSIZE - off%BSIZE);
     memmove(bp->data + off%BSIZE, src, m);
-    log_write(bp);
+    // from the buffer, not src, which may be user memory
+    pcache_write(ip, (char*)bp->data + off%BSIZE, off, m);
+    if(ip->type == T_FILE)
+      log_data(bp);  // ordered: written home, not logged
+    else
+      log_write(bp);
     brelse(bp);
   }
 
@@ -510,6 +820,31 @@ writei(struct inode *ip, char *src, uint off, uint n)
   return n;
 }
 
+//PAGEBREAK!
+// Blocks a writei of n bytes may log: the data blocks, say two
+// of them partial, and the inode, indirect blocks and bitmap
+// blocks that allocating them can change.
+int
+writeiblocks(uint n)
+{
+  int nb = n / BSIZE + 2;
+
+  return nb + 1 + (nb / NINDIRECT + 2) + (nb / BPB + 1);
+}
+
+// The most bytes a writei within an operation of nblocks blocks
+// may write.
+uint
+writeimax(int nblocks)
+{
+  uint n;
+
+  n = nblocks > 7 ? (nblocks - 7) * BSIZE : BSIZE;
+  while(n > BSIZE && writeiblocks(n) > nblocks)
+    n -= BSIZE;
+  return n;
+}
+
 //PAGEBREAK!
 // Directories
 
@@ -530,6 +865,12 @@ dirlookup(struct inode *dp, char *name, uint *poff)
   if(dp->type != T_DIR)
     panic("dirlookup not DIR");
 
+  if(dcache_lookup(dp, name, &inum, &off) == 0){
+    if(poff)
+      *poff = off;
+    return iget(dp->dev, inum);
+  }
+
   for(off = 0; off < dp->size; off += sizeof(de)){
     if(readi(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
       panic("dirlookup read");
@@ -540,6 +881,7 @@ dirlookup(struct inode *dp, char *name, uint *poff)
       if(poff)
         *poff = off;
       inum = de.inum;
+      dcache_enter(dp, name, inum, off);
       return iget(dp->dev, inum);
     }
   }
@@ -573,6 +915,7 @@ dirlink(struct inode *dp, char *name, uint inum)
   de.inum = inum;
   if(writei(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
     panic("dirlink");
+  dcache_enter(dp, name, inum, off);
 
   return 0;
 }
@@ -620,6 +963,7 @@ skipelem(char *path, char *name)
 // Look up and return the inode for a path name.
 // If parent != 0, return the inode for the parent and copy the final
 // path element into name, which must have room for DIRSIZ bytes.
+// Crosses into tmpfs at /tmp and out again (tmpfs_cross).
 // Must be called inside a transaction since it calls iput().
 static struct inode*
 namex(char *path, int nameiparent, char *name)
@@ -632,7 +976,7 @@ namex(char *path, int nameiparent, char *name)
     ip = idup(myproc()->cwd);
 
   while((path = skipelem(path, name)) != 0){
-    ilock(ip);
+    ilockshared(ip);
     if(ip->type != T_DIR){
       iunlockput(ip);
       return 0;
@@ -646,7 +990,9 @@ namex(char *path, int nameiparent, char *name)
       iunlockput(ip);
       return 0;
     }
-    iunlockput(ip);
+    iunlock(ip);
+    next = tmpfs_cross(ip, next, name);
+    iput(ip);
     ip = next;
   }
   if(nameiparent){
@@ -0,0 +1,234 @@
+// File system benchmarks: the rate of creates and unlinks, the
+// throughput of sequential writes and reads in small (one block)
+// and large pieces, random one-block reads, and the latency of
+// fsync, which waits for a log commit.  Times are in rdtsc
+// cycles.
+//
+// usage: fsbench [-p nproc] [dir]
+//
+// With -p, nproc processes run the benchmarks at once, each on
+// files of its own, to show contention in the buffer cache and
+// the log.  The files go in dir, . by default.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "fs.h"
+
+#define NFILES   64          // files created and unlinked
+#define FILESIZE (256*1024)  // bytes written and read sequentially
+#define BIG      (64*1024)   // a large write or read
+#define NRAND    512         // random reads
+#define NSYNC    16          // fsyncs
+#define MAXPROC  4
+
+char dir[64];
+char buf[BIG];
+int id;  // which of the processes this is
+
+static char*
+putstr(char *p, char *s)
+{
+  while(*s)
+    *p++ = *s++;
+  return p;
+}
+
+static char*
+putnum(char *p, uint x)
+{
+  char tmp[12];
+  int i;
+
+  i = 0;
+  do
+    tmp[i++] = '0' + x % 10;
+  while((x /= 10) != 0);
+  while(i > 0)
+    *p++ = tmp[--i];
+  return p;
+}
+
+// Print one result.  The line goes out in one write, so that
+// those of processes running at once don't interleave.
+static void
+report(char *what, uint64 t, uint n, char *unit)
+{
+  char line[80], *p;
+
+  p = line;
+  if(id > 0){
+    p = putstr(p, "[");
+    p = putnum(p, id);
+    p = putstr(p, "] ");
+  }
+  p = putstr(p, what);
+  p = putstr(p, ": ");
+  p = putnum(p, per(t, n));
+  p = putstr(p, " cycles/");
+  p = putstr(p, unit);
+  p = putstr(p, "\n");
+  write(1, line, p - line);
+}
+
+static void
+fail(char *what)
+{
+  printf(2, "fsbench: %s failed\n", what);
+  exit();
+}
+
+// The path of this process's file i in dir.
+static char*
+name(int i)
+{
+  static char path[80];
+  char *p;
+
+  p = putstr(path, dir);
+  p = putstr(p, "/fsb");
+  p = putnum(p, id);
+  p = putstr(p, ".");
+  p = putnum(p, i);
+  *p = 0;
+  return path;
+}
+
+static void
+creates(void)
+{
+  uint64 t;
+  int i, fd;
+
+  t = cycles();
+  for(i = 0; i < NFILES; i++){
+    if((fd = open(name(i), O_CREATE|O_RDWR)) < 0)
+      fail("create");
+    close(fd);
+  }
+  report("create", cycles() - t, NFILES, "file");
+
+  t = cycles();
+  for(i = 0; i < NFILES; i++)
+    if(unlink(name(i)) < 0)
+      fail("unlink");
+  report("unlink", cycles() - t, NFILES, "file");
+}
+
+// Write the file anew in pieces of n bytes, then read it back.
+static void
+sequential(int n, char *wname, char *rname)
+{
+  uint64 t;
+  int fd, off;
+
+  unlink(name(0));
+  if((fd = open(name(0), O_CREATE|O_RDWR)) < 0)
+    fail("create");
+  t = cycles();
+  for(off = 0; off < FILESIZE; off += n)
+    if(write(fd, buf, n) != n)
+      fail("write");
+  report(wname, cycles() - t, FILESIZE/1024, "KB");
+  close(fd);
+
+  if((fd = open(name(0), O_RDONLY)) < 0)
+    fail("open");
+  t = cycles();
+  for(off = 0; off < FILESIZE; off += n)
+    if(read(fd, buf, n) != n)
+      fail("read");
+  report(rname, cycles() - t, FILESIZE/1024, "KB");
+  close(fd);
+}
+
+// Read single blocks of the file left by sequential() at random.
+static void
+randread(void)
+{
+  uint64 t;
+  uint seed;
+  int fd, i;
+
+  if((fd = open(name(0), O_RDONLY)) < 0)
+    fail("open");
+  seed = 1 + id;
+  t = cycles();
+  for(i = 0; i < NRAND; i++){
+    seed = seed * 1103515245 + 12345;
+    if(pread(fd, buf, BSIZE, (seed >> 8) % (FILESIZE/BSIZE) * BSIZE) != BSIZE)
+      fail("pread");
+  }
+  report("random read", cycles() - t, NRAND, "read");
+  close(fd);
+}
+
+// Write a little and wait for it to be on disk.
+static void
+syncs(void)
+{
+  uint64 t;
+  int fd, i;
+
+  if((fd = open(name(0), O_RDWR)) < 0)
+    fail("open");
+  t = cycles();
+  for(i = 0; i < NSYNC; i++){
+    if(write(fd, buf, 1) != 1 || fsync(fd) < 0)
+      fail("fsync");
+  }
+  report("write+fsync", cycles() - t, NSYNC, "call");
+  close(fd);
+  unlink(name(0));
+}
+
+static void
+bench(void)
+{
+  creates();
+  sequential(BSIZE, "small write", "small read");
+  sequential(BIG, "large write", "large read");
+  randread();
+  syncs();
+}
+
+int
+main(int argc, char *argv[])
+{
+  uint64 t;
+  int i, nproc, pid;
+
+  nproc = 1;
+  if(argc > 2 && strcmp(argv[1], "-p") == 0){
+    nproc = atoi(argv[2]);
+    argc -= 2;
+    argv += 2;
+  }
+  if(nproc < 1 || nproc > MAXPROC)
+    fail("-p");
+  if(argc > 1 && strlen(argv[1]) > sizeof(dir) - 1)
+    fail("dir");
+  strcpy(dir, argc > 1 ? argv[1] : ".");
+  memset(buf, 'f', sizeof(buf));
+
+  if(nproc == 1){
+    bench();
+  } else {
+    t = cycles();
+    for(i = 1; i <= nproc; i++){
+      if((pid = fork()) < 0)
+        fail("fork");
+      if(pid == 0){
+        id = i;
+        bench();
+        exit();
+      }
+    }
+    for(i = 0; i < nproc; i++)
+      wait();
+    report("all processes", cycles() - t, 1, "run");
+  }
+  printf(1, "fsbench: done\n");
+  exit();
+}
@@ -0,0 +1,125 @@
+// Futexes: waiting on a word of user memory.
+//
+// futex_wait(addr, val) sleeps as long as the word at addr holds
+// val; futex_wake(addr, n) wakes up to n of the processes waiting
+// on it.  A word is known by the physical frame it lies in, so
+// every process mapping the same memory, MAP_SHARED or as threads,
+// waits on the same word.  Both calls fault the word in for
+// writing first, which breaks copy-on-write, so private memory
+// after a fork is each process's own.
+//
+// The sleep channel is the word's kernel address.  The check of
+// the word and the sleep happen under its bucket's lock, which
+// futex_wake takes too, so a wake that follows a store to the word
+// can't come between them and be missed.  A wait may still return
+// early, if the process is killed or if the memory was unmapped and
+// its frame reused by someone else's futex, so callers check the
+// word again, as with any futex.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "mm.h"
+
+#define NFUTEXHASH 16
+
+static struct spinlock futexlock[NFUTEXHASH];
+
+void
+futexinit(void)
+{
+  int i;
+
+  for(i = 0; i < NFUTEXHASH; i++)
+    initlock(&futexlock[i], "futex");
+}
+
+static struct spinlock*
+bucket(uint *w)
+{
+  return &futexlock[((uint)w / sizeof(uint)) % NFUTEXHASH];
+}
+
+// The kernel address of the word at user address va, already
+// faulted in, or 0 if it isn't mapped writable.  Caller holds the
+// address space's lock, which keeps the frame mapped meanwhile.
+static uint*
+futexword(uint va)
+{
+  pte_t *pte;
+  uint pa;
+
+  pte = walkpgdir(myproc()->mm->pgdir, (char*)va, 0);
+  if(pte == 0 || (*pte & (PTE_P|PTE_W|PTE_U)) != (PTE_P|PTE_W|PTE_U))
+    return 0;
+  if(*pte & PTE_PS)
+    pa = PTE_ADDR(*pte) + va % HUGEPGSIZE;
+  else
+    pa = PTE_ADDR(*pte) + va % PGSIZE;
+  return (uint*)P2V(pa);
+}
+
+// Fetch the word address argument, checking it is aligned and
+// faulting it in.
+static int
+argword(int n, uint *va)
+{
+  if(argint(n, (int*)va) < 0 || *va % sizeof(uint) != 0)
+    return -1;
+  return uaccess(*va, sizeof(uint), 1);
+}
+
+int
+sys_futex_wait(void)
+{
+  struct mm *mm = myproc()->mm;
+  struct spinlock *lk;
+  uint va, *w;
+  int val;
+
+  if(argword(0, &va) < 0 || argint(1, &val) < 0)
+    return -1;
+  acquiresleepshared(&mm->lock);
+  if((w = futexword(va)) == 0){
+    releasesleep(&mm->lock);
+    return -1;
+  }
+  lk = bucket(w);
+  acquire(lk);
+  releasesleep(&mm->lock);
+  if(*w != val){
+    release(lk);
+    return -1;
+  }
+  sleep(w, lk);
+  release(lk);
+  return myproc()->killed ? -1 : 0;
+}
+
+int
+sys_futex_wake(void)
+{
+  struct mm *mm = myproc()->mm;
+  struct spinlock *lk;
+  uint va, *w;
+  int n, r;
+
+  if(argword(0, &va) < 0 || argint(1, &n) < 0 || n < 0)
+    return -1;
+  acquiresleepshared(&mm->lock);
+  if((w = futexword(va)) == 0){
+    releasesleep(&mm->lock);
+    return -1;
+  }
+  lk = bucket(w);
+  acquire(lk);
+  releasesleep(&mm->lock);
+  r = wakeupn(w, n);
+  release(lk);
+  return r;
+}
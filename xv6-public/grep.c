@@ -1,107 +1,273 @@
 // Simple grep.  Only supports ^ . * $ operators.
+//
+// The pattern is compiled into a list of items, each a character
+// or '.' that may be starred, and run as an NFA over a line's
+// characters, a set of positions in the list at a time, so that
+// matching takes time linear in the line however the pattern
+// backtracks.  A pattern with no operators is searched for as a
+// plain string across the whole buffer instead of a line at a
+// time, memchr finding its first character.  Files are mapped
+// rather than read; pipes and devices are read in large chunks.
 
 #include "types.h"
 #include "stat.h"
 #include "user.h"
+#include "mmap.h"
 
-char buf[1024];
-int match(char*, char*);
+#define MAXRE 256        // pattern items
+#define READSZ (64*1024) // bytes read at a time
+
+struct item {
+  char c;     // character to match
+  char any;   // '.': any character
+  char star;  // zero or more of it
+};
+
+struct item re[MAXRE];
+int nre;
+int bol, eol;  // anchored at the line's start / end
+int literal;   // no operators: re is a plain string
+
+char lit[MAXRE];  // re's characters, if literal
+
+char *buf;
+uint bufsz;
+
+char obuf[8192];  // output, written a buffer at a time
+int nout;
 
 void
-grep(char *pattern, int fd)
+flush(void)
+{
+  if(nout > 0)
+    write(1, obuf, nout);
+  nout = 0;
+}
+
+// Print the line [s, e), which doesn't include its newline.
+void
+emit(char *s, char *e)
+{
+  int n = e - s;
+
+  if(nout + n + 1 > sizeof(obuf)){
+    flush();
+    if(n + 1 > sizeof(obuf)){
+      write(1, s, n);
+      write(1, "\n", 1);
+      return;
+    }
+  }
+  memmove(obuf + nout, s, n);
+  nout += n;
+  obuf[nout++] = '\n';
+}
+
+void
+compile(char *p)
+{
+  int i;
+
+  if(*p == '^'){
+    bol = 1;
+    p++;
+  }
+  for(; *p; nre++){
+    if(p[0] == '$' && p[1] == '\0'){
+      eol = 1;
+      break;
+    }
+    if(nre == MAXRE){
+      printf(2, "grep: pattern too long\n");
+      exit();
+    }
+    re[nre].c = p[0];
+    re[nre].any = p[0] == '.';
+    re[nre].star = p[1] == '*';
+    p += re[nre].star ? 2 : 1;
+  }
+  literal = nre > 0 && !bol && !eol;
+  for(i = 0; i < nre; i++){
+    if(re[i].any || re[i].star)
+      literal = 0;
+    lit[i] = re[i].c;
+  }
+}
+
+//PAGEBREAK!
+// The NFA.  Being at position i means re[i..] is left to match;
+// at nre the pattern has matched.  A list holds each position
+// once, which mark, stamped with the list's generation, tracks.
+
+uint mark[MAXRE + 1];
+uint gen;
+int cur[MAXRE + 1], nxt[MAXRE + 1];
+
+// Add position i to the list l of n, and those a starred item
+// there lets it skip to.
+void
+add(int *l, int *n, int i)
+{
+  for(; mark[i] != gen; i++){
+    mark[i] = gen;
+    l[(*n)++] = i;
+    if(i == nre || !re[i].star)
+      break;
+  }
+}
+
+// Does the line [s, e) match?
+int
+match(char *s, char *e)
+{
+  int *l, *ln, *t;
+  int i, n, nn, first;
+
+  l = cur;
+  ln = nxt;
+  n = 0;
+  gen++;
+  for(first = 1;; s++, first = 0){
+    if(first || !bol)
+      add(l, &n, 0);
+    if(mark[nre] == gen && (!eol || s == e))
+      return 1;
+    if(s == e || n == 0)
+      return 0;
+    gen++;
+    nn = 0;
+    for(i = 0; i < n; i++){
+      if(l[i] == nre || !(re[l[i]].any || re[l[i]].c == *s))
+        continue;
+      add(ln, &nn, re[l[i]].star ? l[i] : l[i] + 1);
+    }
+    t = l;
+    l = ln;
+    ln = t;
+    n = nn;
+  }
+}
+
+// Find the pattern as a plain string in [s, e).
+char*
+find(char *s, char *e)
+{
+  char *p;
+  int i;
+
+  while(e - s >= nre){
+    if((p = memchr(s, lit[0], e - s - nre + 1)) == 0)
+      return 0;
+    for(i = 1; i < nre && p[i] == lit[i]; i++)
+      ;
+    if(i == nre)
+      return p;
+    s = p + 1;
+  }
+  return 0;
+}
+
+// Print the matching lines of [s, e), the last of which may lack
+// its newline.
+void
+lines(char *s, char *e)
 {
-  int n, m;
   char *p, *q;
 
+  if(literal){
+    while((p = find(s, e)) != 0){
+      for(q = p; q > s && q[-1] != '\n'; q--)
+        ;
+      if((p = memchr(p, '\n', e - p)) == 0)
+        p = e;
+      emit(q, p);
+      s = p + 1;
+      if(p == e)
+        break;
+    }
+    return;
+  }
+  for(; s < e; s = p + 1){
+    if((p = memchr(s, '\n', e - s)) == 0)
+      p = e;
+    if(match(s, p))
+      emit(s, p);
+  }
+}
+
+void
+grep(int fd)
+{
+  struct stat st;
+  char *p, *e, *nbuf;
+  int n, m;
+
+  if(fstat(fd, &st) == 0 && st.type == T_FILE && st.size > 0 &&
+     (p = mmap(0, st.size, PROT_READ, MAP_PRIVATE, fd, 0)) != (char*)-1){
+    lines(p, p + st.size);
+    munmap(p, st.size);
+    return;
+  }
+
   m = 0;
-  while((n = read(fd, buf+m, sizeof(buf)-m-1)) > 0){
+  while((n = read(fd, buf + m, bufsz - m)) > 0){
     m += n;
-    buf[m] = '\0';
-    p = buf;
-    while((q = strchr(p, '\n')) != 0){
-      *q = 0;
-      if(match(pattern, p)){
-        *q = '\n';
-        write(1, p, q+1 - p);
+    for(e = buf + m; e > buf && e[-1] != '\n'; e--)
+      ;
+    if(e == buf){
+      // no whole line yet: make room for a longer one
+      if(m == bufsz){
+        if((nbuf = malloc(2 * bufsz)) == 0){
+          printf(2, "grep: line too long\n");
+          exit();
+        }
+        memmove(nbuf, buf, m);
+        free(buf);
+        buf = nbuf;
+        bufsz *= 2;
       }
-      p = q+1;
-    }
-    if(p == buf)
-      m = 0;
-    if(m > 0){
-      m -= p - buf;
-      memmove(buf, p, m);
+      continue;
     }
+    lines(buf, e);
+    m -= e - buf;
+    memmove(buf, e, m);
+    flush();
   }
+  if(m > 0)
+    lines(buf, buf + m);
 }
 
 int
 main(int argc, char *argv[])
 {
   int fd, i;
-  char *pattern;
 
   if(argc <= 1){
     printf(2, "usage: grep pattern [file ...]\n");
     exit();
   }
-  pattern = argv[1];
+  compile(argv[1]);
+  bufsz = READSZ;
+  if((buf = malloc(bufsz)) == 0){
+    printf(2, "grep: out of memory\n");
+    exit();
+  }
 
   if(argc <= 2){
-    grep(pattern, 0);
+    grep(0);
+    flush();
     exit();
   }
 
   for(i = 2; i < argc; i++){
     if((fd = open(argv[i], 0)) < 0){
+      flush();
       printf(1, "grep: cannot open %s\n", argv[i]);
       exit();
     }
-    grep(pattern, fd);
+    grep(fd);
     close(fd);
   }
+  flush();
   exit();
 }
-
-// Regexp matcher from Kernighan & Pike,
-// The Practice of Programming, Chapter 9.
-
-int matchhere(char*, char*);
-int matchstar(int, char*, char*);
-
-int
-match(char *re, char *text)
-{
-  if(re[0] == '^')
-    return matchhere(re+1, text);
-  do{  // must look at empty string
-    if(matchhere(re, text))
-      return 1;
-  }while(*text++ != '\0');
-  return 0;
-}
-
-// matchhere: search for re at beginning of text
-int matchhere(char *re, char *text)
-{
-  if(re[0] == '\0')
-    return 1;
-  if(re[1] == '*')
-    return matchstar(re[0], re+2, text);
-  if(re[0] == '$' && re[1] == '\0')
-    return *text == '\0';
-  if(*text!='\0' && (re[0]=='.' || re[0]==*text))
-    return matchhere(re+1, text+1);
-  return 0;
-}
-
-// matchstar: search for c*re at beginning of text
-int matchstar(int c, char *re, char *text)
-{
-  do{  // a * matches zero or more instances
-    if(matchhere(re, text))
-      return 1;
-  }while(*text!='\0' && (*text++==c || c=='.'));
-  return 0;
-}
-
@@ -12,6 +12,8 @@
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "kstats.h"
+#include "trace.h"
 
 #define SECTOR_SIZE   512
 #define IDE_BSY       0x80
@@ -27,9 +29,24 @@
 // idequeue points to the buf now being read/written to the disk.
 // idequeue->qnext points to the next buf to be processed.
 // You must hold idelock while manipulating queue.
+//
+// idestart coalesces a run of queued bufs for consecutive blocks
+// going the same way into one command for all their sectors.  The
+// disk interrupts once per sector, so ideintr moves one sector at
+// a time and finishes each buf once all of its sectors are done.
+//
+// Behind the active command, bufs wait in C-SCAN order: ascending
+// from the block the disk is at, then wrapping round to the lowest.
+// A buf passed over by MAXAGE later arrivals lets no others ahead
+// of it, so a stream of requests near the head can't starve it.
+
+#define MAXRUN 32  // most blocks one command transfers
+#define MAXAGE 16  // times a queued buf may be passed over
 
 static struct spinlock idelock;
 static struct buf *idequeue;
+static int iderun;  // bufs at the head of idequeue in the active command
+static int ideoff;  // bytes of idequeue's data transferred so far
 
 static int havedisk1;
 static void idestart(struct buf*);
@@ -69,33 +86,43 @@ ideinit(void)
   outb(0x1f6, 0xe0 | (0<<4));
 }
 
-// Start the request for b.  Caller must hold idelock.
+// Start the request for b, together with the bufs queued after
+// it that continue it on disk.  Caller must hold idelock.
 static void
 idestart(struct buf *b)
 {
+  struct buf *q;
+
   if(b == 0)
     panic("idestart");
-  if(b->blockno >= FSSIZE)
-    panic("incorrect blockno");
   int sector_per_block =  BSIZE/SECTOR_SIZE;
   int sector = b->blockno * sector_per_block;
-  int read_cmd = (sector_per_block == 1) ? IDE_CMD_READ :  IDE_CMD_RDMUL;
-  int write_cmd = (sector_per_block == 1) ? IDE_CMD_WRITE : IDE_CMD_WRMUL;
 
-  if (sector_per_block > 7) panic("idestart");
+  if (MAXRUN * sector_per_block > 255) panic("idestart");
+
+  iderun = 1;
+  for(q = b; q->qnext && iderun < MAXRUN; q = q->qnext, iderun++){
+    if(q->qnext->dev != b->dev || q->qnext->blockno != q->blockno + 1 ||
+       (q->qnext->flags & B_DIRTY) != (b->flags & B_DIRTY))
+      break;
+  }
+  // the swap area lies past FSSIZE, so only LBA28's limit applies
+  if(q->blockno >= (1 << 28) / sector_per_block)
+    panic("incorrect blockno");
+  ideoff = 0;
 
   idewait(0);
   outb(0x3f6, 0);  // generate interrupt
-  outb(0x1f2, sector_per_block);  // number of sectors
+  outb(0x1f2, iderun * sector_per_block);  // number of sectors
   outb(0x1f3, sector & 0xff);
   outb(0x1f4, (sector >> 8) & 0xff);
   outb(0x1f5, (sector >> 16) & 0xff);
   outb(0x1f6, 0xe0 | ((b->dev&1)<<4) | ((sector>>24)&0x0f));
   if(b->flags & B_DIRTY){
-    outb(0x1f7, write_cmd);
-    outsl(0x1f0, b->data, BSIZE/4);
+    outb(0x1f7, IDE_CMD_WRITE);
+    outsl(0x1f0, b->data, SECTOR_SIZE/4);
   } else {
-    outb(0x1f7, read_cmd);
+    outb(0x1f7, IDE_CMD_READ);
   }
 }
 
@@ -104,6 +131,7 @@ void
 ideintr(void)
 {
   struct buf *b;
+  int async;
 
   // First queued buffer is the active request.
   acquire(&idelock);
@@ -112,32 +140,60 @@ ideintr(void)
     release(&idelock);
     return;
   }
-  idequeue = b->qnext;
 
   // Read data if needed.
   if(!(b->flags & B_DIRTY) && idewait(1) >= 0)
-    insl(0x1f0, b->data, BSIZE/4);
+    insl(0x1f0, b->data + ideoff, SECTOR_SIZE/4);
+  ideoff += SECTOR_SIZE;
+
+  if(ideoff < BSIZE){
+    // More of b to go; a write is fed its next sector.
+    if(b->flags & B_DIRTY){
+      idewait(0);
+      outsl(0x1f0, b->data + ideoff, SECTOR_SIZE/4);
+    }
+    release(&idelock);
+    return;
+  }
+  idequeue = b->qnext;
+  ideoff = 0;
 
   // Wake process waiting for this buf.
   b->flags |= B_VALID;
   b->flags &= ~B_DIRTY;
+  async = b->flags & B_ASYNC;
+  b->flags &= ~B_ASYNC;
+  if(tracing)
+    tracepoint(TR_DISKDONE, b->blockno);
   wakeup(b);
 
-  // Start disk on next buf in queue.
-  if(idequeue != 0)
+  // Carry on with the command's next buf, or
+  // start disk on next buf in queue.
+  if(--iderun > 0){
+    if(idequeue->flags & B_DIRTY){
+      idewait(0);
+      outsl(0x1f0, idequeue->data, SECTOR_SIZE/4);
+    }
+  } else if(idequeue != 0)
     idestart(idequeue);
 
   release(&idelock);
+
+  // Nobody waits for a read-ahead buffer; hand it back to the cache.
+  if(async)
+    bdoneasync(b);
 }
 
 //PAGEBREAK!
-// Sync buf with disk.
-// If B_DIRTY is set, write buf to disk, clear B_DIRTY, set B_VALID.
-// Else if B_VALID is not set, read buf from disk, set B_VALID.
+// Queue b to be synced with disk, starting the disk if it is
+// idle, and return without waiting.  If b has B_ASYNC set, the
+// interrupt releases it when done; otherwise call iderwwait.
 void
-iderw(struct buf *b)
+iderwstart(struct buf *b)
 {
-  struct buf **pp;
+  struct buf **pp, **q, *p;
+  uint pos, key;
+  int i;
 
   if(!holdingsleep(&b->lock))
     panic("iderw: buf not locked");
@@ -146,23 +202,57 @@ iderw(struct buf *b)
   if(b->dev != 0 && !havedisk1)
     panic("iderw: ide disk 1 not present");
 
+  kstat(KS_DISKIO);
+  if(tracing)
+    tracepoint(TR_DISKIO, b->blockno);
   acquire(&idelock);  //DOC:acquire-lock
 
-  // Append b to idequeue.
-  b->qnext = 0;
-  for(pp=&idequeue; *pp; pp=&(*pp)->qnext)  //DOC:insert-queue
+  // Skip the active command; pos is the last block it moves.
+  pos = 0;
+  pp = &idequeue;
+  for(i = 0; i < iderun && *pp; i++){
+    pos = (*pp)->blockno;
+    pp = &(*pp)->qnext;
+  }
+  // Nothing may go ahead of a buf that has waited long enough.
+  for(q = pp; *q; q = &(*q)->qnext)
+    if((*q)->qage >= MAXAGE)
+      pp = &(*q)->qnext;
+  // Then find b's place in the sweep: key is how far past
+  // pos the head must travel, wrapping round, to reach it.
+  key = b->blockno - pos - 1;
+  for(; *pp && (*pp)->blockno - pos - 1 <= key; pp = &(*pp)->qnext)  //DOC:insert-queue
     ;
+  b->qnext = *pp;
+  b->qage = 0;
   *pp = b;
+  for(p = b->qnext; p; p = p->qnext)
+    p->qage++;
 
   // Start disk if necessary.
   if(idequeue == b)
     idestart(b);
 
-  // Wait for request to finish.
+  release(&idelock);
+}
+
+// Wait for b's request to finish.
+void
+iderwwait(struct buf *b)
+{
+  acquire(&idelock);
   while((b->flags & (B_VALID|B_DIRTY)) != B_VALID){
     sleep(b, &idelock);
   }
-
-
   release(&idelock);
 }
+
+// Sync buf with disk.
+// If B_DIRTY is set, write buf to disk, clear B_DIRTY, set B_VALID.
+// Else if B_VALID is not set, read buf from disk, set B_VALID.
+void
+iderw(struct buf *b)
+{
+  iderwstart(b);
+  iderwwait(b);
+}
@@ -73,3 +73,13 @@ ioapicenable(int irq, int cpunum)
   ioapicwrite(REG_TABLE+2*irq, T_IRQ0 + irq);
   ioapicwrite(REG_TABLE+2*irq+1, cpunum << 24);
 }
+
+// Route irq, a PCI interrupt line (level-triggered, active low),
+// to the given cpunum as if it were IRQ as, so that a PCI device
+// can stand in for a legacy one (e.g. a virtio disk for IRQ_IDE).
+void
+ioapicroute(int irq, int as, int cpunum)
+{
+  ioapicwrite(REG_TABLE+2*irq, INT_LEVEL | INT_ACTIVELOW | (T_IRQ0 + as));
+  ioapicwrite(REG_TABLE+2*irq+1, cpunum << 24);
+}
@@ -1,6 +1,29 @@
 // Physical memory allocator, intended to allocate
 // memory for user processes, kernel stacks, page table pages,
 // and pipe buffers. Allocates 4096-byte pages.
+//
+// Each CPU keeps a small cache of free pages so that kalloc
+// and kfree usually touch only that CPU's list.  Pages move
+// between a cache and the global pool in batches of KBATCH,
+// and a CPU whose cache and the pool are both empty steals
+// from the other CPUs.
+//
+// Each cache also holds up to KZERO pages that were zeroed
+// while the CPU was idle (see kidlezero), which kzalloc hands
+// out for anonymous memory.  Freed pages are only filled with
+// junk in a debug kernel (make KDEBUG=1).
+//
+// Read faults on anonymous memory map the one zero page
+// (kzeropage) copy-on-write rather than a page of their own; its
+// reference count never drops to zero, so a write always copies.
+//
+// kinit2 also sets aside NHUGEPAGE aligned, physically contiguous
+// 4MB frames for huge-page mappings (khugealloc).  Once the 4KB
+// pages run out, the buffer and page caches are asked to give
+// pages back (bshrink, pcache_shrink), and only then are the
+// set-aside frames broken up.
+// Past that kalloc fails; callers that may sleep can use
+// kallocreclaim (swap.c), which evicts user pages to make room.
 
 #include "types.h"
 #include "defs.h"
@@ -8,6 +31,12 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "spinlock.h"
+#include "x86.h"
+#include "kstats.h"
+
+#define KCACHE 64  // most free pages a CPU keeps for itself
+#define KBATCH 32  // pages moved to or from the global pool at once
+#define KZERO  32  // most pre-zeroed pages a CPU keeps
 
 void freerange(void *vstart, void *vend);
 extern char end[]; // first address after kernel loaded from ELF file
@@ -17,29 +46,77 @@ struct run {
   struct run *next;
 };
 
+// Per-CPU free page cache.  The lock is only ever contended
+// when another CPU steals; aligned so caches don't share lines.
+struct kcache {
+  struct spinlock lock;
+  struct run *freelist;
+  int nfree;
+  struct run *zerolist;  // pages that are all zero but for r->next
+  int nzero;
+} __attribute__((aligned(64)));
+
 struct {
   struct spinlock lock;
   int use_lock;
   struct run *freelist;
+  char *lazy;            // free pages never yet on a list: [lazy, lazyend)
+  char *lazyend;
+  int nfree;             // pages on freelist or in the lazy range
+  struct kcache cpu[NCPU];
+  struct run *hugelist;  // free 4MB frames
+  // Number of page tables (or other owners) referring to each
+  // physical page, so copy-on-write pages can be shared.
+  // Updated with atomic adds, not under a lock.
+  int ref[PHYSTOP/PGSIZE];
 } kmem;
 
+#define PAGEREF(v) kmem.ref[V2P(v) / PGSIZE]
+
+static char *zeropage;
+
 // Initialization happens in two phases.
 // 1. main() calls kinit1() while still using entrypgdir to place just
 // the pages mapped by entrypgdir on free list.
 // 2. main() calls kinit2() with the rest of the physical pages
 // after installing a full page table that maps them on all cores.
+// Those aren't put on a list one by one, which would take a while
+// for a large memory: they stay a range that refill carves pages
+// off as the CPUs need them.
 void
 kinit1(void *vstart, void *vend)
 {
+  int i;
+
   initlock(&kmem.lock, "kmem");
+  for(i = 0; i < NCPU; i++)
+    initlock(&kmem.cpu[i].lock, "kcache");
   kmem.use_lock = 0;
   freerange(vstart, vend);
+  if((zeropage = kalloc()) == 0)
+    panic("kinit1: zero page");
+  memset(zeropage, 0, PGSIZE);
 }
 
 void
 kinit2(void *vstart, void *vend)
 {
-  freerange(vstart, vend);
+  struct run *r;
+  char *p;
+  int n;
+
+  // Huge frames come off the top, and must be 4MB aligned physically.
+  p = (char*)P2V(HUGEPGROUNDDOWN(V2P(vend)));
+  for(n = 0; n < NHUGEPAGE && p - HUGEPGSIZE >= (char*)vstart; n++){
+    p -= HUGEPGSIZE;
+    r = (struct run*)p;
+    r->next = kmem.hugelist;
+    kmem.hugelist = r;
+  }
+  kmem.lazy = (char*)PGROUNDUP((uint)vstart);
+  kmem.lazyend = (char*)PGROUNDDOWN((uint)(n > 0 ? p : vend));
+  if(kmem.lazyend > kmem.lazy)
+    kmem.nfree += (kmem.lazyend - kmem.lazy) / PGSIZE;
   kmem.use_lock = 1;
 }
 
@@ -48,32 +125,180 @@ freerange(void *vstart, void *vend)
 {
   char *p;
   p = (char*)PGROUNDUP((uint)vstart);
-  for(; p + PGSIZE <= (char*)vend; p += PGSIZE)
+  for(; p + PGSIZE <= (char*)vend; p += PGSIZE){
+    PAGEREF(p) = 1;
     kfree(p);
+  }
+}
+
+// Lock and return this CPU's page cache.
+static struct kcache*
+mycache(void)
+{
+  struct kcache *c;
+
+  pushcli();
+  c = &kmem.cpu[cpuid()];
+  acquire(&c->lock);
+  popcli();
+  return c;
+}
+
+// Move up to KBATCH pages from the global pool into c, from
+// its free list or else carved off the lazy range.
+// Caller holds c->lock.
+static void
+refill(struct kcache *c)
+{
+  struct run *r;
+  int n;
+
+  acquire(&kmem.lock);
+  for(n = 0; n < KBATCH; n++){
+    if((r = kmem.freelist) != 0)
+      kmem.freelist = r->next;
+    else if(kmem.lazy < kmem.lazyend){
+      r = (struct run*)kmem.lazy;
+      kmem.lazy += PGSIZE;
+    } else
+      break;
+    kmem.nfree--;
+    r->next = c->freelist;
+    c->freelist = r;
+    c->nfree++;
+  }
+  release(&kmem.lock);
+}
+
+// Return KBATCH pages from c to the global pool.
+// Caller holds c->lock.
+static void
+drain(struct kcache *c)
+{
+  struct run *r;
+  int n;
+
+  acquire(&kmem.lock);
+  for(n = 0; n < KBATCH && (r = c->freelist) != 0; n++){
+    c->freelist = r->next;
+    c->nfree--;
+    r->next = kmem.freelist;
+    kmem.freelist = r;
+    kmem.nfree++;
+  }
+  release(&kmem.lock);
+}
+
+// Take one page from another CPU's cache, or 0 if every
+// cache is empty.  Takes half of the victim's free list and
+// keeps the rest for this CPU; only when no CPU has plain
+// free pages left does it dip into their zeroed pages.
+// Must not hold a cache lock.
+static struct run*
+steal(void)
+{
+  struct kcache *c, *mine;
+  struct run *r, *list, *last;
+  int i, n;
+
+  for(i = 0; i < 2*NCPU; i++){
+    c = &kmem.cpu[i % NCPU];
+    if(i < NCPU && c->nfree == 0)
+      continue;
+    acquire(&c->lock);
+    if(i >= NCPU && c->zerolist){
+      r = c->zerolist;
+      c->zerolist = r->next;
+      c->nzero--;
+      release(&c->lock);
+      return r;
+    }
+    list = c->freelist;
+    if(list == 0){
+      release(&c->lock);
+      continue;
+    }
+    last = list;
+    for(n = 1; n < (c->nfree + 1) / 2; n++)
+      last = last->next;
+    c->freelist = last->next;
+    c->nfree -= n;
+    release(&c->lock);
+
+    r = list;
+    list = r->next;
+    last->next = 0;
+    if(list){
+      mine = mycache();
+      last->next = mine->freelist;
+      mine->freelist = list;
+      mine->nfree += n - 1;
+      release(&mine->lock);
+    }
+    return r;
+  }
+  return 0;
+}
+
+// Break a free 4MB frame up into ordinary pages, when those
+// have run out.  Returns -1 if there is no free frame.
+static int
+splithuge(void)
+{
+  struct run *r;
+
+  acquire(&kmem.lock);
+  if((r = kmem.hugelist) != 0)
+    kmem.hugelist = r->next;
+  release(&kmem.lock);
+  if(r == 0)
+    return -1;
+  freerange(r, (char*)r + HUGEPGSIZE);
+  return 0;
 }
+
 //PAGEBREAK: 21
-// Free the page of physical memory pointed at by v,
-// which normally should have been returned by a
+// Drop a reference to the page of physical memory pointed
+// at by v, which normally should have been returned by a
 // call to kalloc().  (The exception is when
 // initializing the allocator; see kinit above.)
+// The page is freed when its last reference goes away.
 void
 kfree(char *v)
 {
   struct run *r;
+  struct kcache *c;
+  int old;
 
   if((uint)v % PGSIZE || v < end || V2P(v) >= PHYSTOP)
     panic("kfree");
 
+  old = xadd(&PAGEREF(v), -1);
+  if(old < 1)
+    panic("kfree: ref");
+  if(old > 1)
+    return;
+
+#ifdef KDEBUG
   // Fill with junk to catch dangling refs.
   memset(v, 1, PGSIZE);
+#endif
 
-  if(kmem.use_lock)
-    acquire(&kmem.lock);
   r = (struct run*)v;
-  r->next = kmem.freelist;
-  kmem.freelist = r;
-  if(kmem.use_lock)
-    release(&kmem.lock);
+  if(!kmem.use_lock){
+    r->next = kmem.freelist;
+    kmem.freelist = r;
+    kmem.nfree++;
+    return;
+  }
+
+  kstat(KS_KFREE);
+  c = mycache();
+  r->next = c->freelist;
+  c->freelist = r;
+  if(++c->nfree > KCACHE)
+    drain(c);
+  release(&c->lock);
 }
 
 // Allocate one 4096-byte page of physical memory.
@@ -83,14 +308,189 @@ char*
 kalloc(void)
 {
   struct run *r;
+  struct kcache *c;
 
-  if(kmem.use_lock)
-    acquire(&kmem.lock);
-  r = kmem.freelist;
+  if(!kmem.use_lock){
+    r = kmem.freelist;
+    if(r){
+      kmem.freelist = r->next;
+      kmem.nfree--;
+    }
+  } else {
+    c = mycache();
+    if(c->freelist == 0)
+      refill(c);
+    r = c->freelist;
+    if(r){
+      c->freelist = r->next;
+      c->nfree--;
+    } else if((r = c->zerolist) != 0){
+      c->zerolist = r->next;
+      c->nzero--;
+    }
+    release(&c->lock);
+    if(r == 0)
+      r = steal();
+    if(r == 0 && (bshrink() == 0 || pcache_shrink() == 0 || splithuge() == 0))
+      return kalloc();
+    if(r)
+      kstat(KS_KALLOC);
+  }
   if(r)
-    kmem.freelist = r->next;
-  if(kmem.use_lock)
-    release(&kmem.lock);
+    PAGEREF(r) = 1;
+  return (char*)r;
+}
+
+// Allocate a page that is filled with zeros, preferring one
+// zeroed ahead of time so the caller doesn't pay for it.
+char*
+kzalloc(void)
+{
+  struct run *r = 0;
+  struct kcache *c;
+
+  if(kmem.use_lock){
+    c = mycache();
+    if((r = c->zerolist) != 0){
+      c->zerolist = r->next;
+      c->nzero--;
+    }
+    release(&c->lock);
+  }
+  if(r){
+    kstat(KS_KALLOC);
+    r->next = 0;
+    PAGEREF(r) = 1;
+    return (char*)r;
+  }
+  if((r = (struct run*)kalloc()) != 0)
+    memset(r, 0, PGSIZE);
   return (char*)r;
 }
 
+// Zero one free page into this CPU's zero pool, unless it is
+// already full.  Called by the scheduler when it finds nothing
+// to run, so the cost comes out of idle time.
+// Return 1 if there was a page to zero.
+int
+kidlezero(void)
+{
+  struct kcache *c;
+  struct run *r;
+
+  if(!kmem.use_lock)
+    return 0;
+  c = mycache();
+  r = 0;
+  if(c->nzero < KZERO){
+    if(c->freelist == 0)
+      refill(c);
+    if((r = c->freelist) != 0){
+      c->freelist = r->next;
+      c->nfree--;
+    }
+  }
+  release(&c->lock);
+  if(r == 0)
+    return 0;
+
+  memset(r, 0, PGSIZE);
+
+  c = mycache();
+  r->next = c->zerolist;
+  c->zerolist = r;
+  c->nzero++;
+  release(&c->lock);
+  return 1;
+}
+
+// Return roughly how many pages are free, for the page
+// reclaimer to keep above its low water mark.  Read without
+// the locks, so it is only a hint.
+int
+kfreepages(void)
+{
+  int i, n;
+
+  n = kmem.nfree;
+  for(i = 0; i < NCPU; i++)
+    n += kmem.cpu[i].nfree + kmem.cpu[i].nzero;
+  return n;
+}
+
+// Add a reference to an allocated page, e.g. when fork
+// maps it copy-on-write into the child.
+void
+kref(char *v)
+{
+  if((uint)v % PGSIZE || v < end || V2P(v) >= PHYSTOP)
+    panic("kref");
+
+  if(xadd(&PAGEREF(v), 1) < 1)
+    panic("kref: free page");
+}
+
+// Return the zero page with a new reference, for the caller to
+// map read-only.
+char*
+kzeropage(void)
+{
+  kref(zeropage);
+  return zeropage;
+}
+
+// Is v the zero page?
+int
+iszeropage(char *v)
+{
+  return v == zeropage;
+}
+
+// Return how many references the page at v has.
+int
+krefcount(char *v)
+{
+  return PAGEREF(v);
+}
+
+// Allocate a physically contiguous, 4MB-aligned frame for a
+// huge-page mapping.  Its reference count is that of its first
+// page, so kref and krefcount work on it, but it must be
+// released with khugefree.  Returns 0 if none is free.
+char*
+khugealloc(void)
+{
+  struct run *r;
+
+  acquire(&kmem.lock);
+  if((r = kmem.hugelist) != 0)
+    kmem.hugelist = r->next;
+  release(&kmem.lock);
+  if(r)
+    PAGEREF(r) = 1;
+  return (char*)r;
+}
+
+// Drop a reference to the huge frame at v, freeing it when
+// the last one goes away.
+void
+khugefree(char *v)
+{
+  struct run *r;
+  int old;
+
+  if((uint)v % HUGEPGSIZE || v < end || V2P(v) >= PHYSTOP)
+    panic("khugefree");
+
+  old = xadd(&PAGEREF(v), -1);
+  if(old < 1)
+    panic("khugefree: ref");
+  if(old > 1)
+    return;
+
+  r = (struct run*)v;
+  acquire(&kmem.lock);
+  r->next = kmem.hugelist;
+  kmem.hugelist = r;
+  release(&kmem.lock);
+}
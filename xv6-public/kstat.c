@@ -0,0 +1,147 @@
+// Print how much the kernel's event counters, and its page fault
+// latency histograms, moved.
+//
+// usage: kstat [command [args...]]
+//
+// With a command, run it and print the events it (and anything
+// else running meanwhile) caused; without, print the events of
+// each second until killed.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "syscall.h"
+#include "kstats.h"
+
+#define SECOND 100  // clock ticks
+
+char *events[NKSTAT] = {
+[KS_FAULTANON]  "anonymous faults",
+[KS_FAULTCOW]   "cow faults",
+[KS_FAULTFILE]  "file faults",
+[KS_FAULTSWAP]  "swap-in faults",
+[KS_KALLOC]     "pages allocated",
+[KS_KFREE]      "pages freed",
+[KS_BHIT]       "buffer cache hits",
+[KS_BMISS]      "buffer cache misses",
+[KS_COMMIT]     "log commits",
+[KS_DISKIO]     "disk requests",
+[KS_SWTCH]      "context switches",
+[KS_SYSCALL]    "system calls",
+};
+
+char *syscalls[NSYSSTAT] = {
+[SYS_fork]        "fork",
+[SYS_exit]        "exit",
+[SYS_wait]        "wait",
+[SYS_pipe]        "pipe",
+[SYS_read]        "read",
+[SYS_kill]        "kill",
+[SYS_exec]        "exec",
+[SYS_fstat]       "fstat",
+[SYS_chdir]       "chdir",
+[SYS_dup]         "dup",
+[SYS_getpid]      "getpid",
+[SYS_sbrk]        "sbrk",
+[SYS_sleep]       "sleep",
+[SYS_uptime]      "uptime",
+[SYS_open]        "open",
+[SYS_write]       "write",
+[SYS_mknod]       "mknod",
+[SYS_unlink]      "unlink",
+[SYS_link]        "link",
+[SYS_mkdir]       "mkdir",
+[SYS_close]       "close",
+[SYS_mmap]        "mmap",
+[SYS_munmap]      "munmap",
+[SYS_msync]       "msync",
+[SYS_mprotect]    "mprotect",
+[SYS_madvise]     "madvise",
+[SYS_splice]      "splice",
+[SYS_setpriority] "setpriority",
+[SYS_usleep]      "usleep",
+[SYS_clone]       "clone",
+[SYS_join]        "join",
+[SYS_spawn]       "spawn",
+[SYS_lockstat]    "lockstat",
+[SYS_ringsetup]   "ringsetup",
+[SYS_ringenter]   "ringenter",
+[SYS_readv]       "readv",
+[SYS_writev]      "writev",
+[SYS_pread]       "pread",
+[SYS_pwrite]      "pwrite",
+[SYS_futex_wait]  "futex_wait",
+[SYS_futex_wake]  "futex_wake",
+[SYS_fsync]       "fsync",
+[SYS_yield]       "yield",
+[SYS_kstats]      "kstats",
+[SYS_profile]     "profile",
+[SYS_profread]    "profread",
+[SYS_trace]       "trace",
+[SYS_traceread]   "traceread",
+[SYS_memstat]     "memstat",
+[SYS_copyfile]    "copyfile",
+};
+
+char *faults[NFAULTLAT] = {
+[FL_ANON]     "anonymous",
+[FL_FILE]     "file",
+[FL_COW]      "cow",
+[FL_SWAP]     "swap-in",
+[FL_GROWSUP]  "growsup",
+};
+
+// Print the counters that moved from a to b.
+void
+delta(struct kstats *a, struct kstats *b)
+{
+  int i, k;
+
+  for(i = 0; i < NKSTAT; i++)
+    if(b->count[i] != a->count[i])
+      printf(1, "%s: %d\n", events[i], b->count[i] - a->count[i]);
+  for(i = 0; i < NSYSSTAT; i++)
+    if(b->syscall[i] != a->syscall[i])
+      printf(1, "  %s: %d\n", syscalls[i] ? syscalls[i] : "?", b->syscall[i] - a->syscall[i]);
+  for(k = 0; k < NFAULTLAT; k++)
+    for(i = 0; i < NLATBUCKET; i++)
+      if(b->faultlat[k][i] != a->faultlat[k][i])
+        printf(1, "%s fault latency >= 2^%d cycles: %d\n", faults[k], i,
+               b->faultlat[k][i] - a->faultlat[k][i]);
+}
+
+struct kstats a, b;
+
+int
+main(int argc, char *argv[])
+{
+  int pid;
+
+  if(kstats(&a) < 0){
+    printf(2, "kstat: kstats failed\n");
+    exit();
+  }
+  if(argc < 2){
+    for(;;){
+      sleep(SECOND);
+      kstats(&b);
+      printf(1, "--\n");
+      delta(&a, &b);
+      a = b;
+    }
+  }
+
+  if((pid = fork()) < 0){
+    printf(2, "kstat: fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    exec(argv[1], argv + 1);
+    printf(2, "kstat: exec %s failed\n", argv[1]);
+    exit();
+  }
+  wait();
+  kstats(&b);
+  delta(&a, &b);
+  exit();
+}
@@ -0,0 +1,74 @@
+//
+// Kernel event counters.
+//
+// Hot paths count events with kstat(), into counters of their
+// CPU's own, on cache lines no other CPU writes, so counting
+// takes no atomic operation and no cache line moves between CPUs.
+// kstats() adds the CPUs' counters up for the kstats system call.
+//
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "x86.h"
+#include "kstats.h"
+
+static struct {
+  struct kstats s;
+} __attribute__((aligned(64))) percpu[NCPU];
+
+// Count one event ev on this CPU.
+void
+kstat(int ev)
+{
+  pushcli();
+  percpu[cpuid()].s.count[ev]++;
+  popcli();
+}
+
+// Count a system call numbered num on this CPU.
+void
+kstatsyscall(int num)
+{
+  struct kstats *s;
+
+  pushcli();
+  s = &percpu[cpuid()].s;
+  s->count[KS_SYSCALL]++;
+  if(num < NSYSSTAT)
+    s->syscall[num]++;
+  popcli();
+}
+
+// Count a page fault of kind k that took cycles on this CPU.
+void
+kstatfault(int k, uint64 cycles)
+{
+  int b;
+
+  b = cycles >> 32 ? 31 : 31 - __builtin_clz((uint)cycles | 1);
+  pushcli();
+  percpu[cpuid()].s.faultlat[k][b]++;
+  popcli();
+}
+
+// Add up the CPUs' counters into ks.
+void
+kstats(struct kstats *ks)
+{
+  int c, i, b;
+
+  memset(ks, 0, sizeof(*ks));
+  for(c = 0; c < ncpu; c++){
+    for(i = 0; i < NKSTAT; i++)
+      ks->count[i] += percpu[c].s.count[i];
+    for(i = 0; i < NSYSSTAT; i++)
+      ks->syscall[i] += percpu[c].s.syscall[i];
+    for(i = 0; i < NFAULTLAT; i++)
+      for(b = 0; b < NLATBUCKET; b++)
+        ks->faultlat[i][b] += percpu[c].s.faultlat[i][b];
+  }
+}
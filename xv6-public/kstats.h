@@ -0,0 +1,39 @@
+// Kernel event counters, as kstats() reports them.  They count
+// from boot and wrap round; take differences.
+
+enum {
+  KS_FAULTANON,  // page faults that gave anonymous or heap memory a page
+  KS_FAULTCOW,   // ... that broke copy-on-write
+  KS_FAULTFILE,  // ... that mapped file pages
+  KS_FAULTSWAP,  // ... that read a page back from swap
+  KS_KALLOC,     // pages allocated
+  KS_KFREE,      // pages freed
+  KS_BHIT,       // buffer cache lookups that found the block
+  KS_BMISS,      // ... that had to recycle a buffer for it
+  KS_COMMIT,     // log groups committed
+  KS_DISKIO,     // block requests sent to the disk
+  KS_SWTCH,      // switches from a process to the scheduler
+  KS_SYSCALL,    // system calls, all told
+  NKSTAT
+};
+
+#define NSYSSTAT 64  // system call numbers counted one by one
+
+// Page fault latency histograms: faultlat[k][b] counts faults of
+// kind k that took from 2^b up to 2^(b+1) rdtsc cycles.
+enum {
+  FL_ANON,     // anonymous or heap memory zero-filled
+  FL_FILE,     // file pages mapped, perhaps read from disk
+  FL_COW,      // copy-on-write broken
+  FL_SWAP,     // page read back from swap
+  FL_GROWSUP,  // MAP_GROWSUP mapping grown into its guard page
+  NFAULTLAT
+};
+
+#define NLATBUCKET 32
+
+struct kstats {
+  uint count[NKSTAT];
+  uint syscall[NSYSSTAT];  // system calls, by number
+  uint faultlat[NFAULTLAT][NLATBUCKET];
+};
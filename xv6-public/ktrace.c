@@ -0,0 +1,170 @@
+// Run a command with the kernel's tracepoints on and print what
+// they recorded meanwhile, in time order, one event a line:
+//
+//   <cycles since the first> <cpu> <pid> <event> <arg>
+//
+// usage: ktrace command [args...]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "mmap.h"
+#include "trace.h"
+
+#define NREC 16384  // records kept; later ones are counted only
+
+char *events[NTREVENT] = {
+[TR_FAULT]       "fault",
+[TR_FAULTDONE]   "faultdone",
+[TR_SYSCALL]     "syscall",
+[TR_SYSRET]      "sysret",
+[TR_SLEEP]       "sleep",
+[TR_WAKEUP]      "wakeup",
+[TR_DISKIO]      "diskio",
+[TR_DISKDONE]    "diskdone",
+[TR_COMMIT]      "commit",
+[TR_COMMITDONE]  "commitdone",
+};
+
+struct tracerec *rec;
+int nrec;
+int notkept;
+
+// Whether the command is done, shared with the process that
+// waits for it.
+volatile int *done;
+
+// Take the records the kernel has so far.
+static void
+drain(void)
+{
+  static struct tracerec s[256];
+  int i, n;
+
+  while((n = traceread(s, sizeof(s)/sizeof(s[0]))) > 0){
+    for(i = 0; i < n; i++){
+      if(nrec < NREC)
+        rec[nrec++] = s[i];
+      else
+        notkept++;
+    }
+  }
+}
+
+// Sort the records by time.  Each CPU's are in order already,
+// but the CPUs' are interleaved in chunks.
+static void
+sort(void)
+{
+  struct tracerec t;
+  int gap, i, j;
+
+  for(gap = nrec / 2; gap > 0; gap /= 2)
+    for(i = gap; i < nrec; i++){
+      t = rec[i];
+      for(j = i; j >= gap && rec[j - gap].tsc > t.tsc; j -= gap)
+        rec[j] = rec[j - gap];
+      rec[j] = t;
+    }
+}
+
+// Print n in decimal, done by hand as there is no libgcc for
+// 64-bit division.
+static void
+putu64(uint64 n)
+{
+  char buf[21];
+  uint64 q, r;
+  int i, k;
+
+  k = sizeof(buf) - 1;
+  buf[k] = 0;
+  do {
+    q = r = 0;
+    for(i = 63; i >= 0; i--){
+      r = r << 1 | (n >> i & 1);
+      if(r >= 10){
+        r -= 10;
+        q |= (uint64)1 << i;
+      }
+    }
+    buf[--k] = '0' + r;
+    n = q;
+  } while(n > 0);
+  printf(1, "%s", buf + k);
+}
+
+static void
+print(void)
+{
+  struct tracerec *r;
+
+  for(r = rec; r < rec + nrec; r++){
+    putu64(r->tsc - rec[0].tsc);
+    printf(1, " %d %d %s ", r->cpu, r->pid,
+           r->ev < NTREVENT ? events[r->ev] : "?");
+    switch(r->ev){
+    case TR_FAULT:
+    case TR_SLEEP:
+      printf(1, "0x%x\n", r->arg);
+      break;
+    case TR_COMMITDONE:
+      printf(1, "\n");
+      break;
+    default:
+      printf(1, "%d\n", r->arg);
+    }
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int pid, lost;
+
+  if(argc < 2){
+    printf(2, "usage: ktrace command [args...]\n");
+    exit();
+  }
+  rec = malloc(NREC * sizeof(*rec));
+  done = mmap(0, 4096, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+  if(rec == 0 || done == (void*)-1){
+    printf(2, "ktrace: out of memory\n");
+    exit();
+  }
+  *done = 0;
+
+  trace(1);
+  if((pid = fork()) < 0){
+    printf(2, "ktrace: fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    if((pid = fork()) == 0){
+      exec(argv[1], argv + 1);
+      printf(2, "ktrace: exec %s failed\n", argv[1]);
+      exit();
+    }
+    if(pid > 0)
+      wait();
+    *done = 1;
+    exit();
+  }
+
+  // Drain the rings while the command runs, so they don't wrap.
+  while(!*done){
+    sleep(1);
+    drain();
+  }
+  lost = trace(0);
+  drain();
+  wait();
+
+  sort();
+  print();
+  if(lost)
+    printf(1, "%d records lost\n", lost);
+  if(notkept)
+    printf(1, "%d records not kept\n", notkept);
+  exit();
+}
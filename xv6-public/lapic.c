@@ -9,6 +9,7 @@
 #include "traps.h"
 #include "mmu.h"
 #include "x86.h"
+#include "proc.h"
 
 // Local APIC registers, divided by 4 for use as uint[] indices.
 #define ID      (0x0020/4)   // ID
@@ -32,6 +33,7 @@
 #define TIMER   (0x0320/4)   // Local Vector Table 0 (TIMER)
   #define X1         0x0000000B   // divide counts by 1
   #define PERIODIC   0x00020000   // Periodic
+  #define ONESHOT    0x00000000   // One-shot
 #define PCINT   (0x0340/4)   // Performance Counter LVT
 #define LINT0   (0x0350/4)   // Local Vector Table 1 (LINT0)
 #define LINT1   (0x0360/4)   // Local Vector Table 2 (LINT1)
@@ -43,6 +45,14 @@
 
 volatile uint *lapic;  // Initialized in mp.c
 
+// Clock rates, measured against the PIT by calibrate().
+static uint tscmhz;      // TSC counts per microsecond
+static uint64 tscboot;   // TSC when measured
+static uint lapictick;   // lapic timer counts per tick (TICKUS)
+
+#define PITHZ    1193182  // PIT input clock
+#define PITLATCH (PITHZ / (1000000 / TICKUS))
+
 //PAGEBREAK!
 static void
 lapicw(int index, int value)
@@ -51,6 +61,69 @@ lapicw(int index, int value)
   lapic[ID];  // wait for write to finish, by reading
 }
 
+// n / d, for d != 0, without libgcc.
+static uint64
+div64(uint64 n, uint d)
+{
+  uint hi, lo, q, r;
+
+  hi = n >> 32;
+  lo = n;
+  r = hi % d;
+  asm("divl %4" : "=a" (q), "=d" (r) : "0" (lo), "1" (r), "rm" (d));
+  return (uint64)(hi / d) << 32 | q;
+}
+
+// Count TSC cycles and lapic timer counts while PIT channel 2
+// counts down one tick.
+static void
+calibrate(void)
+{
+  uint64 t0;
+  uint i;
+
+  lapicw(TDCR, X1);
+  lapicw(TIMER, MASKED | ONESHOT | (T_IRQ0 + IRQ_TIMER));
+  outb(0x61, (inb(0x61) & ~0x02) | 0x01);  // gate on, speaker off
+  outb(0x43, 0xB0);                        // channel 2, mode 0
+  outb(0x42, PITLATCH & 0xFF);
+  outb(0x42, PITLATCH >> 8);
+  lapicw(TICR, 0xFFFFFFFF);
+  t0 = rdtsc();
+  for(i = 0; i < 100000000 && !(inb(0x61) & 0x20); i++)
+    ;
+  tscboot = rdtsc();
+  tscmhz = div64(tscboot - t0, TICKUS);
+  lapictick = 0xFFFFFFFF - lapic[TCCR];
+  lapicw(TICR, 0);
+  if(i == 100000000 || tscmhz == 0 || lapictick == 0){
+    // No PIT: guess at 1GHz, as xv6 always has.
+    tscmhz = 1000;
+    lapictick = 10000000;
+  }
+}
+
+// Microseconds since boot, modulo 2^32.
+uint
+nowus(void)
+{
+  return div64(rdtsc() - tscboot, tscmhz);
+}
+
+// Interrupt once in us microseconds, or never if us is 0.
+void
+lapictimer(uint us)
+{
+  uint64 n;
+
+  if(!lapic)
+    return;
+  n = div64((uint64)us * lapictick, TICKUS);
+  if(us && n == 0)
+    n = 1;
+  lapicw(TICR, n > 0xFFFFFFFF ? 0xFFFFFFFF : n);
+}
+
 void
 lapicinit(void)
 {
@@ -60,13 +133,15 @@ lapicinit(void)
   // Enable local APIC; set spurious interrupt vector.
   lapicw(SVR, ENABLE | (T_IRQ0 + IRQ_SPURIOUS));
 
-  // The timer repeatedly counts down at bus frequency
-  // from lapic[TICR] and then issues an interrupt.
-  // If xv6 cared more about precise timekeeping,
-  // TICR would be calibrated using an external time source.
+  // The timer counts down once at bus frequency from
+  // lapic[TICR] and then issues an interrupt; timerintr()
+  // sets it going again.  The boot CPU measures the
+  // bus frequency first.
+  if(lapictick == 0)
+    calibrate();
   lapicw(TDCR, X1);
-  lapicw(TIMER, PERIODIC | (T_IRQ0 + IRQ_TIMER));
-  lapicw(TICR, 10000000);
+  lapicw(TIMER, ONESHOT | (T_IRQ0 + IRQ_TIMER));
+  lapicw(TICR, lapictick);
 
   // Disable logical interrupt lines.
   lapicw(LINT0, MASKED);
@@ -160,6 +235,95 @@ lapicstartap(uchar apicid, uint addr)
   }
 }
 
+//PAGEBREAK!
+// TLB shootdown.
+//
+// A CPU that changed PTEs of a page table that other CPUs may
+// have loaded (cpu->pgdir, set by switchuvm) sends just those
+// CPUs an IPI and spins until each has dropped its stale TLB
+// entries.  One shootdown is in flight at a time.  A CPU waiting
+// to start one, with interrupts off, services the one in progress
+// itself, so two CPUs shooting at each other cannot deadlock.
+static struct {
+  volatile uint busy;
+  pde_t *pgdir;
+  struct tlbbatch *b;        // on the sender's stack
+  volatile uint targets;     // bit i set: cpus[i] still to flush
+} shootdown;
+
+// Send a fixed-vector IPI to the CPU with local APIC ID apicid.
+void
+lapicipi(uchar apicid, int vector)
+{
+  lapicw(ICRHI, apicid<<24);
+  lapicw(ICRLO, FIXED | ASSERT | vector);
+  while(lapic[ICRLO] & DELIVS)
+    ;
+}
+
+// Carry out the shootdown in progress on this CPU, if it is a
+// target.  Called with interrupts off, from trap() on a
+// T_TLBFLUSH IPI and from tlbshootdown.
+void
+tlbshootintr(void)
+{
+  struct cpu *c = mycpu();
+  uint bit = 1 << (c - cpus);
+  int i;
+
+  if(!(shootdown.targets & bit))
+    return;
+  if(c->pgdir == shootdown.pgdir){
+    if(shootdown.b->n > TLBFLUSHMAX)
+      lcr3(V2P(c->pgdir));
+    else
+      for(i = 0; i < shootdown.b->n; i++)
+        invlpg((void*)shootdown.b->va[i]);
+  }
+  __sync_fetch_and_and(&shootdown.targets, ~bit);
+}
+
+// Drop the pages in batch b of page table pgdir from the TLBs
+// of the other CPUs that have pgdir loaded, and wait until they
+// have.  The caller has already flushed its own TLB, and must not
+// hold a spinlock, since the targets may be spinning for it.
+void
+tlbshootdown(pde_t *pgdir, struct tlbbatch *b)
+{
+  struct cpu *c, *me;
+  uint targets;
+
+  if(ncpu < 2)
+    return;
+  pushcli();
+  me = mycpu();
+  while(xchg(&shootdown.busy, 1) != 0)
+    tlbshootintr();
+
+  // Our PTE stores must be visible before we look at which
+  // CPUs have pgdir loaded; switchuvm sets it before lcr3.
+  __sync_synchronize();
+  targets = 0;
+  for(c = cpus; c < cpus+ncpu; c++)
+    if(c != me && c->pgdir == pgdir)
+      targets |= 1 << (c - cpus);
+
+  if(targets){
+    shootdown.pgdir = pgdir;
+    shootdown.b = b;
+    __sync_synchronize();
+    shootdown.targets = targets;
+    for(c = cpus; c < cpus+ncpu; c++)
+      if(targets & (1 << (c - cpus)))
+        lapicipi(c->apicid, T_IRQ0 + IRQ_TLBFLUSH);
+    while(shootdown.targets)
+      ;
+  }
+
+  xchg(&shootdown.busy, 0);
+  popcli();
+}
+
 #define CMOS_STATA   0x0a
 #define CMOS_STATB   0x0b
 #define CMOS_UIP    (1 << 7)        // RTC update in progress
@@ -227,3 +391,17 @@ cmostime(struct rtcdate *r)
   *r = t1;
   r->year += 2000;
 }
+
+// How much memory the machine has, in bytes, as the BIOS left it
+// in the CMOS: the KB above 1MB, or if there are more than 16MB,
+// the 64KB blocks above 16MB.
+uint
+cmosmem(void)
+{
+  uint n;
+
+  if((n = cmos_read(0x34) | cmos_read(0x35) << 8) != 0)
+    return 16*1024*1024 + (n << 16);
+  n = cmos_read(0x30) | cmos_read(0x31) << 8;
+  return EXTMEM + n*1024;
+}
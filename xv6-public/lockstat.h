@@ -0,0 +1,9 @@
+// Contention statistics for the spin locks of one name,
+// as lockstat() reports them.
+struct lockstat {
+  char name[16];
+  uint acquires;     // Times acquired
+  uint contends;     // Acquires that had to wait
+  uint spins;        // Turns of the wait loop, all told
+  uint maxhold;      // Longest held, in rdtsc cycles
+};
@@ -5,6 +5,8 @@
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "kstats.h"
+#include "trace.h"
 
 // Simple logging that allows concurrent FS system calls.
 //
@@ -17,193 +19,481 @@
 // A system call should call begin_op()/end_op() to mark
 // its start and end. Usually begin_op() just increments
 // the count of in-progress FS system calls and returns.
-// But if it thinks the log is close to running out, it
-// sleeps until the last outstanding end_op() commits.
+// It reserves log space for MAXOPBLOCKS blocks; an operation that
+// may write more, such as a large write(), reserves what it needs
+// with begin_opn()/end_opn() instead.
 //
-// The log is a physical re-do log containing disk blocks.
+// Commits are grouped: end_op() doesn't commit, so the system
+// calls of many processes share one commit.  The "logd" kernel
+// thread commits once a commit is wanted: when the log is close
+// to running out (begin_op() then sleeps until it is done), when
+// the open group is COMMITTICKS old, or when log_force() asks.
+// Wanting a commit holds off new system calls until the active
+// ones have finished.
+//
+// The log is a physical re-do log containing disk blocks, kept
+// as a circular buffer so that commits don't wait for installs.
 // The on-disk log format:
-//   header block, containing block #s for block A, B, C, ...
-//   block A
-//   block B
-//   block C
-//   ...
-// Log appends are synchronous.
-
-// Contents of the header block, used for both the on-disk header block
-// and to keep track in memory of logged block# before commit.
+//   log superblock: the live part of the log runs from tail to head
+//   circular part, each committed group in turn:
+//     descriptor block, containing block #s for block A, B, C, ...
+//     block A
+//     block B
+//     block C
+//     ...
+// A commit writes the group's descriptor and blocks after head,
+// then the log superblock with head moved past them; that last
+// write is the commit point.  The "install" kernel thread then
+// copies committed groups to their home locations in the
+// background and moves tail past them, freeing their log space.
+//
+// Until it is installed, a logged block stays pinned in the cache
+// with B_DIRTY and remembers its group in b->logseq.  If a later
+// group logged it since, the installer leaves it to that group if
+// it has committed, and otherwise writes the copy in the log, as
+// the cache holds data not committed yet.
+//
+// File data is not logged but ordered (see log_data): a commit
+// writes the group's data blocks home before its log superblock,
+// so metadata on disk never points at data that isn't there.
+// A crash may leave a file's overwritten blocks with new data
+// under old metadata, but never with garbage.
+
+// Contents of a descriptor block, used for both the on-disk
+// descriptors and to keep track in memory of logged block# before
+// commit.
 struct logheader {
   int n;
   int block[LOGSIZE];
 };
 
+// Contents of the log superblock.
+struct logsuper {
+  uint tail;  // first descriptor not installed
+  uint head;  // past the last committed group
+};
+
 struct log {
   struct spinlock lock;
   int start;
   int size;
   int outstanding; // how many FS sys calls are executing.
+  int reserved;    // log blocks they may still write between them
   int committing;  // in commit(), please wait.
+  int wanted;      // commit once outstanding drops to 0
+  uint opened;     // ticks when the open group logged its first block
+  uint ncommit;    // commits done so far
   int dev;
+  uint seq;        // the open group; groups before it have committed
+  uint tailseq;    // the oldest group not installed
+  uint tail;       // its position in the circular part
+  uint head;       // where the open group will go
+  int used;        // blocks of the circular part holding groups
   struct logheader lh;
+  int nordered;    // file data blocks the open group writes home
+  int ordered[LOGSIZE];
 };
 struct log log;
 
+// Private buffers the installer writes home blocks from.
+static struct buf bounce[LOGSIZE];
+static uchar bouncedata[LOGSIZE][BSIZE];
+
 static void recover_from_log(void);
 static void commit();
+static void logd(void);
+static void installer(void);
+static void want_commit(void);
 
 void
 initlog(int dev)
 {
-  if (sizeof(struct logheader) >= BSIZE)
+  int i;
+
+  if (sizeof(struct logheader) > BSIZE)
     panic("initlog: too big logheader");
 
   struct superblock sb;
   initlock(&log.lock, "log");
+  for (i = 0; i < LOGSIZE; i++) {
+    initsleeplock(&bounce[i].lock, "bounce");
+    bounce[i].data = bouncedata[i];
+  }
   readsb(dev, &sb);
   log.start = sb.logstart;
   log.size = sb.nlog;
   log.dev = dev;
+  // The superblock, descriptor and a whole op must fit.
+  if (log.size < MAXOPBLOCKS + 3)
+    panic("initlog: log too small");
   recover_from_log();
+  if(kthread("logd", logd) == 0 || kthread("install", installer) == 0)
+    panic("initlog");
 }
 
-// Copy committed blocks from log to their home location
-static void
-install_trans(void)
+// Disk block of position i of the circular part.
+static int
+logblock(uint i)
 {
-  int tail;
-
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *lbuf = bread(log.dev, log.start+tail+1); // read log block
-    struct buf *dbuf = bread(log.dev, log.lh.block[tail]); // read dst
-    memmove(dbuf->data, lbuf->data, BSIZE);  // copy block to dst
-    bwrite(dbuf);  // write dst to disk
-    brelse(lbuf);
-    brelse(dbuf);
-  }
+  return log.start + 1 + i % (log.size - 1);
 }
 
-// Read the log header from disk into the in-memory log header
+// Write the log superblock.  Commits and the installer both write
+// it, each with the other's latest tail or head, which are on disk
+// already by the time they are set.
 static void
-read_head(void)
+write_super(void)
 {
   struct buf *buf = bread(log.dev, log.start);
-  struct logheader *lh = (struct logheader *) (buf->data);
-  int i;
-  log.lh.n = lh->n;
-  for (i = 0; i < log.lh.n; i++) {
-    log.lh.block[i] = lh->block[i];
-  }
+  struct logsuper *ls = (struct logsuper *) (buf->data);
+
+  acquire(&log.lock);
+  ls->tail = log.tail;
+  ls->head = log.head;
+  release(&log.lock);
+  bwrite(buf);
   brelse(buf);
 }
 
-// Write in-memory log header to disk.
-// This is the true point at which the
-// current transaction commits.
+// Copy the group at position pos, whose sequence number is seq,
+// to its home locations and return the log blocks it took up.
+// Unless recovering, then move the tail past the group and unpin
+// the cache blocks it wrote.
+static int
+install_trans(uint pos, uint seq, int recovering)
+{
+  struct logheader lh;
+  struct buf *b, *lbuf;
+  int i, fromlog, later;
+
+  b = bread(log.dev, logblock(pos));
+  memmove(&lh, b->data, sizeof(lh));
+  brelse(b);
+  if (lh.n <= 0 || lh.n > LOGSIZE)
+    panic("install_trans");
+
+  for (i = 0; i < lh.n; i++) {
+    bounce[i].blockno = 0;
+    fromlog = recovering;
+    if (!recovering) {
+      b = bread(log.dev, lh.block[i]);
+      if (b->logseq > seq) {
+        acquire(&log.lock);
+        later = b->logseq < log.seq;
+        release(&log.lock);
+        if (!later)
+          fromlog = 1;  // the cache holds uncommitted changes
+      } else {
+        memmove(bounce[i].data, b->data, BSIZE);
+        later = 0;
+      }
+      brelse(b);
+      if (later)
+        continue;  // the later group will install it
+    }
+    if (fromlog) {
+      lbuf = bread(log.dev, logblock(pos+1+i));
+      memmove(bounce[i].data, lbuf->data, BSIZE);
+      brelse(lbuf);
+    }
+    bounce[i].dev = log.dev;
+    bounce[i].blockno = lh.block[i];
+  }
+
+  // Start all the writes before waiting for any, so the disk
+  // can take neighbouring blocks in one go.
+  for (i = 0; i < lh.n; i++) {
+    if (bounce[i].blockno == 0)
+      continue;
+    acquiresleep(&bounce[i].lock);
+    bounce[i].flags = B_DIRTY;
+    iderwstart(&bounce[i]);
+  }
+  for (i = 0; i < lh.n; i++) {
+    if (bounce[i].blockno == 0)
+      continue;
+    iderwwait(&bounce[i]);
+    releasesleep(&bounce[i].lock);
+  }
+  if (recovering)
+    return 1 + lh.n;
+
+  // Until the tail is past the group on disk, recovery would
+  // install it again, so its blocks stay B_LOGGED: log_data()
+  // mustn't write them in place.
+  acquire(&log.lock);
+  log.tail = (pos + 1 + lh.n) % (log.size - 1);
+  log.tailseq = seq + 1;
+  release(&log.lock);
+  write_super();
+  for (i = 0; i < lh.n; i++) {
+    if (bounce[i].blockno == 0)
+      continue;
+    b = bread(log.dev, lh.block[i]);
+    if (b->logseq <= seq)
+      b->flags &= ~(B_DIRTY|B_LOGGED);  // home copy is up to date
+    brelse(b);
+  }
+  return 1 + lh.n;
+}
+
 static void
-write_head(void)
+recover_from_log(void)
 {
   struct buf *buf = bread(log.dev, log.start);
-  struct logheader *hb = (struct logheader *) (buf->data);
-  int i;
-  hb->n = log.lh.n;
-  for (i = 0; i < log.lh.n; i++) {
-    hb->block[i] = log.lh.block[i];
-  }
-  bwrite(buf);
+  struct logsuper *ls = (struct logsuper *) (buf->data);
+  uint pos;
+
+  log.tail = ls->tail;
+  log.head = ls->head;
   brelse(buf);
+  if (log.tail >= log.size - 1 || log.head >= log.size - 1)
+    panic("recover_from_log");
+  // if committed, copy from log to disk
+  pos = log.tail;
+  while (pos != log.head)
+    pos = (pos + install_trans(pos, 0, 1)) % (log.size - 1);
+  log.tail = log.head;
+  log.seq = log.tailseq = 1;
+  write_super(); // clear the log
 }
 
+// The install thread: copy committed groups home, oldest first,
+// and then give back their log space.
 static void
-recover_from_log(void)
+installer(void)
 {
-  read_head();
-  install_trans(); // if committed, copy from log to disk
-  log.lh.n = 0;
-  write_head(); // clear the log
+  uint seq, pos;
+  int len;
+
+  acquire(&log.lock);
+  for(;;){
+    while(log.tailseq == log.seq)
+      sleep(&log.tailseq, &log.lock);
+    seq = log.tailseq;
+    pos = log.tail;
+    release(&log.lock);
+
+    len = install_trans(pos, seq, 0);
+
+    // The tail is past it on disk: commits may reuse the space.
+    acquire(&log.lock);
+    log.used -= len;
+    wakeup(&log);
+  }
 }
 
 // called at the start of each FS system call.
 void
 begin_op(void)
 {
+  begin_opn(MAXOPBLOCKS);
+}
+
+// Start an operation that may write up to n blocks, at most
+// log_maxop().  Finish it with end_opn(n).
+void
+begin_opn(int n)
+{
+  if(n > log_maxop())
+    panic("begin_opn");
   acquire(&log.lock);
   while(1){
-    if(log.committing){
+    if(log.committing || log.wanted){
       sleep(&log, &log.lock);
-    } else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > LOGSIZE){
-      // this op might exhaust log space; wait for commit.
+    } else if(log.lh.n + log.nordered + log.reserved + n > LOGSIZE ||
+              log.used + 1 + log.lh.n + log.reserved + n > log.size - 1){
+      // this op might exhaust log space; wait for the active ops
+      // to finish, or for a commit and install if what they logged
+      // is in the way.
+      if(log.lh.n + log.nordered > 0 && (log.lh.n + log.nordered + n > LOGSIZE ||
+         log.used + 1 + log.lh.n + n > log.size - 1))
+        want_commit();
       sleep(&log, &log.lock);
     } else {
       log.outstanding += 1;
+      log.reserved += n;
       release(&log.lock);
       break;
     }
   }
 }
 
+// The most blocks one operation may write: what a group can
+// hold, and what fits in the log behind a descriptor.
+int
+log_maxop(void)
+{
+  return LOGSIZE < log.size - 2 ? LOGSIZE : log.size - 2;
+}
+
 // called at the end of each FS system call.
-// commits if this was the last outstanding operation.
 void
 end_op(void)
 {
-  int do_commit = 0;
+  end_opn(MAXOPBLOCKS);
+}
 
+// Finish an operation started with begin_opn(n).
+// lets logd commit if this was the last outstanding
+// operation and a commit is wanted.
+void
+end_opn(int n)
+{
   acquire(&log.lock);
   log.outstanding -= 1;
+  log.reserved -= n;
   if(log.committing)
     panic("log.committing");
-  if(log.outstanding == 0){
-    do_commit = 1;
-    log.committing = 1;
-  } else {
-    // begin_op() may be waiting for log space,
-    // and decrementing log.outstanding has decreased
-    // the amount of reserved space.
-    wakeup(&log);
-  }
+  if(log.outstanding == 0 && log.wanted)
+    wakeup(&log.wanted);
+  // begin_op() may be waiting for log space,
+  // and decrementing log.outstanding has decreased
+  // the amount of reserved space.
+  wakeup(&log);
   release(&log.lock);
+}
 
-  if(do_commit){
+// Ask logd to commit the open group.
+// Caller holds log.lock.
+static void
+want_commit(void)
+{
+  log.wanted = 1;
+  if(log.outstanding == 0)
+    wakeup(&log.wanted);
+}
+
+// The commit thread.
+static void
+logd(void)
+{
+  acquire(&log.lock);
+  for(;;){
+    while(!log.wanted || log.outstanding > 0)
+      sleep(&log.wanted, &log.lock);
+    log.wanted = 0;
+    log.committing = 1;
     // call commit w/o holding locks, since not allowed
     // to sleep with locks.
+    release(&log.lock);
     commit();
     acquire(&log.lock);
     log.committing = 0;
+    log.ncommit++;
     wakeup(&log);
-    release(&log.lock);
   }
 }
 
-// Copy modified blocks from cache to log.
+// Called by the timer: commit the open group once it is
+// COMMITTICKS old.
+void
+logtick(void)
+{
+  if(log.size == 0)
+    return;  // no log yet
+  acquire(&log.lock);
+  if(log.lh.n + log.nordered > 0 && !log.wanted && !log.committing &&
+     ticks - log.opened >= COMMITTICKS)
+    want_commit();
+  release(&log.lock);
+}
+
+// Commit the system calls that have finished and wait until
+// they are on disk.
+void
+log_force(void)
+{
+  uint n;
+
+  acquire(&log.lock);
+  // New system calls don't start during a commit, so any that
+  // have finished are in the group being committed, if any, or
+  // else in the open one.
+  if(log.committing || log.lh.n + log.nordered > 0){
+    n = log.ncommit + 1;
+    if(!log.committing)
+      want_commit();
+    while(log.ncommit < n)
+      sleep(&log, &log.lock);
+  }
+  release(&log.lock);
+}
+
+// Copy modified blocks from cache to the log after its head,
+// behind the group's descriptor.
 static void
 write_log(void)
 {
   int tail;
 
+  struct buf *to[LOGSIZE+1];
+
+  // The log blocks are consecutive, so this is one disk command
+  // unless the group wraps round.
+  to[0] = bread(log.dev, logblock(log.head)); // descriptor
+  memmove(to[0]->data, &log.lh, sizeof(log.lh));
+  bwritestart(to[0]);
   for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *to = bread(log.dev, log.start+tail+1); // log block
+    to[tail+1] = bread(log.dev, logblock(log.head+tail+1)); // log block
     struct buf *from = bread(log.dev, log.lh.block[tail]); // cache block
-    memmove(to->data, from->data, BSIZE);
-    bwrite(to);  // write the log
+    memmove(to[tail+1]->data, from->data, BSIZE);
+    bwritestart(to[tail+1]);  // write the log
     brelse(from);
-    brelse(to);
+  }
+  for (tail = 0; tail <= log.lh.n; tail++) {
+    bwritewait(to[tail]);
+    brelse(to[tail]);
   }
 }
 
 static void
 commit()
 {
+  struct buf *od[LOGSIZE];
+  int i, n;
+
+  kstat(KS_COMMIT);
+  if(tracing)
+    tracepoint(TR_COMMIT, log.lh.n);
+  // The group's file data goes home first, since once it
+  // commits, its inodes point at the data.
+  for (i = 0; i < log.nordered; i++) {
+    od[i] = bread(log.dev, log.ordered[i]);
+    od[i]->flags &= ~B_ORDERED;
+    bwritestart(od[i]);
+  }
+  if (log.lh.n > 0)
+    write_log();     // Write descriptor and modified blocks to log
+  for (i = 0; i < log.nordered; i++) {
+    bwritewait(od[i]);
+    brelse(od[i]);
+  }
+  acquire(&log.lock);
+  log.nordered = 0;
+  release(&log.lock);
+
   if (log.lh.n > 0) {
-    write_log();     // Write modified blocks from cache to log
-    write_head();    // Write header to disk -- the real commit
-    install_trans(); // Now install writes to home locations
+    n = 1 + log.lh.n;
+    acquire(&log.lock);
+    log.head = (log.head + n) % (log.size - 1);
+    release(&log.lock);
+    write_super();   // Write head to disk -- the real commit
+    acquire(&log.lock);
+    log.used += n;
     log.lh.n = 0;
-    write_head();    // Erase the transaction from the log
+    log.seq++;
+    wakeup(&log.tailseq);  // the installer takes it from here
+    release(&log.lock);
   }
+  if(tracing)
+    tracepoint(TR_COMMITDONE, 0);
 }
 
 // Caller has modified b->data and is done with the buffer.
 // Record the block number and pin in the cache with B_DIRTY.
-// commit()/write_log() will do the disk write.
+// commit()/write_log() will do the log write, and the installer
+// the write home.
 //
 // log_write() replaces bwrite(); a typical use is:
 //   bp = bread(...)
@@ -215,20 +505,63 @@ log_write(struct buf *b)
 {
   int i;
 
-  if (log.lh.n >= LOGSIZE || log.lh.n >= log.size - 1)
-    panic("too big a transaction");
   if (log.outstanding < 1)
     panic("log_write outside of trans");
 
   acquire(&log.lock);
+  if (b->flags & B_ORDERED) {
+    // Was file data, but now the log has to keep it.
+    for (i = 0; log.ordered[i] != b->blockno; i++)
+      ;
+    log.ordered[i] = log.ordered[--log.nordered];
+    b->flags &= ~B_ORDERED;
+  }
   for (i = 0; i < log.lh.n; i++) {
     if (log.lh.block[i] == b->blockno)   // log absorbtion
       break;
   }
-  log.lh.block[i] = b->blockno;
-  if (i == log.lh.n)
+  if (i == log.lh.n){
+    if (log.lh.n + log.nordered >= LOGSIZE || log.lh.n >= log.size - 2)
+      panic("too big a transaction");
+    if (log.lh.n + log.nordered == 0)
+      log.opened = ticks;
+    log.lh.block[i] = b->blockno;
     log.lh.n++;
-  b->flags |= B_DIRTY; // prevent eviction
+  }
+  b->logseq = log.seq;
+  b->flags |= B_DIRTY|B_LOGGED; // prevent eviction until installed
   release(&log.lock);
 }
 
+// Like log_write(), but for a file data block, which doesn't go
+// through the log: commit() writes it home before the group's
+// metadata, so the data is written once.  A block the log still
+// has a copy of goes through the log all the same, since else
+// installing or recovering that copy could overwrite the data.
+void
+log_data(struct buf *b)
+{
+  int i;
+
+  if (b->flags & B_LOGGED) {
+    log_write(b);
+    return;
+  }
+  if (log.outstanding < 1)
+    panic("log_data outside of trans");
+
+  acquire(&log.lock);
+  for (i = 0; i < log.nordered; i++) {
+    if (log.ordered[i] == b->blockno)
+      break;
+  }
+  if (i == log.nordered){
+    if (log.lh.n + log.nordered >= LOGSIZE)
+      panic("too big a transaction");
+    if (log.lh.n + log.nordered == 0)
+      log.opened = ticks;
+    log.ordered[log.nordered++] = b->blockno;
+  }
+  b->flags |= B_DIRTY|B_ORDERED; // prevent eviction until written
+  release(&log.lock);
+}
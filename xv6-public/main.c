@@ -11,6 +11,8 @@ static void mpmain(void)  __attribute__((noreturn));
 extern pde_t *kpgdir;
 extern char end[]; // first address after kernel loaded from ELF file
 
+static volatile uint apentered; // the AP startothers started is off its boot parameters
+
 // Bootstrap processor starts running C code here.
 // Allocate a real stack and switch to it, first
 // doing some setup required for memory allocator to work.
@@ -28,12 +30,21 @@ main(void)
   uartinit();      // serial port
   pinit();         // process table
   tvinit();        // trap vectors
+  timerinit();     // sleep deadlines
+  profinit();      // sampling profiler
+  traceinit();     // tracepoints
   binit();         // buffer cache
+  dcacheinit();    // directory name cache
   fileinit();      // file table
+  pipeinit();      // pipe object cache
+  futexinit();     // futex wait buckets
+  vmainit();       // mmap region table
   ideinit();       // disk 
   startothers();   // start other processors
-  kinit2(P2V(4*1024*1024), P2V(PHYSTOP)); // must come after startothers()
+  kinit2(P2V(4*1024*1024), P2V(physend)); // must come after startothers()
   userinit();      // first user process
+  writebackinit(); // mmap flusher thread
+  pcacheinit();    // file page cache and its prefetch thread
   mpmain();        // finish this processor's setup
 }
 
@@ -41,6 +52,7 @@ main(void)
 static void
 mpenter(void)
 {
+  xchg(&apentered, 1);
   switchkvm();
   seginit();
   lapicinit();
@@ -60,6 +72,10 @@ mpmain(void)
 pde_t entrypgdir[];  // For entry.S
 
 // Start the non-boot (AP) processors.
+// They share the boot parameters below the entry code, so they
+// are started one at a time, but each is only waited for until it
+// has taken them and reached mpenter: the rest of its setup
+// overlaps with the next one's start and with the rest of main.
 static void
 startothers(void)
 {
@@ -86,10 +102,11 @@ startothers(void)
     *(void(**)(void))(code-8) = mpenter;
     *(int**)(code-12) = (void *) V2P(entrypgdir);
 
+    apentered = 0;
     lapicstartap(c->apicid, V2P(code));
 
-    // wait for cpu to finish mpmain()
-    while(c->started == 0)
+    // wait for cpu to be done with the parameters
+    while(apentered == 0)
       ;
   }
 }
@@ -1,13 +1,18 @@
 // Memory layout
 
 #define EXTMEM  0x100000            // Start of extended memory
-#define PHYSTOP 0xE000000           // Top physical memory
+#define PHYSTOP 0x40000000          // Most physical memory the kernel maps (see physend)
 #define DEVSPACE 0xFE000000         // Other devices are at high addresses
 
 // Key addresses for address space layout (see kmap in vm.c for layout)
 #define KERNBASE 0x80000000         // First kernel virtual address
 #define KERNLINK (KERNBASE+EXTMEM)  // Address where kernel is linked
 
+// User mmap regions live in [MMAP_AREA_START, MMAP_AREA_END); the
+// image, stack and heap below it.
+#define MMAP_AREA_START 0x60000000
+#define MMAP_AREA_END 0x80000000
+
 #define V2P(a) (((uint) (a)) - KERNBASE)
 #define P2V(a) ((void *)(((char *) (a)) + KERNBASE))
 
@@ -0,0 +1,14 @@
+// The memory use of one process, as memstat() reports it.
+// Resident pages are counted by what is in its page table when
+// asked; the zero page, which read faults on fresh memory map,
+// counts as nothing.
+struct memstat {
+  int pid;
+  char name[16];
+  uint heap;     // Bytes of heap and below (sz)
+  uint mapped;   // Bytes of mmap mappings, the program's image too
+  uint anon;     // Resident pages of private or anonymous memory
+  uint file;     // Resident pages of the page cache, mapped
+  uint cow;      // Anonymous pages shared copy-on-write with others
+  uint swapped;  // Pages out in swap
+};
@@ -18,17 +18,25 @@
 #define NINODES 200
 
 // Disk layout:
-// [ boot block | sb block | log | inode blocks | free bit map | data blocks ]
-
-int nbitmap = FSSIZE/(BSIZE*8) + 1;
-int ninodeblocks = NINODES / IPB + 1;
-int nlog = LOGSIZE;
+// [ boot block | sb block | log | inode blocks | free bit map | data blocks | swap ]
+//
+// The file system is built in memory and written out in one go.
+// Each file's blocks are allocated together, its indirect blocks
+// first, so that its data lies in one run; the root directory,
+// whose entries come in between the files, is written last.
+
+int fssize = FSSIZE;
+int ninodes = NINODES;
+int nbitmap;
+int ninodeblocks;
+int nlog = NLOG;
+int nswap = NSWAP;  // pages of swap after the file system
 int nmeta;    // Number of meta blocks (boot, sb, nlog, inode, bitmap)
 int nblocks;  // Number of data blocks
 
 int fsfd;
+char *img;  // the file system's fssize blocks
 struct superblock sb;
-char zeroes[BSIZE];
 uint freeinode = 1;
 uint freeblock;
 
@@ -40,6 +48,7 @@ void rinode(uint inum, struct dinode *ip);
 void rsect(uint sec, void *buf);
 uint ialloc(ushort type);
 void iappend(uint inum, void *p, int n);
+char *readfile(char *path, int *n);
 
 // convert to intel byte order
 ushort
@@ -67,19 +76,54 @@ xint(uint x)
 int
 main(int argc, char *argv[])
 {
-  int i, cc, fd;
+  int i, n, nfiles;
   uint rootino, inum, off;
-  struct dirent de;
-  char buf[BSIZE];
+  struct dirent de, *files;
+  char buf[BSIZE], *data;
   struct dinode din;
+  long long done, total;
+  ssize_t cc;
 
 
   static_assert(sizeof(int) == 4, "Integers must be 4 bytes!");
 
+  for(;;){
+    if(argc > 2 && strcmp(argv[1], "-b") == 0)
+      fssize = atoi(argv[2]);
+    else if(argc > 2 && strcmp(argv[1], "-i") == 0)
+      ninodes = atoi(argv[2]);
+    else if(argc > 2 && strcmp(argv[1], "-l") == 0)
+      nlog = atoi(argv[2]);
+    else if(argc > 2 && strcmp(argv[1], "-s") == 0)
+      nswap = atoi(argv[2]);
+    else
+      break;
+    argc -= 2;
+    argv += 2;
+  }
   if(argc < 2){
-    fprintf(stderr, "Usage: mkfs fs.img files...\n");
+    fprintf(stderr, "Usage: mkfs [-b blocks] [-i inodes] [-l logblocks] [-s swappages] fs.img files...\n");
+    exit(1);
+  }
+  // dirents hold 16-bit inode numbers
+  if(ninodes < argc + 2 || ninodes > 0xFFFF){
+    fprintf(stderr, "mkfs: inodes must be %d to %d\n", argc + 2, 0xFFFF);
+    exit(1);
+  }
+  if(fssize < 64 || (long long)fssize + (long long)nswap * BPP >= 1 << 28){
+    fprintf(stderr, "mkfs: file system and swap must be 64 to %d blocks\n", (1 << 28) - 1);
+    exit(1);
+  }
+  if(nlog < MAXOPBLOCKS+3 || nlog > fssize/2){
+    fprintf(stderr, "mkfs: log must be %d to %d blocks\n", MAXOPBLOCKS+3, fssize/2);
+    exit(1);
+  }
+  if(nswap < 0 || nswap > NSWAPMAX){
+    fprintf(stderr, "mkfs: swap must be 0 to %d pages\n", NSWAPMAX);
     exit(1);
   }
+  nbitmap = fssize/BPB + 1;
+  ninodeblocks = ninodes / IPB + 1;
 
   assert((BSIZE % sizeof(struct dinode)) == 0);
   assert((BSIZE % sizeof(struct dirent)) == 0);
@@ -92,23 +136,31 @@ main(int argc, char *argv[])
 
   // 1 fs block = 1 disk sector
   nmeta = 2 + nlog + ninodeblocks + nbitmap;
-  nblocks = FSSIZE - nmeta;
+  nblocks = fssize - nmeta;
+  if(nblocks <= 0){
+    fprintf(stderr, "mkfs: no room for data in %d blocks\n", fssize);
+    exit(1);
+  }
 
-  sb.size = xint(FSSIZE);
+  sb.size = xint(fssize);
   sb.nblocks = xint(nblocks);
-  sb.ninodes = xint(NINODES);
+  sb.ninodes = xint(ninodes);
   sb.nlog = xint(nlog);
   sb.logstart = xint(2);
   sb.inodestart = xint(2+nlog);
   sb.bmapstart = xint(2+nlog+ninodeblocks);
+  sb.swapstart = xint(fssize);
+  sb.nswap = xint(nswap);
 
-  printf("nmeta %d (boot, super, log blocks %u inode blocks %u, bitmap blocks %u) blocks %d total %d\n",
-         nmeta, nlog, ninodeblocks, nbitmap, nblocks, FSSIZE);
+  printf("nmeta %d (boot, super, log blocks %u inode blocks %u, bitmap blocks %u) blocks %d total %d swap pages %d\n",
+         nmeta, nlog, ninodeblocks, nbitmap, nblocks, fssize, nswap);
 
   freeblock = nmeta;     // the first free block that we can allocate
 
-  for(i = 0; i < FSSIZE; i++)
-    wsect(i, zeroes);
+  if((img = calloc(fssize, BSIZE)) == 0){
+    perror("calloc");
+    exit(1);
+  }
 
   memset(buf, 0, sizeof(buf));
   memmove(buf, &sb, sizeof(sb));
@@ -127,13 +179,30 @@ main(int argc, char *argv[])
   strcpy(de.name, "..");
   iappend(rootino, &de, sizeof(de));
 
+  // An empty /tmp, for the kernel to mount tmpfs on.
+  inum = ialloc(T_DIR);
+
+  bzero(&de, sizeof(de));
+  de.inum = xshort(inum);
+  strcpy(de.name, "tmp");
+  iappend(rootino, &de, sizeof(de));
+
+  bzero(&de, sizeof(de));
+  de.inum = xshort(inum);
+  strcpy(de.name, ".");
+  iappend(inum, &de, sizeof(de));
+
+  bzero(&de, sizeof(de));
+  de.inum = xshort(rootino);
+  strcpy(de.name, "..");
+  iappend(inum, &de, sizeof(de));
+
+  files = calloc(argc, sizeof(struct dirent));
+  nfiles = 0;
   for(i = 2; i < argc; i++){
     assert(index(argv[i], '/') == 0);
 
-    if((fd = open(argv[i], 0)) < 0){
-      perror(argv[i]);
-      exit(1);
-    }
+    data = readfile(argv[i], &n);
 
     // Skip leading _ in name when writing to file system.
     // The binaries are named _rm, _cat, etc. to keep the
@@ -147,13 +216,12 @@ main(int argc, char *argv[])
     bzero(&de, sizeof(de));
     de.inum = xshort(inum);
     strncpy(de.name, argv[i], DIRSIZ);
-    iappend(rootino, &de, sizeof(de));
+    files[nfiles++] = de;
 
-    while((cc = read(fd, buf, sizeof(buf))) > 0)
-      iappend(inum, buf, cc);
-
-    close(fd);
+    iappend(inum, data, n);
+    free(data);
   }
+  iappend(rootino, files, nfiles * sizeof(struct dirent));
 
   // fix size of root inode dir
   rinode(rootino, &din);
@@ -164,20 +232,57 @@ main(int argc, char *argv[])
 
   balloc(freeblock);
 
+  // The swap area needn't be zero; just make the image big enough.
+  total = (long long)fssize * BSIZE;
+  for(done = 0; done < total; done += cc){
+    if((cc = write(fsfd, img + done, total - done < (1 << 20) ? total - done : (1 << 20))) <= 0){
+      perror("write");
+      exit(1);
+    }
+  }
+  if(ftruncate(fsfd, (off_t)(fssize + (off_t)nswap * BPP) * BSIZE) < 0){
+    perror("ftruncate");
+    exit(1);
+  }
+
   exit(0);
 }
 
-void
-wsect(uint sec, void *buf)
+// Read all of the file at path into memory; set *n to its size.
+char*
+readfile(char *path, int *n)
 {
-  if(lseek(fsfd, sec * BSIZE, 0) != sec * BSIZE){
-    perror("lseek");
+  char *data;
+  off_t size;
+  ssize_t cc;
+  int fd;
+
+  if((fd = open(path, 0)) < 0 || (size = lseek(fd, 0, SEEK_END)) < 0 ||
+     lseek(fd, 0, SEEK_SET) != 0){
+    perror(path);
+    exit(1);
+  }
+  if((data = malloc(size + 1)) == 0){
+    perror("malloc");
     exit(1);
   }
-  if(write(fsfd, buf, BSIZE) != BSIZE){
-    perror("write");
+  for(*n = 0; *n < size; *n += cc)
+    if((cc = read(fd, data + *n, size - *n)) <= 0){
+      perror(path);
+      exit(1);
+    }
+  close(fd);
+  return data;
+}
+
+void
+wsect(uint sec, void *buf)
+{
+  if(sec >= fssize){
+    fprintf(stderr, "mkfs: file system full\n");
     exit(1);
   }
+  memmove(img + (long long)sec * BSIZE, buf, BSIZE);
 }
 
 void
@@ -210,14 +315,11 @@ rinode(uint inum, struct dinode *ip)
 void
 rsect(uint sec, void *buf)
 {
-  if(lseek(fsfd, sec * BSIZE, 0) != sec * BSIZE){
-    perror("lseek");
-    exit(1);
-  }
-  if(read(fsfd, buf, BSIZE) != BSIZE){
-    perror("read");
+  if(sec >= fssize){
+    fprintf(stderr, "mkfs: file system full\n");
     exit(1);
   }
+  memmove(buf, img + (long long)sec * BSIZE, BSIZE);
 }
 
 uint
@@ -226,6 +328,10 @@ ialloc(ushort type)
   uint inum = freeinode++;
   struct dinode din;
 
+  if(inum >= ninodes){
+    fprintf(stderr, "mkfs: out of inodes\n");
+    exit(1);
+  }
   bzero(&din, sizeof(din));
   din.type = xshort(type);
   din.nlink = xshort(1);
@@ -238,20 +344,63 @@ void
 balloc(int used)
 {
   uchar buf[BSIZE];
-  int i;
+  int b, i;
 
   printf("balloc: first %d blocks have been allocated\n", used);
-  assert(used < BSIZE*8);
-  bzero(buf, BSIZE);
-  for(i = 0; i < used; i++){
-    buf[i/8] = buf[i/8] | (0x1 << (i%8));
+  assert(used <= fssize);
+  for(b = 0; b < used; b += BPB){
+    bzero(buf, BSIZE);
+    for(i = 0; i < BPB && b + i < used; i++){
+      buf[i/8] = buf[i/8] | (0x1 << (i%8));
+    }
+    printf("balloc: write bitmap block at sector %d\n", xint(sb.bmapstart) + b/BPB);
+    wsect(xint(sb.bmapstart) + b/BPB, buf);
   }
-  printf("balloc: write bitmap block at sector %d\n", sb.bmapstart);
-  wsect(sb.bmapstart, buf);
 }
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 
+// Allocate the block at *a if there is none there yet, and
+// return its number.
+uint
+bnew(uint *a)
+{
+  if(xint(*a) == 0)
+    *a = xint(freeblock++);
+  return xint(*a);
+}
+
+// Return the block holding block fbn of the file din, allocating
+// any indirect blocks on the way.  The block itself is allocated
+// only if data, else 0 is returned.
+uint
+bmap(struct dinode *din, uint fbn, int data)
+{
+  uint indirect[NINDIRECT];
+  uint x, y;
+
+  if(fbn < NDIRECT)
+    return data ? bnew(&din->addrs[fbn]) : 0;
+  fbn -= NDIRECT;
+  if(fbn < NINDIRECT){
+    x = bnew(&din->addrs[NDIRECT]);
+    rsect(x, (char*)indirect);
+    y = data ? bnew(&indirect[fbn]) : 0;
+    wsect(x, (char*)indirect);
+    return y;
+  }
+  fbn -= NINDIRECT;
+  assert(fbn < NDINDIRECT);
+  x = bnew(&din->addrs[NDIRECT+1]);
+  rsect(x, (char*)indirect);
+  y = bnew(&indirect[fbn / NINDIRECT]);
+  wsect(x, (char*)indirect);
+  rsect(y, (char*)indirect);
+  x = data ? bnew(&indirect[fbn % NINDIRECT]) : 0;
+  wsect(y, (char*)indirect);
+  return x;
+}
+
 void
 iappend(uint inum, void *xp, int n)
 {
@@ -259,31 +408,18 @@ iappend(uint inum, void *xp, int n)
   uint fbn, off, n1;
   struct dinode din;
   char buf[BSIZE];
-  uint indirect[NINDIRECT];
   uint x;
 
   rinode(inum, &din);
   off = xint(din.size);
   // printf("append inum %d at off %d sz %d\n", inum, off, n);
+  // the indirect blocks first, so that the data is one run
+  if(n > 0)
+    for(fbn = off / BSIZE; fbn <= (off + n - 1) / BSIZE; fbn++)
+      bmap(&din, fbn, 0);
   while(n > 0){
     fbn = off / BSIZE;
-    assert(fbn < MAXFILE);
-    if(fbn < NDIRECT){
-      if(xint(din.addrs[fbn]) == 0){
-        din.addrs[fbn] = xint(freeblock++);
-      }
-      x = xint(din.addrs[fbn]);
-    } else {
-      if(xint(din.addrs[NDIRECT]) == 0){
-        din.addrs[NDIRECT] = xint(freeblock++);
-      }
-      rsect(xint(din.addrs[NDIRECT]), (char*)indirect);
-      if(indirect[fbn - NDIRECT] == 0){
-        indirect[fbn - NDIRECT] = xint(freeblock++);
-        wsect(xint(din.addrs[NDIRECT]), (char*)indirect);
-      }
-      x = xint(indirect[fbn-NDIRECT]);
-    }
+    x = bmap(&din, fbn, 1);
     n1 = min(n, (fbn + 1) * BSIZE - off);
     rsect(x, buf);
     bcopy(p, buf + off - (fbn * BSIZE), n1);
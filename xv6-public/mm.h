@@ -0,0 +1,12 @@
+// An address space: its page table, heap size and mappings.
+// Threads made by clone share one; fork copies it.
+struct mm {
+  int ref;                            // processes holding it, zombies too
+  int users;                          // processes that haven't exited
+  struct sleeplock lock;              // held to change or fault in mappings
+  pde_t *pgdir;                       // Page table
+  uint sz;                            // Size of the heap and below (bytes)
+  struct mem_mapping *memoryMappings; // Root of the VMA index (vma.c)
+  int num_mappings;
+  uint mmap_hint;                     // Where next-fit mmap placement resumes
+};
@@ -5,7 +5,22 @@
 #define MAP_ANON MAP_ANONYMOUS
 #define MAP_FIXED 0x0008
 #define MAP_GROWSUP 0x0010
+#define MAP_HUGE 0x0020
+#define MAP_POPULATE 0x0040
+#define MAP_IMAGE 0x0080 /* kernel only: a program segment exec mapped */
 
 /* Protections on memory mapping */
+#define PROT_NONE 0x0
 #define PROT_READ 0x1
 #define PROT_WRITE 0x2
+
+/* Advice for madvise */
+#define MADV_NORMAL 0
+#define MADV_RANDOM 1
+#define MADV_SEQUENTIAL 2
+#define MADV_WILLNEED 3
+#define MADV_DONTNEED 4
+
+/* Flags for msync */
+#define MS_ASYNC 0x1
+#define MS_SYNC 0x2
@@ -0,0 +1,257 @@
+// Microbenchmarks of the virtual memory system: page fault
+// latency (anonymous, file and copy-on-write), the cost of mmap
+// and munmap as a process's mappings grow in number, fork as its
+// address space grows, and the speed of scanning a mapped file.
+// Times are in rdtsc cycles, the best of NROUND runs.
+//
+// usage: mmapbench [dir]
+//
+// The file benchmarks use a scratch file in dir, . by default;
+// mmapbench /tmp measures tmpfs instead of the disk.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "mmap.h"
+
+#define PG      4096
+#define NROUND  4    // runs of each benchmark
+#define NFAULT  256  // pages touched by the fault benchmarks
+#define NFILE   64   // pages in the scratch file
+#define NCALL   200  // mmap/munmap pairs timed per mapping count
+
+char path[64];
+char buf[PG];
+
+static void
+fail(char *what)
+{
+  printf(1, "mmapbench: %s failed\n", what);
+  unlink(path);
+  exit();
+}
+
+static char*
+anonmap(int n)
+{
+  char *p;
+
+  p = mmap(0, n, PROT_READ|PROT_WRITE, MAP_ANONYMOUS|MAP_PRIVATE, -1, 0);
+  if(p == (char*)-1)
+    fail("mmap");
+  return p;
+}
+
+static void
+touch(char *p, int npages)
+{
+  int i;
+
+  for(i = 0; i < npages; i++)
+    p[i*PG] = i;
+}
+
+static void
+report(char *what, uint64 best, uint n, char *unit)
+{
+  printf(1, "%s: %d cycles/%s\n", what, per(best, n), unit);
+}
+
+// Write faults on fresh anonymous memory.
+static uint64
+anonfault(void)
+{
+  uint64 t;
+  char *p;
+
+  p = anonmap(NFAULT*PG);
+  t = cycles();
+  touch(p, NFAULT);
+  t = cycles() - t;
+  munmap(p, NFAULT*PG);
+  return t;
+}
+
+// Read faults on a private mapping of the scratch file, whose
+// pages the page cache already holds.
+static uint64
+filefault(int fd)
+{
+  volatile char *p;
+  volatile int sum;
+  uint64 t;
+  int i;
+
+  p = mmap(0, NFILE*PG, PROT_READ, MAP_PRIVATE, fd, 0);
+  if(p == (char*)-1)
+    fail("mmap");
+  sum = 0;
+  t = cycles();
+  for(i = 0; i < NFILE; i++)
+    sum += p[i*PG];
+  t = cycles() - t;
+  munmap((char*)p, NFILE*PG);
+  return t;
+}
+
+// Write faults that copy pages shared with a parent after fork.
+// The child times them and passes the result back over a pipe.
+static uint64
+cowfault(void)
+{
+  uint64 t;
+  char *p;
+  int fds[2], pid;
+
+  p = anonmap(NFAULT*PG);
+  touch(p, NFAULT);
+  if(pipe(fds) < 0)
+    fail("pipe");
+  if((pid = fork()) < 0)
+    fail("fork");
+  if(pid == 0){
+    t = cycles();
+    touch(p, NFAULT);
+    t = cycles() - t;
+    write(fds[1], &t, sizeof(t));
+    exit();
+  }
+  if(read(fds[0], &t, sizeof(t)) != sizeof(t))
+    fail("read");
+  wait();
+  close(fds[0]);
+  close(fds[1]);
+  munmap(p, NFAULT*PG);
+  return t;
+}
+
+// An mmap and munmap of one page among nmap other mappings.
+// The others alternate in protection so they stay separate.
+static uint64
+mapcall(int nmap)
+{
+  static char *other[512];
+  uint64 t;
+  char *p;
+  int i;
+
+  for(i = 0; i < nmap; i++){
+    other[i] = mmap(0, PG, i%2 ? PROT_READ : PROT_READ|PROT_WRITE,
+                    MAP_ANONYMOUS|MAP_PRIVATE, -1, 0);
+    if(other[i] == (char*)-1)
+      fail("mmap");
+  }
+  t = cycles();
+  for(i = 0; i < NCALL; i++){
+    p = anonmap(PG);
+    if(munmap(p, PG) < 0)
+      fail("munmap");
+  }
+  t = cycles() - t;
+  for(i = 0; i < nmap; i++)
+    munmap(other[i], PG);
+  return t;
+}
+
+// A fork of a process with npages of anonymous memory in use,
+// up to when fork returns in the parent.
+static uint64
+forkcost(int npages)
+{
+  uint64 t;
+  char *p;
+  int pid;
+
+  p = 0;
+  if(npages > 0){
+    p = anonmap(npages*PG);
+    touch(p, npages);
+  }
+  t = cycles();
+  if((pid = fork()) < 0)
+    fail("fork");
+  if(pid == 0)
+    exit();
+  t = cycles() - t;
+  wait();
+  if(p)
+    munmap(p, npages*PG);
+  return t;
+}
+
+// Map the scratch file shared and read all of it, faults and all.
+static uint64
+scan(int fd)
+{
+  volatile int sum;
+  uint64 t;
+  int *p, i;
+
+  t = cycles();
+  p = mmap(0, NFILE*PG, PROT_READ, MAP_SHARED, fd, 0);
+  if(p == (int*)-1)
+    fail("mmap");
+  sum = 0;
+  for(i = 0; i < NFILE*PG/sizeof(int); i++)
+    sum += p[i];
+  munmap(p, NFILE*PG);
+  t = cycles() - t;
+  return t;
+}
+
+#define BEST(best, expr) do { \
+    int r_; uint64 t_; \
+    for(r_ = 0, (best) = ~(uint64)0; r_ < NROUND; r_++) \
+      if((t_ = (expr)) < (best)) \
+        (best) = t_; \
+  } while(0)
+
+int
+main(int argc, char *argv[])
+{
+  static int nmaps[] = { 0, 64, 256, 512 };
+  static int sizes[] = { 0, 256, 1024, 4096 };
+  uint64 best;
+  int fd, i, n;
+
+  strcpy(path, argc > 1 ? argv[1] : ".");
+  n = strlen(path);
+  if(n > sizeof(path) - 16)
+    fail("path");
+  strcpy(path + n, "/mmapbench.tmp");
+
+  if((fd = open(path, O_CREATE|O_RDWR)) < 0)
+    fail("open");
+  for(i = 0; i < NFILE; i++){
+    memset(buf, i, PG);
+    if(write(fd, buf, PG) != PG)
+      fail("write");
+  }
+
+  BEST(best, anonfault());
+  report("anon fault", best, NFAULT, "page");
+  BEST(best, filefault(fd));
+  report("file fault", best, NFILE, "page");
+  BEST(best, cowfault());
+  report("cow fault", best, NFAULT, "page");
+
+  for(i = 0; i < sizeof(nmaps)/sizeof(nmaps[0]); i++){
+    BEST(best, mapcall(nmaps[i]));
+    printf(1, "mmap+munmap, %d mappings", nmaps[i]);
+    report("", best, NCALL, "call");
+  }
+  for(i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++){
+    BEST(best, forkcost(sizes[i]));
+    printf(1, "fork, %d pages", sizes[i]);
+    report("", best, 1, "fork");
+  }
+
+  BEST(best, scan(fd));
+  report("mapped scan", best, NFILE*PG/1024, "KB");
+
+  close(fd);
+  unlink(path);
+  printf(1, "mmapbench: done\n");
+  exit();
+}
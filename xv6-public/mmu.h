@@ -11,6 +11,14 @@
 
 #define CR4_PSE         0x00000010      // Page size extension
 
+// cpuid leaf 1 %edx feature flags
+#define CPUID_SEP       0x00000800      // sysenter and sysexit
+
+// Model-specific registers
+#define MSR_SYSENTER_CS  0x174          // sysenter's %cs; %ss, and sysexit's, follow it
+#define MSR_SYSENTER_ESP 0x175          // sysenter's %esp
+#define MSR_SYSENTER_EIP 0x176          // sysenter's %eip
+
 // various segment selectors.
 #define SEG_KCODE 1  // kernel code
 #define SEG_KDATA 2  // kernel data+stack
@@ -83,21 +91,33 @@ struct segdesc {
 #define NPDENTRIES      1024    // # directory entries per page directory
 #define NPTENTRIES      1024    // # PTEs per page table
 #define PGSIZE          4096    // bytes mapped by a page
+#define HUGEPGSIZE      (PGSIZE*NPTENTRIES)  // bytes mapped by a PTE_PS directory entry
 
 #define PTXSHIFT        12      // offset of PTX in a linear address
 #define PDXSHIFT        22      // offset of PDX in a linear address
 
 #define PGROUNDUP(sz)  (((sz)+PGSIZE-1) & ~(PGSIZE-1))
 #define PGROUNDDOWN(a) (((a)) & ~(PGSIZE-1))
+#define HUGEPGROUNDUP(sz)  (((sz)+HUGEPGSIZE-1) & ~(HUGEPGSIZE-1))
+#define HUGEPGROUNDDOWN(a) (((a)) & ~(HUGEPGSIZE-1))
 
 // Page table/directory entry flags.
 #define PTE_P           0x001   // Present
 #define PTE_W           0x002   // Writeable
 #define PTE_U           0x004   // User
+#define PTE_A           0x020   // Accessed
+#define PTE_D           0x040   // Dirty
 #define PTE_PS          0x080   // Page Size
+#define PDE_SHARED      0x200   // Page table shared by fork (see ptunshare)
+#define PTE_SWAP        0x400   // Not present: in swap slot PTE_ADDR(pte) >> PTXSHIFT
 #define PTE_COW         0x800   // Copy-On-Write
 
 // Address in page table or page directory entry
+// Page fault error code bits
+#define FEC_PR          0x1     // Fault on a present page (a protection violation)
+#define FEC_WR          0x2     // Fault caused by a write
+#define FEC_U           0x4     // Fault in user mode
+
 #define PTE_ADDR(pte)   ((uint)(pte) & ~0xFFF)
 #define PTE_FLAGS(pte)  ((uint)(pte) &  0xFFF)
 
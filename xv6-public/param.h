@@ -1,14 +1,42 @@
 #define NPROC        64  // maximum number of processes
 #define KSTACKSIZE 4096  // size of per-process kernel stack
 #define NCPU          8  // maximum number of CPUs
-#define NOFILE       16  // open files per process
-#define NFILE       100  // open files per system
-#define NINODE       50  // maximum number of active i-nodes
+#define NPRIO         4  // scheduler priority levels, 0 the highest
+#define BOOSTTICKS  100  // ticks between raising every process to level 0
+#define NOFILE       16  // open files per process, to start with
+#define NOFILEMAX  1024  // ... and once its table has grown to a page
+#define PIPEPAGES     1  // pages of buffer per pipe, a power of two
+#define NINODE       50  // i-nodes the inode cache starts with
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
+#define TMPDEV        3  // device number of the in-memory tmpfs on /tmp
+#define NTMPINODE   256  // tmpfs inodes
 #define MAXARG       32  // max exec arguments
+#define MAXPATH     128  // longest path a system call takes, with its nul
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
-#define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
-#define FSSIZE       1000  // size of file system in blocks
+#define LOGSIZE     127  // max data blocks in one log group (one descriptor block)
+#define NLOG         64  // default size of mkfs's on-disk log, in blocks
+#define COMMITTICKS   2  // ticks a group of log transactions may stay open
+#define TICKUS    10000  // microseconds per clock tick
+#define PROFUS     1000  // microseconds between profiler samples
+#define NBUF         (MAXOPBLOCKS*3)  // buffers the disk block cache starts with
+#define BCACHEPCT    10  // most of physical memory the block cache may use, in %
+#define READAHEAD     8  // blocks (pages, of file data) read ahead of a sequential readi
+#define FSSIZE       4000  // size of file system in blocks
+#define NVMA       1024  // maximum number of memory mappings system-wide
+#define MMAPGUARD     1  // unmapped guard pages on each side of an mmap region
+#define MMAPNEXTFIT   0  // place mmap regions next-fit (1) or first-fit (0)
+#define FAULTAROUND   4  // pages mapped per file-backed mmap fault
+#define FAULTAROUNDMAX 32  // fault-around window limit for sequential access
+#define GROWSUPCHUNK 16  // pages a MAP_GROWSUP mapping grows by at a time
+#define NPCACHE    2048  // pages in the file page cache
+#define NPAGEIO       4  // pages moving straight to or from disk at once
+#define NDCACHE     128  // names in the directory lookup cache
+#define NHUGEPAGE     8  // 4MB frames set aside for huge-page mappings
+#define TLBFLUSHMAX  32  // pages invalidated one by one before a full TLB flush
+#define NSWAP     16384  // default size of mkfs's swap area, in pages
+#define NSWAPMAX  65536  // most swap pages the kernel will use
+#define SWAPLOW     256  // free pages below which kswapd starts reclaiming
+#define SWAPHIGH    512  // ... and the free pages it reclaims up to
+#define SWAPBATCH    32  // pages evicted per pass of the reclaim clock
 
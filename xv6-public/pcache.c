@@ -0,0 +1,321 @@
+//
+// Page cache for file data.
+//
+// Maps (device, inode, page-aligned file offset) to a physical
+// page, so every process that maps the same part of a file with
+// MAP_SHARED gets the same frame and sees the others' stores.
+// read() of a regular file copies from the same pages (readi),
+// and private mappings and exec copy theirs from them, so file
+// data is in memory once.  Pages are filled straight from the
+// disk, not through the buffer cache (readpage).
+// The cache holds one reference on each page (see kref); the
+// page tables that map it hold the rest.  A page whose only
+// reference is the cache's is unused and may be evicted, to make
+// room in the cache or, through pcache_shrink, when kalloc runs
+// out of memory.
+//
+// Filling an entry reads the file, so callers hold the inode's
+// sleep-lock, which also keeps two processes from filling the
+// same page at once.  pcache.lock only protects the table.
+//
+// writei() writes through to cached pages so that write() and
+// the cache agree.
+//
+// madvise(MADV_WILLNEED) queues ranges for the "prefetch" kernel
+// thread, which reads them into the cache ahead of the faults.
+//
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+
+#define NPCHASH 1021
+#define NPREFETCH 16  // MADV_WILLNEED ranges queued for the prefetcher
+
+struct cpage {
+  uint dev;
+  uint inum;
+  uint off;          // page-aligned file offset
+  char *page;        // 0 if the entry is free
+  struct cpage *next;  // hash chain
+};
+
+struct {
+  struct spinlock lock;
+  struct cpage page[NPCACHE];
+  struct cpage *hash[NPCHASH];
+  int hand;          // where the eviction scan resumes
+} pcache;
+
+// A range of a file to read into the cache.  The queue holds a
+// reference on the inode.
+struct pfreq {
+  struct inode *ip;
+  uint off;
+  uint end;
+};
+
+struct {
+  struct spinlock lock;
+  struct pfreq q[NPREFETCH];
+  uint r;  // next request to read
+  uint w;  // next free slot
+} pfq;
+
+static uint
+pchash(uint dev, uint inum, uint off)
+{
+  return (dev * 31 + inum * 17 + off / PGSIZE) % NPCHASH;
+}
+
+static void prefetcher(void);
+
+void
+pcacheinit(void)
+{
+  initlock(&pcache.lock, "pcache");
+  initlock(&pfq.lock, "pfq");
+  if(kthread("prefetch", prefetcher) == 0)
+    panic("pcacheinit");
+}
+
+// Look up a cached page.  Caller holds pcache.lock.
+static struct cpage*
+pclookup(uint dev, uint inum, uint off)
+{
+  struct cpage *c;
+
+  for(c = pcache.hash[pchash(dev, inum, off)]; c; c = c->next)
+    if(c->dev == dev && c->inum == inum && c->off == off)
+      return c;
+  return 0;
+}
+
+static void
+pcunhash(struct cpage *c)
+{
+  struct cpage **pp;
+
+  for(pp = &pcache.hash[pchash(c->dev, c->inum, c->off)]; *pp; pp = &(*pp)->next)
+    if(*pp == c){
+      *pp = c->next;
+      break;
+    }
+  kfree(c->page);
+  c->page = 0;
+}
+
+// Find a free entry, evicting a page nobody maps if needed.
+// Returns 0 if every cached page is in use.
+// Caller holds pcache.lock.
+static struct cpage*
+pcslot(void)
+{
+  struct cpage *c;
+  int i;
+
+  for(i = 0; i < NPCACHE; i++){
+    c = &pcache.page[(pcache.hand + i) % NPCACHE];
+    if(c->page == 0 || krefcount(c->page) == 1){
+      pcache.hand = (pcache.hand + i + 1) % NPCACHE;
+      if(c->page)
+        pcunhash(c);
+      return c;
+    }
+  }
+  return 0;
+}
+
+// Evict one cached page nobody maps.  Called by kalloc when
+// memory runs out.  Returns 0 if it freed a page, -1 if not.
+int
+pcache_shrink(void)
+{
+  struct cpage *c;
+  int i;
+
+  // A kalloc with the lock held must not wait for itself.
+  if(holding(&pcache.lock))
+    return -1;
+  acquire(&pcache.lock);
+  for(i = 0; i < NPCACHE; i++){
+    c = &pcache.page[(pcache.hand + i) % NPCACHE];
+    if(c->page && krefcount(c->page) == 1){
+      pcache.hand = (pcache.hand + i + 1) % NPCACHE;
+      pcunhash(c);
+      release(&pcache.lock);
+      return 0;
+    }
+  }
+  release(&pcache.lock);
+  return -1;
+}
+
+// Return the cached page holding ip's data at page-aligned offset
+// off, with a reference for the caller, or 0 if it isn't cached.
+static char*
+pcache_lookup(struct inode *ip, uint off)
+{
+  struct cpage *c;
+  char *mem = 0;
+
+  acquire(&pcache.lock);
+  if((c = pclookup(ip->dev, ip->inum, off)) != 0){
+    mem = c->page;
+    kref(mem);
+  }
+  release(&pcache.lock);
+  return mem;
+}
+
+// Is page the cached page of ip's data at page-aligned offset
+// off?  Caller needn't hold ip->lock: the answer may be stale by
+// the time it returns, which is fine for statistics.
+int
+pcache_holds(struct inode *ip, uint off, char *page)
+{
+  struct cpage *c;
+  int r;
+
+  acquire(&pcache.lock);
+  r = (c = pclookup(ip->dev, ip->inum, off)) != 0 && c->page == page;
+  release(&pcache.lock);
+  return r;
+}
+
+// Return the page holding ip's data at page-aligned offset off,
+// reading it from the file if it is not cached, with a reference
+// for the caller.  Past the end of the file the page reads as
+// zeros.  A tmpfs file's pages are its content already, and are
+// handed out as they are, not cached.  Returns 0 if out of memory.
+// Caller must hold ip->lock, shared will do: a page that
+// another reader cached meanwhile is used instead of ours.
+char*
+pcache_get(struct inode *ip, uint off)
+{
+  struct cpage *c;
+  char *mem, *cached;
+
+  if(ip->dev == TMPDEV)
+    return tmpfs_getpage(ip, off);
+  if((mem = pcache_lookup(ip, off)) != 0)
+    return mem;
+
+  if((mem = kalloc()) == 0)
+    return 0;
+  readpage(ip, mem, off);
+
+  acquire(&pcache.lock);
+  if((c = pclookup(ip->dev, ip->inum, off)) != 0){
+    cached = c->page;
+    kref(cached);
+    release(&pcache.lock);
+    kfree(mem);
+    return cached;
+  }
+  if((c = pcslot()) != 0){
+    c->dev = ip->dev;
+    c->inum = ip->inum;
+    c->off = off;
+    c->page = mem;
+    c->next = pcache.hash[pchash(c->dev, c->inum, off)];
+    pcache.hash[pchash(c->dev, c->inum, off)] = c;
+    kref(mem);
+  }
+  release(&pcache.lock);
+  return mem;
+}
+
+// Copy n bytes written to ip at off into any cached pages they
+// cover.  src is kernel memory, the buffer writei just wrote (a
+// user buffer could fault here, with pcache.lock held).
+// Caller must hold ip->lock.
+void
+pcache_write(struct inode *ip, char *src, uint off, uint n)
+{
+  struct cpage *c;
+  uint a, m;
+
+  acquire(&pcache.lock);
+  for(a = PGROUNDDOWN(off); a < off + n; a += PGSIZE){
+    if((c = pclookup(ip->dev, ip->inum, a)) == 0)
+      continue;
+    if(a < off){
+      m = PGSIZE - (off - a) < n ? PGSIZE - (off - a) : n;
+      memmove(c->page + (off - a), src, m);
+    } else {
+      m = off + n - a < PGSIZE ? off + n - a : PGSIZE;
+      memmove(c->page, src + (a - off), m);
+    }
+  }
+  release(&pcache.lock);
+}
+
+// Forget every cached page of ip, e.g. when it is truncated.
+// Pages still mapped stay valid for their mappers.
+void
+pcache_drop(struct inode *ip)
+{
+  struct cpage *c;
+
+  acquire(&pcache.lock);
+  for(c = pcache.page; c < pcache.page + NPCACHE; c++)
+    if(c->page && c->dev == ip->dev && c->inum == ip->inum)
+      pcunhash(c);
+  release(&pcache.lock);
+}
+
+// Ask the prefetcher to read ip's pages in [off, end) into the
+// cache.  This is only a hint, dropped if the queue is full.
+void
+pcache_prefetch(struct inode *ip, uint off, uint end)
+{
+  struct pfreq *q;
+
+  // more than this would only evict the range's own first pages
+  if(end - off > NPCACHE / 2 * PGSIZE)
+    end = off + NPCACHE / 2 * PGSIZE;
+  acquire(&pfq.lock);
+  if(pfq.w - pfq.r < NPREFETCH){
+    q = &pfq.q[pfq.w++ % NPREFETCH];
+    q->ip = idup(ip);
+    q->off = off;
+    q->end = end;
+    wakeup(&pfq.w);
+  }
+  release(&pfq.lock);
+}
+
+// The prefetch thread: fill the cache with queued ranges, as far
+// as the file goes.
+static void
+prefetcher(void)
+{
+  struct pfreq req;
+  char *page;
+  uint off;
+
+  for(;;){
+    acquire(&pfq.lock);
+    while(pfq.r == pfq.w)
+      sleep(&pfq.w, &pfq.lock);
+    req = pfq.q[pfq.r++ % NPREFETCH];
+    release(&pfq.lock);
+
+    ilockshared(req.ip);
+    for(off = req.off; off < req.end && off < req.ip->size; off += PGSIZE){
+      if((page = pcache_get(req.ip, off)) == 0)
+        break;
+      kfree(page);  // the cache keeps its own reference
+    }
+    iunlock(req.ip);
+    begin_op();
+    iput(req.ip);
+    end_op();
+  }
+}
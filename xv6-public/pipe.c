@@ -7,29 +7,87 @@
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "uio.h"
 
-#define PIPESIZE 512
+// The buffer is a ring of PIPEPAGES pages, indexed by nread and
+// nwrite modulo PIPESIZE, so PIPEPAGES must be a power of two.
+// Copies move whole runs, each ending at a page end at the most.
+//
+// Copies are made with the lock released, so that the other side
+// can go on meanwhile and a fault on a user address may sleep:
+// wbusy and rbusy keep other writers and readers out until the
+// copy is done.  write() and read() keep them set for the whole
+// call, over all of a writev()'s buffers, so one write() isn't
+// interleaved with another's data.
+// splice() fills or drains the buffer in place a run at a time
+// (see pipewbegin and piperbegin).
+#define PIPESIZE (PIPEPAGES*PGSIZE)
 
 struct pipe {
   struct spinlock lock;
-  char data[PIPESIZE];
+  char *page[PIPEPAGES];
   uint nread;     // number of bytes read
   uint nwrite;    // number of bytes written
   int readopen;   // read fd is still open
   int writeopen;  // write fd is still open
+  int rbusy;      // a reader is copying out of the buffer
+  int wbusy;      // a writer is copying into the buffer
 };
 
+// Where byte i of the stream is in the buffer.
+static char*
+pipeptr(struct pipe *p, uint i)
+{
+  return p->page[i / PGSIZE % PIPEPAGES] + i % PGSIZE;
+}
+
+static struct slabcache *pipecache;
+
+void
+pipeinit(void)
+{
+  pipecache = slabcreate("pipe", sizeof(struct pipe));
+}
+
+// How many of n bytes starting at byte i a copy with avail
+// bytes to go at can move in one run.
+static int
+piperun(uint i, uint avail, int n)
+{
+  uint m = PGSIZE - i % PGSIZE;
+
+  if(m > avail)
+    m = avail;
+  return n < m ? n : m;
+}
+
+static void
+pipefree(struct pipe *p)
+{
+  int i;
+
+  for(i = 0; i < PIPEPAGES; i++)
+    if(p->page[i])
+      kfree(p->page[i]);
+  slabfree(pipecache, p);
+}
+
 int
 pipealloc(struct file **f0, struct file **f1)
 {
   struct pipe *p;
+  int i;
 
   p = 0;
   *f0 = *f1 = 0;
   if((*f0 = filealloc()) == 0 || (*f1 = filealloc()) == 0)
     goto bad;
-  if((p = (struct pipe*)kalloc()) == 0)
+  if((p = slaballoc(pipecache)) == 0)
     goto bad;
+  memset(p, 0, sizeof(*p));
+  for(i = 0; i < PIPEPAGES; i++)
+    if((p->page[i] = kalloc()) == 0)
+      goto bad;
   p->readopen = 1;
   p->writeopen = 1;
   p->nwrite = 0;
@@ -48,7 +106,7 @@ pipealloc(struct file **f0, struct file **f1)
 //PAGEBREAK: 20
  bad:
   if(p)
-    kfree((char*)p);
+    pipefree(p);
   if(*f0)
     fileclose(*f0);
   if(*f1)
@@ -69,53 +127,166 @@ pipeclose(struct pipe *p, int writable)
   }
   if(p->readopen == 0 && p->writeopen == 0){
     release(&p->lock);
-    kfree((char*)p);
+    pipefree(p);
   } else
     release(&p->lock);
 }
 
 //PAGEBREAK: 40
 int
-pipewrite(struct pipe *p, char *addr, int n)
+pipewrite(struct pipe *p, struct iovec *iov, int niov)
 {
-  int i;
+  char *run, *addr;
+  int i, m, n, v, tot;
 
   acquire(&p->lock);
-  for(i = 0; i < n; i++){
-    while(p->nwrite == p->nread + PIPESIZE){  //DOC: pipewrite-full
-      if(p->readopen == 0 || myproc()->killed){
-        release(&p->lock);
-        return -1;
+  while(p->wbusy)
+    sleep(&p->nwrite, &p->lock);
+  p->wbusy = 1;
+  for(tot = 0, v = 0; v < niov; v++){
+    addr = iov[v].base;
+    n = iov[v].len;
+    for(i = 0; i < n; i += m){
+      while(p->nwrite == p->nread + PIPESIZE){  //DOC: pipewrite-full
+        if(p->readopen == 0 || myproc()->killed){
+          p->wbusy = 0;
+          wakeup(&p->nwrite);
+          release(&p->lock);
+          return -1;
+        }
+        wakeup(&p->nread);
+        sleep(&p->nwrite, &p->lock);  //DOC: pipewrite-sleep
       }
-      wakeup(&p->nread);
-      sleep(&p->nwrite, &p->lock);  //DOC: pipewrite-sleep
+      m = piperun(p->nwrite, PIPESIZE - (p->nwrite - p->nread), n - i);
+      run = pipeptr(p, p->nwrite);
+      release(&p->lock);
+      memmove(run, addr + i, m);
+      acquire(&p->lock);
+      p->nwrite += m;
+      wakeup(&p->nread);  //DOC: pipewrite-wakeup1
     }
-    p->data[p->nwrite++ % PIPESIZE] = addr[i];
+    tot += n;
   }
-  wakeup(&p->nread);  //DOC: pipewrite-wakeup1
+  p->wbusy = 0;
+  wakeup(&p->nwrite);
   release(&p->lock);
-  return n;
+  return tot;
 }
 
+// Read what the pipe has, up to the length of the buffers in
+// iov, filling them in turn; only an empty pipe waits.
 int
-piperead(struct pipe *p, char *addr, int n)
+piperead(struct pipe *p, struct iovec *iov, int niov)
 {
-  int i;
+  char *run, *addr;
+  int i, m, n, v, tot;
 
   acquire(&p->lock);
-  while(p->nread == p->nwrite && p->writeopen){  //DOC: pipe-empty
+  while(p->rbusy || (p->nread == p->nwrite && p->writeopen)){  //DOC: pipe-empty
     if(myproc()->killed){
       release(&p->lock);
       return -1;
     }
     sleep(&p->nread, &p->lock); //DOC: piperead-sleep
   }
-  for(i = 0; i < n; i++){  //DOC: piperead-copy
-    if(p->nread == p->nwrite)
-      break;
-    addr[i] = p->data[p->nread++ % PIPESIZE];
+  p->rbusy = 1;
+  for(tot = 0, v = 0; v < niov && p->nread != p->nwrite; v++){
+    addr = iov[v].base;
+    n = iov[v].len;
+    for(i = 0; i < n; i += m){  //DOC: piperead-copy
+      if(p->nread == p->nwrite)
+        break;
+      m = piperun(p->nread, p->nwrite - p->nread, n - i);
+      run = pipeptr(p, p->nread);
+      release(&p->lock);
+      memmove(addr + i, run, m);
+      acquire(&p->lock);
+      p->nread += m;
+      wakeup(&p->nwrite);  //DOC: piperead-wakeup
+    }
+    tot += i;
   }
-  wakeup(&p->nwrite);  //DOC: piperead-wakeup
+  p->rbusy = 0;
+  wakeup(&p->nread);
+  release(&p->lock);
+  return tot;
+}
+
+// Wait for room in p and claim the run of free buffer after its
+// data, up to n bytes: set *run to it and return its length.
+// The caller fills it without p->lock, while no other writer
+// can, and then calls pipewend.  Returns -1 if nobody reads p.
+int
+pipewbegin(struct pipe *p, char **run, int n)
+{
+  int m;
+
+  acquire(&p->lock);
+  while(p->wbusy || p->nwrite == p->nread + PIPESIZE){
+    if(p->readopen == 0 || myproc()->killed){
+      release(&p->lock);
+      return -1;
+    }
+    wakeup(&p->nread);
+    sleep(&p->nwrite, &p->lock);
+  }
+  p->wbusy = 1;
+  m = piperun(p->nwrite, PIPESIZE - (p->nwrite - p->nread), n);
+  *run = pipeptr(p, p->nwrite);
+  release(&p->lock);
+  return m;
+}
+
+// Finish filling a run from pipewbegin, of which n bytes were
+// written.
+void
+pipewend(struct pipe *p, int n)
+{
+  acquire(&p->lock);
+  p->nwrite += n;
+  p->wbusy = 0;
+  wakeup(&p->nread);
+  wakeup(&p->nwrite);
+  release(&p->lock);
+}
+
+// Wait for data in p and claim the run of it at the front, up to
+// n bytes: set *run to it and return its length.  The caller
+// copies it out without p->lock, while no other reader can, and
+// then calls piperend.  Returns 0 at end of file, with nothing
+// claimed, and -1 if killed.
+int
+piperbegin(struct pipe *p, char **run, int n)
+{
+  int m;
+
+  acquire(&p->lock);
+  while(p->rbusy || (p->nread == p->nwrite && p->writeopen)){
+    if(myproc()->killed){
+      release(&p->lock);
+      return -1;
+    }
+    sleep(&p->nread, &p->lock);
+  }
+  if(p->nread == p->nwrite){
+    release(&p->lock);
+    return 0;
+  }
+  p->rbusy = 1;
+  m = piperun(p->nread, p->nwrite - p->nread, n);
+  *run = pipeptr(p, p->nread);
+  release(&p->lock);
+  return m;
+}
+
+// Finish with a run from piperbegin, of which n bytes were used.
+void
+piperend(struct pipe *p, int n)
+{
+  acquire(&p->lock);
+  p->nread += n;
+  p->rbusy = 0;
+  wakeup(&p->nwrite);
+  wakeup(&p->nread);
   release(&p->lock);
-  return i;
 }
@@ -5,29 +5,359 @@
 #include "memlayout.h"
 #include "x86.h"
 #include "proc.h"
+#include "traps.h"
 #include "spinlock.h"
 #include "mmap.h"
 #include "sleeplock.h"
+#include "mm.h"
 #include "fs.h"
 #include "file.h"
+#include "kstats.h"
+#include "trace.h"
+#include "memstat.h"
+
+// Each CPU has its own run queues, one FIFO per priority level,
+// and runs the head of its highest non-empty one.  A process that
+// uses up its level's quantum, (1 << level) ticks, moves down a
+// level; every BOOSTTICKS all of them go back to level 0 so batch
+// jobs, once demoted, can't starve forever.
+//
+// A process goes back on the queue of the CPU it last ran on, to
+// find its cache still warm; new processes go to the CPU with the
+// fewest queued.  A CPU with nothing queued steals from the CPU
+// with the most.
+struct runq
+{
+  struct spinlock lock;
+  struct proc *head[NPRIO];
+  struct proc *tail[NPRIO];
+  uint levels; // bit i set if head[i] is non-empty
+  int n;       // processes queued
+};
 
+#define NWAITHASH 31 // wait queues, hashed by sleep channel
+
+struct waitq
+{
+  struct spinlock lock;
+  struct proc *head; // SLEEPING processes
+};
+
+// ptable.lock guards handing out and giving back process slots
+// and address spaces, and the parent links: allocproc, reap and
+// the scans of exit, wait and join.  A process's state, chan and
+// run queue fields are guarded by its own lock, plock(p), so that
+// forks, exits and wakeups on different CPUs don't meet on one
+// lock.  A process holds plock(p) across sched(): the scheduler
+// takes it before switching to p and lets it go when p switches
+// back.  Each run queue and wait queue has a lock of its own.
+// Locks are taken in the order ptable.lock, a wait queue's lock,
+// plock(p), a run queue's lock.
 struct
 {
   struct spinlock lock;
   struct proc proc[NPROC];
+  struct proc *free;                  // UNUSED slots, latest freed first
+  struct spinlock plock[NPROC];       // by slot in proc
+  struct runq rq[NCPU];               // by cpuid()
+  uint boosted;                       // ticks at the last boost
+  struct waitq waitq[NWAITHASH];      // by chan
+  struct mm mm[NPROC];                // address spaces, free if ref is 0
 } ptable;
 
 static struct proc *initproc;
 
+#define NKSTACKCACHE 4 // kernel stacks a CPU keeps for reuse
+
+// Each CPU keeps a few kernel stacks of reaped processes for new
+// ones, so that fork and wait skip the page allocator.
+struct kstackcache
+{
+  char *stack[NKSTACKCACHE];
+  int n;
+} __attribute__((aligned(64)));
+
+static struct kstackcache kstacks[NCPU];
+
 int nextpid = 1;
 extern void forkret(void);
 extern void trapret(void);
 
-static void wakeup1(void *chan);
+static void boost(void);
+
+static struct spinlock *
+plock(struct proc *p)
+{
+  return &ptable.plock[p - ptable.proc];
+}
+
+static struct waitq *
+waitq(void *chan)
+{
+  return &ptable.waitq[(uint)chan % NWAITHASH];
+}
+
+// Take SLEEPING p off its wait queue.
+// Its wait queue's lock and plock(p) must be held.
+static void
+unsleep(struct proc *p)
+{
+  struct proc **pp;
+
+  for (pp = &waitq(p->chan)->head; *pp != p; pp = &(*pp)->wnext)
+    if (*pp == 0)
+      panic("unsleep");
+  *pp = p->wnext;
+}
+
+// Wake a halted CPU to run or steal newly RUNNABLE p: p's own
+// if it is idle, else any idle one.  A process that is giving up
+// the CPU will be picked up by this one.
+// p's run queue lock must be held.
+static void
+kick(struct proc *p)
+{
+  struct cpu *c;
+
+  if (p == myproc())
+    return;
+  c = &cpus[p->cpu];
+  if (!c->idle)
+    for (c = cpus; c < &cpus[ncpu] && !c->idle; c++)
+      ;
+  if (c == &cpus[ncpu])
+    return;
+  c->idle = 0;
+  if (c != mycpu())
+    lapicipi(c->apicid, T_IRQ0 + IRQ_WAKEUP);
+}
+
+// Make p RUNNABLE at the back of its level's queue on p->cpu.
+// plock(p) must be held.
+static void
+runnable(struct proc *p)
+{
+  struct runq *rq = &ptable.rq[p->cpu];
+
+  acquire(&rq->lock);
+  p->state = RUNNABLE;
+  p->rnext = 0;
+  if (rq->tail[p->priority])
+    rq->tail[p->priority]->rnext = p;
+  else
+    rq->head[p->priority] = p;
+  rq->tail[p->priority] = p;
+  rq->levels |= 1 << p->priority;
+  rq->n++;
+  kick(p);
+  release(&rq->lock);
+}
+
+// Make new process p RUNNABLE on the CPU with the fewest queued.
+// The counts are read without their locks, as a hint.
+// plock(p) must be held.
+static void
+place(struct proc *p)
+{
+  int i;
+
+  p->cpu = 0;
+  for (i = 1; i < ncpu; i++)
+    if (ptable.rq[i].n < ptable.rq[p->cpu].n)
+      p->cpu = i;
+  runnable(p);
+}
+
+// Take the first process off rq's highest non-empty level,
+// or return 0 if rq is empty.
+// rq->lock must be held.
+static struct proc *
+dequeue(struct runq *rq)
+{
+  struct proc *p;
+  int i;
+
+  if (rq->levels == 0)
+    return 0;
+  i = __builtin_ctz(rq->levels);
+  p = rq->head[i];
+  if ((rq->head[i] = p->rnext) == 0)
+  {
+    rq->tail[i] = 0;
+    rq->levels &= ~(1 << i);
+  }
+  rq->n--;
+  return p;
+}
+
+// Take RUNNABLE p off its run queue.  Return -1 if it is not
+// there: a scheduler has dequeued it and is waiting for plock(p)
+// to run it.
+// plock(p) must be held.
+static int
+unqueue(struct proc *p)
+{
+  struct runq *rq = &ptable.rq[p->cpu];
+  struct proc **pp, *prev;
+
+  acquire(&rq->lock);
+  prev = 0;
+  for (pp = &rq->head[p->priority]; *pp; pp = &(*pp)->rnext)
+  {
+    if (*pp == p)
+    {
+      *pp = p->rnext;
+      if (rq->tail[p->priority] == p)
+        rq->tail[p->priority] = prev;
+      if (rq->head[p->priority] == 0)
+        rq->levels &= ~(1 << p->priority);
+      rq->n--;
+      release(&rq->lock);
+      return 0;
+    }
+    prev = *pp;
+  }
+  release(&rq->lock);
+  return -1;
+}
+
+// Take a process for idle CPU c from the CPU with the most queued.
+static struct proc *
+steal(int c)
+{
+  struct proc *p;
+  int i, victim;
+
+  victim = -1;
+  for (i = 0; i < ncpu; i++)
+    if (i != c && ptable.rq[i].n > 0 &&
+        (victim < 0 || ptable.rq[i].n > ptable.rq[victim].n))
+      victim = i;
+  if (victim < 0)
+    return 0;
+  acquire(&ptable.rq[victim].lock);
+  p = dequeue(&ptable.rq[victim]);
+  release(&ptable.rq[victim].lock);
+  return p;
+}
 
 void pinit(void)
 {
+  struct mm *mm;
+  int i;
+
   initlock(&ptable.lock, "ptable");
+  for (i = 0; i < NPROC; i++)
+    initlock(&ptable.plock[i], "proc");
+  for (i = NPROC - 1; i >= 0; i--)
+  {
+    ptable.proc[i].fnext = ptable.free;
+    ptable.free = &ptable.proc[i];
+  }
+  for (i = 0; i < NCPU; i++)
+    initlock(&ptable.rq[i].lock, "runq");
+  for (i = 0; i < NWAITHASH; i++)
+    initlock(&ptable.waitq[i].lock, "waitq");
+  for (mm = ptable.mm; mm < &ptable.mm[NPROC]; mm++)
+    initsleeplock(&mm->lock, "mm");
+}
+
+// Find a free address space and give it one user.
+// The ptable lock must be held.
+static struct mm *
+mmalloc(void)
+{
+  struct mm *mm;
+
+  for (mm = ptable.mm; mm < &ptable.mm[NPROC]; mm++)
+  {
+    if (mm->ref == 0)
+    {
+      mm->ref = mm->users = 1;
+      mm->pgdir = 0;
+      mm->sz = 0;
+      mm->memoryMappings = 0;
+      mm->num_mappings = 0;
+      mm->mmap_hint = 0;
+      return mm;
+    }
+  }
+  return 0;
+}
+
+static char *
+kstackalloc(void)
+{
+  struct kstackcache *c;
+  char *s;
+
+  pushcli();
+  c = &kstacks[cpuid()];
+  s = c->n > 0 ? c->stack[--c->n] : 0;
+  popcli();
+  return s ? s : kalloc();
+}
+
+static void
+kstackfree(char *s)
+{
+  struct kstackcache *c;
+
+  pushcli();
+  c = &kstacks[cpuid()];
+  if (c->n < NKSTACKCACHE)
+  {
+    c->stack[c->n++] = s;
+    s = 0;
+  }
+  popcli();
+  if (s)
+    kfree(s);
+}
+
+// Make p UNUSED and put its slot on the free list.
+// The ptable lock must be held.
+static void
+freeslot(struct proc *p)
+{
+  p->state = UNUSED;
+  p->fnext = ptable.free;
+  ptable.free = p;
+}
+
+// Give back the process slot and address space of a process
+// that never ran.
+static void
+unalloc(struct proc *p)
+{
+  if (p->kstack)
+    kstackfree(p->kstack);
+  p->kstack = 0;
+  fdfree(p);
+  if (p->mm->pgdir)
+    freevm(p->mm->pgdir);
+  acquire(&ptable.lock);
+  p->mm->ref = p->mm->users = 0;
+  freeslot(p);
+  release(&ptable.lock);
+}
+
+// Free zombie p's kernel stack, and its page table too if no other
+// process still uses it.
+// The ptable lock and plock(p) must be held.
+static void
+reap(struct proc *p)
+{
+  kstackfree(p->kstack);
+  p->kstack = 0;
+  if (--p->mm->ref == 0)
+    freevm(p->mm->pgdir);
+  p->mm = 0;
+  p->pid = 0;
+  p->parent = 0;
+  p->name[0] = 0;
+  p->killed = 0;
+  freeslot(p);
 }
 
 // Must be called with interrupts disabled
@@ -72,8 +402,8 @@ myproc(void)
 }
 
 // PAGEBREAK: 32
-//  Look in the process table for an UNUSED proc.
-//  If found, change state to EMBRYO and initialize
+//  Take an UNUSED proc off the free list.
+//  If there is one, change state to EMBRYO and initialize
 //  state required to run in the kernel.
 //  Otherwise return 0.
 static struct proc *
@@ -84,26 +414,30 @@ allocproc(void)
   char *sp;
 
   acquire(&ptable.lock);
-
-  for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-    if (p->state == UNUSED)
-      goto found;
-
-  release(&ptable.lock);
-  return 0;
-
-found:
+  if ((p = ptable.free) == 0 || (p->mm = mmalloc()) == 0)
+  {
+    release(&ptable.lock);
+    return 0;
+  }
+  ptable.free = p->fnext;
   p->state = EMBRYO;
   p->pid = nextpid++;
+  p->priority = 0;
+  p->usedticks = 0;
+  p->theap = -1;
+  p->ring = 0;
+  p->sysargs = 0;
+  p->ofile = p->ofile0;
+  p->nofile = NOFILE;
 
   release(&ptable.lock);
 
   // Allocate kernel stack.
-  if ((p->kstack = kalloc()) == 0)
+  if ((p->kstack = kstackalloc()) == 0)
   { // here we call kalloc which is going to return
     // it returns the first free page of memory
     // it returns a pointer to a VA
-    p->state = UNUSED;
+    unalloc(p);
     return 0;
   }
   sp = p->kstack + KSTACKSIZE; // this is just incrementing the stack pointer to the top of the stack
@@ -138,11 +472,11 @@ void userinit(void)
   // p->kstack which is the kernal stack of the process
 
   initproc = p;
-  if ((p->pgdir = setupkvm()) == 0) // 3. setupkvm is the next call to investigate
+  if ((p->mm->pgdir = setupkvm()) == 0) // 3. setupkvm is the next call to investigate
                                     //
     panic("userinit: out of memory?");
-  inituvm(p->pgdir, _binary_initcode_start, (int)_binary_initcode_size);
-  p->sz = PGSIZE;
+  inituvm(p->mm->pgdir, _binary_initcode_start, (int)_binary_initcode_size);
+  p->mm->sz = PGSIZE;
   memset(p->tf, 0, sizeof(*p->tf));
   p->tf->cs = (SEG_UCODE << 3) | DPL_USER;
   p->tf->ds = (SEG_UDATA << 3) | DPL_USER;
@@ -159,36 +493,103 @@ void userinit(void)
   // run this process. the acquire forces the above
   // writes to be visible, and the lock is also needed
   // because the assignment might not be atomic.
-  acquire(&ptable.lock);
+  acquire(plock(p));
 
-  p->state = RUNNABLE;
+  place(p);
 
-  release(&ptable.lock);
+  release(plock(p));
+}
+
+// Start a kernel thread running fn, which must never return.
+// It has a process slot and a kernel stack like any process but
+// no user memory: forkret "returns" into fn instead of trapret.
+struct proc *
+kthread(char *name, void (*fn)(void))
+{
+  struct proc *p;
+
+  if ((p = allocproc()) == 0)
+    return 0;
+  if ((p->mm->pgdir = setupkvm()) == 0)
+  {
+    unalloc(p);
+    return 0;
+  }
+  *(uint *)((char *)p->context + sizeof *p->context) = (uint)fn;
+  safestrcpy(p->name, name, sizeof(p->name));
+
+  acquire(plock(p));
+  place(p);
+  release(plock(p));
+  return p;
 }
 
-// Grow current process's memory by n bytes.
+// Grow current process's memory by n bytes, for its threads too.
+// Growing only moves sz: the page fault handler backs the new part
+// of the heap with zeroed pages as it is touched.
 // Return 0 on success, -1 on failure.
 int growproc(int n)
 {
   uint sz;
   struct proc *curproc = myproc();
 
-  sz = curproc->sz;
+  acquiresleep(&curproc->mm->lock);
+  sz = curproc->mm->sz;
   if (n > 0)
   {
-    if ((sz = allocuvm(curproc->pgdir, sz, sz + n)) == 0)
+    if (sz + n < sz || sz + n > MMAP_AREA_START)
+    {
+      releasesleep(&curproc->mm->lock);
       return -1;
+    }
+    sz += n;
   }
   else if (n < 0)
   {
-    if ((sz = deallocuvm(curproc->pgdir, sz, sz + n)) == 0)
+    if ((sz = deallocuvm(curproc->mm->pgdir, sz, sz + n)) == 0)
+    {
+      releasesleep(&curproc->mm->lock);
       return -1;
+    }
   }
-  curproc->sz = sz;
+  curproc->mm->sz = sz;
+  releasesleep(&curproc->mm->lock);
   switchuvm(curproc);
   return 0;
 }
 
+// Give child np the frames of p's shared anonymous mapping map,
+// faulting in the pages p hasn't touched yet so that the two can't
+// later fault in different ones.  Returns -1 if out of memory.
+static int share_anon(struct proc *p, struct proc *np, struct mem_mapping *map)
+{
+  uint a;
+  pte_t *pte, *cpte;
+  char *mem;
+
+  for (a = map->addr; a < vma_end(map); a += PGSIZE)
+  {
+    if ((pte = walkpgdir(p->mm->pgdir, (void *)a, 0)) == 0 || !(*pte & PTE_P))
+    {
+      if ((mem = kzalloc()) == 0)
+        return -1;
+      if (mappages(p->mm->pgdir, (char *)a, PGSIZE, V2P(mem), vma_pteflags(map)) < 0)
+      {
+        kfree(mem);
+        return -1;
+      }
+      if ((pte = walkpgdir(p->mm->pgdir, (void *)a, 0)) == 0)
+        return -1;
+    }
+    if ((cpte = walkpgdir(np->mm->pgdir, (void *)a, 1)) == 0)
+      return -1;
+    *cpte = *pte;
+    kref(P2V(PTE_ADDR(*pte)));
+  }
+  map->allocated = 1;
+  return 0;
+}
+
 // Create a new process copying p as the parent.
 // Sets up stack to return as if from system call.
 // Caller must set state of returned proc to RUNNABLE.
@@ -197,79 +598,144 @@ int fork(void)
   // now lets take a look at our new program we have created
   int i, pid;
   struct proc *np;
+  struct mem_mapping *map;
   struct proc *curproc = myproc();
+  struct tlbbatch flushes; // parent pages made read-only
 
   // Allocate process.
   if ((np = allocproc()) == 0)
   {
     return -1;
   }
-
-  
+  if (curproc->nofile > np->nofile && fdgrow(np) < 0)
+  {
+    unalloc(np);
+    return -1;
+  }
 
   // THIS NEXT SECTION OF CODE IS THE IMPLEMTATION OF MAPSHARED
 
-  np->num_mappings = curproc->num_mappings; // copy the number of mappings
+  acquiresleep(&curproc->mm->lock); // threads may be changing the mappings
+  if (vma_copy(&np->mm->memoryMappings, curproc->mm->memoryMappings) < 0)
+  {
+    releasesleep(&curproc->mm->lock);
+    unalloc(np);
+    return -1;
+  }
+  np->mm->num_mappings = curproc->mm->num_mappings; // copy the number of mappings
+  np->mm->mmap_hint = curproc->mm->mmap_hint;
 
   // Set up the new page directory for the child
-  if ((np->pgdir = copyuvm(curproc->pgdir, curproc->sz)) == 0)
+  if ((np->mm->pgdir = copyuvm(curproc->mm)) == 0)
   {
-    kfree(np->kstack);
-    np->kstack = 0;
-    np->state = UNUSED;
+    releasesleep(&curproc->mm->lock);
+    vma_clear(&np->mm->memoryMappings);
+    unalloc(np);
     return -1;
   }
 
   // Copy and mark the parent's pages as COW
-  for (i = 0; i < curproc->num_mappings; i++)
+  flushes.n = flushes.nfree = 0;
+  for (map = vma_first(curproc->mm->memoryMappings); map; map = vma_above(curproc->mm->memoryMappings, map->addr))
   {
-    struct mem_mapping *map = &curproc->memoryMappings[i];
+    // Shared anonymous memory has nothing behind it that the child
+    // could fault its pages in from, so the child maps the parent's
+    // frames, all of them, writable as they are
+    if ((map->flags & MAP_SHARED) && (map->flags & MAP_ANONYMOUS))
+    {
+      if (share_anon(curproc, np, map) < 0)
+      {
+        tlbflushdone(curproc->mm->pgdir, &flushes);
+        releasesleep(&curproc->mm->lock);
+        vma_clear(&np->mm->memoryMappings);
+        unalloc(np);
+        return -1;
+      }
+      continue;
+    }
 
-    // Check if mapping is private and should be COW
-    if (map->flags & MAP_PRIVATE)
+    // Check if mapping is private and should be COW; the program
+    // image lies below sz, so copyuvm has already shared it
+    if ((map->flags & MAP_PRIVATE) && !(map->flags & MAP_IMAGE))
     {
      
       // go through the mappings for the current proc and make all pte's read only, then copy all the pte's to the child
 
       for (uint address = map->addr; address < map->addr + map->length; address += PGSIZE)
       {
+        // copyuvm shared the whole page table
+        if (np->mm->pgdir[PDX(address)] & PDE_SHARED)
+        {
+          address = PGADDR(PDX(address) + 1, 0, 0) - PGSIZE;
+          continue;
+        }
+
         // Access the PTE for the parent.
-        pte_t *pte = walkpgdir(curproc->pgdir, (void *)address, 0);
-        if (pte && (*pte & PTE_P))
+        pte_t *pte = walkpgdir(curproc->mm->pgdir, (void *)address, 0);
+        if (pte && (*pte & PTE_PS))
+        {
+          // A huge page: the child shares the whole 4MB frame
+          // through its own page directory entry.
+          if (*pte & PTE_W)
+          {
+            *pte &= ~PTE_W;
+            *pte |= PTE_COW;
+            tlbinval(&flushes, address);
+          }
+          np->mm->pgdir[PDX(address)] = *pte;
+          kref(P2V(PTE_ADDR(*pte)));
+          address = HUGEPGROUNDDOWN(address) + HUGEPGSIZE - PGSIZE;
+        }
+        else if (pte && (*pte & PTE_P))
         {
           // Make the parent's page read-only and set the COW flag.
-          *pte &= ~PTE_W;
-          *pte |= PTE_COW;
-          lcr3(V2P(curproc->pgdir)); // Flush the TLB to ensure the new PTE setting takes effect.
+          if (*pte & PTE_W)
+          {
+            *pte &= ~PTE_W;
+            *pte |= PTE_COW;
+            tlbinval(&flushes, address); // the TLB must not keep the page writable
+          }
 
           // Now ensure the child has a PTE for the same address.
-          pte_t *child_pte = walkpgdir(np->pgdir, (void *)address, 1); // Pass 1 to create the PTE if it does not exist.
+          pte_t *child_pte = walkpgdir(np->mm->pgdir, (void *)address, 1); // Pass 1 to create the PTE if it does not exist.
           if (child_pte)
           {
-            // Copy parent PTE to child PTE.
+            // Copy parent PTE to child PTE; the frame now has one more sharer.
             *child_pte = *pte;
+            kref(P2V(PTE_ADDR(*pte)));
           }
           else
           {
             panic("Failed to allocate PTE for child.");
           }
         }
+        else if (pte && (*pte & PTE_SWAP))
+        {
+          // A page out in swap: the child shares the slot.
+          pte_t *child_pte = walkpgdir(np->mm->pgdir, (void *)address, 1);
+          if (child_pte == 0)
+            panic("Failed to allocate PTE for child.");
+          *child_pte = *pte;
+          swapdup(*pte);
+        }
       }
     }
-    np->memoryMappings[i] = *map;
   }
- 
+
+  tlbflushdone(curproc->mm->pgdir, &flushes);
+  releasesleep(&curproc->mm->lock);
+
   //END SECTION
 
   // Copy process state from proc.
-  np->sz = curproc->sz;
+  np->mm->sz = curproc->mm->sz;
   np->parent = curproc;
   *np->tf = *curproc->tf;
 
   // Clear %eax so that fork returns 0 in the child.
   np->tf->eax = 0;
 
-  for (i = 0; i < NOFILE; i++)
+  for (i = 0; i < curproc->nofile; i++)
     if (curproc->ofile[i])
       np->ofile[i] = filedup(curproc->ofile[i]);
   np->cwd = idup(curproc->cwd);
@@ -278,118 +744,273 @@ int fork(void)
 
   pid = np->pid;
 
-  acquire(&ptable.lock);
+  acquire(plock(np));
 
-  np->state = RUNNABLE;
+  np->priority = curproc->priority;
+  place(np);
 
-  release(&ptable.lock);
+  release(plock(np));
 
   return pid;
 }
 
-// Exit the current process.  Does not return.
-// An exited process remains in the zombie state
-// until its parent calls wait() to find out it exited.
-void exit(void)
+// Start the program at path in a new child process, as fork and
+// exec would but without copying this process's memory first.
+// The child's descriptors 0, 1 and 2 are files[0..2] (if not 0)
+// and it has no others.  Returns the child's pid.
+int spawn(char *path, char **argv, struct file **files)
 {
+  int i, pid;
+  struct proc *np;
   struct proc *curproc = myproc();
-  struct proc *p;
-  int fd;
 
-  if (curproc == initproc)
-    panic("init exiting");
+  if ((np = allocproc()) == 0)
+    return -1;
 
-  // Close all open files.
-  for (fd = 0; fd < NOFILE; fd++)
+  np->parent = curproc;
+  *np->tf = *curproc->tf; // user segments and flags
+  for (i = 0; i < 3; i++)
+    if (files[i])
+      np->ofile[i] = filedup(files[i]);
+  np->cwd = idup(curproc->cwd);
+
+  if (execproc(np, path, argv) < 0)
   {
-    if (curproc->ofile[fd])
+    for (i = 0; i < 3; i++)
     {
-      fileclose(curproc->ofile[fd]);
-      curproc->ofile[fd] = 0;
+      if (np->ofile[i])
+      {
+        fileclose(np->ofile[i]);
+        np->ofile[i] = 0;
+      }
     }
+    begin_op();
+    iput(np->cwd);
+    end_op();
+    np->cwd = 0;
+    unalloc(np);
+    return -1;
   }
 
-  begin_op();
-  iput(curproc->cwd);
-  end_op();
-  curproc->cwd = 0;
+  pid = np->pid;
 
-  acquire(&ptable.lock);
+  acquire(plock(np));
+  np->priority = curproc->priority;
+  place(np);
+  release(plock(np));
 
-  // Parent might be sleeping in wait().
-  wakeup1(curproc->parent);
+  return pid;
+}
 
-  // Pass abandoned children to init.
-  for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+// Create a thread: a process sharing this one's page table and
+// mappings that starts in fn(arg) on the PGSIZE user stack at
+// stack.  It gets its own copies of the file descriptors, which
+// share the open files.  Returns the new pid; join reaps it.
+int clone(void (*fn)(void *), void *arg, void *stack)
+{
+  int i;
+  uint sp, ustack[2];
+  struct proc *np;
+  struct proc *curproc = myproc();
+
+  if ((np = allocproc()) == 0)
+    return -1;
+  if (curproc->nofile > np->nofile && fdgrow(np) < 0)
   {
-    if (p->parent == curproc)
-    {
-      p->parent = initproc;
-      if (p->state == ZOMBIE)
-        wakeup1(initproc);
-    }
+    unalloc(np);
+    return -1;
   }
-  // clear out memory of
-  memset(curproc->memoryMappings, 0, sizeof(struct mem_mapping) * 32);
-  curproc->num_mappings = 0;
 
-  // Jump into the scheduler, never to return.
-  curproc->state = ZOMBIE;
-  sched();
-  panic("zombie exit");
+  sp = (uint)stack + PGSIZE - sizeof ustack;
+  ustack[0] = 0xffffffff; // fake return PC
+  ustack[1] = (uint)arg;
+  if ((uint)stack + PGSIZE < (uint)stack ||
+      copyout(curproc->mm->pgdir, sp, ustack, sizeof ustack) < 0)
+  {
+    unalloc(np);
+    return -1;
+  }
+
+  acquire(&ptable.lock);
+  np->mm->ref = np->mm->users = 0;
+  np->mm = curproc->mm;
+  np->mm->ref++;
+  np->mm->users++;
+  release(&ptable.lock);
+
+  np->ustack = stack;
+  np->parent = curproc;
+  *np->tf = *curproc->tf;
+  np->tf->eip = (uint)fn;
+  np->tf->esp = sp;
+
+  for (i = 0; i < curproc->nofile; i++)
+    if (curproc->ofile[i])
+      np->ofile[i] = filedup(curproc->ofile[i]);
+  np->cwd = idup(curproc->cwd);
+
+  safestrcpy(np->name, curproc->name, sizeof(curproc->name));
+
+  acquire(plock(np));
+  np->priority = curproc->priority;
+  place(np);
+  release(plock(np));
+
+  return np->pid;
 }
 
-// Wait for a child process to exit and return its pid.
-// Return -1 if this process has no children.
-int wait(void)
+// Wait for a thread this process cloned to exit, and return its
+// pid, with the stack it was given in *stack.
+// Return -1 if it has no threads.
+int join(void **stack)
 {
   struct proc *p;
   int havekids, pid;
+  void *ustack;
   struct proc *curproc = myproc();
 
   acquire(&ptable.lock);
   for (;;)
   {
-    // Scan through table looking for exited children.
     havekids = 0;
     for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
     {
-      if (p->parent != curproc)
+      if (p->parent != curproc || p->mm != curproc->mm)
         continue;
       havekids = 1;
+      acquire(plock(p));
       if (p->state == ZOMBIE)
       {
-        // Found one.
         pid = p->pid;
-        kfree(p->kstack);
-        p->kstack = 0;
-        freevm(p->pgdir);
-        p->pid = 0;
-        p->parent = 0;
-        p->name[0] = 0;
-        p->killed = 0;
-        p->state = UNUSED;
+        ustack = p->ustack;
+        reap(p);
+        release(plock(p));
         release(&ptable.lock);
+        *stack = ustack; // may fault
         return pid;
       }
+      release(plock(p));
     }
 
-    // No point waiting if we don't have any children.
     if (!havekids || curproc->killed)
     {
       release(&ptable.lock);
       return -1;
     }
 
-    // Wait for children to exit.  (See wakeup1 call in proc_exit.)
-    sleep(curproc, &ptable.lock); // DOC: wait-sleep
+    sleep(curproc, &ptable.lock);
   }
 }
 
-// PAGEBREAK: 42
-//  Per-CPU process scheduler.
-//  Each CPU calls scheduler() after setting itself up.
-//  Scheduler never returns.  It loops, doing:
+// Exit the current process.  Does not return.
+// An exited process remains in the zombie state
+// until its parent calls wait() to find out it exited.
+void exit(void)
+{
+  struct proc *curproc = myproc();
+  struct proc *p;
+  int fd, last;
+
+  if (curproc == initproc)
+    panic("init exiting");
+
+  // The last user of the address space unmaps every mapping;
+  // what is left goes with the pgdir in wait().
+  acquiresleep(&curproc->mm->lock);
+  acquire(&ptable.lock);
+  last = --curproc->mm->users == 0;
+  release(&ptable.lock);
+  if (last)
+    unmap_all(curproc);
+  releasesleep(&curproc->mm->lock);
+
+  // Close all open files.
+  for (fd = 0; fd < curproc->nofile; fd++)
+  {
+    if (curproc->ofile[fd])
+    {
+      fileclose(curproc->ofile[fd]);
+      curproc->ofile[fd] = 0;
+    }
+  }
+  fdfree(curproc);
+
+  begin_op();
+  iput(curproc->cwd);
+  end_op();
+  curproc->cwd = 0;
+
+  acquire(&ptable.lock);
+
+  // Parent might be sleeping in wait().
+  wakeup(curproc->parent);
+
+  // Pass abandoned children to init.
+  for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+  {
+    if (p->parent == curproc)
+    {
+      p->parent = initproc;
+      if (p->state == ZOMBIE)
+        wakeup(initproc);
+    }
+  }
+  // Jump into the scheduler, never to return.
+  acquire(plock(curproc));
+  curproc->state = ZOMBIE;
+  release(&ptable.lock);
+  sched();
+  panic("zombie exit");
+}
+
+// Wait for a child process to exit and return its pid.
+// Return -1 if this process has no children.
+int wait(void)
+{
+  struct proc *p;
+  int havekids, pid;
+  struct proc *curproc = myproc();
+
+  acquire(&ptable.lock);
+  for (;;)
+  {
+    // Scan through table looking for exited children.
+    havekids = 0;
+    for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+    {
+      if (p->parent != curproc || p->mm == curproc->mm)
+        continue; // threads are for join
+      havekids = 1;
+      // p holds its lock until it is off its CPU for good.
+      acquire(plock(p));
+      if (p->state == ZOMBIE)
+      {
+        // Found one.
+        pid = p->pid;
+        reap(p);
+        release(plock(p));
+        release(&ptable.lock);
+        return pid;
+      }
+      release(plock(p));
+    }
+
+    // No point waiting if we don't have any children.
+    if (!havekids || curproc->killed)
+    {
+      release(&ptable.lock);
+      return -1;
+    }
+
+    // Wait for children to exit.  (See wakeup call in exit.)
+    sleep(curproc, &ptable.lock); // DOC: wait-sleep
+  }
+}
+
+// PAGEBREAK: 42
+//  Per-CPU process scheduler.
+//  Each CPU calls scheduler() after setting itself up.
+//  Scheduler never returns.  It loops, doing:
 //   - choose a process to run
 //   - swtch to start running that process
 //   - eventually that process transfers control
@@ -398,6 +1019,8 @@ void scheduler(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
+  struct runq *rq = &ptable.rq[cpuid()];
+  int ran;
   c->proc = 0;
 
   for (;;)
@@ -405,32 +1028,62 @@ void scheduler(void)
     // Enable interrupts on this processor.
     sti();
 
-    // Loop over process table looking for process to run.
-    acquire(&ptable.lock);
-    for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+    ran = 0;
+    if (ticks - ptable.boosted >= BOOSTTICKS)
+      boost();
+
+    // Run the first process on this CPU's highest non-empty
+    // level, or else one from the busiest CPU.  Going idle under
+    // the run queue lock means runnable() either queues its
+    // process before we look or finds us idle and kicks us.
+    acquire(&rq->lock);
+    if ((p = dequeue(rq)) == 0)
+      c->idle = 1;
+    release(&rq->lock);
+    if (p == 0 && (p = steal(cpuid())) != 0)
+      c->idle = 0;
+    if (p)
     {
-      if (p->state != RUNNABLE)
-        continue;
+      ran = 1;
 
       // Switch to chosen process.  It is the process's job
-      // to release ptable.lock and then reacquire it
+      // to release plock(p) and then reacquire it
       // before jumping back to us.
+      acquire(plock(p));
+      p->cpu = cpuid();
       c->proc = p;
       switchuvm(p);
       p->state = RUNNING;
 
       swtch(&(c->scheduler), p->context);
       switchkvm();
+      c->pgdir = 0;
 
       // Process is done running for now.
       // It should have changed its p->state before coming back.
       c->proc = 0;
+      release(plock(p));
     }
-    release(&ptable.lock);
+
+    // Nothing to run: use the time to pre-zero a free page, or
+    // else halt until an interrupt.  A process made RUNNABLE
+    // meanwhile clears idle, and its IPI wakes the hlt.
+    if (!ran && !kidlezero())
+    {
+      cli();
+      if (c->idle)
+      {
+        timerset(1);
+        stihlt();
+        cli();
+        timerset(0);
+      }
+    }
+    c->idle = 0;
   }
 }
 
-// Enter scheduler.  Must hold only ptable.lock
+// Enter scheduler.  Must hold only plock(p)
 // and have changed proc->state. Saves and restores
 // intena because intena is a property of this
 // kernel thread, not this CPU. It should
@@ -442,8 +1095,8 @@ void sched(void)
   int intena;
   struct proc *p = myproc();
 
-  if (!holding(&ptable.lock))
-    panic("sched ptable.lock");
+  if (!holding(plock(p)))
+    panic("sched plock");
   if (mycpu()->ncli != 1)
     panic("sched locks");
   if (p->state == RUNNING)
@@ -451,6 +1104,7 @@ void sched(void)
   if (readeflags() & FL_IF)
     panic("sched interruptible");
   intena = mycpu()->intena;
+  kstat(KS_SWTCH);
   swtch(&p->context, mycpu()->scheduler);
   mycpu()->intena = intena;
 }
@@ -458,10 +1112,127 @@ void sched(void)
 // Give up the CPU for one scheduling round.
 void yield(void)
 {
-  acquire(&ptable.lock); // DOC: yieldlock
-  myproc()->state = RUNNABLE;
+  struct proc *p = myproc();
+
+  acquire(plock(p)); // DOC: yieldlock
+  runnable(p);
   sched();
+  release(plock(p));
+}
+
+// Charge the running process for a clock tick.  It gives up the
+// CPU when it has used its level's quantum, moving down a level,
+// or when a process at a higher level is waiting.
+void schedtick(void)
+{
+  struct proc *p = myproc();
+  int preempt;
+
+  acquire(plock(p));
+  preempt = 0;
+  if (++p->usedticks >= (1 << p->priority))
+  {
+    if (p->priority < NPRIO - 1)
+      p->priority++;
+    p->usedticks = 0;
+    preempt = 1;
+  }
+  if (ptable.rq[p->cpu].levels & ((1 << p->priority) - 1))
+    preempt = 1;
+  if (preempt)
+  {
+    runnable(p);
+    sched();
+  }
+  release(plock(p));
+}
+
+// Move every process to level 0 with a fresh quantum, unless
+// another CPU just has.  A queued process's level is guarded by
+// its run queue's lock, any other's by its own lock.
+static void
+boost(void)
+{
+  struct proc *p;
+  struct runq *rq;
+  int i;
+
+  acquire(&ptable.lock);
+  if (ticks - ptable.boosted < BOOSTTICKS)
+  {
+    release(&ptable.lock);
+    return;
+  }
+  ptable.boosted = ticks;
   release(&ptable.lock);
+
+  for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+  {
+    acquire(plock(p));
+    if (p->state != RUNNABLE)
+    {
+      p->priority = 0;
+      p->usedticks = 0;
+    }
+    release(plock(p));
+  }
+  for (rq = ptable.rq; rq < &ptable.rq[ncpu]; rq++)
+  {
+    acquire(&rq->lock);
+    for (i = 0; i < NPRIO; i++)
+    {
+      for (p = rq->head[i]; p; p = p->rnext)
+      {
+        p->priority = 0;
+        p->usedticks = 0;
+      }
+      if (i == 0 || rq->head[i] == 0)
+        continue;
+      if (rq->tail[0])
+        rq->tail[0]->rnext = rq->head[i];
+      else
+        rq->head[0] = rq->head[i];
+      rq->tail[0] = rq->tail[i];
+      rq->head[i] = rq->tail[i] = 0;
+    }
+    if (rq->levels)
+      rq->levels = 1;
+    release(&rq->lock);
+  }
+}
+
+// Put process pid at priority level prio with a fresh quantum.
+// Return its old level, or -1 if there is no such process.
+int setpriority(int pid, int prio)
+{
+  struct proc *p;
+  int old;
+
+  if (prio < 0 || prio >= NPRIO)
+    return -1;
+  for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+  {
+    acquire(plock(p));
+    if (p->pid == pid && p->state != UNUSED && p->state != ZOMBIE)
+    {
+      old = p->priority;
+      if (p->state == RUNNABLE && unqueue(p) == 0)
+      {
+        p->priority = prio;
+        p->usedticks = 0;
+        runnable(p);
+      }
+      else
+      {
+        p->priority = prio;
+        p->usedticks = 0;
+      }
+      release(plock(p));
+      return old;
+    }
+    release(plock(p));
+  }
+  return -1;
 }
 
 // A fork child's very first scheduling by scheduler()
@@ -469,8 +1240,8 @@ void yield(void)
 void forkret(void)
 {
   static int first = 1;
-  // Still holding ptable.lock from scheduler.
-  release(&ptable.lock);
+  // Still holding plock(p) from scheduler.
+  release(plock(myproc()));
 
   if (first)
   {
@@ -480,6 +1251,8 @@ void forkret(void)
     first = 0;
     iinit(ROOTDEV);
     initlog(ROOTDEV);
+    swapinit(ROOTDEV);
+    tmpfsinit();
   }
 
   // Return to "caller", actually trapret (see allocproc).
@@ -490,6 +1263,7 @@ void forkret(void)
 void sleep(void *chan, struct spinlock *lk)
 {
   struct proc *p = myproc();
+  struct waitq *wq;
 
   if (p == 0)
     panic("sleep");
@@ -497,20 +1271,22 @@ void sleep(void *chan, struct spinlock *lk)
   if (lk == 0)
     panic("sleep without lk");
 
-  // Must acquire ptable.lock in order to
-  // change p->state and then call sched.
-  // Once we hold ptable.lock, we can be
-  // guaranteed that we won't miss any wakeup
-  // (wakeup runs with ptable.lock locked),
-  // so it's okay to release lk.
-  if (lk != &ptable.lock)
-  {                        // DOC: sleeplock0
-    acquire(&ptable.lock); // DOC: sleeplock1
-    release(lk);
-  }
-  // Go to sleep.
+  // Once p is on chan's wait queue holding plock(p), a wakeup
+  // can't take it off before sched() has switched away, so it
+  // won't miss one and it's okay to release lk.
+  wq = waitq(chan);
+  acquire(&wq->lock); // DOC: sleeplock1
   p->chan = chan;
+  p->wnext = wq->head;
+  wq->head = p;
+  acquire(plock(p));
+  release(&wq->lock);
+  release(lk);
+
+  // Go to sleep.
   p->state = SLEEPING;
+  if (tracing)
+    tracepoint(TR_SLEEP, (uint)chan);
 
   sched();
 
@@ -518,32 +1294,53 @@ void sleep(void *chan, struct spinlock *lk)
   p->chan = 0;
 
   // Reacquire original lock.
-  if (lk != &ptable.lock)
-  { // DOC: sleeplock2
-    release(&ptable.lock);
-    acquire(lk);
-  }
+  release(plock(p)); // DOC: sleeplock2
+  acquire(lk);
 }
 
 // PAGEBREAK!
 //  Wake up all processes sleeping on chan.
-//  The ptable lock must be held.
-static void
-wakeup1(void *chan)
+void wakeup(void *chan)
 {
-  struct proc *p;
-
-  for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-    if (p->state == SLEEPING && p->chan == chan)
-      p->state = RUNNABLE;
+  wakeupn(chan, NPROC);
 }
 
-// Wake up all processes sleeping on chan.
-void wakeup(void *chan)
+// Wake up at most n of the processes sleeping on chan, those
+// that have slept longest, and return how many it woke.
+int wakeupn(void *chan, int n)
 {
-  acquire(&ptable.lock);
-  wakeup1(chan);
-  release(&ptable.lock);
+  struct waitq *wq = waitq(chan);
+  struct proc **pp, *p;
+  int skip, woken = 0;
+
+  acquire(&wq->lock);
+  // sleep adds to the head, so the longest asleep are at the end:
+  // pass over all but the last n
+  skip = 0;
+  if (n < NPROC)
+    for (p = wq->head; p; p = p->wnext)
+      if (p->chan == chan)
+        skip++;
+  skip -= n;
+  for (pp = &wq->head; (p = *pp) != 0 && woken < n;)
+  {
+    if (p->chan == chan && skip-- > 0)
+      pp = &p->wnext;
+    else if (p->chan == chan)
+    {
+      acquire(plock(p));
+      *pp = p->wnext;
+      runnable(p);
+      if (tracing)
+        tracepoint(TR_WAKEUP, p->pid);
+      release(plock(p));
+      woken++;
+    }
+    else
+      pp = &p->wnext;
+  }
+  release(&wq->lock);
+  return woken;
 }
 
 // Kill the process with the given pid.
@@ -552,21 +1349,35 @@ void wakeup(void *chan)
 int kill(int pid)
 {
   struct proc *p;
+  struct waitq *wq;
 
-  acquire(&ptable.lock);
   for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
   {
+    acquire(plock(p));
     if (p->pid == pid)
     {
       p->killed = 1;
-      // Wake process from sleep if necessary.
-      if (p->state == SLEEPING)
-        p->state = RUNNABLE;
-      release(&ptable.lock);
+      // Wake process from sleep if necessary.  Its wait queue's
+      // lock comes first, so let go of plock(p) to take it and
+      // look again.
+      while (p->pid == pid && p->state == SLEEPING)
+      {
+        wq = waitq(p->chan);
+        release(plock(p));
+        acquire(&wq->lock);
+        acquire(plock(p));
+        if (p->pid == pid && p->state == SLEEPING && waitq(p->chan) == wq)
+        {
+          unsleep(p);
+          runnable(p);
+        }
+        release(&wq->lock);
+      }
+      release(plock(p));
       return 0;
     }
+    release(plock(p));
   }
-  release(&ptable.lock);
   return -1;
 }
 
@@ -614,7 +1425,7 @@ void procdump(void)
       state = states[p->state];
     else
       state = "???";
-    cprintf("%d %s %s", p->pid, state, p->name);
+    cprintf("%d %s %d %s", p->pid, state, p->priority, p->name);
     if (p->state == SLEEPING)
     {
       getcallerpcs((uint *)p->context->ebp + 2, pc);
@@ -625,149 +1436,671 @@ void procdump(void)
   }
 }
 
+// Map the page of file mapping map at a, read from ip, which the
+// caller has locked. Returns -1 if out of memory.
+static int
+map_file_page(struct proc *p, struct mem_mapping *map, struct inode *ip, uint a)
+{
+  uint offset_into_file = map->offset + (a - map->addr);
+  char *mem;
+
+  // shared mappings of a file all map its page cache frames, as do
+  // the read-only segments of a program, so its text is in memory
+  // once however many run it; private ones get their own copy of
+  // the cached page, or if the cache has no room, read straight
+  // into the frame
+  if ((map->flags & MAP_SHARED) || ((map->flags & MAP_IMAGE) && !(map->prot & PROT_WRITE)))
+    mem = pcache_get(ip, offset_into_file);
+  else if ((mem = kallocreclaim(0)) != 0)
+  {
+    char *cached = pcache_get(ip, offset_into_file);
+    if (cached)
+    {
+      memmove(mem, cached, PGSIZE);
+      kfree(cached);
+    }
+    else
+      readpage(ip, mem, offset_into_file);
+
+    // a program's data can end part way into a page; the rest is bss
+    uint filesz = map->filesz - (a - map->addr);
+    if ((map->flags & MAP_IMAGE) && filesz < PGSIZE)
+      memset(mem + filesz, 0, PGSIZE - filesz);
+  }
+  if (mem == 0)
+    return -1;
+
+  if (mappages(p->mm->pgdir, (char *)a, PGSIZE, V2P(mem), vma_pteflags(map)) < 0)
+  {
+    kfree(mem);
+    return -1;
+  }
+  return 0;
+}
+
+// Map the file page at va and, around it, up to the mapping's
+// fault-around window of following pages that are not yet present,
+// all under one shared inode lock. Reading a file never allocates
+// blocks, so like read() this needs no log transaction and doesn't
+// wait behind a commit. A fault on the page
+// where the previous window ended looks like a sequential scan and
+// doubles the window (up to FAULTAROUNDMAX); any other fault resets
+// it to FAULTAROUND. madvise can instead fix the window at its
+// largest (MADV_SEQUENTIAL) or at just the faulting page (MADV_RANDOM).
+// Returns -1 if there is no memory even for the faulting page.
+static int
+fault_file_pages(struct proc *p, struct mem_mapping *map, struct inode *ip, uint va)
+{
+  uint a, end;
+  int window;
+
+  if (map->advice == MADV_RANDOM)
+    window = 1;
+  else if (map->advice == MADV_SEQUENTIAL)
+    window = FAULTAROUNDMAX;
+  else if (va == map->ra_next && map->ra_window > 0)
+    window = map->ra_window * 2 > FAULTAROUNDMAX ? FAULTAROUNDMAX : map->ra_window * 2;
+  else
+    window = FAULTAROUND;
+  map->ra_window = window;
+
+  end = va + window * PGSIZE;
+  if (end > vma_end(map) || end < va)
+    end = vma_end(map);
+
+  ilockshared(ip);
+  for (a = va; a < end; a += PGSIZE)
+  {
+    int offset_into_file = map->offset + (a - map->addr); // this is were we want to grab the data in the file
+
+    if (a != va)
+    {
+      // neighbours are only worth mapping while there is file data behind them
+      pte_t *pte = walkpgdir(p->mm->pgdir, (void *)a, 0);
+      if (pte && (*pte & (PTE_P | PTE_SWAP)))
+        continue;
+      if (offset_into_file >= ip->size || ((map->flags & MAP_IMAGE) && a - map->addr >= map->filesz))
+        break;
+    }
+
+    if (map_file_page(p, map, ip, a) < 0)
+      break;
+  }
+  iunlock(ip);
+
+  map->ra_next = a;
+  if (a == va)
+  {
+    cprintf("Out of memory - file page fault\n");
+    return -1;
+  }
+  return 1;
+}
+
 // I decided to define our user level functions in proc.c as this is where almost everyting happens
 
-int page_fault_handler(uint va)
+// Back the whole 4MB-aligned chunk around va with one huge page, if
+// anonymous mapping map covers all of it, no small pages have been
+// mapped there yet, and a huge frame is free.  Returns 0 on success.
+// Shared mappings keep to small pages, since splitting a huge page
+// copies it, which would unshare it.
+static int
+fault_huge_page(struct proc *p, struct mem_mapping *map, uint va)
+{
+  uint a = HUGEPGROUNDDOWN(va);
+  char *mem;
+
+  if (map->flags & MAP_SHARED)
+    return -1;
+  if (a < map->addr || a + HUGEPGSIZE > vma_end(map) || a + HUGEPGSIZE < a)
+    return -1;
+  if (p->mm->pgdir[PDX(a)] & PTE_P)
+    return -1;
+  if ((mem = khugealloc()) == 0)
+    return -1;
+  memset(mem, 0, HUGEPGSIZE);
+  p->mm->pgdir[PDX(a)] = V2P(mem) | PTE_P | PTE_PS | vma_pteflags(map);
+  return 0;
+}
+
+// Map the zero page read-only at va, for a read fault on memory
+// that starts out zero; if perm lets it be written, the first write
+// copies it.  Returns 1, or -1 if out of memory.
+static int
+map_zero_page(struct proc *p, uint va, uint perm)
+{
+  char *zero = kzeropage();
+
+  if (perm & PTE_W)
+    perm = (perm & ~PTE_W) | PTE_COW;
+  if (mappages(p->mm->pgdir, (char *)PGROUNDDOWN(va), PGSIZE, V2P(zero), perm) < 0)
+  {
+    kfree(zero);
+    return -1;
+  }
+  return 1;
+}
+
+// Handle a fault at va, with the address space locked.  Sets
+// *kind to the kind of fault it was (FL_ in kstats.h) if it was
+// handled.
+static int pagefault(uint va, uint err, int *kind)
 {
-  struct file *f = 0;
   struct inode *ip = 0;
+  int grew = 0;
 
   /* Case 1 - Lazy Allocation */
   // go throgh kalloc routine
   struct proc *currproc = myproc(); // get the current process
 
-  pte_t *pte = walkpgdir(currproc->pgdir, (void *)va, 0);
+  pte_t *pte = walkpgdir(currproc->mm->pgdir, (void *)va, 0);
 
+  // find the mapping that covers va
+  struct mem_mapping *map = vma_lookup(currproc->mm->memoryMappings, va);
+
+  // the mapping's protection comes first: no access at all under
+  // PROT_NONE, and no writes without PROT_WRITE, even to COW pages
+  if (map && (map->prot == PROT_NONE || ((err & FEC_WR) && !(map->prot & PROT_WRITE))))
+  {
+    cprintf("Segmentation Fault\n");
+    return -1;
+  }
+
+  // the PTE allows the access: the fault went through a page table
+  // fork shared, which walkpgdir has just made this process's own
+  if (pte && (*pte & (PTE_P | PTE_U)) == (PTE_P | PTE_U) && (!(err & FEC_WR) || (*pte & PTE_W)))
+    return 1;
 
   // Check if the page fault was due to a write on a COW page
-  if (pte && (*pte & PTE_COW) && !(*pte & PTE_W))
+  if (pte && (*pte & PTE_P) && (*pte & PTE_COW) && !(*pte & PTE_W))
   {
     // This is a COW fault, handle it
-    char *mem = kalloc();
-    if (mem == 0)
+    kstat(KS_FAULTCOW);
+    *kind = FL_COW;
+    char *old_page = P2V(PTE_ADDR(*pte)); // Get the address of the old page
+    int huge = *pte & PTE_PS;            // a whole 4MB page is shared
+
+    if (krefcount(old_page) == 1)
     {
-      panic("Out of memory - COW page fault handler"); // Handle allocation failure
+      // Every other sharer is gone, so the page is ours to write.
+      *pte |= PTE_W;
     }
-    char *old_page = P2V(PTE_ADDR(*pte)); // Get the address of the old page
-    memmove(mem, old_page, PGSIZE);       // Copy contents to the new page
+    else if (iszeropage(old_page))
+    {
+      // the first write to memory that has only been read
+      char *mem = kallocreclaim(1);
+      if (mem == 0)
+      {
+        cprintf("Out of memory - zero page write fault\n");
+        return -1;
+      }
+      *pte = V2P(mem) | PTE_FLAGS(*pte) | PTE_W;
+      kfree(old_page);
+    }
+    else
+    {
+      char *mem = huge ? khugealloc() : kallocreclaim(0);
+      if (mem == 0)
+      {
+        // the few huge frames can run out, and with swap full so can
+        // memory; that costs this process, not the kernel
+        cprintf("Out of memory - COW page fault handler\n");
+        return -1;
+      }
+      memmove(mem, old_page, huge ? HUGEPGSIZE : PGSIZE); // Copy contents to the new page
 
-    // Update PTE to point to the new page and make it writable
-    *pte = V2P(mem) | PTE_FLAGS(*pte) | PTE_W;
+      // Update PTE to point to the new page and make it writable
+      *pte = V2P(mem) | PTE_FLAGS(*pte) | PTE_W;
+      if (huge)
+        khugefree(old_page);
+      else
+        kfree(old_page); // drop our reference to the shared page
+    }
     *pte &= ~PTE_COW; // Clear the COW flag
 
-    lcr3(V2P(currproc->pgdir)); // Flush the TLB
+    struct tlbbatch b = {0};
+    tlbinval(&b, va); // only this page's TLB entry is stale
+    tlbflushdone(currproc->mm->pgdir, &b);
 
     return 1; // COW fault handled successfully
   }
 
-  // get the number of array of mappings
-  int num_mappings = currproc->num_mappings;
+  // any other fault on a present page is a protection violation
+  if (pte && (*pte & PTE_P))
+  {
+    cprintf("Segmentation Fault\n");
+    return -1;
+  }
 
-  // I don't even care about the other mappings
+  // a page the reclaimer wrote out to swap is read back in
+  if (pte && (*pte & PTE_SWAP))
+  {
+    kstat(KS_FAULTSWAP);
+    *kind = FL_SWAP;
+    if (swapin(pte, map ? vma_pteflags(map) : PTE_W | PTE_U) < 0)
+    {
+      cprintf("Out of memory - swap in\n");
+      return -1;
+    }
+    return 1;
+  }
 
-  for (int i = 0; i < num_mappings; i++)
+  // the heap below sz is backed on first touch, by a zeroed page,
+  // or the zero page until it is written
+  if (map == 0 && va < currproc->mm->sz)
   {
+    kstat(KS_FAULTANON);
+    *kind = FL_ANON;
+    if (!(err & FEC_WR))
+      return map_zero_page(currproc, va, PTE_W | PTE_U);
+    char *mem = kallocreclaim(1);
+    if (mem == 0)
+    {
+      cprintf("Out of memory - heap page fault\n");
+      return -1;
+    }
+    if (mappages(currproc->mm->pgdir, (char *)PGROUNDDOWN(va), PGSIZE, V2P(mem), PTE_W | PTE_U) < 0)
+    {
+      kfree(mem);
+      return -1;
+    }
+    return 1;
+  }
 
-    // now I need to get the specific mapping at I
-    struct mem_mapping map = currproc->memoryMappings[i];
+  // the first check we want to do is check to see if it is Map_grows up
+  if (map == 0)
+  {
+    // a MAP_GROWSUP mapping can take over the guard page right above it,
+    // and grows by GROWSUPCHUNK pages at once, up to the ceiling that
+    // leaves a guard page below the next mapping; both are found in the
+    // VMA index, so growing costs two tree walks however many there are
+    map = vma_floor(currproc->mm->memoryMappings, va);
+    if (map == 0 || !(map->flags & MAP_GROWSUP) || va >= vma_end(map) + PGSIZE)
+    {
+      cprintf("Segmentation Fault\n");
+      return -1;
+    }
 
-    if (va >= map.addr && va < PGROUNDUP(map.addr + map.length))
+    uint end_of_mapping = vma_end(map);
+    struct mem_mapping *next = vma_above(currproc->mm->memoryMappings, map->addr);
+    uint ceiling = next ? next->addr - PGSIZE : KERNBASE;
+    if (ceiling < end_of_mapping + PGSIZE)
     {
+      cprintf("Segmentation Fault\n");
+      return -1;
+    }
+    if (ceiling - end_of_mapping > GROWSUPCHUNK * PGSIZE)
+      ceiling = end_of_mapping + GROWSUPCHUNK * PGSIZE;
 
-      map.allocated = 1; // set the mapping to be allocated
-      
-      if (map.fd > 0)
-      {
-        f = currproc->ofile[map.fd];
-        if (f == 0)
-        {
-          // Handle error: Invalid file descriptor
-          panic("mapping failed 1");
-        }
-        ip = f->ip;
-      }
+    map->length = ceiling - map->addr;
+    vma_resized(currproc->mm->memoryMappings, map);
+    grew = 1;
+  }
 
-      int file_backed = 0;
-      char *mem = kalloc(); // Call THIS ONLY IF PGDIR FAILS and if it doesn't fail teh value returned by pdgir will be parent's pgdir
-      if (mem == 0)
-      {
-        // Handle error: free any previously allocated pages
-        panic("mapping failed 2"); // Allocation failed
-      }
+  map->allocated = 1; // set the mapping to be allocated
 
-      // the first check we want to do is check to see if it is Map_grows up
-      if ((map.flags & MAP_GROWSUP))
-      {
-        uint end_of_mapping = PGROUNDUP(map.addr + map.length) + PGSIZE; // this is going to get end of our mapping
-        uint next_mapping_start = 0xFFFFFFFF;
+  if (map->file)
+  {
+    ip = map->file->ip; // the mapping holds its own reference to the file
+  }
 
-        for (int j = 0; j < num_mappings; j++)
-        {
+  // a program's bss, past its file data, starts out zero like
+  // anonymous memory
+  if ((map->flags & MAP_ANONYMOUS) || ((map->flags & MAP_IMAGE) && PGROUNDDOWN(va) - map->addr >= map->filesz))
+  {
+    kstat(KS_FAULTANON);
+    *kind = grew ? FL_GROWSUP : FL_ANON;
+    // memory that is only read needs no frame of its own; shared
+    // memory does, since copying on write would unshare it
+    if (!(err & FEC_WR) && !(map->flags & MAP_SHARED))
+    {
+      return map_zero_page(currproc, va, vma_pteflags(map));
+    }
+    if ((map->flags & MAP_ANONYMOUS) && fault_huge_page(currproc, map, va) == 0)
+    {
+      return 1;
+    }
 
-          if (currproc->memoryMappings[j].addr >= end_of_mapping &&
-              currproc->memoryMappings[j].addr < next_mapping_start)
-          {
-            next_mapping_start = currproc->memoryMappings[j].addr; // this sets the next mapping start to be in the right place
+    char *mem = kallocreclaim(1); // anonymous pages come pre-zeroed
+    if (mem == 0)
+    {
+      cprintf("Out of memory - anonymous page fault\n");
+      return -1;
+    }
+    if (mappages(currproc->mm->pgdir, (char *)va, PGSIZE, V2P(mem), vma_pteflags(map)) < 0)
+    {
+      kfree(mem);
+      return -1;
+    }
+    return 1;
+  }
 
-            break;
-          }
-        }
-        if (PGSIZE >= next_mapping_start - end_of_mapping)
-        {
-          break;
-        }
+  // this is the case where we are mapping from a file
+  kstat(KS_FAULTFILE);
+  *kind = grew ? FL_GROWSUP : FL_FILE;
+  return fault_file_pages(currproc, map, ip, PGROUNDDOWN(va));
+}
 
-        currproc->memoryMappings[i].length += (int)PGSIZE;
+// The trap handler: resolve a fault at va, or return -1 if the
+// process has no business touching it.  Handled faults go into
+// the latency histograms, waiting for the address space's lock
+// included.
+int page_fault_handler(uint va, uint err)
+{
+  struct mm *mm = myproc()->mm;
+  uint64 t0 = rdtsc();
+  int r, kind = -1;
+
+  if (tracing)
+    tracepoint(TR_FAULT, va);
+  acquiresleep(&mm->lock);
+  r = pagefault(va, err, &kind);
+  releasesleep(&mm->lock);
+  if (tracing)
+    tracepoint(TR_FAULTDONE, r);
+  if (r >= 0 && kind >= 0)
+    kstatfault(kind, rdtsc() - t0);
+  return r;
+}
 
-        // if not mapped anonymous we need to increment the file size
+// Fault in the pages of [va, va+n) that are not present yet, and if
+// write, break copy-on-write on those that are, so the kernel can then
+// use a system call's buffer without faulting on it with a spinlock
+// held (pipes and the console copy under theirs), as a fault reading
+// a file page sleeps.  Returns -1 if part of the range can't be
+// backed, or written.
+int fault_in(uint va, uint n, int write)
+{
+  struct proc *p = myproc();
+  pte_t *pte;
+  uint a;
 
-      }
+  for (a = PGROUNDDOWN(va); a < va + n; a += PGSIZE)
+  {
+    pte = walkpgdir(p->mm->pgdir, (void *)a, 0);
+    if ((pte == 0 || !(*pte & PTE_P)) && page_fault_handler(a, write ? FEC_WR : 0) < 0)
+      return -1;
+    if (write)
+    {
+      pte = walkpgdir(p->mm->pgdir, (void *)a, 0);
+      if (pte == 0 || (!(*pte & PTE_W) && page_fault_handler(a, FEC_PR | FEC_WR) < 0))
+        return -1;
+    }
+  }
+  return 0;
+}
 
-      if (!(map.flags & MAP_ANONYMOUS))
-      { // this is the case where we are mapping from a file
-        file_backed = 1;
-        
+// Return the end of the memory the current process may use from
+// va on: sz if va is below it, else the end of the accessible
+// mappings that run on from the one va is in.  Returns va if
+// there are none.  System calls take buffers in mappings (like
+// those malloc maps for big requests) as well as below sz.
+uint uend(uint va)
+{
+  struct proc *p = myproc();
+  struct mem_mapping *map;
+  uint a;
+
+  if (va < p->mm->sz)
+    return p->mm->sz;
+  acquiresleep(&p->mm->lock);
+  for (a = va; (map = vma_lookup(p->mm->memoryMappings, a)) != 0 && map->prot != PROT_NONE;)
+    a = vma_end(map);
+  releasesleep(&p->mm->lock);
+  return a;
+}
 
-        uint page_in_file = PGROUNDDOWN(va);                      // this is the page aligned
-        int offset_into_file = (int)page_in_file - (int)map.addr; // this is were we want to grab the data in the file
-        
+// Check that the current process may use [va, va+n), and for
+// writing if write, and fault it in (see fault_in) so the kernel
+// can copy to or from it directly.  Returns -1 if it may not.
+int uaccess(uint va, uint n, int write)
+{
+  if (va + n < va || uend(va) < va + n)
+    return -1;
+  return fault_in(va, n, write);
+}
 
-        // now we need to read the contents of the file
-        if (file_backed)
-        {
+// Unmap every mapping of process p, as munmap would.  A mapping
+// whose writeback fails is just dropped; its pages go with the pgdir.
+// Caller holds p->mm->lock.
+void unmap_all(struct proc *p)
+{
+  struct mem_mapping *map;
 
-          char buffer[PGSIZE]; // Create a buffer to hold the read data
-          begin_op();
-          ilock(ip);
-          // if it is a guard page do not read
-          readi(ip, buffer, offset_into_file, PGSIZE);
-          iunlock(ip);
-          end_op();
+  while ((map = p->mm->memoryMappings) != 0)
+  {
+    if (unmap_mapping(p, map) < 0)
+    {
+      vma_remove(&p->mm->memoryMappings, map);
+      vma_free(map);
+      p->mm->num_mappings--;
+    }
+  }
+}
 
-          memmove(mem, buffer, PGSIZE);
-        }
-      }
-      if (!file_backed)
+// Detach process p from the address space its threads share,
+// for exec to give it a new one with page table pgdir.  Return 1
+// if it did, in which case exec hands the old one to mmput once
+// off it, 0 if p was alone in it (exec then switches its page
+// table itself, under the address space's lock), or -1 if there
+// is no address space to spare.
+int mmunshare(struct proc *p, pde_t *pgdir)
+{
+  struct mm *mm;
+
+  acquire(&ptable.lock);
+  if (p->mm->users == 1)
+  {
+    release(&ptable.lock);
+    return 0;
+  }
+  if ((mm = mmalloc()) == 0)
+  {
+    release(&ptable.lock);
+    return -1;
+  }
+  p->mm->users--;
+  p->mm = mm;
+  p->mm->pgdir = pgdir;
+  release(&ptable.lock);
+  return 1;
+}
+
+// Drop a reference to address space mm, and free its page table
+// if it was the last.
+void mmput(struct mm *mm)
+{
+  acquire(&ptable.lock);
+  if (--mm->ref == 0)
+    freevm(mm->pgdir);
+  release(&ptable.lock);
+}
+
+// Pin and lock, for the page reclaimer, the address space of the
+// process in slot i.  Returns 0 if the slot has no live user
+// memory, shares it with an earlier slot (a thread), or its lock
+// is taken, which includes the caller's own while it handles a
+// fault.
+struct mm *mmgrab(int i)
+{
+  struct proc *p = &ptable.proc[i], *q;
+  struct mm *mm;
+
+  acquire(&ptable.lock);
+  mm = p->mm;
+  if (p->state == UNUSED || p->state == EMBRYO || mm == 0 || mm->users == 0)
+    goto none;
+  for (q = ptable.proc; q < p; q++)
+    if (q->mm == mm && q->state != UNUSED && q->state != EMBRYO)
+      goto none;
+  if (!tryacquiresleep(&mm->lock))
+    goto none;
+  mm->ref++;
+  release(&ptable.lock);
+  return mm;
+
+none:
+  release(&ptable.lock);
+  return 0;
+}
+
+// Unlock and unpin address space mm after mmgrab.
+void mmdrop(struct mm *mm)
+{
+  mmput(mm);
+  releasesleep(&mm->lock);
+}
+
+// Add up what address space mm maps into ms.  mm's lock must be
+// held.
+static void mmstat(struct mm *mm, struct memstat *ms)
+{
+  struct mem_mapping *map;
+  pde_t pde;
+  pte_t *pte;
+  char *v;
+  uint va;
+
+  ms->heap = mm->sz;
+  for (map = vma_first(mm->memoryMappings); map; map = vma_above(mm->memoryMappings, map->addr))
+    ms->mapped += map->length;
+
+  for (va = 0; va < KERNBASE; va += PGSIZE)
+  {
+    pde = mm->pgdir[PDX(va)];
+    if (!(pde & PTE_P) || (pde & PTE_PS))
+    {
+      if ((pde & (PTE_P | PTE_PS | PTE_U)) == (PTE_P | PTE_PS | PTE_U))
       {
-        memset(mem, 0, PGSIZE); // zero out the page
+        ms->anon += NPTENTRIES; // huge pages are only ever anonymous
+        if ((pde & PTE_COW) && krefcount(P2V(PTE_ADDR(pde))) > 1)
+          ms->cow += NPTENTRIES;
       }
+      va = PGADDR(PDX(va) + 1, 0, 0) - PGSIZE;
+      continue;
+    }
+    pte = (pte_t *)P2V(PTE_ADDR(pde)) + PTX(va); // not walkpgdir, which would unshare it
+    if (*pte & PTE_SWAP)
+      ms->swapped++;
+    if ((*pte & (PTE_P | PTE_U)) != (PTE_P | PTE_U))
+      continue;
+    v = P2V(PTE_ADDR(*pte));
+    if (iszeropage(v))
+      continue;
+    map = vma_lookup(mm->memoryMappings, va);
+    if (map && map->file &&
+        ((map->flags & MAP_SHARED) ||
+         pcache_holds(map->file->ip, map->offset + va - map->addr, v)))
+      ms->file++;
+    else
+    {
+      ms->anon++;
+      if ((pde & PDE_SHARED) || ((*pte & PTE_COW) && krefcount(v) > 1))
+        ms->cow++;
+    }
+  }
+}
+
+// Fill in the memory use of up to n live processes in ms, and
+// return how many there are.  Threads sharing an address space
+// each report all of it.
+int memstat(struct memstat *ms, int n)
+{
+  struct memstat m;
+  struct proc *p;
+  struct mm *mm;
+  int k = 0;
+
+  for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+  {
+    acquire(&ptable.lock);
+    mm = p->mm;
+    if (p->state == UNUSED || p->state == EMBRYO || mm == 0 || mm->users == 0)
+    {
+      release(&ptable.lock);
+      continue;
+    }
+    mm->ref++;
+    memset(&m, 0, sizeof(m));
+    m.pid = p->pid;
+    safestrcpy(m.name, p->name, sizeof(m.name));
+    release(&ptable.lock);
+
+    acquiresleep(&mm->lock);
+    mmstat(mm, &m);
+    releasesleep(&mm->lock);
+    mmput(mm);
+    if (k < n)
+      ms[k] = m;
+    k++;
+  }
+  return k;
+}
 
-      if (mappages(currproc->pgdir, (char *)va, PGSIZE, V2P(mem), PTE_W | PTE_U) < 0)
+// Is some process asleep on a channel inside the page at kernel
+// address page?  A futex waiter sleeps on its word's kernel
+// address, so the reclaimer has to leave that page where it is.
+// A hint, read without the locks.
+int chaninpage(char *page)
+{
+  struct proc *p;
+
+  for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+    if (p->state == SLEEPING && (char *)p->chan >= page && (char *)p->chan < page + PGSIZE)
+      return 1;
+  return 0;
+}
+
+// Back all of the new mapping map up front, for MAP_POPULATE, so
+// its first accesses don't fault. A file mapping is read in one pass
+// under a single inode lock, but only as far as the file goes: pages
+// past its end are left to fault in, so that writing back a shared
+// mapping still only extends the file where the process stored.
+// Pages that don't fit in memory are likewise left to fault in.
+void populate_mapping(struct proc *p, struct mem_mapping *map)
+{
+  uint a, end = vma_end(map);
+
+  if (map->prot == PROT_NONE)
+  {
+    return; // nothing may touch it, so there is nothing to prefault
+  }
+  map->allocated = 1;
+
+  if (map->flags & MAP_ANONYMOUS)
+  {
+    for (a = map->addr; a < end; a += PGSIZE)
+    {
+      if (a % HUGEPGSIZE == 0 && fault_huge_page(p, map, a) == 0)
       {
-        kfree(mem);
+        a += HUGEPGSIZE - PGSIZE;
+        continue;
       }
-      else
+      char *mem = kzalloc();
+      if (mem == 0)
       {
-        // After successful mappages call
-        walkpgdir(currproc->pgdir, (void *)va, 0);
-
+        return;
+      }
+      if (mappages(p->mm->pgdir, (char *)a, PGSIZE, V2P(mem), vma_pteflags(map)) < 0)
+      {
+        kfree(mem);
+        return;
       }
-
-      file_backed = 0;
-      return 1;
     }
+    return;
   }
 
-  cprintf("Segmentation Fault\n");
-  return -1;
-}
\ No newline at end of file
+  struct inode *ip = map->file->ip;
+  ilockshared(ip);
+  for (a = map->addr; a < end; a += PGSIZE)
+  {
+    if (map->offset + (a - map->addr) >= ip->size || map_file_page(p, map, ip, a) < 0)
+    {
+      break;
+    }
+  }
+  iunlock(ip);
+  // a fault where population stopped continues the sequential scan
+  map->ra_next = a;
+  map->ra_window = FAULTAROUNDMAX;
+}
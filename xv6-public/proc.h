@@ -8,18 +8,47 @@ struct cpu {
   int ncli;                    // Depth of pushcli nesting.
   int intena;                  // Were interrupts enabled before pushcli?
   struct proc *proc;           // The process running on this cpu or null
+  pde_t *volatile pgdir;       // User page table loaded, or 0 (see tlbshootdown)
+  volatile int idle;           // Found nothing to run and may halt (see kick)
+  uint nexttick;               // When the running process is next charged a tick
+};
+
+// User pages whose PTEs changed, to be dropped from the TLBs
+// (see tlbinval).  Past TLBFLUSHMAX pages only the count is kept
+// and the whole TLB is flushed.  Frames that were unmapped wait
+// in free[] until the flush (see tlbfree).
+struct tlbbatch {
+  int n;
+  uint va[TLBFLUSHMAX];
+  int nfree;
+  char *free[TLBFLUSHMAX];  // low bit set: a huge frame
 };
 
 struct mem_mapping {
   uint addr; // Starting virtual address
   int length; // Length of the mapping in bytes
   int flags;  // Flags as passed to mmap (e.g., MAP_FIXED, MAP_ANONYMOUS, etc.)
-  int fd;     // File descriptor for file-backed mappings, if applicable
+  int prot;   // PROT_READ/PROT_WRITE, or PROT_NONE (see mprotect)
+  struct file *file; // Backing file (own reference), or 0 if anonymous
+  uint offset; // File offset that addr maps (file-backed mappings)
   int originalLength; 
   int allocated;
+  uint ra_next;   // page where the last fault-around window ended
+  int ra_window;  // current fault-around window, in pages
+  int advice;     // MADV_ access pattern hint from madvise
+  uint filesz;    // MAP_IMAGE: bytes backed by the file, the rest is bss
+
+  // VMA index links, maintained by vma.c
+  struct mem_mapping *left;
+  struct mem_mapping *right;
+  int height;  // AVL height of this subtree
+  uint lo;     // lowest start address in this subtree
+  uint hi;     // highest end address in this subtree
+  uint maxgap; // largest hole between two mappings in this subtree
 };
 
-int page_fault_handler(uint addr); // the trap handler
+int page_fault_handler(uint addr, uint err); // the trap handler
+void populate_mapping(struct proc *p, struct mem_mapping *map); // MAP_POPULATE
 
 extern struct cpu cpus[NCPU];
 extern int ncpu;
@@ -47,8 +76,6 @@ enum procstate { UNUSED, EMBRYO, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
 // Per-process state
 struct proc {
-  uint sz;                     // Size of process memory (bytes)
-  pde_t* pgdir;                // Page table
   char *kstack;                // Bottom of kernel stack for this process
   enum procstate state;        // Process state
   int pid;                     // Process ID
@@ -57,11 +84,25 @@ struct proc {
   struct context *context;     // swtch() here to run process
   void *chan;                  // If non-zero, sleeping on chan
   int killed;                  // If non-zero, have been killed
-  struct file *ofile[NOFILE];  // Open files
+  struct file **ofile;         // Open files: ofile0, or a page (fdgrow)
+  int nofile;                  // Entries in ofile
+  struct file *ofile0[NOFILE];
+  char strarg[2][MAXPATH];     // argstr's copies of string arguments
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
-  struct mem_mapping memoryMappings[32];
-  int num_mappings; 
+  struct mm *mm;               // Mappings, shared with threads (mm.h)
+  char *ustack;                // Stack clone started it on, for join
+  int priority;                // Run queue level, 0 (highest) to NPRIO-1
+  int usedticks;               // Ticks run at this level
+  struct proc *rnext;          // Next on the run queue
+  struct proc *fnext;          // Next free slot, if UNUSED
+  int cpu;                     // CPU whose run queue it goes on
+  struct proc *wnext;          // Next on the wait queue for chan
+  uint wakeat;                 // timersleep deadline, in nowus() time
+  int theap;                   // Index in the timer heap, or -1
+  struct ring *ring;           // Submission ring (ring.c), or 0
+  int ringentries;             // Its size, as ringsetup() made it
+  int *sysargs;                // Arguments of the ring entry running, or 0
 };
 
 // Process memory is laid out contiguously, low addresses first:
@@ -0,0 +1,106 @@
+//
+// Sampling profiler.
+//
+// While profiling is on, each busy CPU's timer goes off every
+// PROFUS microseconds as well as on its ticks (see arm in
+// timer.c), and the interrupt records where the CPU was, kernel
+// or user, in a ring of the CPU's own.  profread() drains the
+// rings; a ring that is full drops samples until it is.
+//
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "x86.h"
+#include "spinlock.h"
+#include "prof.h"
+
+#define NPROFRING 1024  // samples a CPU holds until drained
+
+struct profring {
+  struct spinlock lock;
+  uint r;        // next sample to read
+  uint w;        // next free slot
+  uint dropped;  // samples lost to a full ring
+  struct profsample s[NPROFRING];
+} __attribute__((aligned(64)));
+
+static struct profring ring[NCPU];
+int profiling;
+
+void
+profinit(void)
+{
+  int i;
+
+  for(i = 0; i < NCPU; i++)
+    initlock(&ring[i].lock, "prof");
+}
+
+// Record where the timer interrupt with trap frame tf found
+// this CPU.  Called with interrupts off.
+void
+profsample(struct trapframe *tf)
+{
+  struct profring *r = &ring[cpuid()];
+  struct profsample *s;
+  struct proc *p;
+
+  acquire(&r->lock);
+  if(r->w - r->r < NPROFRING){
+    s = &r->s[r->w++ % NPROFRING];
+    s->eip = tf->eip;
+    p = myproc();
+    s->pid = p ? p->pid : 0;
+    s->cpu = cpuid();
+  } else
+    r->dropped++;
+  release(&r->lock);
+}
+
+// Turn profiling on, with empty rings, or off.  Returns how many
+// samples were dropped since it was last turned on.
+int
+profile(int on)
+{
+  int i, dropped;
+
+  dropped = 0;
+  for(i = 0; i < ncpu; i++){
+    acquire(&ring[i].lock);
+    dropped += ring[i].dropped;
+    if(on)
+      ring[i].r = ring[i].w = ring[i].dropped = 0;
+    release(&ring[i].lock);
+  }
+  profiling = on;
+  return dropped;
+}
+
+// Move up to n samples from the rings to s, which may be user
+// memory; return how many.  They go through buf so that no page
+// fault can happen with a ring locked.
+int
+profread(struct profsample *s, int n)
+{
+  struct profsample buf[32];
+  struct profring *r;
+  int i, k, got;
+
+  got = 0;
+  for(i = 0; i < ncpu && got < n; ){
+    r = &ring[i];
+    acquire(&r->lock);
+    for(k = 0; r->r != r->w && k < NELEM(buf) && got + k < n; k++)
+      buf[k] = r->s[r->r++ % NPROFRING];
+    release(&r->lock);
+    memmove(s + got, buf, k * sizeof(buf[0]));
+    got += k;
+    if(k < NELEM(buf))
+      i++;
+  }
+  return got;
+}
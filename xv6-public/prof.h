@@ -0,0 +1,7 @@
+// Where a CPU was when its profiling timer went off, as
+// profread() returns the samples.
+struct profsample {
+  uint eip;
+  int pid;  // process running, or 0 if none (the scheduler)
+  int cpu;
+};
@@ -0,0 +1,225 @@
+// Run a command under the kernel's sampling profiler and print
+// where the CPUs spent their time, by function.
+//
+// usage: profile command [args...]
+//
+// Kernel addresses are looked up in /kernel.sym and the command's
+// own in /<command>.sym, which the Makefile puts on the disk.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "fs.h"
+#include "mmap.h"
+#include "memlayout.h"
+#include "prof.h"
+
+#define NTOP 30  // functions printed
+
+struct sym {
+  uint addr;
+  char *name;
+  uint count;  // samples in it
+};
+
+struct symtab {
+  struct sym *s;
+  int n;
+  uint other;  // samples in none of s
+};
+
+struct symtab ktab, utab;
+uint others;  // samples in other processes' user code
+uint total;
+
+// The command's pid and whether it is done, shared with the
+// process that waits for it.
+struct {
+  volatile int pid;
+  volatile int done;
+} *shared;
+
+static int
+hexval(char c)
+{
+  if(c >= '0' && c <= '9')
+    return c - '0';
+  if(c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  return -1;
+}
+
+// Read the symbols, lines of "<8 hex digits> <name>", in path.
+static void
+load(char *path, struct symtab *t)
+{
+  struct stat st;
+  char *buf, *p, *e;
+  int fd, n, i, h;
+  uint addr;
+
+  if((fd = open(path, O_RDONLY)) < 0 || fstat(fd, &st) < 0){
+    printf(2, "profile: no symbols in %s\n", path);
+    return;
+  }
+  buf = malloc(st.size + 1);
+  for(n = 0; n < st.size; n += i)
+    if((i = read(fd, buf + n, st.size - n)) <= 0)
+      break;
+  buf[n] = 0;
+  close(fd);
+
+  for(i = 0, t->n = 0; i < n; i++)
+    if(buf[i] == '\n')
+      t->n++;
+  t->s = malloc((t->n + 1) * sizeof(struct sym));
+  t->n = 0;
+  for(p = buf; *p; p = e + 1){
+    if((e = strchr(p, '\n')) == 0)
+      break;
+    *e = 0;
+    addr = 0;
+    for(i = 0; i < 8 && (h = hexval(p[i])) >= 0; i++)
+      addr = addr << 4 | h;
+    if(i == 8 && p[8] == ' ' && addr != 0){
+      t->s[t->n].addr = addr;
+      t->s[t->n].name = p + 9;
+      t->s[t->n].count = 0;
+      t->n++;
+    }
+  }
+}
+
+// Charge a sample at eip to the function it is in.
+static void
+charge(struct symtab *t, uint eip)
+{
+  struct sym *best;
+  int i;
+
+  best = 0;
+  for(i = 0; i < t->n; i++)
+    if(t->s[i].addr <= eip && (best == 0 || t->s[i].addr > best->addr))
+      best = &t->s[i];
+  if(best)
+    best->count++;
+  else
+    t->other++;
+}
+
+// Take the samples the kernel has so far.
+static void
+drain(void)
+{
+  static struct profsample s[256];
+  int i, n;
+
+  while((n = profread(s, sizeof(s)/sizeof(s[0]))) > 0){
+    for(i = 0; i < n; i++){
+      total++;
+      if(s[i].eip >= KERNBASE)
+        charge(&ktab, s[i].eip);
+      else if(s[i].pid == shared->pid)
+        charge(&utab, s[i].eip);
+      else
+        others++;
+    }
+  }
+}
+
+static void
+line(uint count, char *name, char *where)
+{
+  printf(1, "%d\t%d%%\t%s%s\n", count, count * 100 / total, name, where);
+}
+
+// Print the functions with the most samples.
+static void
+report(void)
+{
+  struct sym *best;
+  int i, k;
+
+  printf(1, "%d samples\nsamples\t%%\tfunction\n", total);
+  if(total == 0)
+    return;
+  for(k = 0; k < NTOP; k++){
+    best = 0;
+    for(i = 0; i < ktab.n; i++)
+      if(ktab.s[i].count > 0 && (best == 0 || ktab.s[i].count > best->count))
+        best = &ktab.s[i];
+    for(i = 0; i < utab.n; i++)
+      if(utab.s[i].count > 0 && (best == 0 || utab.s[i].count > best->count))
+        best = &utab.s[i];
+    if(best == 0)
+      break;
+    line(best->count, best->name, best >= ktab.s && best < ktab.s + ktab.n ? "" : " (user)");
+    best->count = 0;
+  }
+  if(ktab.other)
+    line(ktab.other, "?", "");
+  if(utab.other)
+    line(utab.other, "?", " (user)");
+  if(others)
+    line(others, "other processes", " (user)");
+}
+
+int
+main(int argc, char *argv[])
+{
+  char path[DIRSIZ + 8];
+  int pid, dropped;
+
+  if(argc < 2){
+    printf(2, "usage: profile command [args...]\n");
+    exit();
+  }
+  load("/kernel.sym", &ktab);
+  if(strlen(argv[1]) <= DIRSIZ){
+    strcpy(path, "/");
+    strcpy(path + 1, argv[1]);
+    strcpy(path + strlen(path), ".sym");
+    load(path, &utab);
+  }
+
+  shared = mmap(0, 4096, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+  if(shared == (void*)-1){
+    printf(2, "profile: mmap failed\n");
+    exit();
+  }
+  shared->pid = -1;
+  shared->done = 0;
+
+  profile(1);
+  if((pid = fork()) < 0){
+    printf(2, "profile: fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    if((pid = fork()) == 0){
+      shared->pid = getpid();
+      exec(argv[1], argv + 1);
+      printf(2, "profile: exec %s failed\n", argv[1]);
+      exit();
+    }
+    if(pid > 0)
+      wait();
+    shared->done = 1;
+    exit();
+  }
+
+  // Drain the rings while the command runs, so they don't fill.
+  while(!shared->done){
+    sleep(1);
+    drain();
+  }
+  wait();
+  dropped = profile(0);
+  drain();
+
+  report();
+  if(dropped)
+    printf(1, "%d samples dropped\n", dropped);
+  exit();
+}
@@ -0,0 +1,36 @@
+// List the processes and the memory each uses, in KB.
+//
+// usage: ps
+//
+// rss is resident anon + file; cow is the part of anon that is
+// shared copy-on-write with other processes.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "param.h"
+#include "memstat.h"
+
+#define KB(pages) ((pages) * 4)
+
+struct memstat ms[NPROC];
+
+int
+main(int argc, char *argv[])
+{
+  struct memstat *m;
+  int n;
+
+  if((n = memstat(ms, NPROC)) < 0){
+    printf(2, "ps: memstat failed\n");
+    exit();
+  }
+  if(n > NPROC)
+    n = NPROC;
+  printf(1, "pid\theap\tmapped\trss\tanon\tfile\tcow\tswap\tname\n");
+  for(m = ms; m < ms + n; m++)
+    printf(1, "%d\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t%s\n", m->pid,
+           m->heap / 1024, m->mapped / 1024, KB(m->anon + m->file),
+           KB(m->anon), KB(m->file), KB(m->cow), KB(m->swapped), m->name);
+  exit();
+}
@@ -0,0 +1,127 @@
+// System call submission rings.
+//
+// A process that makes many system calls in a row can queue them
+// in a ring in memory it shares with the kernel and have them
+// all run by one trap, ringenter(), rather than one each.  The
+// process maps the ring MAP_SHARED | MAP_ANONYMOUS and hands it
+// over with ringsetup().  ringenter() runs the submitted entries
+// in order, as if the process had made each call itself, and
+// posts each result with the entry's data so the process can
+// match them up.
+//
+// The ring stays the process's memory: it is checked before the
+// kernel touches it, on every ringenter() and again after each
+// entry, which may have unmapped it, and the kernel trusts
+// nothing in it but the entries themselves.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "proc.h"
+#include "mmap.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "mm.h"
+#include "syscall.h"
+#include "ring.h"
+
+// Is [va, va+n) in one writable shared anonymous mapping?
+static int
+ringmapped(uint va, uint n)
+{
+  struct mm *mm = myproc()->mm;
+  struct mem_mapping *map;
+  int r;
+
+  acquiresleep(&mm->lock);
+  map = vma_lookup(mm->memoryMappings, va);
+  r = map != 0 && (map->flags & MAP_SHARED) && (map->flags & MAP_ANONYMOUS) &&
+    (map->prot & PROT_WRITE) && va + n >= va && va + n <= vma_end(map);
+  releasesleep(&mm->lock);
+  return r;
+}
+
+// Is p's ring still there, and resident, so the kernel can write
+// to it without faulting?
+static int
+ringok(struct proc *p)
+{
+  uint n = RING_SIZE(p->ringentries);
+
+  return ringmapped((uint)p->ring, n) && fault_in((uint)p->ring, n, 1) == 0;
+}
+
+// Can a ring entry make system call op?  Not if it would end or
+// replace the process, or wait for others to, or enter a ring.
+static int
+ringop(int op)
+{
+  switch(op){
+  case SYS_fork:
+  case SYS_exit:
+  case SYS_wait:
+  case SYS_exec:
+  case SYS_clone:
+  case SYS_join:
+  case SYS_spawn:
+  case SYS_ringsetup:
+  case SYS_ringenter:
+    return 0;
+  }
+  return 1;
+}
+
+// Make the ring at r, of n entries, this process's.
+int
+sys_ringsetup(void)
+{
+  struct proc *p = myproc();
+  struct ring *r;
+  int n;
+
+  if(argint(1, &n) < 0 || n <= 0 || n > RINGMAX || (n & (n - 1)) != 0)
+    return -1;
+  if(argoutptr(0, (char**)&r, RING_SIZE(n)) < 0 || !ringmapped((uint)r, RING_SIZE(n)))
+    return -1;
+  r->entries = n;
+  r->sqhead = r->sqtail = 0;
+  r->cqhead = r->cqtail = 0;
+  p->ring = r;
+  p->ringentries = n;
+  return 0;
+}
+
+// Run up to n submitted entries, while there is room for their
+// completions, and return how many ran.  If an entry unmaps the
+// ring, it is the last to run, and its completion is lost.
+int
+sys_ringenter(void)
+{
+  struct proc *p = myproc();
+  struct ring *r = p->ring;
+  struct ringsqe sqe;
+  struct ringcqe *cqe;
+  uint mask;
+  int n, done, res;
+
+  if(argint(0, &n) < 0 || r == 0 || !ringok(p))
+    return -1;
+  mask = p->ringentries - 1;
+  for(done = 0; done < n && !p->killed; done++){
+    if(r->sqhead == r->sqtail || r->cqtail - r->cqhead > mask)
+      break;
+    __sync_synchronize();  // read the entry only after its tail
+    sqe = RING_SQ(r)[r->sqhead & mask];
+    r->sqhead++;
+    res = ringop(sqe.op) ? syscallargs(sqe.op, sqe.arg) : -1;
+    if(!ringok(p))
+      return done + 1;
+    cqe = &RING_CQ(r, p->ringentries)[r->cqtail & mask];
+    cqe->res = res;
+    cqe->data = sqe.data;
+    __sync_synchronize();  // the completion, then its tail
+    r->cqtail++;
+  }
+  return done;
+}
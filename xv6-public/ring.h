@@ -0,0 +1,31 @@
+// System call submission ring, shared by a process and the kernel
+// (see ring.c).  The header is followed by n submission entries,
+// then n completion entries, n a power of two.  Heads and tails
+// count up forever; entry i of a queue is at i & (n-1).
+
+#define RINGARGS 6   // arguments a submitted call can take
+#define RINGMAX 1024 // most entries a ring can have
+
+struct ringsqe {
+  int op;              // SYS_ number, as in syscall.h
+  int arg[RINGARGS];
+  uint data;           // given back with the result
+};
+
+struct ringcqe {
+  int res;             // what the call returned
+  uint data;           // its submission's data
+};
+
+struct ring {
+  uint entries;
+  uint sqhead;         // next submission the kernel runs
+  uint sqtail;         // where the process submits next
+  uint cqhead;         // next completion the process takes
+  uint cqtail;         // where the kernel completes next
+};
+
+#define RING_SQ(r) ((struct ringsqe*)((r) + 1))
+#define RING_CQ(r, n) ((struct ringcqe*)(RING_SQ(r) + (n)))
+#define RING_SIZE(n) (sizeof(struct ring) + \
+  (n) * (sizeof(struct ringsqe) + sizeof(struct ringcqe)))
@@ -0,0 +1,160 @@
+// Scheduler and IPC benchmarks: the cost of a yield from one
+// process to another, a one-byte round trip between two processes
+// over pipes, bulk pipe throughput, and the latency of fork+wait
+// and fork+exec+wait.  Times are in rdtsc cycles.
+//
+// usage: schedbench
+//
+// Run it under different CPUS= settings: with one CPU, a yield
+// is a switch to the other process and back, while with more the
+// two may run side by side.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define NYIELD  2000   // yields
+#define NTRIP   2000   // pipe round trips
+#define NBULK   (1024*1024)  // bytes through a pipe
+#define CHUNK   4096   // ... a write at a time
+#define NFORK   100    // forks
+
+char buf[CHUNK];
+
+static void
+report(char *what, uint64 t, uint n, char *unit)
+{
+  printf(1, "%s: %d cycles/%s\n", what, per(t, n), unit);
+}
+
+static void
+fail(char *what)
+{
+  printf(2, "schedbench: %s failed\n", what);
+  exit();
+}
+
+// Two processes yielding to each other.  The child yields until
+// the parent kills it.
+static void
+yields(void)
+{
+  uint64 t;
+  int i, pid;
+
+  if((pid = fork()) < 0)
+    fail("fork");
+  if(pid == 0)
+    for(;;)
+      yield();
+  t = cycles();
+  for(i = 0; i < NYIELD; i++)
+    yield();
+  t = cycles() - t;
+  kill(pid);
+  wait();
+  report("yield", t, NYIELD, "yield");
+}
+
+// A byte sent to a child over one pipe and back over another.
+static void
+pingpong(void)
+{
+  int to[2], from[2], i, pid;
+  uint64 t;
+  char c;
+
+  if(pipe(to) < 0 || pipe(from) < 0)
+    fail("pipe");
+  if((pid = fork()) < 0)
+    fail("fork");
+  if(pid == 0){
+    close(to[1]);
+    close(from[0]);
+    while(read(to[0], &c, 1) == 1)
+      write(from[1], &c, 1);
+    exit();
+  }
+  close(to[0]);
+  close(from[1]);
+  t = cycles();
+  for(i = 0; i < NTRIP; i++){
+    if(write(to[1], "x", 1) != 1 || read(from[0], &c, 1) != 1)
+      fail("pipe round trip");
+  }
+  t = cycles() - t;
+  close(to[1]);
+  close(from[0]);
+  wait();
+  report("pipe round trip", t, NTRIP, "trip");
+}
+
+// NBULK bytes written into a pipe, and read out by a child.
+static void
+bulk(void)
+{
+  int fds[2], n, got, pid;
+  uint64 t;
+
+  if(pipe(fds) < 0)
+    fail("pipe");
+  t = cycles();
+  if((pid = fork()) < 0)
+    fail("fork");
+  if(pid == 0){
+    close(fds[1]);
+    got = 0;
+    while((n = read(fds[0], buf, sizeof(buf))) > 0)
+      got += n;
+    if(got != NBULK)
+      fail("pipe read");
+    exit();
+  }
+  close(fds[0]);
+  for(n = 0; n < NBULK; n += CHUNK)
+    if(write(fds[1], buf, CHUNK) != CHUNK)
+      fail("pipe write");
+  close(fds[1]);
+  wait();
+  t = cycles() - t;
+  report("pipe bulk", t, NBULK/1024, "KB");
+}
+
+// fork and wait for a child that exits at once, or that first
+// execs path with argument -x, which makes schedbench exit.
+static void
+forks(char *path)
+{
+  char *argv[] = { path, "-x", 0 };
+  uint64 t;
+  int i, pid;
+
+  t = cycles();
+  for(i = 0; i < NFORK; i++){
+    if((pid = fork()) < 0)
+      fail("fork");
+    if(pid == 0){
+      if(path)
+        exec(path, argv);
+      exit();
+    }
+    wait();
+  }
+  t = cycles() - t;
+  report(path ? "fork+exec+wait" : "fork+wait", t, NFORK, "child");
+}
+
+int
+main(int argc, char *argv[])
+{
+  if(argc > 1 && strcmp(argv[1], "-x") == 0)
+    exit();
+
+  yields();
+  pingpong();
+  bulk();
+  forks(0);
+  forks(argv[0]);
+  printf(1, "schedbench: done\n");
+  exit();
+}
@@ -52,6 +52,41 @@ struct backcmd {
 int fork1(void);  // Fork but panics on failure.
 void panic(char*);
 struct cmd *parsecmd(char*);
+void freecmd(struct cmd*);
+
+// Start cmd with spawn, when it is a program with at most some
+// redirections, with fds as its 0, 1 and 2.  Returns the pid, or
+// -1 if cmd is anything else or won't start, in which case the
+// caller runs it the slow way, with fork1 and runcmd, which also
+// reports the errors.
+int
+spawncmd(struct cmd *cmd, int *fds)
+{
+  struct execcmd *ecmd;
+  struct redircmd *rcmd;
+  int cfds[3], opened[3], i, n, pid;
+
+  for(i = 0; i < 3; i++)
+    cfds[i] = fds[i];
+  n = 0;
+  pid = -1;
+  while(cmd && cmd->type == REDIR){
+    rcmd = (struct redircmd*)cmd;
+    if(rcmd->fd > 2 || n == 3 || (cfds[rcmd->fd] = open(rcmd->file, rcmd->mode)) < 0)
+      goto done;
+    opened[n++] = cfds[rcmd->fd];
+    cmd = rcmd->cmd;
+  }
+  if(cmd && cmd->type == EXEC){
+    ecmd = (struct execcmd*)cmd;
+    if(ecmd->argv[0])
+      pid = spawn(ecmd->argv[0], ecmd->argv, cfds);
+  }
+done:
+  for(i = 0; i < n; i++)
+    close(opened[i]);
+  return pid;
+}
 
 // Execute cmd.  Never returns.
 void
@@ -130,6 +165,72 @@ runcmd(struct cmd *cmd)
   exit();
 }
 
+// Free a parsed command, now that the shell itself parses them.
+void
+freecmd(struct cmd *cmd)
+{
+  if(cmd == 0)
+    return;
+  switch(cmd->type){
+  case REDIR:
+    freecmd(((struct redircmd*)cmd)->cmd);
+    break;
+  case PIPE:
+    freecmd(((struct pipecmd*)cmd)->left);
+    freecmd(((struct pipecmd*)cmd)->right);
+    break;
+  case LIST:
+    freecmd(((struct listcmd*)cmd)->left);
+    freecmd(((struct listcmd*)cmd)->right);
+    break;
+  case BACK:
+    freecmd(((struct backcmd*)cmd)->cmd);
+    break;
+  }
+  free(cmd);
+}
+
+// Run a command typed at the prompt and wait for it.  Programs,
+// alone or at both ends of a pipe, are spawned straight from the
+// shell rather than forked from it.
+void
+runtop(struct cmd *cmd)
+{
+  static int std[3] = {0, 1, 2};
+  struct pipecmd *pcmd;
+  int p[2], lfds[3] = {0, -1, 2}, rfds[3] = {-1, 1, 2};
+
+  if(cmd && cmd->type == PIPE){
+    pcmd = (struct pipecmd*)cmd;
+    if(pipe(p) < 0)
+      panic("pipe");
+    lfds[1] = p[1];
+    rfds[0] = p[0];
+    if(spawncmd(pcmd->left, lfds) < 0 && fork1() == 0){
+      close(1);
+      dup(p[1]);
+      close(p[0]);
+      close(p[1]);
+      runcmd(pcmd->left);
+    }
+    if(spawncmd(pcmd->right, rfds) < 0 && fork1() == 0){
+      close(0);
+      dup(p[0]);
+      close(p[0]);
+      close(p[1]);
+      runcmd(pcmd->right);
+    }
+    close(p[0]);
+    close(p[1]);
+    wait();
+    wait();
+    return;
+  }
+  if(spawncmd(cmd, std) < 0 && fork1() == 0)
+    runcmd(cmd);
+  wait();
+}
+
 int
 getcmd(char *buf, int nbuf)
 {
@@ -145,6 +246,7 @@ int
 main(void)
 {
   static char buf[100];
+  struct cmd *cmd;
   int fd;
 
   // Ensure that three file descriptors are open.
@@ -164,9 +266,10 @@ main(void)
         printf(2, "cannot cd %s\n", buf+3);
       continue;
     }
-    if(fork1() == 0)
-      runcmd(parsecmd(buf));
-    wait();
+    if((cmd = parsecmd(buf)) == 0)
+      continue;
+    runtop(cmd);
+    freecmd(cmd);
   }
   exit();
 }
@@ -324,6 +427,19 @@ struct cmd *parsepipe(char**, char*);
 struct cmd *parseexec(char**, char*);
 struct cmd *nulterminate(struct cmd*);
 
+// The shell parses commands itself, so a syntax error mustn't
+// exit: the parser notes it, stops where it is, and parsecmd
+// returns 0.
+int parseerr;
+
+void
+syntax(char *s)
+{
+  if(!parseerr)
+    printf(2, "%s\n", s);
+  parseerr = 1;
+}
+
 struct cmd*
 parsecmd(char *s)
 {
@@ -331,11 +447,16 @@ parsecmd(char *s)
   struct cmd *cmd;
 
   es = s + strlen(s);
+  parseerr = 0;
   cmd = parseline(&s, es);
   peek(&s, es, "");
-  if(s != es){
+  if(s != es && !parseerr){
     printf(2, "leftovers: %s\n", s);
-    panic("syntax");
+    syntax("syntax");
+  }
+  if(parseerr){
+    freecmd(cmd);
+    return 0;
   }
   nulterminate(cmd);
   return cmd;
@@ -379,8 +500,10 @@ parseredirs(struct cmd *cmd, char **ps, char *es)
 
   while(peek(ps, es, "<>")){
     tok = gettoken(ps, es, 0, 0);
-    if(gettoken(ps, es, &q, &eq) != 'a')
-      panic("missing file for redirection");
+    if(gettoken(ps, es, &q, &eq) != 'a'){
+      syntax("missing file for redirection");
+      break;
+    }
     switch(tok){
     case '<':
       cmd = redircmd(cmd, q, eq, O_RDONLY, 0);
@@ -405,8 +528,10 @@ parseblock(char **ps, char *es)
     panic("parseblock");
   gettoken(ps, es, 0, 0);
   cmd = parseline(ps, es);
-  if(!peek(ps, es, ")"))
-    panic("syntax - missing )");
+  if(!peek(ps, es, ")")){
+    syntax("syntax - missing )");
+    return cmd;
+  }
   gettoken(ps, es, 0, 0);
   cmd = parseredirs(cmd, ps, es);
   return cmd;
@@ -431,13 +556,17 @@ parseexec(char **ps, char *es)
   while(!peek(ps, es, "|)&;")){
     if((tok=gettoken(ps, es, &q, &eq)) == 0)
       break;
-    if(tok != 'a')
-      panic("syntax");
+    if(tok != 'a'){
+      syntax("syntax");
+      break;
+    }
+    if(argc == MAXARGS-1){
+      syntax("too many args");
+      break;
+    }
     cmd->argv[argc] = q;
     cmd->eargv[argc] = eq;
     argc++;
-    if(argc >= MAXARGS)
-      panic("too many args");
     ret = parseredirs(ret, ps, es);
   }
   cmd->argv[argc] = 0;
@@ -0,0 +1,198 @@
+// Object caches for small kernel structures.
+//
+// A slab is one page from kalloc, with a header at its start and
+// the rest cut into objects of one size; an object's slab is the
+// page it lies in.  A cache keeps the slabs that have free objects
+// on a list, under its lock.
+//
+// In front of the slabs each CPU has a magazine of up to NMAG
+// free objects, which slaballoc and slabfree use with interrupts
+// off but without the lock.  Only a magazine that is empty or full
+// goes to the slabs, for half a magazine's worth at once.  A slab
+// whose objects are all free again goes back to kalloc, unless it
+// is the only one the cache has left.
+//
+// Caches are made at boot, before the other CPUs start, and last
+// forever.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "spinlock.h"
+
+#define NSLABCACHE 16
+#define NMAG 16  // objects in a CPU's magazine
+
+struct obj {
+  struct obj *next;
+};
+
+struct slab {
+  struct slabcache *cache;
+  struct slab *next;   // in the cache's list of slabs with free objects
+  struct slab *prev;
+  struct obj *free;
+  int inuse;           // objects handed out, or in a magazine
+};
+
+struct slabcache {
+  struct spinlock lock;
+  char *name;
+  uint size;           // of an object
+  int perslab;
+  struct slab *partial;
+  int nslab;
+  struct {
+    void *obj[NMAG];
+    int n;
+  } mag[NCPU];
+};
+
+static struct slabcache caches[NSLABCACHE];
+static int ncache;
+
+// Make a cache of objects of size bytes.
+struct slabcache*
+slabcreate(char *name, uint size)
+{
+  struct slabcache *c;
+
+  size = (size + 7) & ~7;
+  if(ncache == NSLABCACHE || size + sizeof(struct slab) > PGSIZE)
+    panic("slabcreate");
+  c = &caches[ncache++];
+  initlock(&c->lock, name);
+  c->name = name;
+  c->size = size;
+  c->perslab = (PGSIZE - sizeof(struct slab)) / size;
+  return c;
+}
+
+static void
+unlist(struct slabcache *c, struct slab *s)
+{
+  if(s->prev)
+    s->prev->next = s->next;
+  else
+    c->partial = s->next;
+  if(s->next)
+    s->next->prev = s->prev;
+}
+
+static void
+enlist(struct slabcache *c, struct slab *s)
+{
+  s->prev = 0;
+  s->next = c->partial;
+  if(c->partial)
+    c->partial->prev = s;
+  c->partial = s;
+}
+
+// Add a new slab to c.  Caller holds c->lock.
+static int
+grow(struct slabcache *c)
+{
+  struct slab *s;
+  char *p;
+  int i;
+
+  if((s = (struct slab*)kalloc()) == 0)
+    return -1;
+  s->cache = c;
+  s->free = 0;
+  s->inuse = 0;
+  p = (char*)(s + 1);
+  for(i = 0; i < c->perslab; i++, p += c->size){
+    ((struct obj*)p)->next = s->free;
+    s->free = (struct obj*)p;
+  }
+  enlist(c, s);
+  c->nslab++;
+  return 0;
+}
+
+// Fill this CPU's magazine halfway from the slabs.
+// Caller holds c->lock.
+static void
+fill(struct slabcache *c, int cpu)
+{
+  struct slab *s;
+  struct obj *o;
+
+  while(c->mag[cpu].n < NMAG/2){
+    if(c->partial == 0 && grow(c) < 0)
+      return;
+    s = c->partial;
+    o = s->free;
+    s->free = o->next;
+    s->inuse++;
+    if(s->free == 0)
+      unlist(c, s);
+    c->mag[cpu].obj[c->mag[cpu].n++] = o;
+  }
+}
+
+// Give half of this CPU's magazine back to the slabs.
+// Caller holds c->lock.
+static void
+empty(struct slabcache *c, int cpu)
+{
+  struct slab *s;
+  struct obj *o;
+
+  while(c->mag[cpu].n > NMAG/2){
+    o = c->mag[cpu].obj[--c->mag[cpu].n];
+    s = (struct slab*)PGROUNDDOWN((uint)o);
+    if(s->free == 0)
+      enlist(c, s);
+    o->next = s->free;
+    s->free = o;
+    if(--s->inuse == 0 && c->nslab > 1){
+      unlist(c, s);
+      c->nslab--;
+      kfree((char*)s);
+    }
+  }
+}
+
+// Allocate an object from c.  Returns 0 if out of memory.
+void*
+slaballoc(struct slabcache *c)
+{
+  void *o;
+  int cpu;
+
+  pushcli();
+  cpu = cpuid();
+  if(c->mag[cpu].n == 0){
+    acquire(&c->lock);
+    fill(c, cpu);
+    release(&c->lock);
+  }
+  o = 0;
+  if(c->mag[cpu].n > 0)
+    o = c->mag[cpu].obj[--c->mag[cpu].n];
+  popcli();
+  return o;
+}
+
+// Free object o, allocated from c.
+void
+slabfree(struct slabcache *c, void *o)
+{
+  int cpu;
+
+  if(((struct slab*)PGROUNDDOWN((uint)o))->cache != c)
+    panic("slabfree");
+  pushcli();
+  cpu = cpuid();
+  if(c->mag[cpu].n == NMAG){
+    acquire(&c->lock);
+    empty(c, cpu);
+    release(&c->lock);
+  }
+  c->mag[cpu].obj[c->mag[cpu].n++] = o;
+  popcli();
+}
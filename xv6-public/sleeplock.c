@@ -1,4 +1,9 @@
 // Sleeping locks
+//
+// A sleep lock is held either exclusively by one process or
+// shared by any number, as readers.  A process waiting for it
+// exclusively keeps new readers out, so a stream of them can't
+// starve it.
 
 #include "types.h"
 #include "defs.h"
@@ -16,6 +21,8 @@ initsleeplock(struct sleeplock *lk, char *name)
   initlock(&lk->lk, "sleep lock");
   lk->name = name;
   lk->locked = 0;
+  lk->readers = 0;
+  lk->writers = 0;
   lk->pid = 0;
 }
 
@@ -23,21 +30,59 @@ void
 acquiresleep(struct sleeplock *lk)
 {
   acquire(&lk->lk);
-  while (lk->locked) {
+  lk->writers++;
+  while (lk->locked || lk->readers > 0) {
     sleep(lk, &lk->lk);
   }
+  lk->writers--;
   lk->locked = 1;
   lk->pid = myproc()->pid;
   release(&lk->lk);
 }
 
+// Acquire lk if nobody holds it or is waiting for it, without
+// sleeping.  Returns 1 if it did.
+int
+tryacquiresleep(struct sleeplock *lk)
+{
+  int r;
+
+  acquire(&lk->lk);
+  r = !lk->locked && lk->readers == 0 && lk->writers == 0;
+  if (r) {
+    lk->locked = 1;
+    lk->pid = myproc()->pid;
+  }
+  release(&lk->lk);
+  return r;
+}
+
+// Acquire lk shared with other readers.
+void
+acquiresleepshared(struct sleeplock *lk)
+{
+  acquire(&lk->lk);
+  while (lk->locked || lk->writers > 0) {
+    sleep(lk, &lk->lk);
+  }
+  lk->readers++;
+  release(&lk->lk);
+}
+
+// Release lk, held exclusively or shared.
 void
 releasesleep(struct sleeplock *lk)
 {
   acquire(&lk->lk);
-  lk->locked = 0;
-  lk->pid = 0;
-  wakeup(lk);
+  if (lk->locked) {
+    lk->locked = 0;
+    lk->pid = 0;
+  } else if (lk->readers > 0) {
+    lk->readers--;
+  } else
+    panic("releasesleep");
+  if (lk->readers == 0)
+    wakeup(lk);
   release(&lk->lk);
 }
 
@@ -1,4 +1,14 @@
 // Mutual exclusion spin locks.
+//
+// A lock is a ticket lock: acquire takes the next ticket and
+// spins until the lock's owner count reaches it, so CPUs get the
+// lock in the order they asked for it, and while waiting they
+// only read the lock, not fight over it with xchg.
+//
+// Each name of lock has counters, per CPU so that keeping them
+// takes no atomic operations: how often its locks were acquired,
+// how often and how long an acquire had to wait, and the longest
+// one was held.  lockstat() adds them up.
 
 #include "types.h"
 #include "defs.h"
@@ -8,13 +18,71 @@
 #include "mmu.h"
 #include "proc.h"
 #include "spinlock.h"
+#include "lockstat.h"
+
+#define NLOCKCLASS 64
+
+struct lockclass {
+  char *name;
+  struct {
+    uint acquires;
+    uint contends;
+    uint spins;
+    uint maxhold;
+  } cpu[NCPU];
+};
+
+static struct lockclass classes[NLOCKCLASS];
+static int nclass;         // entries below it are set up
+static uint classlock;
+
+static struct lockclass*
+findclass(char *name, int n)
+{
+  struct lockclass *c;
+
+  for(c = classes; c < &classes[n]; c++)
+    if(c->name == name || strncmp(c->name, name, sizeof(((struct lockstat*)0)->name)) == 0)
+      return c;
+  return 0;
+}
+
+// Return the counters of locks called name, made on first use.
+// Return 0, and keep no counters, if there are too many names.
+// Locks are made before the CPUs are found, so this can't rely
+// on pushcli() and spins on classlock with interrupts off.
+static struct lockclass*
+lockclass(char *name)
+{
+  struct lockclass *c;
+  uint eflags;
+
+  if((c = findclass(name, nclass)) != 0)
+    return c;
+  eflags = readeflags();
+  cli();
+  while(xchg(&classlock, 1) != 0)
+    ;
+  if((c = findclass(name, nclass)) == 0 && nclass < NLOCKCLASS){
+    c = &classes[nclass];
+    c->name = name;
+    __sync_synchronize();
+    nclass++;
+  }
+  xchg(&classlock, 0);
+  if(eflags & FL_IF)
+    sti();
+  return c;
+}
 
 void
 initlock(struct spinlock *lk, char *name)
 {
   lk->name = name;
-  lk->locked = 0;
+  lk->next = 0;
+  lk->owner = 0;
   lk->cpu = 0;
+  lk->class = lockclass(name);
 }
 
 // Acquire the lock.
@@ -24,13 +92,16 @@ initlock(struct spinlock *lk, char *name)
 void
 acquire(struct spinlock *lk)
 {
+  uint ticket, spins;
+
   pushcli(); // disable interrupts to avoid deadlock.
   if(holding(lk))
     panic("acquire");
 
-  // The xchg is atomic.
-  while(xchg(&lk->locked, 1) != 0)
-    ;
+  // The xadd is atomic.
+  ticket = xadd((volatile int*)&lk->next, 1);
+  for(spins = 0; *(volatile uint*)&lk->owner != ticket; spins++)
+    pause();
 
   // Tell the C compiler and the processor to not move loads or stores
   // past this point, to ensure that the critical section's memory
@@ -40,15 +111,30 @@ acquire(struct spinlock *lk)
   // Record info about lock acquisition for debugging.
   lk->cpu = mycpu();
   getcallerpcs(&lk, lk->pcs);
+
+  if(lk->class){
+    lk->class->cpu[lk->cpu - cpus].acquires++;
+    if(spins){
+      lk->class->cpu[lk->cpu - cpus].contends++;
+      lk->class->cpu[lk->cpu - cpus].spins += spins;
+    }
+  }
+  lk->start = rdtsc();
 }
 
 // Release the lock.
 void
 release(struct spinlock *lk)
 {
+  uint held;
+
   if(!holding(lk))
     panic("release");
 
+  held = rdtsc() - lk->start;
+  if(lk->class && held > lk->class->cpu[lk->cpu - cpus].maxhold)
+    lk->class->cpu[lk->cpu - cpus].maxhold = held;
+
   lk->pcs[0] = 0;
   lk->cpu = 0;
 
@@ -59,10 +145,10 @@ release(struct spinlock *lk)
   // stores; __sync_synchronize() tells them both not to.
   __sync_synchronize();
 
-  // Release the lock, equivalent to lk->locked = 0.
-  // This code can't use a C assignment, since it might
-  // not be atomic. A real OS would use C atomics here.
-  asm volatile("movl $0, %0" : "+m" (lk->locked) : );
+  // Serve the next ticket, equivalent to lk->owner++.
+  // Only the holder writes owner, so this needn't be a locked
+  // instruction, but it must be a single store.
+  asm volatile("movl %1, %0" : "=m" (lk->owner) : "r" (lk->owner + 1));
 
   popcli();
 }
@@ -91,7 +177,7 @@ holding(struct spinlock *lock)
 {
   int r;
   pushcli();
-  r = lock->locked && lock->cpu == mycpu();
+  r = lock->owner != lock->next && lock->cpu == mycpu();
   popcli();
   return r;
 }
@@ -124,3 +210,26 @@ popcli(void)
     sti();
 }
 
+
+// Copy the counters of up to n names of lock into ls, and return
+// how many names there are.
+int
+lockstat(struct lockstat *ls, int n)
+{
+  struct lockclass *c;
+  int i, nc;
+
+  nc = nclass;
+  for(c = classes; c < &classes[nc] && c < &classes[n]; c++, ls++){
+    safestrcpy(ls->name, c->name, sizeof(ls->name));
+    ls->acquires = ls->contends = ls->spins = ls->maxhold = 0;
+    for(i = 0; i < ncpu; i++){
+      ls->acquires += c->cpu[i].acquires;
+      ls->contends += c->cpu[i].contends;
+      ls->spins += c->cpu[i].spins;
+      if(c->cpu[i].maxhold > ls->maxhold)
+        ls->maxhold = c->cpu[i].maxhold;
+    }
+  }
+  return nc;
+}
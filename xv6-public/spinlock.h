@@ -1,11 +1,15 @@
 // Mutual exclusion lock.
 struct spinlock {
-  uint locked;       // Is the lock held?
+  uint next;         // Ticket handed out next
+  uint owner;        // Ticket being served; held if it isn't next
 
   // For debugging:
   char *name;        // Name of lock.
   struct cpu *cpu;   // The cpu holding the lock.
   uint pcs[10];      // The call stack (an array of program counters)
                      // that locked the lock.
-};
 
+  // For lockstat():
+  struct lockclass *class;  // Counters of the locks of this name
+  uint start;        // rdtsc when acquired
+};
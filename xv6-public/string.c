@@ -1,14 +1,24 @@
 #include "types.h"
 #include "x86.h"
 
+// memset and memmove work a long at a time once the destination
+// is aligned, with only the odd bytes at either end done singly.
+
 void*
 memset(void *dst, int c, uint n)
 {
-  if ((int)dst%4 == 0 && n%4 == 0){
-    c &= 0xFF;
-    stosl(dst, (c<<24)|(c<<16)|(c<<8)|c, n/4);
-  } else
-    stosb(dst, c, n);
+  char *d;
+
+  d = dst;
+  c &= 0xFF;
+  if(n >= 8){
+    for(; (uint)d%4; n--)
+      *d++ = c;
+    stosl(d, (c<<24)|(c<<16)|(c<<8)|c, n/4);
+    d += n & ~3;
+    n %= 4;
+  }
+  stosb(d, c, n);
   return dst;
 }
 
@@ -37,13 +47,30 @@ memmove(void *dst, const void *src, uint n)
   s = src;
   d = dst;
   if(s < d && s + n > d){
+    // Overlapping, with dst above src: copy from the end down.
     s += n;
     d += n;
+    if(n >= 8){
+      for(; (uint)d%4; n--)
+        *--d = *--s;
+      s -= n & ~3;
+      d -= n & ~3;
+      movslback(d, s, n/4);
+      n %= 4;
+    }
     while(n-- > 0)
       *--d = *--s;
-  } else
-    while(n-- > 0)
-      *d++ = *s++;
+  } else {
+    if(n >= 8){
+      for(; (uint)d%4; n--)
+        *d++ = *s++;
+      movsl(d, s, n/4);
+      s += n & ~3;
+      d += n & ~3;
+      n %= 4;
+    }
+    movsb(d, s, n);
+  }
 
   return dst;
 }
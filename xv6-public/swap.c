@@ -0,0 +1,302 @@
+//
+// Page reclaim and swap.
+//
+// When free memory runs low the "kswapd" kernel thread evicts user
+// pages until there are SWAPHIGH free again, and a page fault that
+// finds no page free at all evicts some itself (kallocreclaim)
+// rather than fail.
+//
+// Pages are picked by a clock over the address spaces' page
+// tables.  The hand sweeps the user PTEs of each address space in
+// turn; a page whose accessed bit (PTE_A) the hardware has set
+// since the hand last came by has the bit cleared and is passed
+// over once more.  Only 4KB pages that one page table maps alone
+// are candidates: huge pages, the zero page, pages shared
+// copy-on-write, page tables fork shared, and MAP_SHARED memory
+// (the page cache's, or shared with other processes) stay where
+// they are.
+//
+// A clean page of a private file mapping is simply dropped: a
+// fault reads it back from the file.  Any other page is written to
+// a slot of the swap area that mkfs leaves after the file system,
+// and its PTE becomes a non-present PTE_SWAP entry holding the
+// slot number, which the page fault handler reads back (swapin).
+// Slots are reference counted, so fork can share a swapped out
+// page with the child just as it shares a resident one.
+//
+// The reclaimer only tries the address spaces' locks, passing over
+// busy ones, so a page fault can reclaim while holding its own.
+//
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "x86.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "mmap.h"
+#include "mm.h"
+
+#define SWAPPTE(slot)  ((uint)(slot) << PTXSHIFT | PTE_SWAP)
+#define SWAPSLOT(pte)  (PTE_ADDR(pte) >> PTXSHIFT)
+
+#define SWAPUS  (10*TICKUS)  // how often kswapd looks at free memory
+
+struct {
+  struct spinlock lock;
+  uint dev;
+  uint start;           // first block of the swap area
+  uint nslot;           // pages it holds
+  uint hint;            // where the search for a free slot resumes
+  uchar ref[NSWAPMAX];  // PTEs referring to each slot, 0 if free
+} swap;
+
+// The clock hand: the process slot whose address space it is in,
+// and the next address it looks at there.  Holding lock makes a
+// CPU the only one reclaiming.
+struct {
+  struct sleeplock lock;
+  int slot;
+  uint va;
+} hand;
+
+static void kswapd(void);
+
+// Find the swap area on dev and start kswapd.  Runs in the first
+// process, since reading the super block sleeps.
+void
+swapinit(int dev)
+{
+  struct superblock sb;
+
+  initlock(&swap.lock, "swap");
+  initsleeplock(&hand.lock, "reclaim");
+
+  readsb(dev, &sb);
+  swap.dev = dev;
+  swap.start = sb.swapstart;
+  swap.nslot = sb.nswap < NSWAPMAX ? sb.nswap : NSWAPMAX;
+  cprintf("swap: %d pages at block %d\n", swap.nslot, swap.start);
+
+  // clean file pages can be reclaimed even without a swap area
+  if(kthread("kswapd", kswapd) == 0)
+    panic("swapinit");
+}
+
+// Allocate a swap slot, or return -1 if they are all in use.
+static int
+slotalloc(void)
+{
+  uint i, s;
+
+  acquire(&swap.lock);
+  for(i = 0; i < swap.nslot; i++){
+    s = (swap.hint + i) % swap.nslot;
+    if(swap.ref[s] == 0){
+      swap.ref[s] = 1;
+      swap.hint = s + 1;
+      release(&swap.lock);
+      return s;
+    }
+  }
+  release(&swap.lock);
+  return -1;
+}
+
+// Add a reference to the slot of PTE_SWAP entry pte, for fork.
+void
+swapdup(pte_t pte)
+{
+  acquire(&swap.lock);
+  if(swap.ref[SWAPSLOT(pte)]++ == 0)
+    panic("swapdup");
+  release(&swap.lock);
+}
+
+// Drop a reference to the slot of PTE_SWAP entry pte.
+void
+swapfree(pte_t pte)
+{
+  acquire(&swap.lock);
+  if(swap.ref[SWAPSLOT(pte)]-- == 0)
+    panic("swapfree");
+  release(&swap.lock);
+}
+
+// Write the page at page to swap slot slot, or read it from there.
+// The slot's blocks are consecutive, so the disk driver moves the
+// page in one command.
+static void
+slotio(uint slot, char *page, int write)
+{
+  uint blockno[BPP];
+  int i;
+
+  for(i = 0; i < BPP; i++)
+    blockno[i] = swap.start + slot*BPP + i;
+  bpageio(swap.dev, blockno, page, write);
+}
+
+// Read the page that PTE_SWAP entry *pte refers to into a new
+// frame and map it there with permissions perm.  The frame is
+// marked dirty, so that a page of a private file mapping that was
+// swapped out isn't later dropped as if it matched the file.
+// Caller holds the address space's lock.  Returns -1 if out of
+// memory.
+int
+swapin(pte_t *pte, uint perm)
+{
+  pte_t old = *pte;
+  char *mem;
+
+  if((mem = kallocreclaim(0)) == 0)
+    return -1;
+  slotio(SWAPSLOT(old), mem, 0);
+  *pte = V2P(mem) | perm | PTE_P | PTE_D;
+  swapfree(old);
+  return 0;
+}
+
+// What backs the page at va of address space mm if the reclaimer
+// takes its frame away: 1 if it has to go to swap, 0 if the file
+// does, -1 if it must stay (shared memory).
+static int
+backing(struct mm *mm, uint va)
+{
+  struct mem_mapping *map;
+
+  if((map = vma_lookup(mm->memoryMappings, va)) == 0)
+    return va < mm->sz ? 1 : -1;
+  if(map->flags & MAP_SHARED)
+    return -1;
+  if((map->flags & MAP_ANONYMOUS) || map->file == 0 ||
+     ((map->flags & MAP_IMAGE) && va - map->addr >= map->filesz))
+    return 1;
+  return 0;
+}
+
+// Move the hand on through address space mm, evicting up to n
+// pages.  Returns how many it evicted.
+static int
+scan(struct mm *mm, int n)
+{
+  pde_t *pgdir = mm->pgdir;
+  struct tlbbatch b;
+  char *page[SWAPBATCH];
+  int slot[SWAPBATCH];
+  pte_t *pte, old;
+  char *v;
+  uint va;
+  int i, k, anon;
+
+  if(n > SWAPBATCH)
+    n = SWAPBATCH;
+  b.n = b.nfree = 0;
+  k = 0;
+  for(va = hand.va; va < KERNBASE && k < n; va += PGSIZE){
+    if(!(pgdir[PDX(va)] & PTE_P) || (pgdir[PDX(va)] & (PTE_PS|PDE_SHARED))){
+      va = PGADDR(PDX(va) + 1, 0, 0) - PGSIZE;
+      continue;
+    }
+    pte = walkpgdir(pgdir, (void*)va, 0);
+    if((*pte & (PTE_P|PTE_U)) != (PTE_P|PTE_U))
+      continue;
+    v = P2V(PTE_ADDR(*pte));
+    if(iszeropage(v) || krefcount(v) != 1 || (anon = backing(mm, va)) < 0)
+      continue;
+    if(*pte & PTE_A){
+      // second chance; the hardware sets the bit concurrently,
+      // along with PTE_D, so clear it atomically
+      __sync_fetch_and_and(pte, ~PTE_A);
+      continue;
+    }
+    if(chaninpage(v))
+      continue;
+
+    slot[k] = -1;
+    if((anon || (*pte & PTE_D)) && (slot[k] = slotalloc()) < 0)
+      continue;
+    old = xchg(pte, slot[k] < 0 ? 0 : SWAPPTE(slot[k]));
+    if(slot[k] < 0 && (old & PTE_D)){
+      // written since we looked: it has to go to swap after all
+      if((slot[k] = slotalloc()) < 0){
+        *pte = old;
+        continue;
+      }
+      *pte = SWAPPTE(slot[k]);
+    }
+    page[k++] = v;
+    tlbinval(&b, va);
+  }
+  hand.va = va;
+
+  // Once no TLB maps the pages nobody can change them, and a
+  // fault on one waits for mm's lock until they are written.
+  tlbflushdone(pgdir, &b);
+  for(i = 0; i < k; i++){
+    if(slot[i] >= 0)
+      slotio(slot[i], page[i], 1);
+    kfree(page[i]);
+  }
+  return k;
+}
+
+// Evict up to n user pages, and return how many were.  The hand
+// goes round at most twice: once to clear accessed bits, and once
+// more to take the pages that weren't used again meanwhile.
+int
+reclaim(int n)
+{
+  struct mm *mm;
+  int got, passed;
+
+  acquiresleep(&hand.lock);
+  got = 0;
+  passed = 0;
+  while(got < n && passed <= 2*NPROC){
+    if((mm = mmgrab(hand.slot)) != 0){
+      got += scan(mm, n - got);
+      mmdrop(mm);
+    } else
+      hand.va = KERNBASE;
+    if(hand.va >= KERNBASE){
+      hand.va = 0;
+      hand.slot = (hand.slot + 1) % NPROC;
+      passed++;
+    }
+  }
+  releasesleep(&hand.lock);
+  return got;
+}
+
+// Allocate a page as kalloc does, zeroed if zero, evicting user
+// pages to make room if there are none free.  Only for callers
+// that may sleep and hold no spinlock, like the page fault
+// handler.  Returns 0 if nothing more can be evicted.
+char*
+kallocreclaim(int zero)
+{
+  char *mem;
+
+  while((mem = zero ? kzalloc() : kalloc()) == 0)
+    if(reclaim(SWAPBATCH) == 0)
+      return 0;
+  return mem;
+}
+
+// Keep some pages free, so that faults seldom have to reclaim
+// for themselves.
+static void
+kswapd(void)
+{
+  for(;;){
+    timersleep(SWAPUS);
+    if(kfreepages() < SWAPLOW)
+      while(kfreepages() < SWAPHIGH && reclaim(SWAPBATCH) > 0)
+        ;
+  }
+}
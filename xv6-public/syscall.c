@@ -6,8 +6,10 @@
 #include "proc.h"
 #include "x86.h"
 #include "syscall.h"
+#include "ring.h"
+#include "trace.h"
 
-// User code makes a system call with INT T_SYSCALL.
+// User code makes a system call with sysenter or INT T_SYSCALL.
 // System call number in %eax.
 // Arguments on the stack, from the user call to the C
 // library system call function. The saved user %esp points
@@ -17,69 +19,89 @@
 int
 fetchint(uint addr, int *ip)
 {
-  struct proc *curproc = myproc();
-
-  if(addr >= curproc->sz || addr+4 > curproc->sz)
-    return -1;
-  *ip = *(int*)(addr);
-  return 0;
+  return copyin(ip, addr, sizeof(*ip));
 }
 
-// Fetch the nul-terminated string at addr from the current process.
-// Doesn't actually copy the string - just sets *pp to point at it.
-// Returns length of string, not including nul.
+// Copy the nul-terminated string at addr from the current process
+// to buf, which holds max bytes.  The kernel uses the copy: the
+// string itself is in memory that a thread of the process, or
+// another process sharing a mapping, may change meanwhile.
+// Returns length of string, not including nul, or -1 if it
+// doesn't fit.
 int
-fetchstr(uint addr, char **pp)
+fetchstr(uint addr, char *buf, int max)
 {
   char *s, *ep;
-  struct proc *curproc = myproc();
+  int n;
 
-  if(addr >= curproc->sz)
-    return -1;
-  *pp = (char*)addr;
-  ep = (char*)curproc->sz;
-  for(s = *pp; s < ep; s++){
-    if(*s == 0)
-      return s - *pp;
+  s = (char*)addr;
+  ep = (char*)uend(addr);
+  for(n = 0; n < max && s < ep; n++, s++){
+    if((n == 0 || (uint)s % PGSIZE == 0) && fault_in((uint)s, 1, 0) < 0)
+      return -1;
+    if((buf[n] = *s) == 0)
+      return n;
   }
   return -1;
 }
 
 // Fetch the nth 32-bit system call argument.
+// A ring entry's arguments are in the entry instead.
 int
 argint(int n, int *ip)
 {
+  if(myproc()->sysargs){
+    if(n >= RINGARGS)
+      return -1;
+    *ip = myproc()->sysargs[n];
+    return 0;
+  }
   return fetchint((myproc()->tf->esp) + 4 + 4*n, ip);
 }
 
 // Fetch the nth word-sized system call argument as a pointer
 // to a block of memory of size bytes.  Check that the pointer
-// lies within the process address space.
+// lies within the process address space, below sz or in its
+// mappings, and fault the block in.
 int
 argptr(int n, char **pp, int size)
 {
   int i;
-  struct proc *curproc = myproc();
- 
+
   if(argint(n, &i) < 0)
     return -1;
-  if(size < 0 || (uint)i >= curproc->sz || (uint)i+size > curproc->sz)
+  if(size < 0 || uaccess(i, size, 0) < 0)
     return -1;
   *pp = (char*)i;
   return 0;
 }
 
-// Fetch the nth word-sized system call argument as a string pointer.
-// Check that the pointer is valid and the string is nul-terminated.
-// (There is no shared writable memory, so the string can't change
-// between this check and being used by the kernel.)
+// As argptr, for a block the system call will write: it must
+// be writable, and is faulted in for writing.
+int
+argoutptr(int n, char **pp, int size)
+{
+  int i;
+
+  if(argint(n, &i) < 0)
+    return -1;
+  if(size < 0 || uaccess(i, size, 1) < 0)
+    return -1;
+  *pp = (char*)i;
+  return 0;
+}
+
+// Fetch the nth word-sized system call argument as a string, of
+// at most MAXPATH bytes, and point *pp at the kernel's copy of it
+// (see fetchstr).  Only the first two arguments can be strings.
 int
 argstr(int n, char **pp)
 {
   int addr;
-  if(argint(n, &addr) < 0)
+  if(n >= NELEM(myproc()->strarg) || argint(n, &addr) < 0)
     return -1;
-  return fetchstr(addr, pp);
+  *pp = myproc()->strarg[n];
+  return fetchstr(addr, *pp, MAXPATH);
 }
 
 extern int sys_chdir(void);
@@ -105,6 +127,33 @@ extern int sys_write(void);
 extern int sys_uptime(void);
 extern int sys_mmap(void);
 extern int sys_munmap(void);
+extern int sys_msync(void);
+extern int sys_mprotect(void);
+extern int sys_madvise(void);
+extern int sys_splice(void);
+extern int sys_setpriority(void);
+extern int sys_usleep(void);
+extern int sys_clone(void);
+extern int sys_join(void);
+extern int sys_spawn(void);
+extern int sys_lockstat(void);
+extern int sys_ringsetup(void);
+extern int sys_ringenter(void);
+extern int sys_readv(void);
+extern int sys_writev(void);
+extern int sys_pread(void);
+extern int sys_pwrite(void);
+extern int sys_futex_wait(void);
+extern int sys_futex_wake(void);
+extern int sys_fsync(void);
+extern int sys_yield(void);
+extern int sys_kstats(void);
+extern int sys_profile(void);
+extern int sys_profread(void);
+extern int sys_trace(void);
+extern int sys_traceread(void);
+extern int sys_memstat(void);
+extern int sys_copyfile(void);
 
 static int (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -129,7 +178,34 @@ static int (*syscalls[])(void) = {
 [SYS_mkdir]   sys_mkdir,
 [SYS_close]   sys_close,
 [SYS_mmap]    sys_mmap,
-[SYS_munmap]  sys_munmap, 
+[SYS_munmap]  sys_munmap,
+[SYS_msync]   sys_msync,
+[SYS_mprotect] sys_mprotect,
+[SYS_madvise] sys_madvise,
+[SYS_splice]  sys_splice,
+[SYS_setpriority] sys_setpriority,
+[SYS_usleep]  sys_usleep,
+[SYS_clone]   sys_clone,
+[SYS_join]    sys_join,
+[SYS_spawn]   sys_spawn,
+[SYS_lockstat] sys_lockstat,
+[SYS_ringsetup] sys_ringsetup,
+[SYS_ringenter] sys_ringenter,
+[SYS_readv]   sys_readv,
+[SYS_writev]  sys_writev,
+[SYS_pread]   sys_pread,
+[SYS_pwrite]  sys_pwrite,
+[SYS_futex_wait] sys_futex_wait,
+[SYS_futex_wake] sys_futex_wake,
+[SYS_fsync]   sys_fsync,
+[SYS_yield]   sys_yield,
+[SYS_kstats]  sys_kstats,
+[SYS_profile] sys_profile,
+[SYS_profread] sys_profread,
+[SYS_trace]   sys_trace,
+[SYS_traceread] sys_traceread,
+[SYS_memstat] sys_memstat,
+[SYS_copyfile] sys_copyfile,
 };
 
 void
@@ -140,10 +216,36 @@ syscall(void)
 
   num = curproc->tf->eax;
   if(num > 0 && num < NELEM(syscalls) && syscalls[num]) {
+    kstatsyscall(num);
+    if(tracing)
+      tracepoint(TR_SYSCALL, num);
     curproc->tf->eax = syscalls[num]();
+    if(tracing)
+      tracepoint(TR_SYSRET, curproc->tf->eax);
   } else {
     cprintf("%d %s: unknown sys call %d\n",
             curproc->pid, curproc->name, num);
     curproc->tf->eax = -1;
   }
 }
+
+// Make system call num with the arguments in args rather than
+// on the user stack, for a submission ring (ring.c).
+int
+syscallargs(int num, int *args)
+{
+  struct proc *curproc = myproc();
+  int r;
+
+  if(num <= 0 || num >= NELEM(syscalls) || !syscalls[num])
+    return -1;
+  kstatsyscall(num);
+  if(tracing)
+    tracepoint(TR_SYSCALL, num);
+  curproc->sysargs = args;
+  r = syscalls[num]();
+  curproc->sysargs = 0;
+  if(tracing)
+    tracepoint(TR_SYSRET, r);
+  return r;
+}
@@ -22,3 +22,30 @@
 #define SYS_close  21
 #define SYS_mmap   22
 #define SYS_munmap 23
+#define SYS_msync  24
+#define SYS_mprotect 25
+#define SYS_madvise 26
+#define SYS_splice 27
+#define SYS_setpriority 28
+#define SYS_usleep 29
+#define SYS_clone  30
+#define SYS_join   31
+#define SYS_spawn  32
+#define SYS_lockstat 33
+#define SYS_ringsetup 34
+#define SYS_ringenter 35
+#define SYS_readv  36
+#define SYS_writev 37
+#define SYS_pread  38
+#define SYS_pwrite 39
+#define SYS_futex_wait 40
+#define SYS_futex_wake 41
+#define SYS_fsync  42
+#define SYS_yield  43
+#define SYS_kstats 44
+#define SYS_profile 45
+#define SYS_profread 46
+#define SYS_trace  47
+#define SYS_traceread 48
+#define SYS_memstat 49
+#define SYS_copyfile 50
@@ -15,6 +15,7 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
+#include "uio.h"
 
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
@@ -26,7 +27,7 @@ argfd(int n, int *pfd, struct file **pf)
 
   if(argint(n, &fd) < 0)
     return -1;
-  if(fd < 0 || fd >= NOFILE || (f=myproc()->ofile[fd]) == 0)
+  if(fd < 0 || fd >= myproc()->nofile || (f=myproc()->ofile[fd]) == 0)
     return -1;
   if(pfd)
     *pfd = fd;
@@ -35,7 +36,8 @@ argfd(int n, int *pfd, struct file **pf)
   return 0;
 }
 
-// Allocate a file descriptor for the given file.
+// Allocate a file descriptor for the given file, growing the
+// table if it is full.
 // Takes over file reference from caller on success.
 static int
 fdalloc(struct file *f)
@@ -43,13 +45,16 @@ fdalloc(struct file *f)
   int fd;
   struct proc *curproc = myproc();
 
-  for(fd = 0; fd < NOFILE; fd++){
+  for(fd = 0; fd < curproc->nofile; fd++){
     if(curproc->ofile[fd] == 0){
       curproc->ofile[fd] = f;
       return fd;
     }
   }
-  return -1;
+  if(fdgrow(curproc) < 0)
+    return -1;
+  curproc->ofile[fd] = f;
+  return fd;
 }
 
 int
@@ -73,7 +78,7 @@ sys_read(void)
   int n;
   char *p;
 
-  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n) < 0)
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argoutptr(1, &p, n) < 0)
     return -1;
   return fileread(f, p, n);
 }
@@ -90,6 +95,122 @@ sys_write(void)
   return filewrite(f, p, n);
 }
 
+// Fetch the nth and n+1th system call arguments as an array of
+// iovecs and its length, copying it to iov, and check that each
+// buffer lies in the process, and if write is set that the call
+// may write it.
+static int
+argiov(int n, struct iovec *iov, int *niov, int write)
+{
+  int i, p, tot;
+
+  if(argint(n, &p) < 0 || argint(n+1, niov) < 0)
+    return -1;
+  if(*niov < 0 || *niov > IOVMAX)
+    return -1;
+  if(copyin(iov, p, *niov * sizeof(struct iovec)) < 0)
+    return -1;
+  for(tot = i = 0; i < *niov; i++){
+    if(iov[i].len < 0 || tot + iov[i].len < tot)
+      return -1;
+    tot += iov[i].len;
+    if(uaccess((uint)iov[i].base, iov[i].len, write) < 0)
+      return -1;
+  }
+  return 0;
+}
+
+int
+sys_readv(void)
+{
+  struct file *f;
+  struct iovec iov[IOVMAX];
+  int niov;
+
+  if(argfd(0, 0, &f) < 0 || argiov(1, iov, &niov, 1) < 0)
+    return -1;
+  return filereadv(f, iov, niov, -1);
+}
+
+int
+sys_writev(void)
+{
+  struct file *f;
+  struct iovec iov[IOVMAX];
+  int niov;
+
+  if(argfd(0, 0, &f) < 0 || argiov(1, iov, &niov, 0) < 0)
+    return -1;
+  return filewritev(f, iov, niov, -1);
+}
+
+int
+sys_pread(void)
+{
+  struct file *f;
+  struct iovec iov;
+  int off;
+
+  if(argfd(0, 0, &f) < 0 || argint(2, &iov.len) < 0 || argint(3, &off) < 0)
+    return -1;
+  if(off < 0 || argoutptr(1, (char**)&iov.base, iov.len) < 0)
+    return -1;
+  return filereadv(f, &iov, 1, off);
+}
+
+int
+sys_pwrite(void)
+{
+  struct file *f;
+  struct iovec iov;
+  int off;
+
+  if(argfd(0, 0, &f) < 0 || argint(2, &iov.len) < 0 || argint(3, &off) < 0)
+    return -1;
+  if(off < 0 || argptr(1, (char**)&iov.base, iov.len) < 0)
+    return -1;
+  return filewritev(f, &iov, 1, off);
+}
+
+// Wait until what has been written to the file is on disk.
+// The log commits all finished system calls together, so this
+// forces a commit of the open group.
+int
+sys_fsync(void)
+{
+  struct file *f;
+
+  if(argfd(0, 0, &f) < 0)
+    return -1;
+  if(f->type == FD_INODE && f->ip->dev != TMPDEV)
+    log_force();
+  return 0;
+}
+
+int
+sys_splice(void)
+{
+  struct file *in, *out;
+  int n;
+
+  if(argfd(0, 0, &in) < 0 || argfd(1, 0, &out) < 0 || argint(2, &n) < 0 || n < 0)
+    return -1;
+  return filesplice(in, out, n);
+}
+
+int
+sys_copyfile(void)
+{
+  struct file *out, *in;
+  int off, n;
+
+  if(argfd(0, 0, &out) < 0 || argfd(1, 0, &in) < 0)
+    return -1;
+  if(argint(2, &off) < 0 || argint(3, &n) < 0 || off < -1 || n < 0)
+    return -1;
+  return filecopy(out, in, off, n);
+}
+
 int
 sys_close(void)
 {
@@ -109,7 +230,7 @@ sys_fstat(void)
   struct file *f;
   struct stat *st;
 
-  if(argfd(0, 0, &f) < 0 || argptr(1, (void*)&st, sizeof(*st)) < 0)
+  if(argfd(0, 0, &f) < 0 || argoutptr(1, (void*)&st, sizeof(*st)) < 0)
     return -1;
   return filestat(f, st);
 }
@@ -218,6 +339,7 @@ sys_unlink(void)
   memset(&de, 0, sizeof(de));
   if(writei(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
     panic("unlink: writei");
+  dcache_remove(dp, name);
   if(ip->type == T_DIR){
     dp->nlink--;
     iupdate(dp);
@@ -393,19 +515,20 @@ sys_chdir(void)
   return 0;
 }
 
-int
-sys_exec(void)
+// Fetch the nth system call argument as a null-terminated user
+// array of at most MAXARG strings.
+static int
+argargv(int n, char **argv, char *page)
 {
-  char *path, *argv[MAXARG];
-  int i;
+  int i, len, off;
   uint uargv, uarg;
 
-  if(argstr(0, &path) < 0 || argint(1, (int*)&uargv) < 0){
+  if(argint(n, (int*)&uargv) < 0)
     return -1;
-  }
-  memset(argv, 0, sizeof(argv));
+  memset(argv, 0, MAXARG*sizeof(argv[0]));
+  off = 0;
   for(i=0;; i++){
-    if(i >= NELEM(argv))
+    if(i >= MAXARG)
       return -1;
     if(fetchint(uargv+4*i, (int*)&uarg) < 0)
       return -1;
@@ -413,10 +536,61 @@ sys_exec(void)
       argv[i] = 0;
       break;
     }
-    if(fetchstr(uarg, &argv[i]) < 0)
+    argv[i] = page + off;
+    if((len = fetchstr(uarg, argv[i], PGSIZE - off)) < 0)
       return -1;
+    off += len + 1;
+  }
+  return 0;
+}
+
+int
+sys_exec(void)
+{
+  char *path, *argv[MAXARG], *page;
+  int r;
+
+  if((page = kalloc()) == 0)
+    return -1;
+  r = -1;
+  if(argstr(0, &path) >= 0 && argargv(1, argv, page) >= 0)
+    r = exec(path, argv);
+  kfree(page);
+  return r;
+}
+
+// spawn(path, argv, fds): run path in a new child whose
+// descriptors 0, 1 and 2 are this process's fds[0..2], or its
+// own 0, 1 and 2 if fds is 0.  A descriptor of -1 leaves the
+// child's closed.
+int
+sys_spawn(void)
+{
+  char *path, *argv[MAXARG], *page;
+  struct file *files[3];
+  int *fds, ufds, i, fd, r;
+
+  if((page = kalloc()) == 0)
+    return -1;
+  r = -1;
+  if(argstr(0, &path) < 0 || argargv(1, argv, page) < 0 || argint(2, &ufds) < 0)
+    goto out;
+  if(ufds && argptr(2, (char**)&fds, 3*sizeof(fds[0])) < 0)
+    goto out;
+  for(i = 0; i < 3; i++){
+    fd = ufds ? fds[i] : i;
+    files[i] = 0;
+    if(fd == -1)
+      continue;
+    if(fd < 0 || fd >= myproc()->nofile || (files[i] = myproc()->ofile[fd]) == 0){
+      if(ufds)
+        goto out;
+    }
   }
-  return exec(path, argv);
+  r = spawn(path, argv, files);
+out:
+  kfree(page);
+  return r;
 }
 
 int
@@ -426,7 +600,7 @@ sys_pipe(void)
   struct file *rf, *wf;
   int fd0, fd1;
 
-  if(argptr(0, (void*)&fd, 2*sizeof(fd[0])) < 0)
+  if(argoutptr(0, (void*)&fd, 2*sizeof(fd[0])) < 0)
     return -1;
   if(pipealloc(&rf, &wf) < 0)
     return -1;
@@ -10,11 +10,14 @@
 #include "mmap.h"
 #include "spinlock.h"
 #include "sleeplock.h"
+#include "mm.h"
 #include "fs.h"
 #include "file.h"
-
-#define MMAP_AREA_START 0x60000000
-#define MMAP_AREA_END 0x80000000
+#include "lockstat.h"
+#include "kstats.h"
+#include "prof.h"
+#include "trace.h"
+#include "memstat.h"
 
 int sys_fork(void)
 {
@@ -53,7 +56,7 @@ int sys_sbrk(void)
 
   if (argint(0, &n) < 0)
     return -1;
-  addr = myproc()->sz;
+  addr = myproc()->mm->sz;
   if (growproc(n) < 0)
     return -1;
   return addr;
@@ -61,23 +64,35 @@ int sys_sbrk(void)
 
 int sys_sleep(void)
 {
-  int n;
-  uint ticks0;
+  int n, m;
 
   if (argint(0, &n) < 0)
     return -1;
-  acquire(&tickslock);
-  ticks0 = ticks;
-  while (ticks - ticks0 < n)
+  // In pieces, since timer deadlines can be at most
+  // 2^31 microseconds away.
+  for (; n > 0; n -= m)
   {
-    if (myproc()->killed)
-    {
-      release(&tickslock);
+    m = n < 1000 ? n : 1000;
+    if (timersleep(m * TICKUS) < 0)
       return -1;
-    }
-    sleep(&ticks, &tickslock);
   }
-  release(&tickslock);
+  return 0;
+}
+
+// Sleep for a number of microseconds.
+int sys_usleep(void)
+{
+  int n;
+
+  if (argint(0, &n) < 0 || n < 0)
+    return -1;
+  return timersleep(n);
+}
+
+// Give up the CPU to any other runnable process.
+int sys_yield(void)
+{
+  yield();
   return 0;
 }
 
@@ -93,41 +108,138 @@ int sys_uptime(void)
   return xticks;
 }
 
+// Move a process to another scheduler level (0 is the highest).
+// Returns its old level.
+int sys_setpriority(void)
+{
+  int pid, prio;
+
+  if (argint(0, &pid) < 0 || argint(1, &prio) < 0)
+    return -1;
+  return setpriority(pid, prio);
+}
+
+// Copy the counters of up to n names of spin lock to the array
+// at ls, and return how many names there are.
+int sys_lockstat(void)
+{
+  struct lockstat *ls;
+  int n;
+
+  if (argint(1, &n) < 0 || n < 0 || n > 0x7fffffff / sizeof(*ls) ||
+      argoutptr(0, (char **)&ls, n * sizeof(*ls)) < 0)
+    return -1;
+  return lockstat(ls, n);
+}
+
+// Copy the kernel's event counters to the struct kstats at ks.
+int sys_kstats(void)
+{
+  struct kstats *ks;
+
+  if (argoutptr(0, (char **)&ks, sizeof(*ks)) < 0)
+    return -1;
+  kstats(ks);
+  return 0;
+}
+
+// Turn the sampling profiler on (1) or off (0).  Returns how
+// many samples were dropped since it was turned on.
+int sys_profile(void)
+{
+  int on;
+
+  if (argint(0, &on) < 0)
+    return -1;
+  return profile(on != 0);
+}
+
+// Move up to n profiler samples to the array at s, and return
+// how many.
+int sys_profread(void)
+{
+  struct profsample *s;
+  int n;
+
+  if (argint(1, &n) < 0 || n < 0 || n > 0x7fffffff / sizeof(*s) ||
+      argoutptr(0, (char **)&s, n * sizeof(*s)) < 0)
+    return -1;
+  return profread(s, n);
+}
+
+// Turn tracing on (1) or off (0).  Returns how many records were
+// overwritten before they were read since it was turned on.
+int sys_trace(void)
+{
+  int on;
+
+  if (argint(0, &on) < 0)
+    return -1;
+  return trace(on != 0);
+}
+
+// Move up to n trace records to the array at s, and return how
+// many.
+int sys_traceread(void)
+{
+  struct tracerec *s;
+  int n;
+
+  if (argint(1, &n) < 0 || n < 0 || n > 0x7fffffff / sizeof(*s) ||
+      argoutptr(0, (char **)&s, n * sizeof(*s)) < 0)
+    return -1;
+  return traceread(s, n);
+}
+
+// Copy the memory use of up to n processes to ms, and return how
+// many processes there are.
+int sys_memstat(void)
+{
+  struct memstat *ms;
+  int n;
+
+  if (argint(1, &n) < 0 || n < 0 || n > 0x7fffffff / sizeof(*ms) ||
+      argoutptr(0, (char **)&ms, n * sizeof(*ms)) < 0)
+    return -1;
+  return memstat(ms, n);
+}
+
 // Function to find an available address
-uint find_available_address(int length)
+// Holes come from the VMA index, which tracks the largest gap in every
+// subtree, so this is O(log n) in the number of mappings. First-fit
+// searches from the bottom of the area; next-fit resumes after the
+// previous allocation and wraps around (MMAPNEXTFIT in param.h).
+uint find_available_address(int length, uint align)
 {
-  // TODO: at some point need to do guard pages
   struct proc *curproc = myproc();
-  uint addr = MMAP_AREA_START;
+  uint guard = MMAPGUARD * PGSIZE;
+  uint need = PGROUNDUP(length) + 2 * guard + (align - PGSIZE); // keep a guard page on each side
+  uint from = MMAP_AREA_START;
+  uint addr;
 
-  while (addr + length <= MMAP_AREA_END)
+  if (MMAPNEXTFIT && curproc->mm->mmap_hint > MMAP_AREA_START)
   {
-    int overlap = 0;
-    for (int i = 0; i < curproc->num_mappings; i++)
-    {
-      uint existing_start = curproc->memoryMappings[i].addr;                             // get the start of the first mapping
-      uint existing_end = existing_start + PGROUNDUP(curproc->memoryMappings[i].length); // get the end of the currmapping
-      uint new_end = addr + length;                                                      // get the new end of the address
+    from = curproc->mm->mmap_hint;
+  }
 
-      if ((existing_start < new_end && existing_end > addr)) // if the current address has a mapping and the existing end is greater than address
-      // we have found a region that has already been mapped, therefore we should break and increment addr by page size
-      {
-        overlap = 1;
-        break;
-      }
-    }
-    if (!overlap)
-    {
-      return addr; // Found an available address
-    }
-    addr += PGSIZE;
+  addr = vma_findgap(curproc->mm->memoryMappings, need, MMAP_AREA_START, MMAP_AREA_END, from);
+  if (addr == 0 && from != MMAP_AREA_START)
+  {
+    addr = vma_findgap(curproc->mm->memoryMappings, need, MMAP_AREA_START, MMAP_AREA_END, MMAP_AREA_START);
+  }
+  if (addr == 0)
+  {
+    return 0; // Failed to find an available address
   }
-  return 0; // Failed to find an available address
+
+  addr = (addr + guard + align - 1) & ~(align - 1);
+  curproc->mm->mmap_hint = addr + PGROUNDUP(length);
+  return addr;
 }
 
 // here is our kernal level program, this will eventually call our user level
 // program that is defined in proc.c get args from user space
-int sys_mmap(void)
+static int mmap1(void)
 {
   void *addr; // the requested address
   int length; // the size of memory needed //TODO: this needs to be rounded up
@@ -142,7 +254,7 @@ int sys_mmap(void)
     return -1;
   }
 
-  if (length <= 0)
+  if (length <= 0 || (prot & ~(PROT_READ | PROT_WRITE)) != 0)
   {
     return -1;
   }
@@ -164,6 +276,11 @@ int sys_mmap(void)
   {
     return -1;
   }
+  // Program segments are exec's to map.
+  if (flags & MAP_IMAGE)
+  {
+    return -1;
+  }
 
   // If MAP_FIXED is set, then the address should be non-null and page-aligned.
   if ((flags & MAP_FIXED) && (addr == 0 || (uint)addr % PGSIZE != 0))
@@ -174,22 +291,55 @@ int sys_mmap(void)
   // If it's not an anonymous mapping, validate that the file descriptor is valid, and the offset is within the file bounds.
   if (!(flags & MAP_ANONYMOUS))
   {
-    if (fd < 0 || fd >= NOFILE || myproc()->ofile[fd] == 0)
+    if (fd < 0 || fd >= myproc()->nofile || myproc()->ofile[fd] == 0)
     {
       return -1; // Invalid file descriptor
     }
+    // Only inodes can be mapped, and only if open for reading,
+    // and for writing too if stores are to reach the file.
+    if (myproc()->ofile[fd]->type != FD_INODE || !myproc()->ofile[fd]->readable ||
+        ((flags & MAP_SHARED) && (prot & PROT_WRITE) && !myproc()->ofile[fd]->writable))
+    {
+      return -1;
+    }
+    // The mapping starts offset bytes into the file, on a page boundary.
+    if (offset < 0 || offset % PGSIZE != 0)
+    {
+      return -1;
+    }
   }
 
 
+  // Anonymous mappings of 4MB or more are placed 4MB aligned so the
+  // page fault handler can back them with huge pages.  MAP_HUGE asks
+  // for that even for smaller ones, by rounding them up to 4MB.
+  uint align = PGSIZE;
+  if (flags & MAP_ANONYMOUS)
+  {
+    if ((flags & MAP_HUGE) && length <= MMAP_AREA_END - MMAP_AREA_START)
+    {
+      length = HUGEPGROUNDUP(length);
+    }
+    if (length >= HUGEPGSIZE)
+    {
+      align = HUGEPGSIZE;
+    }
+  }
+
   // Address allocation
   uint new_address;
   if (flags & MAP_FIXED) // map to a fixed address
   {
     new_address = (uint)addr;
+    if (new_address + PGROUNDUP(length) > MMAP_AREA_END ||
+        vma_overlaps(currproc->mm->memoryMappings, new_address, new_address + PGROUNDUP(length)))
+    {
+      return -1;
+    }
   }
   else
   {
-    new_address = find_available_address(length);
+    new_address = find_available_address(length, align);
     if (new_address == 0)
     {
       return -1; // Failed to find an available address
@@ -197,27 +347,74 @@ int sys_mmap(void)
   }
 
 
-  // now we have found the address we can go ahead and add it to the sturct
-  struct mem_mapping new_mapping;
+  // now we have found the address we can go ahead and add it to the index
+  struct mem_mapping *new_mapping = vma_alloc();
+  if (new_mapping == 0)
+  {
+    return -1; // Out of mapping slots
+  }
 
-  new_mapping.addr = new_address;
-  new_mapping.length = length;
-  new_mapping.flags = flags;
-  new_mapping.fd = fd;
-  new_mapping.originalLength = length;
+  new_mapping->addr = new_address;
+  new_mapping->length = length;
+  new_mapping->flags = flags;
+  new_mapping->prot = prot;
+  if (!(flags & MAP_ANONYMOUS))
+  {
+    // The mapping keeps the file open, so fd may be closed right away.
+    new_mapping->file = filedup(currproc->ofile[fd]);
+    new_mapping->offset = offset;
+  }
+  new_mapping->originalLength = length;
 
-  currproc->memoryMappings[currproc->num_mappings] = new_mapping; // add the new mappings to the struct
-  currproc->num_mappings++;
+  vma_insert(&currproc->mm->memoryMappings, new_mapping); // add the new mappings to the struct
+  currproc->mm->num_mappings++;
+  if (flags & MAP_POPULATE)
+  {
+    populate_mapping(currproc, new_mapping); // take the faults now rather than on first use
+  }
+  // fold it into compatible neighbours, so arenas carved out of
+  // adjacent mmaps cost one node
+  currproc->mm->num_mappings -= vma_merge(&currproc->mm->memoryMappings, &new_mapping);
   return new_address; // return the new address
 }
 
+// Tear down mapping map of process p: write a MAP_SHARED file
+// mapping's modified pages back, release the pages and page-table
+// pages behind it, and drop it from the index.  Returns -1, leaving
+// the mapping in place, if the writeback fails.
+int unmap_mapping(struct proc *p, struct mem_mapping *map)
+{
+  // If the mapping is file-backed with the MAP_SHARED flag, write it back to the file.
+  if ((map->flags & MAP_SHARED) && map->file)
+  {
+    if (mmap_writeback(p, map, map->file->ip, map->addr, vma_end(map), 0) < 0)
+    {
+      return -1;
+    }
+  }
+
+  // Free the frames once no TLB can reach them.
+  if (unmapuvm(p->mm->pgdir, map->addr, vma_end(map)) < 0)
+  {
+    return -1;
+  }
+
+  // Drop the mapping from the index.
+  vma_remove(&p->mm->memoryMappings, map);
+  vma_free(map);
+  p->mm->num_mappings--;
+  return 0;
+}
+
 // the goal of this function is unmap memory, we need to get args from the user spac e
-int sys_munmap(void)
+// Unmaps every page in [addr, addr+length), which may cover parts of
+// several mappings: a mapping cut at either end is split first.
+static int munmap1(void)
 {
   void *addr; // this is the address we need to get
-  int length; // we are not doing partial unmappings
+  int length;
   struct proc *curproc = myproc();
-  struct file *f;
+  struct mem_mapping *map, *next;
 
   // Retrieve the arguments from the system call.
   if (argint(0, (void *)&addr) < 0 || argint(1, &length) < 0)
@@ -225,76 +422,309 @@ int sys_munmap(void)
     return -1;
   }
 
-  struct inode *ip = 0;
-  int found_mapping = 0; // Flag to check if mapping is found
+  uint start = (uint)addr;
+  uint end = start + PGROUNDUP(length);
+  if (length <= 0 || start % PGSIZE != 0 || end < start)
+  {
+    return -1;
+  }
 
-  // Iterate over the mappings and find the mapping for the given address.
-  for (int i = 0; i < curproc->num_mappings; i++)
+  // Nothing mapped there at all is an error.
+  if (!vma_overlaps(curproc->mm->memoryMappings, start, end))
   {
-    struct mem_mapping *map = &curproc->memoryMappings[i];
+    return -1;
+  }
 
-    if ((uint)addr >= map->addr && (uint)addr + length <= map->addr + map->length)
+  // Split the mappings cut at either end before tearing anything
+  // down, so that running out of mapping nodes leaves the range as it
+  // was. Only the mappings holding start and end-1 can be cut.
+  if ((map = vma_floor(curproc->mm->memoryMappings, start)) && map->addr < start && vma_end(map) > start)
+  {
+    // keep the part below start
+    if (vma_split(&curproc->mm->memoryMappings, map, start) == 0)
+    {
+      return -1;
+    }
+    curproc->mm->num_mappings++;
+  }
+  if ((map = vma_floor(curproc->mm->memoryMappings, end - 1)) && vma_end(map) > end)
+  {
+    // keep the part above end
+    if (vma_split(&curproc->mm->memoryMappings, map, end) == 0)
     {
-      found_mapping = 1; // Set flag if mapping is found
+      return -1;
+    }
+    curproc->mm->num_mappings++;
+  }
 
-    
+  // Every mapping now lies wholly inside or outside the range.
+  if ((map = vma_floor(curproc->mm->memoryMappings, start)) == 0 || map->addr < start)
+  {
+    map = vma_above(curproc->mm->memoryMappings, start);
+  }
+  for (; map && map->addr < end; map = next)
+  {
+    next = vma_above(curproc->mm->memoryMappings, map->addr);
+    if (unmap_mapping(curproc, map) < 0)
+    {
+      return -1;
+    }
+  }
+  return 0;
+}
 
-      // If the mapping is file-backed with the MAP_SHARED flag, write it back to the file.
-      if ((map->flags & MAP_SHARED) && !(map->flags & MAP_ANONYMOUS) && map->fd >= 0)
-      {
-        f = curproc->ofile[map->fd];
-        if (f == 0)
-        {
-          // Handle error: Invalid file descriptor
-          panic("mapping failed 1");
-        }
-        ip = f->ip;
-      }
+// Write a MAP_SHARED file mapping's modified pages back to the file
+// without unmapping it.  With MS_SYNC the pages are on disk when this
+// returns; with MS_ASYNC they are handed to the flusher thread.
+static int msync1(void)
+{
+  void *addr;
+  int length, flags;
+  struct proc *curproc = myproc();
 
-      // Handle unmap and free pages
-      uint va = (uint)addr;
-      while (va < (uint)addr + length)
-      {
-        pte_t *pte = walkpgdir(curproc->pgdir, (void *)va, 0);
-        if (pte && (*pte & PTE_P))
-        {
-          char *pa = P2V(PTE_ADDR(*pte));
-          if ((map->flags & MAP_SHARED) && !(map->flags & MAP_ANONYMOUS))
-          {
-            // Write back to file if necessary
-            char buffer[PGSIZE];
-            memmove(buffer, pa, PGSIZE);
-            uint offset_into_file = va - map->addr;
-            begin_op();
-            ilock(ip);
-            int written_bytes = writei(ip, buffer, offset_into_file, PGSIZE);
-            iunlock(ip);
-            end_op();
-            if (written_bytes < 0)
-            {
-              return -1;
-            }
-          }
-        }
-
-        va += PGSIZE;
-      }
+  if (argint(0, (void *)&addr) < 0 || argint(1, &length) < 0 || argint(2, &flags) < 0)
+  {
+    return -1;
+  }
+  // Exactly one of MS_SYNC and MS_ASYNC.
+  if (length < 0 || (flags != MS_SYNC && flags != MS_ASYNC))
+  {
+    return -1;
+  }
+
+  struct mem_mapping *map = vma_lookup(curproc->mm->memoryMappings, (uint)addr);
+  if (map == 0 || (uint)addr + length > map->addr + map->length)
+  {
+    return -1;
+  }
+
+  // Anonymous and private mappings have nothing to write back.
+  if (!(map->flags & MAP_SHARED) || map->file == 0)
+  {
+    return 0;
+  }
+  if (mmap_writeback(curproc, map, map->file->ip, (uint)addr, (uint)addr + length, flags == MS_ASYNC) < 0)
+  {
+    return -1;
+  }
+  if (flags == MS_SYNC)
+  {
+    log_force(); // the writes are only on disk once their log group commits
+  }
+  return 0;
+}
+
+// Split mapping map of process p, which overlaps [start, end), so
+// that its part inside the range is a mapping of its own, and return
+// that part. Returns 0 if out of mapping nodes.
+static struct mem_mapping *isolate_range(struct proc *p, struct mem_mapping *map, uint start, uint end)
+{
+  if (map->addr < start)
+  {
+    if ((map = vma_split(&p->mm->memoryMappings, map, start)) == 0)
+    {
+      return 0;
     }
+    p->mm->num_mappings++;
+  }
+  if (vma_end(map) > end)
+  {
+    if (vma_split(&p->mm->memoryMappings, map, end) == 0)
+    {
+      return 0;
+    }
+    p->mm->num_mappings++;
+  }
+  return map;
+}
 
-    // Shift the remaining mappings in the array up one spot to fill the gap.
-    for (int k = i; k < curproc->num_mappings - 1; k++)
+// Change the protection of the pages in [addr, addr+length), which
+// must all be mapped, to prot: PROT_NONE, PROT_READ or
+// PROT_READ|PROT_WRITE.  Mappings cut by the range are split.
+static int mprotect1(void)
+{
+  void *addr;
+  int length, prot;
+  struct proc *curproc = myproc();
+  struct mem_mapping *map, *next;
+  uint a;
+
+  if (argint(0, (void *)&addr) < 0 || argint(1, &length) < 0 || argint(2, &prot) < 0)
+  {
+    return -1;
+  }
+
+  uint start = (uint)addr;
+  uint end = start + PGROUNDUP(length);
+  if (length <= 0 || start % PGSIZE != 0 || end < start || (prot & ~(PROT_READ | PROT_WRITE)) != 0)
+  {
+    return -1;
+  }
+
+  // Check the whole range first, so a failure changes nothing.
+  for (a = start; a < end; a = vma_end(map))
+  {
+    if ((map = vma_lookup(curproc->mm->memoryMappings, a)) == 0)
+    {
+      return -1;
+    }
+    // stores to a shared file mapping need a file open for writing
+    if ((prot & PROT_WRITE) && (map->flags & MAP_SHARED) && map->file && !map->file->writable)
+    {
+      return -1;
+    }
+  }
+
+  for (map = vma_lookup(curproc->mm->memoryMappings, start); map && map->addr < end; map = next)
+  {
+    if ((map = isolate_range(curproc, map, start, end)) == 0)
     {
-      curproc->memoryMappings[k] = curproc->memoryMappings[k + 1];
+      return -1;
     }
-    curproc->num_mappings--;
 
-    break; // Exit the loop after handling the found mapping.
+    map->prot = prot;
+    if (protectuvm(curproc->mm->pgdir, map->addr, vma_end(map), vma_pteflags(map), map->flags & MAP_PRIVATE) < 0)
+    {
+      return -1;
+    }
+    curproc->mm->num_mappings -= vma_merge(&curproc->mm->memoryMappings, &map);
+    next = vma_above(curproc->mm->memoryMappings, map->addr);
   }
+  return 0;
+}
 
-  if (!found_mapping)
+// Take a hint about how [addr, addr+length) will be used.
+// MADV_NORMAL, MADV_RANDOM and MADV_SEQUENTIAL set the access pattern
+// that sizes the fault-around window. MADV_WILLNEED has the file
+// pages behind the range read into the page cache in the background.
+// MADV_DONTNEED frees the range's pages now, writing back shared file
+// pages first; the next access faults them in again afresh, so private
+// pages read the file anew, or zeros if anonymous.  Shared anonymous
+// pages are the only copy of what the processes sharing them wrote,
+// so they stay.
+static int madvise1(void)
+{
+  void *addr;
+  int length, advice;
+  struct proc *curproc = myproc();
+  struct mem_mapping *map, *next;
+  uint a;
+
+  if (argint(0, (void *)&addr) < 0 || argint(1, &length) < 0 || argint(2, &advice) < 0)
   {
-    return -1; 
+    return -1;
+  }
+
+  uint start = (uint)addr;
+  uint end = start + PGROUNDUP(length);
+  if (length <= 0 || start % PGSIZE != 0 || end < start || advice < MADV_NORMAL || advice > MADV_DONTNEED)
+  {
+    return -1;
+  }
+
+  // the whole range must be mapped
+  for (a = start; a < end; a = vma_end(map))
+  {
+    if ((map = vma_lookup(curproc->mm->memoryMappings, a)) == 0)
+    {
+      return -1;
+    }
   }
 
+  for (map = vma_lookup(curproc->mm->memoryMappings, start); map && map->addr < end; map = next)
+  {
+    uint lo = map->addr < start ? start : map->addr;
+    uint hi = vma_end(map) > end ? end : vma_end(map);
+
+    if (advice == MADV_WILLNEED)
+    {
+      if (map->file)
+      {
+        pcache_prefetch(map->file->ip, map->offset + (lo - map->addr), map->offset + (hi - map->addr));
+      }
+    }
+    else if (advice == MADV_DONTNEED)
+    {
+      if ((map->flags & MAP_SHARED) && map->file &&
+          mmap_writeback(curproc, map, map->file->ip, lo, hi, 0) < 0)
+      {
+        return -1;
+      }
+      if (!((map->flags & MAP_SHARED) && (map->flags & MAP_ANONYMOUS)) &&
+          unmapuvm(curproc->mm->pgdir, lo, hi) < 0)
+      {
+        return -1;
+      }
+    }
+    else
+    {
+      if ((map = isolate_range(curproc, map, start, end)) == 0)
+      {
+        return -1;
+      }
+      map->advice = advice;
+      curproc->mm->num_mappings -= vma_merge(&curproc->mm->memoryMappings, &map);
+    }
+    next = vma_above(curproc->mm->memoryMappings, map->addr);
+  }
   return 0;
 }
+
+// The mapping system calls run with the address space locked,
+// since threads sharing it (see clone) may be changing it or
+// faulting pages in at the same time.
+static int mmlocked(int (*f)(void))
+{
+  struct mm *mm = myproc()->mm;
+  int r;
+
+  acquiresleep(&mm->lock);
+  r = f();
+  releasesleep(&mm->lock);
+  return r;
+}
+
+int sys_mmap(void)
+{
+  return mmlocked(mmap1);
+}
+
+int sys_munmap(void)
+{
+  return mmlocked(munmap1);
+}
+
+int sys_msync(void)
+{
+  return mmlocked(msync1);
+}
+
+int sys_mprotect(void)
+{
+  return mmlocked(mprotect1);
+}
+
+int sys_madvise(void)
+{
+  return mmlocked(madvise1);
+}
+
+// Start a thread running fn(arg) on a PGSIZE stack.
+int sys_clone(void)
+{
+  int fn, arg, stack;
+
+  if (argint(0, &fn) < 0 || argint(1, &arg) < 0 || argint(2, &stack) < 0)
+    return -1;
+  return clone((void (*)(void *))fn, (void *)arg, (void *)stack);
+}
+
+// Wait for a thread to exit; its stack is stored in *stack.
+int sys_join(void)
+{
+  void **stack;
+
+  if (argoutptr(0, (char **)&stack, sizeof(*stack)) < 0)
+    return -1;
+  return join(stack);
+}
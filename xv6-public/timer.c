@@ -0,0 +1,187 @@
+//
+// Timers.
+//
+// Time is the TSC counted in microseconds (nowus in lapic.c),
+// which wraps every 71 minutes, so times are only ever compared
+// by the sign of their difference.  Each CPU's lapic timer is
+// one-shot, and every interrupt arms it again for whichever comes
+// first: the CPU's next scheduling tick or the earliest sleeper's
+// deadline.  A process in timersleep sits in a heap ordered by
+// deadline and is woken once, when it is due, rather than on
+// every tick.  An idle CPU other than CPU 0 arms only for
+// the deadline, and if nobody is sleeping it takes no timer
+// interrupts at all.  CPU 0 keeps ticking to advance ticks,
+// which the log's group commit and the scheduler's boost go by.
+//
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "x86.h"
+#include "spinlock.h"
+
+#define BEFORE(a, b) ((int)((a) - (b)) < 0)
+
+struct {
+  struct spinlock lock;
+  struct proc *heap[NPROC];  // sleepers, earliest deadline first
+  int n;
+  uint nexttick;             // when ticks next advances
+} tq;
+
+void
+timerinit(void)
+{
+  initlock(&tq.lock, "timer");
+}
+
+static void
+heapset(int i, struct proc *p)
+{
+  tq.heap[i] = p;
+  p->theap = i;
+}
+
+// Move the entry at i up or down to where it belongs.
+static void
+heapfix(int i)
+{
+  struct proc *p = tq.heap[i];
+  int c;
+
+  while(i > 0 && BEFORE(p->wakeat, tq.heap[(i-1)/2]->wakeat)){
+    heapset(i, tq.heap[(i-1)/2]);
+    i = (i-1)/2;
+  }
+  for(;;){
+    c = 2*i + 1;
+    if(c >= tq.n)
+      break;
+    if(c+1 < tq.n && BEFORE(tq.heap[c+1]->wakeat, tq.heap[c]->wakeat))
+      c++;
+    if(!BEFORE(tq.heap[c]->wakeat, p->wakeat))
+      break;
+    heapset(i, tq.heap[c]);
+    i = c;
+  }
+  heapset(i, p);
+}
+
+static void
+heapdel(struct proc *p)
+{
+  int i = p->theap;
+
+  p->theap = -1;
+  if(--tq.n > i){
+    heapset(i, tq.heap[tq.n]);
+    heapfix(i);
+  }
+}
+
+// Arm this CPU's lapic timer for its next tick, unless idle,
+// or the earliest deadline if that is sooner.  While profiling,
+// a CPU that isn't idle goes off at least every PROFUS.
+// Caller holds tq.lock.
+static void
+arm(int idle)
+{
+  struct cpu *c = mycpu();
+  uint at, now;
+  int armed;
+
+  armed = 0;
+  now = nowus();
+  if(!idle || c == &cpus[0]){
+    at = c == &cpus[0] ? tq.nexttick : c->nexttick;
+    armed = 1;
+  }
+  if(tq.n > 0 && (!armed || BEFORE(tq.heap[0]->wakeat, at))){
+    at = tq.heap[0]->wakeat;
+    armed = 1;
+  }
+  if(profiling && !idle && (!armed || BEFORE(now + PROFUS, at))){
+    at = now + PROFUS;
+    armed = 1;
+  }
+  if(!armed){
+    lapictimer(0);
+    return;
+  }
+  lapictimer(BEFORE(now, at) ? at - now : 1);
+}
+
+// Re-arm this CPU's timer on going idle (idle=1), when it
+// needs no scheduling tick, or on going back to work.
+// Called with interrupts off.
+void
+timerset(int idle)
+{
+  acquire(&tq.lock);
+  if(!idle)
+    mycpu()->nexttick = nowus() + TICKUS;
+  arm(idle);
+  release(&tq.lock);
+}
+
+// Timer interrupt: advance ticks on CPU 0, wake the sleepers
+// that are due and arm the timer again.  Return 1 if it is
+// time for the running process to be charged a tick.
+int
+timerintr(void)
+{
+  struct cpu *c = mycpu();
+  struct proc *p;
+  uint now;
+  int tick;
+
+  acquire(&tq.lock);
+  now = nowus();
+  tick = 0;
+  if(c == &cpus[0]){
+    acquire(&tickslock);
+    while(!BEFORE(now, tq.nexttick)){
+      ticks++;
+      tq.nexttick += TICKUS;
+      tick = 1;
+    }
+    release(&tickslock);
+  } else if(!BEFORE(now, c->nexttick)){
+    c->nexttick = now + TICKUS;
+    tick = 1;
+  }
+  while(tq.n > 0 && !BEFORE(now, tq.heap[0]->wakeat)){
+    p = tq.heap[0];
+    heapdel(p);
+    wakeup(&p->wakeat);
+  }
+  arm(0);
+  release(&tq.lock);
+
+  if(tick && c == &cpus[0])
+    logtick();
+  return tick;
+}
+
+// Sleep for us microseconds.
+// Return -1 if killed first.
+int
+timersleep(uint us)
+{
+  struct proc *p = myproc();
+
+  acquire(&tq.lock);
+  p->wakeat = nowus() + us;
+  heapset(tq.n++, p);
+  heapfix(p->theap);
+  arm(0);
+  while(BEFORE(nowus(), p->wakeat) && !p->killed)
+    sleep(&p->wakeat, &tq.lock);
+  if(p->theap >= 0)
+    heapdel(p);
+  release(&tq.lock);
+  return p->killed ? -1 : 0;
+}
@@ -0,0 +1,305 @@
+//
+// tmpfs: a file system held in memory, mounted on /tmp.
+//
+// Its inodes are those of device TMPDEV.  They go through the
+// inode cache and its locks like any other, so the code in fs.c
+// works on them unchanged but where it would touch the disk:
+// there it calls in here instead.
+//
+// What would be the disk's inode blocks is tmpfs.inode, which
+// ilock and iupdate copy from and to.  A file's content is
+// kalloc'd pages, found from addrs[] as bmap finds blocks: the
+// first NDIRECT addrs are data pages, the next a page listing
+// NPINDEX data pages, and the last a page listing pages of such
+// lists.  addrs[] hold the pages' kernel addresses.  Reading and
+// writing copy to and from the pages, and no log or buffer is
+// involved; the page cache hands out the pages themselves, so a
+// MAP_SHARED mapping of a tmpfs file maps its content with no
+// copy at all.
+//
+// namex crosses between the root file system and tmpfs through
+// tmpfs_cross: into tmpfs's root at the directory it is mounted
+// on, and back out of it at "..".
+//
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "stat.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define NPINDEX (PGSIZE / sizeof(uint))  // pages an index page lists
+
+struct {
+  struct spinlock lock;  // protects inode[] types, for ialloc
+  struct dinode inode[NTMPINODE];
+  uint mountinum;        // root file system directory mounted on, or 0
+  uint mountparent;      // and its parent
+} tmpfs;
+
+// Set up tmpfs's root directory and mount it on /tmp, if the
+// root file system has one.  Runs in the first process, since
+// looking /tmp up may sleep.
+void
+tmpfsinit(void)
+{
+  struct inode *ip, *dp;
+  char name[DIRSIZ];
+
+  initlock(&tmpfs.lock, "tmpfs");
+  tmpfs.inode[ROOTINO].type = T_DIR;
+  tmpfs.inode[ROOTINO].nlink = 1;
+
+  begin_op();
+  ip = iget(TMPDEV, ROOTINO);
+  ilock(ip);
+  if(dirlink(ip, ".", ROOTINO) < 0 || dirlink(ip, "..", ROOTINO) < 0)
+    panic("tmpfsinit");
+  iunlockput(ip);
+
+  if((ip = namei("/tmp")) != 0 && (dp = nameiparent("/tmp", name)) != 0){
+    ilockshared(ip);
+    if(ip->type == T_DIR){
+      tmpfs.mountinum = ip->inum;
+      tmpfs.mountparent = dp->inum;
+      cprintf("tmpfs: mounted on /tmp\n");
+    }
+    iunlock(ip);
+    iput(dp);
+  }
+  if(ip)
+    iput(ip);
+  end_op();
+}
+
+// Where path lookup goes on from, having found next under name
+// in directory dp: tmpfs's root in place of the directory it is
+// mounted on, and that directory's parent for ".." in tmpfs's
+// root.  Consumes the reference to next.
+struct inode*
+tmpfs_cross(struct inode *dp, struct inode *next, char *name)
+{
+  if(tmpfs.mountinum == 0)
+    return next;
+  if(next->dev == ROOTDEV && next->inum == tmpfs.mountinum){
+    iput(next);
+    return iget(TMPDEV, ROOTINO);
+  }
+  if(dp->dev == TMPDEV && dp->inum == ROOTINO && namecmp(name, "..") == 0){
+    iput(next);
+    return iget(ROOTDEV, tmpfs.mountparent);
+  }
+  return next;
+}
+
+// Allocate a tmpfs inode of type type, as ialloc does on disk.
+// Returns its number.
+uint
+tmpfs_ialloc(short type)
+{
+  struct dinode *dip;
+  uint inum;
+
+  acquire(&tmpfs.lock);
+  for(inum = 1; inum < NTMPINODE; inum++){
+    dip = &tmpfs.inode[inum];
+    if(dip->type == 0){
+      memset(dip, 0, sizeof(*dip));
+      dip->type = type;
+      release(&tmpfs.lock);
+      return inum;
+    }
+  }
+  panic("ialloc: no tmpfs inodes");
+}
+
+// Fill in ip from its tmpfs inode, for ilock.
+void
+tmpfs_iload(struct inode *ip)
+{
+  struct dinode *dip = &tmpfs.inode[ip->inum];
+
+  acquire(&tmpfs.lock);
+  ip->type = dip->type;
+  ip->major = dip->major;
+  ip->minor = dip->minor;
+  ip->nlink = dip->nlink;
+  ip->size = dip->size;
+  memmove(ip->addrs, dip->addrs, sizeof(ip->addrs));
+  release(&tmpfs.lock);
+}
+
+// Copy ip back to its tmpfs inode, for iupdate.
+void
+tmpfs_iupdate(struct inode *ip)
+{
+  struct dinode *dip = &tmpfs.inode[ip->inum];
+
+  acquire(&tmpfs.lock);
+  dip->type = ip->type;
+  dip->major = ip->major;
+  dip->minor = ip->minor;
+  dip->nlink = ip->nlink;
+  dip->size = ip->size;
+  memmove(dip->addrs, ip->addrs, sizeof(ip->addrs));
+  release(&tmpfs.lock);
+}
+
+// Return the index page *slot refers to, allocating it if alloc
+// and there is none; 0 if there is none or no memory.
+static uint*
+tmpindex(uint *slot, int alloc)
+{
+  char *p;
+
+  if(*slot == 0){
+    if(!alloc || (p = kzalloc()) == 0)
+      return 0;
+    *slot = (uint)p;
+  }
+  return (uint*)*slot;
+}
+
+// Return the slot that holds (the address of) page pn of ip,
+// allocating index pages on the way if alloc.  Returns 0 if
+// there is no such slot.  Caller holds ip->lock.
+static uint*
+tmpslot(struct inode *ip, uint pn, int alloc)
+{
+  uint *a;
+
+  if(pn < NDIRECT)
+    return &ip->addrs[pn];
+  pn -= NDIRECT;
+
+  if(pn < NPINDEX){
+    if((a = tmpindex(&ip->addrs[NDIRECT], alloc)) == 0)
+      return 0;
+    return &a[pn];
+  }
+  pn -= NPINDEX;
+
+  if(pn < NPINDEX*NPINDEX){
+    if((a = tmpindex(&ip->addrs[NDIRECT+1], alloc)) == 0 ||
+       (a = tmpindex(&a[pn / NPINDEX], alloc)) == 0)
+      return 0;
+    return &a[pn % NPINDEX];
+  }
+  return 0;
+}
+
+// Return page pn of ip, or 0 if it has none.
+static char*
+tmppage(struct inode *ip, uint pn)
+{
+  uint *slot;
+
+  if((slot = tmpslot(ip, pn, 0)) == 0)
+    return 0;
+  return (char*)*slot;
+}
+
+// Read from tmpfs inode ip, as readi does.
+int
+tmpfs_read(struct inode *ip, char *dst, uint off, uint n)
+{
+  uint tot, m;
+  char *page;
+
+  if(off > ip->size || off + n < off)
+    return -1;
+  if(off + n > ip->size)
+    n = ip->size - off;
+
+  for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
+    m = min(n - tot, PGSIZE - off%PGSIZE);
+    if((page = tmppage(ip, off/PGSIZE)) != 0)
+      memmove(dst, page + off%PGSIZE, m);
+    else
+      memset(dst, 0, m);
+  }
+  return n;
+}
+
+// Write to tmpfs inode ip, as writei does, adding pages as the
+// file grows.  Returns how much was written, which falls short
+// if memory runs out.
+int
+tmpfs_write(struct inode *ip, char *src, uint off, uint n)
+{
+  uint tot, m, *slot;
+  char *page;
+
+  if(off > ip->size || off + n < off)
+    return -1;
+
+  for(tot=0; tot<n; tot+=m, off+=m, src+=m){
+    m = min(n - tot, PGSIZE - off%PGSIZE);
+    if((slot = tmpslot(ip, off/PGSIZE, 1)) == 0)
+      break;
+    if(*slot == 0){
+      if((page = kzalloc()) == 0)
+        break;
+      *slot = (uint)page;
+    }
+    // a MAP_SHARED mapping writing back writes the page itself
+    if(src != (char*)*slot + off%PGSIZE)
+      memmove((char*)*slot + off%PGSIZE, src, m);
+  }
+
+  if(off > ip->size)
+    ip->size = off;
+  iupdate(ip);
+  return tot > 0 || n == 0 ? tot : -1;
+}
+
+// Return the page of ip at page-aligned off with a reference for
+// the caller, for the page cache: the file's own page, or past
+// its end a zeroed one.  Returns 0 if out of memory.
+// Caller holds ip->lock, shared will do.
+char*
+tmpfs_getpage(struct inode *ip, uint off)
+{
+  char *page;
+
+  if(off < ip->size && (page = tmppage(ip, off/PGSIZE)) != 0){
+    kref(page);
+    return page;
+  }
+  return kzalloc();
+}
+
+// Free an index page and the pages it lists, depth levels of
+// listing down.
+static void
+tmpfree(uint addr, int depth)
+{
+  uint *a = (uint*)addr;
+  int i;
+
+  if(depth > 0)
+    for(i = 0; i < NPINDEX; i++)
+      if(a[i])
+        tmpfree(a[i], depth-1);
+  kfree((char*)addr);
+}
+
+// Free all of tmpfs inode ip's pages, for itrunc.  Pages that
+// are still mapped stay valid for their mappers.
+void
+tmpfs_trunc(struct inode *ip)
+{
+  int i;
+
+  for(i = 0; i < NDIRECT+2; i++){
+    if(ip->addrs[i]){
+      tmpfree(ip->addrs[i], i < NDIRECT ? 0 : i - NDIRECT + 1);
+      ip->addrs[i] = 0;
+    }
+  }
+}
@@ -0,0 +1,129 @@
+//
+// Kernel tracepoints.
+//
+// While tracing is on, tracepoints in hot paths record what
+// happened, when, into a ring of their CPU's own, overwriting the
+// oldest records once it is full.  Writers take no lock: only the
+// CPU itself writes its ring, with interrupts off, and it bumps w
+// only after the record is complete.  traceread() drains the rings
+// without stopping the writers and afterwards throws away what
+// they overwrote meanwhile.
+//
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "x86.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "trace.h"
+
+#define NTRACEREC 2048  // records a CPU holds until drained
+
+struct tracering {
+  volatile uint w;  // records written, all told
+  uint r;           // records read
+  uint lost;        // records overwritten before they were read
+  struct tracerec rec[NTRACEREC];
+} __attribute__((aligned(64)));
+
+static struct tracering ring[NCPU];
+static struct sleeplock readlock;  // readers take turns
+int tracing;
+
+void
+traceinit(void)
+{
+  initsleeplock(&readlock, "trace");
+}
+
+// Record event ev with argument arg on this CPU.
+void
+tracepoint(int ev, uint arg)
+{
+  struct tracering *t;
+  struct tracerec *r;
+  struct proc *p;
+
+  pushcli();
+  t = &ring[cpuid()];
+  r = &t->rec[t->w % NTRACEREC];
+  r->tsc = rdtsc();
+  r->ev = ev;
+  r->cpu = cpuid();
+  p = mycpu()->proc;
+  r->pid = p ? p->pid : 0;
+  r->arg = arg;
+  __sync_synchronize();  // the record is complete before w says so
+  t->w++;
+  popcli();
+}
+
+// Turn tracing on, with empty rings, or off.  Returns how many
+// records were overwritten unread since it was last turned on.
+int
+trace(int on)
+{
+  int i, lost;
+
+  acquiresleep(&readlock);
+  tracing = 0;
+  lost = 0;
+  for(i = 0; i < ncpu; i++){
+    lost += ring[i].lost;
+    if(ring[i].w - ring[i].r > NTRACEREC)
+      lost += ring[i].w - ring[i].r - NTRACEREC;
+    if(on){
+      ring[i].r = ring[i].w;
+      ring[i].lost = 0;
+    }
+  }
+  tracing = on;
+  releasesleep(&readlock);
+  return lost;
+}
+
+// Move up to n records from the rings to s, which may be user
+// memory; return how many.  They go through buf, so that what
+// the writer overwrote while they were copied can be dropped
+// before they reach s.
+int
+traceread(struct tracerec *s, int n)
+{
+  struct tracerec buf[32];
+  struct tracering *t;
+  uint w, first;
+  int i, k, got;
+
+  acquiresleep(&readlock);
+  got = 0;
+  for(i = 0; i < ncpu && got < n; ){
+    t = &ring[i];
+    w = t->w;
+    if(w - t->r > NTRACEREC){
+      t->lost += w - t->r - NTRACEREC;
+      t->r = w - NTRACEREC;
+    }
+    for(k = 0; t->r + k != w && k < NELEM(buf) && got + k < n; k++)
+      buf[k] = t->rec[(t->r + k) % NTRACEREC];
+    __sync_synchronize();
+    // The writer may be writing record t->w now, over
+    // t->w - NTRACEREC; records from there on are intact.
+    first = t->w - NTRACEREC + 1;
+    if((int)(first - t->r) > 0){
+      t->lost += first - t->r;
+      t->r = first;
+      continue;
+    }
+    memmove(s + got, buf, k * sizeof(buf[0]));
+    t->r += k;
+    got += k;
+    if(k < NELEM(buf))
+      i++;
+  }
+  releasesleep(&readlock);
+  return got;
+}
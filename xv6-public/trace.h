@@ -0,0 +1,24 @@
+// Kernel trace records, as traceread() returns them.  Each CPU
+// writes its own in order; sort by tsc to merge the CPUs.
+
+enum {
+  TR_FAULT,       // page fault: arg is the address
+  TR_FAULTDONE,   // ... handled: arg is 1, or -1 if it killed the process
+  TR_SYSCALL,     // system call: arg is its number
+  TR_SYSRET,      // ... returns: arg is its result
+  TR_SLEEP,       // process goes to sleep: arg is the channel
+  TR_WAKEUP,      // process woken: arg is its pid
+  TR_DISKIO,      // block request sent to the disk: arg is the block
+  TR_DISKDONE,    // ... done
+  TR_COMMIT,      // log group commit starts: arg is its logged blocks
+  TR_COMMITDONE,  // ... committed
+  NTREVENT
+};
+
+struct tracerec {
+  uint64 tsc;  // rdtsc when it happened
+  ushort ev;
+  ushort cpu;
+  int pid;     // process running, or 0 if none
+  uint arg;
+};
@@ -7,12 +7,15 @@
 #include "x86.h"
 #include "traps.h"
 #include "spinlock.h"
+#include "sleeplock.h"
+#include "mm.h"
 
 #define T_PGFLT 14
 
 // Interrupt descriptor table (shared by all CPUs).
 struct gatedesc idt[256];
 extern uint vectors[];  // in vectors.S: array of 256 entry pointers
+extern char sysentry[];  // in trapasm.S
 struct spinlock tickslock;
 uint ticks;
 
@@ -28,16 +31,40 @@ tvinit(void)
   initlock(&tickslock, "time");
 }
 
+// Load the IDT, and point sysenter at sysentry, on a stack
+// switchuvm() sets through ts.esp0.  On a CPU without sysenter
+// the user's sysenter traps as an illegal opcode, and trap()
+// does what it would have.
 void
 idtinit(void)
 {
   lidt(idt, sizeof(idt));
+  if(cpufeatures() & CPUID_SEP){
+    wrmsr(MSR_SYSENTER_CS, SEG_KCODE<<3);
+    wrmsr(MSR_SYSENTER_ESP, (uint)&mycpu()->ts.esp0);
+    wrmsr(MSR_SYSENTER_EIP, (uint)sysentry);
+  }
+}
+
+// Is tf a user's sysenter that trapped as an illegal opcode?
+static int
+issysenter(struct trapframe *tf)
+{
+  return tf->trapno == T_ILLOP && (tf->cs&3) == DPL_USER &&
+    tf->eip + 2 <= myproc()->mm->sz && *(ushort*)tf->eip == 0x340f;
 }
 
 //PAGEBREAK: 41
 void
 trap(struct trapframe *tf)
 {
+  int tick;
+
+  if(issysenter(tf)){
+    tf->eip = tf->edx;
+    tf->esp = tf->ecx;
+    tf->trapno = T_SYSCALL;
+  }
   if(tf->trapno == T_SYSCALL){
     if(myproc()->killed)
       exit();
@@ -48,20 +75,25 @@ trap(struct trapframe *tf)
     return;
   }
 
+  tick = 0;
   switch(tf->trapno){
   case T_IRQ0 + IRQ_TIMER:
-    if(cpuid() == 0){
-      acquire(&tickslock);
-      ticks++;
-      wakeup(&ticks);
-      release(&tickslock);
-    }
+    if(profiling)
+      profsample(tf);
+    tick = timerintr();
     lapiceoi();
     break;
   case T_IRQ0 + IRQ_IDE:
     ideintr();
     lapiceoi();
     break;
+  case T_IRQ0 + IRQ_TLBFLUSH:
+    tlbshootintr();
+    lapiceoi();
+    break;
+  case T_IRQ0 + IRQ_WAKEUP:
+    lapiceoi();
+    break;
   case T_IRQ0 + IRQ_IDE+1:
     // Bochs generates spurious IDE1 interrupts.
     break;
@@ -80,7 +112,7 @@ trap(struct trapframe *tf)
     lapiceoi();
     break; 
   case T_PGFLT:
-      int ret = page_fault_handler(rcr2()); // Handle page fault, pass the virtual address in
+      int ret = page_fault_handler(rcr2(), tf->err); // Handle page fault, pass the virtual address in
       if (ret < 0){
         kill(myproc()->pid); 
       }
@@ -108,11 +140,11 @@ trap(struct trapframe *tf)
   if(myproc() && myproc()->killed && (tf->cs&3) == DPL_USER)
     exit();
 
-  // Force process to give up CPU on clock tick.
+  // Charge the process for the clock tick; it gives up the CPU
+  // at the end of its quantum (see schedtick in proc.c).
   // If interrupts were on while locks held, would need to check nlock.
-  if(myproc() && myproc()->state == RUNNING &&
-     tf->trapno == T_IRQ0+IRQ_TIMER)
-    yield();
+  if(myproc() && myproc()->state == RUNNING && tick)
+    schedtick();
 
   // Check if the process has been killed since we yielded
   if(myproc() && myproc()->killed && (tf->cs&3) == DPL_USER)
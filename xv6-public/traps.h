@@ -34,5 +34,7 @@
 #define IRQ_COM1         4
 #define IRQ_IDE         14
 #define IRQ_ERROR       19
+#define IRQ_TLBFLUSH    20      // TLB shootdown IPI (see lapic.c)
+#define IRQ_WAKEUP      21      // wake a halted CPU (see kick in proc.c)
 #define IRQ_SPURIOUS    31
 
@@ -1,4 +1,9 @@
 // Intel 8250 serial port (UART).
+//
+// Output goes into a ring that the transmitter drains a FIFO's
+// worth at a time, topped up from the "transmitter empty"
+// interrupt, so writers don't wait for the line.  Only a writer
+// that finds the ring full waits, for the FIFO to make room.
 
 #include "types.h"
 #include "defs.h"
@@ -13,16 +18,28 @@
 #include "x86.h"
 
 #define COM1    0x3f8
+#define TXFIFO  16      // bytes the transmit FIFO holds
+#define TXBUF   1024    // bytes waiting for the FIFO
 
 static int uart;    // is there a uart?
+static int polled;  // send synchronously (see uartpanic)
+
+static struct {
+  struct spinlock lock;
+  char buf[TXBUF];
+  uint r;  // next byte to send
+  uint w;  // next free slot
+} tx;
 
 void
 uartinit(void)
 {
   char *p;
 
-  // Turn off the FIFO
-  outb(COM1+2, 0);
+  initlock(&tx.lock, "uart");
+
+  // Turn on and clear the FIFOs, interrupting on every byte received.
+  outb(COM1+2, 0x07);
 
   // 9600 baud, 8 data bits, 1 stop bit, parity off.
   outb(COM1+3, 0x80);    // Unlock divisor
@@ -30,7 +47,7 @@ uartinit(void)
   outb(COM1+1, 0);
   outb(COM1+3, 0x03);    // Lock divisor, 8 data bits.
   outb(COM1+4, 0);
-  outb(COM1+1, 0x01);    // Enable receive interrupts.
+  outb(COM1+1, 0x03);    // Enable receive and transmitter empty interrupts.
 
   // If status is 0xFF, no serial port.
   if(inb(COM1+5) == 0xFF)
@@ -48,16 +65,78 @@ uartinit(void)
     uartputc(*p);
 }
 
+// Is the transmit FIFO empty?  Wait a while for it if not.
+static int
+txready(void)
+{
+  int i;
+
+  for(i = 0; i < 128 && !(inb(COM1+5) & 0x20); i++)
+    microdelay(10);
+  return inb(COM1+5) & 0x20;
+}
+
+// Hand the FIFO as much of the ring as it takes, if it is empty.
+// Caller holds tx.lock.
+static void
+uartstart(void)
+{
+  int i;
+
+  if(!(inb(COM1+5) & 0x20))
+    return;
+  for(i = 0; i < TXFIFO && tx.r != tx.w; i++)
+    outb(COM1+0, tx.buf[tx.r++ % TXBUF]);
+}
+
+// Queue the n bytes at s for sending.
 void
-uartputc(int c)
+uartwrite(char *s, int n)
 {
   int i;
 
   if(!uart)
     return;
-  for(i = 0; i < 128 && !(inb(COM1+5) & 0x20); i++)
-    microdelay(10);
-  outb(COM1+0, c);
+  if(polled){
+    for(i = 0; i < n; i++){
+      txready();
+      outb(COM1+0, s[i]);
+    }
+    return;
+  }
+
+  acquire(&tx.lock);
+  for(i = 0; i < n; i++){
+    while(tx.w - tx.r == TXBUF){
+      if(!txready())
+        tx.r++;  // the line is stuck; lose the oldest byte
+      uartstart();
+    }
+    tx.buf[tx.w++ % TXBUF] = s[i];
+  }
+  uartstart();
+  release(&tx.lock);
+}
+
+void
+uartputc(int c)
+{
+  char b = c;
+
+  uartwrite(&b, 1);
+}
+
+// The kernel is panicking and won't take interrupts again: send
+// what is queued, and everything after it, synchronously.  Doesn't
+// take tx.lock, which the panicking CPU may hold.
+void
+uartpanic(void)
+{
+  polled = 1;
+  while(uart && tx.r != tx.w){
+    txready();
+    outb(COM1+0, tx.buf[tx.r++ % TXBUF]);
+  }
 }
 
 static int
@@ -73,5 +152,12 @@ uartgetc(void)
 void
 uartintr(void)
 {
-  consoleintr(uartgetc);
+  // Reading the interrupt identification acknowledges a transmitter
+  // empty interrupt; received bytes are acknowledged by reading them.
+  while(!(inb(COM1+2) & 0x01)){
+    acquire(&tx.lock);
+    uartstart();
+    release(&tx.lock);
+    consoleintr(uartgetc);
+  }
 }
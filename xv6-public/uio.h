@@ -0,0 +1,8 @@
+// A buffer of a vectored read or write: readv() and writev()
+// move the bytes of an array of them in turn, as one call.
+struct iovec {
+  void *base;
+  int len;
+};
+
+#define IOVMAX 16  // buffers in one readv or writev
@@ -36,10 +36,49 @@ strlen(const char *s)
 void*
 memset(void *dst, int c, uint n)
 {
-  stosb(dst, c, n);
+  char *d;
+
+  // a long at a time once dst is aligned
+  d = dst;
+  c &= 0xFF;
+  if(n >= 8){
+    for(; (uint)d%4; n--)
+      *d++ = c;
+    stosl(d, (c<<24)|(c<<16)|(c<<8)|c, n/4);
+    d += n & ~3;
+    n %= 4;
+  }
+  stosb(d, c, n);
   return dst;
 }
 
+// Find the first c in the n bytes at s, a long at a time once
+// s is aligned.
+void*
+memchr(const void *s, int c, uint n)
+{
+  const uchar *p;
+  const uint *w;
+  uint mask, x;
+
+  p = s;
+  c &= 0xFF;
+  for(; n > 0 && (uint)p%4; n--, p++)
+    if(*p == c)
+      return (void*)p;
+  // a long holds c if c ^ it has a zero byte
+  mask = c * 0x01010101;
+  for(w = (const uint*)p; n >= 4; n -= 4, w++){
+    x = *w ^ mask;
+    if((x - 0x01010101) & ~x & 0x80808080)
+      break;
+  }
+  for(p = (const uchar*)w; n > 0; n--, p++)
+    if(*p == c)
+      return (void*)p;
+  return 0;
+}
+
 char*
 strchr(const char *s, char c)
 {
@@ -100,7 +139,62 @@ memmove(void *vdst, const void *vsrc, int n)
 
   dst = vdst;
   src = vsrc;
-  while(n-- > 0)
-    *dst++ = *src++;
+  if(n <= 0)
+    return vdst;
+  if(src < dst && src + n > dst){
+    // Overlapping, with dst above src: copy from the end down.
+    src += n;
+    dst += n;
+    if(n >= 8){
+      for(; (uint)dst%4; n--)
+        *--dst = *--src;
+      src -= n & ~3;
+      dst -= n & ~3;
+      movslback(dst, src, n/4);
+      n %= 4;
+    }
+    while(n-- > 0)
+      *--dst = *--src;
+  } else {
+    // a long at a time once dst is aligned
+    if(n >= 8){
+      for(; (uint)dst%4; n--)
+        *dst++ = *src++;
+      movsl(dst, src, n/4);
+      src += n & ~3;
+      dst += n & ~3;
+      n %= 4;
+    }
+    movsb(dst, src, n);
+  }
   return vdst;
 }
+
+// The CPU's time stamp counter, for timing.
+uint64
+cycles(void)
+{
+  uint64 t;
+
+  asm volatile("rdtsc" : "=A" (t));
+  return t;
+}
+
+// t/n, clamped to an int, done by hand as there is no libgcc for
+// 64-bit division.
+uint
+per(uint64 t, uint n)
+{
+  uint64 q, r;
+  int i;
+
+  q = r = 0;
+  for(i = 63; i >= 0; i--){
+    r = r << 1 | (t >> i & 1);
+    if(r >= n){
+      r -= n;
+      q |= (uint64)1 << i;
+    }
+  }
+  return q > 0x7fffffff ? 0x7fffffff : q;
+}
@@ -2,31 +2,51 @@
 #include "stat.h"
 #include "user.h"
 #include "param.h"
+#include "mmap.h"
 
-// Memory allocator by Kernighan and Ritchie,
-// The C programming Language, 2nd ed.  Section 8.7.
+// Memory allocator.
+//
+// Small requests come from per-size-class lists (bins) of free
+// power-of-two blocks, so malloc and free of them take constant
+// time; a bin that runs dry carves a slab of blocks out of the
+// arena.  Slab blocks go back to their bin, never to the arena.
+//
+// Requests too big for a bin take the arena: the first-fit free
+// list by Kernighan and Ritchie, The C programming Language, 2nd
+// ed., Section 8.7, which coalesces neighbours on free and grows
+// with sbrk.  The biggest get an anonymous mmap of their own,
+// which free gives straight back.
+//
+// Every block starts with a header whose ptr says where it came
+// from: a bin, a mapping, or (0) the arena.
 
 typedef long Align;
 
 union header {
   struct {
     union header *ptr;
-    uint size;
+    uint size;  // arena: in units; bin: class; mapping: in bytes
   } s;
   Align x;
 };
 
 typedef union header Header;
 
+#define NBIN 8                // classes of 16, 32, ... 2048 bytes
+#define MINBLOCK 16
+#define SLABSIZE 4096         // at least, unless it has no room for 4 blocks
+#define MMAPMIN (64*1024)     // requests this big get a mapping
+
 static Header base;
 static Header *freep;
+static Header *bins[NBIN];
+static Header slabtag, maptag;  // ptr of blocks from a bin or a mapping
 
-void
-free(void *ap)
+static void
+arenafree(Header *bp)
 {
-  Header *bp, *p;
+  Header *p;
 
-  bp = (Header*)ap - 1;
   for(p = freep; !(bp > p && bp < p->s.ptr); p = p->s.ptr)
     if(p >= p->s.ptr && (bp > p || bp < p->s.ptr))
       break;
@@ -43,6 +63,23 @@ free(void *ap)
   freep = p;
 }
 
+void
+free(void *ap)
+{
+  Header *bp;
+
+  if(ap == 0)
+    return;
+  bp = (Header*)ap - 1;
+  if(bp->s.ptr == &slabtag){
+    bp->s.ptr = bins[bp->s.size];
+    bins[bp->s.size] = bp;
+  } else if(bp->s.ptr == &maptag)
+    munmap(bp, bp->s.size);
+  else
+    arenafree(bp);
+}
+
 static Header*
 morecore(uint nu)
 {
@@ -56,17 +93,16 @@ morecore(uint nu)
     return 0;
   hp = (Header*)p;
   hp->s.size = nu;
-  free((void*)(hp + 1));
+  arenafree(hp);
   return freep;
 }
 
-void*
-malloc(uint nbytes)
+// Take a block of nunits units, header included, from the arena.
+static Header*
+arenaalloc(uint nunits)
 {
   Header *p, *prevp;
-  uint nunits;
 
-  nunits = (nbytes + sizeof(Header) - 1)/sizeof(Header) + 1;
   if((prevp = freep) == 0){
     base.s.ptr = freep = prevp = &base;
     base.s.size = 0;
@@ -81,10 +117,71 @@ malloc(uint nbytes)
         p->s.size = nunits;
       }
       freep = prevp;
-      return (void*)(p + 1);
+      p->s.ptr = 0;
+      return p;
     }
     if(p == freep)
       if((p = morecore(nunits)) == 0)
         return 0;
   }
 }
+
+// Fill bin c with a new slab's worth of blocks.
+static int
+refill(int c)
+{
+  uint bunits, n, i;
+  Header *s, *p;
+
+  bunits = (MINBLOCK << c) / sizeof(Header);
+  n = SLABSIZE / (MINBLOCK << c);
+  if(n < 4)
+    n = 4;
+  if((s = arenaalloc(n * bunits + 1)) == 0)
+    return -1;
+  for(i = 0, p = s + 1; i < n; i++, p += bunits){
+    p->s.size = c;
+    p->s.ptr = bins[c];
+    bins[c] = p;
+  }
+  return 0;
+}
+
+void*
+malloc(uint nbytes)
+{
+  Header *p;
+  uint need;
+  int c;
+
+  need = nbytes + sizeof(Header);
+  if(need < nbytes)
+    return 0;
+
+  for(c = 0; c < NBIN; c++)
+    if(need <= MINBLOCK << c)
+      break;
+  if(c < NBIN){
+    if(bins[c] == 0 && refill(c) < 0)
+      return 0;
+    p = bins[c];
+    bins[c] = p->s.ptr;
+    p->s.ptr = &slabtag;
+    return (void*)(p + 1);
+  }
+
+  if(nbytes >= MMAPMIN){
+    need = (need + 4095) & ~4095;
+    p = mmap(0, need, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if(p != (Header*)-1){
+      p->s.ptr = &maptag;
+      p->s.size = need;
+      return (void*)(p + 1);
+    }
+    // out of address space for mappings; the arena may still do
+  }
+
+  if((p = arenaalloc((need + sizeof(Header) - 1) / sizeof(Header))) == 0)
+    return 0;
+  return (void*)(p + 1);
+}
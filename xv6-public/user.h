@@ -1,5 +1,12 @@
 struct stat;
 struct rtcdate;
+struct lockstat;
+struct kstats;
+struct profsample;
+struct tracerec;
+struct memstat;
+struct ring;
+struct iovec;
 
 // system calls
 int fork(void);
@@ -25,6 +32,33 @@ int sleep(int);
 int uptime(void);
 void *mmap(void *addr, int length, int prot, int flags, int fd, int offset);
 int munmap(void *addr, int length);
+int msync(void *addr, int length, int flags);
+int mprotect(void *addr, int length, int prot);
+int madvise(void *addr, int length, int advice);
+int splice(int fdin, int fdout, int n);
+int setpriority(int pid, int prio);
+int usleep(int us);
+int clone(void (*fn)(void *), void *arg, void *stack);
+int join(void **stack);
+int spawn(char *path, char **argv, int *fds);
+int lockstat(struct lockstat *ls, int n);
+int ringsetup(struct ring *r, int n);
+int ringenter(int n);
+int readv(int fd, struct iovec *iov, int niov);
+int writev(int fd, struct iovec *iov, int niov);
+int pread(int fd, void *buf, int n, int off);
+int pwrite(int fd, void *buf, int n, int off);
+int futex_wait(int *addr, int val);
+int futex_wake(int *addr, int n);
+int fsync(int fd);
+int yield(void);
+int kstats(struct kstats*);
+int profile(int on);
+int profread(struct profsample*, int n);
+int trace(int on);
+int traceread(struct tracerec*, int n);
+int memstat(struct memstat*, int n);
+int copyfile(int outfd, int infd, int off, int n);
 
 
 // ulib.c
@@ -37,6 +71,9 @@ void printf(int, const char*, ...);
 char* gets(char*, int max);
 uint strlen(const char*);
 void* memset(void*, int, uint);
+void* memchr(const void*, int, uint);
 void* malloc(uint);
 void free(void*);
 int atoi(const char*);
+uint64 cycles(void);
+uint per(uint64, uint);
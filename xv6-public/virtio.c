@@ -0,0 +1,307 @@
+// Legacy virtio-blk PCI disk driver.
+// Built instead of ide.c with make VIRTIO=1; it serves the file
+// system disk (ROOTDEV) behind the same ideinit/ideintr/iderw
+// interface, so bio.c doesn't know the difference.
+//
+// Each request is a chain of three descriptors (header, data,
+// status) in one virtqueue, and as many requests as the queue
+// has room for can be in flight at once, with one interrupt
+// finishing any number of them.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "x86.h"
+#include "traps.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "buf.h"
+#include "kstats.h"
+#include "trace.h"
+
+#define SECTOR_SIZE 512
+
+// PCI configuration space, by I/O ports.
+#define PCI_CONFADDR 0xCF8
+#define PCI_CONFDATA 0xCFC
+
+#define VIRTIO_VENDOR 0x1af4
+#define VIRTIO_BLKDEV 0x1001  // legacy ("transitional") block device
+
+// Legacy virtio registers, offsets into the I/O space of BAR 0.
+#define VIO_GUESTFEAT 0x04
+#define VIO_QPFN      0x08  // queue address, in pages
+#define VIO_QSIZE     0x0C
+#define VIO_QSEL      0x0E
+#define VIO_QNOTIFY   0x10
+#define VIO_STATUS    0x12
+#define VIO_ISR       0x13  // reading it acknowledges the interrupt
+
+#define VIO_ACK       1
+#define VIO_DRIVER    2
+#define VIO_DRIVER_OK 4
+
+#define VRING_NEXT  1  // descriptor continues in next
+#define VRING_WRITE 2  // device writes the buffer
+
+#define VBLK_IN  0  // read
+#define VBLK_OUT 1  // write
+
+#define QMAX 256  // largest queue the ring memory below can hold
+
+struct vdesc {
+  uint addr;
+  uint addrhi;
+  uint len;
+  ushort flags;
+  ushort next;
+};
+
+struct vavail {
+  ushort flags;
+  ushort idx;
+  ushort ring[];
+};
+
+struct vusedelem {
+  uint id;   // head descriptor of the finished chain
+  uint len;
+};
+
+struct vused {
+  ushort flags;
+  ushort idx;
+  struct vusedelem ring[];
+};
+
+// Request header and status, device-visible.
+struct vreq {
+  uint type;
+  uint reserved;
+  uint sector;
+  uint sectorhi;
+  uchar status;
+  struct buf *b;
+};
+
+// The ring: descriptors and available ring, then the used ring
+// on the next page boundary, all physically contiguous.
+static char vqmem[4*PGSIZE] __attribute__((aligned(PGSIZE)));
+
+static struct {
+  struct spinlock lock;
+  uint iobase;
+  uint qsize;
+  struct vdesc *desc;
+  struct vavail *avail;
+  volatile struct vused *used;
+  ushort usedidx;        // next used entry to look at
+  char free[QMAX];       // descriptor is free
+  struct vreq req[QMAX]; // by head descriptor
+} vdisk;
+
+static uint
+pciread(int dev, int reg)
+{
+  outl(PCI_CONFADDR, 0x80000000 | (dev << 11) | reg);
+  return inl(PCI_CONFDATA);
+}
+
+static void
+pciwrite(int dev, int reg, uint data)
+{
+  outl(PCI_CONFADDR, 0x80000000 | (dev << 11) | reg);
+  outl(PCI_CONFDATA, data);
+}
+
+void
+ideinit(void)
+{
+  int dev, irq, i;
+  uint n, usedoff;
+
+  initlock(&vdisk.lock, "virtio");
+
+  // Find the disk on PCI bus 0 and let it do I/O and DMA.
+  for(dev = 0; dev < 32; dev++)
+    if(pciread(dev, 0) == (VIRTIO_BLKDEV << 16 | VIRTIO_VENDOR))
+      break;
+  if(dev == 32)
+    panic("virtio: no disk");
+  pciwrite(dev, 0x04, pciread(dev, 0x04) | 0x5);
+  vdisk.iobase = pciread(dev, 0x10) & ~3;
+  irq = pciread(dev, 0x3C) & 0xFF;
+
+  outb(vdisk.iobase+VIO_STATUS, 0);  // reset
+  outb(vdisk.iobase+VIO_STATUS, VIO_ACK);
+  outb(vdisk.iobase+VIO_STATUS, VIO_ACK|VIO_DRIVER);
+  outl(vdisk.iobase+VIO_GUESTFEAT, 0);  // no optional features needed
+
+  outw(vdisk.iobase+VIO_QSEL, 0);
+  n = inw(vdisk.iobase+VIO_QSIZE);
+  usedoff = PGROUNDUP(n*sizeof(struct vdesc) + sizeof(struct vavail) + (n+1)*sizeof(ushort));
+  if(n == 0 || n > QMAX ||
+     usedoff + sizeof(struct vused) + n*sizeof(struct vusedelem) + sizeof(ushort) > sizeof(vqmem))
+    panic("virtio: queue size");
+  vdisk.qsize = n;
+  vdisk.desc = (struct vdesc*)vqmem;
+  vdisk.avail = (struct vavail*)(vqmem + n*sizeof(struct vdesc));
+  vdisk.used = (struct vused*)(vqmem + usedoff);
+  for(i = 0; i < n; i++)
+    vdisk.free[i] = 1;
+  outl(vdisk.iobase+VIO_QPFN, V2P(vqmem) / PGSIZE);
+
+  outb(vdisk.iobase+VIO_STATUS, VIO_ACK|VIO_DRIVER|VIO_DRIVER_OK);
+  ioapicroute(irq, IRQ_IDE, ncpu - 1);
+}
+
+// Take three free descriptors, or return -1 if there aren't.
+// Caller holds vdisk.lock.
+static int
+alloc3(int *d)
+{
+  int i, n;
+
+  for(i = n = 0; i < vdisk.qsize && n < 3; i++)
+    if(vdisk.free[i])
+      d[n++] = i;
+  if(n < 3)
+    return -1;
+  for(i = 0; i < 3; i++)
+    vdisk.free[d[i]] = 0;
+  return 0;
+}
+
+// Free the descriptor chain starting at i.
+// Caller holds vdisk.lock.
+static void
+freechain(int i)
+{
+  for(;;){
+    vdisk.free[i] = 1;
+    if(!(vdisk.desc[i].flags & VRING_NEXT))
+      break;
+    i = vdisk.desc[i].next;
+  }
+  wakeup(&vdisk.free);
+}
+
+static void
+setdesc(int i, void *addr, uint len, int flags, int next)
+{
+  vdisk.desc[i].addr = V2P(addr);
+  vdisk.desc[i].addrhi = 0;
+  vdisk.desc[i].len = len;
+  vdisk.desc[i].flags = flags;
+  vdisk.desc[i].next = next;
+}
+
+// Interrupt handler.
+void
+ideintr(void)
+{
+  struct buf *b, *done[QMAX/3];
+  struct vreq *r;
+  int i, ndone;
+
+  acquire(&vdisk.lock);
+  inb(vdisk.iobase+VIO_ISR);
+
+  ndone = 0;
+  while(vdisk.usedidx != vdisk.used->idx){
+    __sync_synchronize();
+    r = &vdisk.req[vdisk.used->ring[vdisk.usedidx % vdisk.qsize].id];
+    b = r->b;
+    if(r->status != 0)
+      panic("virtio: I/O error");
+
+    // Wake process waiting for this buf.
+    b->flags |= B_VALID;
+    b->flags &= ~B_DIRTY;
+    if(tracing)
+      tracepoint(TR_DISKDONE, b->blockno);
+    wakeup(b);
+    if(b->flags & B_ASYNC){
+      b->flags &= ~B_ASYNC;
+      done[ndone++] = b;
+    }
+    freechain(r - vdisk.req);
+    vdisk.usedidx++;
+  }
+
+  release(&vdisk.lock);
+
+  // Nobody waits for read-ahead buffers; hand them back to the cache.
+  for(i = 0; i < ndone; i++)
+    bdoneasync(done[i]);
+}
+
+//PAGEBREAK!
+// Queue b to be synced with disk and return without waiting.
+// If b has B_ASYNC set, the interrupt releases it when done;
+// otherwise call iderwwait.
+void
+iderwstart(struct buf *b)
+{
+  struct vreq *r;
+  int d[3], write;
+
+  if(!holdingsleep(&b->lock))
+    panic("iderw: buf not locked");
+  if((b->flags & (B_VALID|B_DIRTY)) == B_VALID)
+    panic("iderw: nothing to do");
+  if(b->dev != ROOTDEV)
+    panic("iderw: request not for the virtio disk");
+
+  kstat(KS_DISKIO);
+  if(tracing)
+    tracepoint(TR_DISKIO, b->blockno);
+  acquire(&vdisk.lock);
+  while(alloc3(d) < 0)
+    sleep(&vdisk.free, &vdisk.lock);
+
+  write = b->flags & B_DIRTY;
+  r = &vdisk.req[d[0]];
+  r->type = write ? VBLK_OUT : VBLK_IN;
+  r->reserved = 0;
+  r->sector = b->blockno * (BSIZE / SECTOR_SIZE);
+  r->sectorhi = 0;
+  r->status = 0xFF;
+  r->b = b;
+  setdesc(d[0], r, 16, VRING_NEXT, d[1]);
+  setdesc(d[1], b->data, BSIZE, VRING_NEXT | (write ? 0 : VRING_WRITE), d[2]);
+  setdesc(d[2], &r->status, 1, VRING_WRITE, 0);
+
+  vdisk.avail->ring[vdisk.avail->idx % vdisk.qsize] = d[0];
+  __sync_synchronize();  // the device must see the entry before the index
+  vdisk.avail->idx++;
+  __sync_synchronize();
+  outw(vdisk.iobase+VIO_QNOTIFY, 0);
+
+  release(&vdisk.lock);
+}
+
+// Wait for b's request to finish.
+void
+iderwwait(struct buf *b)
+{
+  acquire(&vdisk.lock);
+  while((b->flags & (B_VALID|B_DIRTY)) != B_VALID){
+    sleep(b, &vdisk.lock);
+  }
+  release(&vdisk.lock);
+}
+
+// Sync buf with disk.
+// If B_DIRTY is set, write buf to disk, clear B_DIRTY, set B_VALID.
+// Else if B_VALID is not set, read buf from disk, set B_VALID.
+void
+iderw(struct buf *b)
+{
+  iderwstart(b);
+  iderwwait(b);
+}
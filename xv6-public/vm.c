@@ -6,9 +6,37 @@
 #include "mmu.h"
 #include "proc.h"
 #include "elf.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "mm.h"
+#include "mmap.h"
 
 extern char data[];  // defined by kernel.ld
 pde_t *kpgdir;  // for use in scheduler()
+uint physend;   // Top physical memory, at most PHYSTOP
+
+// Fork shares the page tables that map only private memory between
+// parent and child instead of copying them (see copyuvm): both
+// directory entries point at the one table, with PDE_SHARED set and
+// PTE_W clear so that no write goes through it.  The table holds a
+// reference on each page it maps, and each directory entry one on
+// the table.  Before a PTE in it may change, walkpgdir gives the
+// address space a table of its own (ptunshare).  ptlock makes the
+// decision to copy or take a table over atomic with its reference
+// count.
+static struct spinlock ptlock;
+
+#define NPGDIRCACHE 4  // page directories a CPU keeps for reuse
+
+// Each CPU keeps a few page directories that freevm gave up, with
+// the user half cleared and the kernel half still kpgdir's, so
+// setupkvm can hand one out as it is.
+struct pgdircache {
+  pde_t *pgdir[NPGDIRCACHE];
+  int n;
+} __attribute__((aligned(64)));
+
+static struct pgdircache pgdirs[NCPU];
 
 // Set up CPU's kernel segment descriptors.
 // Run once on entry on each CPU.
@@ -29,9 +57,80 @@ seginit(void)
   lgdt(c->gdt, sizeof(c->gdt));
 }
 
+// Give pgdir a page table of its own in place of the shared one
+// *pde points to: a copy, or the table itself if no other address
+// space holds it any more.  A copy maps the pages the table does,
+// so those that were writable become copy-on-write, in the shared
+// table as well.  Returns -1 if out of memory.
+static int
+ptunshare(pde_t *pgdir, pde_t *pde)
+{
+  pte_t *pgtab, *copy;
+  struct tlbbatch b;
+  int i;
+
+  acquire(&ptlock);
+  if(!(*pde & PDE_SHARED)){
+    release(&ptlock);  // another thread got here first
+    return 0;
+  }
+  pgtab = (pte_t*)P2V(PTE_ADDR(*pde));
+  if(krefcount((char*)pgtab) > 1){
+    if((copy = (pte_t*)kalloc()) == 0){
+      release(&ptlock);
+      return -1;
+    }
+    for(i = 0; i < NPTENTRIES; i++){
+      if(pgtab[i] & PTE_W)
+        pgtab[i] = (pgtab[i] & ~PTE_W) | PTE_COW;
+      copy[i] = pgtab[i];
+      if(pgtab[i] & PTE_P)
+        kref(P2V(PTE_ADDR(pgtab[i])));
+      else if(pgtab[i] & PTE_SWAP)
+        swapdup(pgtab[i]);
+    }
+    kfree((char*)pgtab);
+    *pde = V2P(copy) | PTE_P | PTE_W | PTE_U;
+  } else
+    *pde = (*pde & ~PDE_SHARED) | PTE_W;
+  release(&ptlock);
+
+  // The TLBs may hold any of the old table's entries.
+  b.n = TLBFLUSHMAX + 1;
+  b.nfree = 0;
+  tlbflushdone(pgdir, &b);
+  return 0;
+}
+
+// Let go of the shared page table *pde points to: if another
+// address space still holds it, drop this one's reference, clear
+// *pde and return 1; otherwise make it this one's own and return 0.
+// The caller flushes the TLBs.
+static int
+ptdrop(pde_t *pde)
+{
+  int r = 0;
+
+  acquire(&ptlock);
+  if(*pde & PDE_SHARED){
+    if(krefcount(P2V(PTE_ADDR(*pde))) > 1){
+      kfree(P2V(PTE_ADDR(*pde)));
+      *pde = 0;
+      r = 1;
+    } else
+      *pde = (*pde & ~PDE_SHARED) | PTE_W;
+  }
+  release(&ptlock);
+  return r;
+}
+
 // Return the address of the PTE in page table pgdir
 // that corresponds to virtual address va.  If alloc!=0,
-// create any required page table pages.
+// create any required page table pages.  If va lies in a
+// huge page, return the page directory entry mapping it.
+// A page table shared with another address space is unshared
+// first, since the caller may change the PTE; returns 0 if
+// that runs out of memory.
 pte_t *
 walkpgdir(pde_t *pgdir, const void *va, int alloc)
 {
@@ -41,6 +140,10 @@ walkpgdir(pde_t *pgdir, const void *va, int alloc)
   pte_t *pgtab;
 
   pde = &pgdir[PDX(va)];
+  if(*pde & PTE_PS)
+    return pde;  // a huge page: the directory entry maps va itself
+  if((*pde & PDE_SHARED) && ptunshare(pgdir, pde) < 0)
+    return 0;
   if(*pde & PTE_P){
     pgtab = (pte_t*)P2V(PTE_ADDR(*pde));
   } else {
@@ -100,16 +203,20 @@ int mappages(pde_t *pgdir, void *va, uint size, uint pa, int perm)
 //   KERNBASE..KERNBASE+EXTMEM: mapped to 0..EXTMEM (for I/O space)
 //   KERNBASE+EXTMEM..data: mapped to EXTMEM..V2P(data)
 //                for the kernel's instructions and r/o data
-//   data..KERNBASE+PHYSTOP: mapped to V2P(data)..PHYSTOP,
+//   data..KERNBASE+physend: mapped to V2P(data)..physend,
 //                                  rw data + free physical memory
 //   0xfe000000..0: mapped direct (devices such as ioapic)
 //
 // The kernel allocates physical memory for its heap and for user memory
-// between V2P(end) and the end of physical memory (PHYSTOP)
-// (directly addressable from end..P2V(PHYSTOP)).
+// between V2P(end) and the end of physical memory (physend)
+// (directly addressable from end..P2V(physend)).  physend is what
+// the machine has, as the CMOS tells it, up to PHYSTOP.
+//
+// The kernel half is built once, in kpgdir, and every other page
+// table shares its page tables, so a new address space costs one
+// page.  Memory above 4MB is mapped with 4MB pages.
 
-// This table defines the kernel's mappings, which are present in
-// every process's page table.
+// This table defines the kernel's mappings below 4MB.
 static struct kmap {
   void *virt;
   uint phys_start;
@@ -118,43 +225,58 @@ static struct kmap {
 } kmap[] = {
  { (void*)KERNBASE, 0,             EXTMEM,    PTE_W}, // I/O space
  { (void*)KERNLINK, V2P(KERNLINK), V2P(data), 0},     // kern text+rodata
- { (void*)data,     V2P(data),     PHYSTOP,   PTE_W}, // kern data+memory
+ { (void*)data,     V2P(data),     HUGEPGSIZE, PTE_W}, // kern data+memory
  { (void*)DEVSPACE, DEVSPACE,      0,         PTE_W}, // more devices
 };
 
-// Set up kernel part of a page table.
+// Set up a page table with the kernel part, shared with kpgdir.
 pde_t*
 setupkvm(void)
 {
-  //4. 
   pde_t *pgdir; // this is the page directory for the current process
-  struct kmap *k;
+  struct pgdircache *c;
+
+  pushcli();
+  c = &pgdirs[cpuid()];
+  pgdir = c->n > 0 ? c->pgdir[--c->n] : 0;
+  popcli();
+  if(pgdir)
+    return pgdir;
 
   if((pgdir = (pde_t*)kalloc()) == 0) // gets a 4096 byte page for the pagedirectory
     return 0;
-  memset(pgdir, 0, PGSIZE);  // zeros out the 4096 bytes
-  if (P2V(PHYSTOP) > (void*)DEVSPACE)
-    panic("PHYSTOP too high");
-  for(k = kmap; k < &kmap[NELEM(kmap)]; k++) // for each kmap structure. what is a kmap structure?
-  // a kmap structure contains the 
-  // k->virt the starting virtual address of the memory region
-  // k->phys_start this is the corresponding pa of the k->virt 
-  // k->phys_end this is ending physical address of the k->virt range
-  // from here we call mappages with the pgdir
-    if(mappages(pgdir, k->virt, k->phys_end - k->phys_start,
-                (uint)k->phys_start, k->perm) < 0) { 
-      freevm(pgdir);
-      return 0;
-    }
+  memset(pgdir, 0, PDX(KERNBASE) * sizeof(pde_t));
+  memmove(&pgdir[PDX(KERNBASE)], &kpgdir[PDX(KERNBASE)],
+          (NPDENTRIES - PDX(KERNBASE)) * sizeof(pde_t));
   return pgdir;
 }
 
-// Allocate one page table for the machine for the kernel address
-// space for scheduler processes.
+// Find out how much memory there is, and build the kernel's
+// page table, which is also the one for scheduler processes.
 void
 kvmalloc(void)
 {
-  kpgdir = setupkvm();
+  struct kmap *k;
+  uint pa;
+
+  if (P2V(PHYSTOP) > (void*)DEVSPACE)
+    panic("PHYSTOP too high");
+  physend = HUGEPGROUNDDOWN(cmosmem());
+  if(physend > PHYSTOP)
+    physend = PHYSTOP;
+  if(physend < 2*HUGEPGSIZE)
+    panic("kvmalloc: too little memory");
+
+  initlock(&ptlock, "ptshare");
+  if((kpgdir = (pde_t*)kalloc()) == 0)
+    panic("kvmalloc");
+  memset(kpgdir, 0, PGSIZE);
+  for(k = kmap; k < &kmap[NELEM(kmap)]; k++)
+    if(mappages(kpgdir, k->virt, k->phys_end - k->phys_start,
+                (uint)k->phys_start, k->perm) < 0)
+      panic("kvmalloc");
+  for(pa = HUGEPGSIZE; pa < physend; pa += HUGEPGSIZE)
+    kpgdir[PDX(P2V(pa))] = pa | PTE_P | PTE_W | PTE_PS;
   switchkvm();
 }
 
@@ -174,7 +296,7 @@ switchuvm(struct proc *p)
     panic("switchuvm: no process");
   if(p->kstack == 0)
     panic("switchuvm: no kstack");
-  if(p->pgdir == 0)
+  if(p->mm->pgdir == 0)
     panic("switchuvm: no pgdir");
 
   pushcli();
@@ -187,7 +309,8 @@ switchuvm(struct proc *p)
   // forbids I/O instructions (e.g., inb and outb) from user space
   mycpu()->ts.iomb = (ushort) 0xFFFF;
   ltr(SEG_TSS << 3);
-  lcr3(V2P(p->pgdir));  // switch to process's address space
+  mycpu()->pgdir = p->mm->pgdir;  // before lcr3, so shootdowns don't miss us
+  lcr3(V2P(p->mm->pgdir));  // switch to process's address space
   popcli();
 }
 
@@ -245,13 +368,12 @@ allocuvm(pde_t *pgdir, uint oldsz, uint newsz)
 
   a = PGROUNDUP(oldsz);
   for(; a < newsz; a += PGSIZE){
-    mem = kalloc();
+    mem = kzalloc();
     if(mem == 0){
       cprintf("allocuvm out of memory\n");
       deallocuvm(pgdir, newsz, oldsz);
       return 0;
     }
-    memset(mem, 0, PGSIZE);
     if(mappages(pgdir, (char*)a, PGSIZE, V2P(mem), PTE_W|PTE_U) < 0){
       cprintf("allocuvm out of memory (2)\n");
       deallocuvm(pgdir, newsz, oldsz);
@@ -280,35 +402,56 @@ deallocuvm(pde_t *pgdir, uint oldsz, uint newsz)
     pte = walkpgdir(pgdir, (char*)a, 0);
     if(!pte)
       a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
-    else if((*pte & PTE_P) != 0){
+    else if(*pte & PTE_PS){
+      khugefree(P2V(PTE_ADDR(*pte)));
+      *pte = 0;
+      a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
+    } else if((*pte & PTE_P) != 0){
       pa = PTE_ADDR(*pte);
       if(pa == 0)
         panic("kfree");
       char *v = P2V(pa);
       kfree(v);
       *pte = 0;
+    } else if(*pte & PTE_SWAP){
+      swapfree(*pte);
+      *pte = 0;
     }
   }
   return newsz;
 }
 
 // Free a page table and all the physical memory pages
-// in the user part.
+// in the user part.  The directory itself goes to this CPU's
+// cache, with its user half cleared, if there is room.
 void
 freevm(pde_t *pgdir)
 {
+  struct pgdircache *c;
   uint i;
 
   if(pgdir == 0)
     panic("freevm: no pgdir");
+  for(i = 0; i < PDX(KERNBASE); i++)
+    if(pgdir[i] & PDE_SHARED)
+      ptdrop(&pgdir[i]);
   deallocuvm(pgdir, KERNBASE, 0);
-  for(i = 0; i < NPDENTRIES; i++){
+  for(i = 0; i < PDX(KERNBASE); i++){  // the kernel's are kpgdir's
     if(pgdir[i] & PTE_P){
       char * v = P2V(PTE_ADDR(pgdir[i]));
       kfree(v);
     }
+    pgdir[i] = 0;
   }
-  kfree((char*)pgdir);
+  pushcli();
+  c = &pgdirs[cpuid()];
+  if(c->n < NPGDIRCACHE){
+    c->pgdir[c->n++] = pgdir;
+    pgdir = 0;
+  }
+  popcli();
+  if(pgdir)
+    kfree((char*)pgdir);
 }
 
 // Clear PTE_U on a page. Used to create an inaccessible
@@ -324,71 +467,312 @@ clearpteu(pde_t *pgdir, char *uva)
   *pte &= ~PTE_U;
 }
 
-// Given a parent process's page table, create a copy
-// of it for a child.
-pde_t*
-copyuvm(pde_t *pgdir, uint sz)
+// The running process's PTE for user address va changed: drop
+// this CPU's stale TLB entry and add va to batch b.  Beyond
+// TLBFLUSHMAX pages one CR3 reload is cheaper than more invlpgs,
+// so tlbflushdone does that at the end.  b->n starts out 0.
+void
+tlbinval(struct tlbbatch *b, uint va)
 {
-  pde_t *d;
-  pte_t *pte;
-  uint pa, i, flags;
-  char *mem;
+  if(b->n < TLBFLUSHMAX){
+    invlpg((void*)va);
+    b->va[b->n] = va;
+  }
+  b->n++;
+}
 
-  if((d = setupkvm()) == 0)
-    return 0;
-  for(i = 0; i < sz; i += PGSIZE){
-    if((pte = walkpgdir(pgdir, (void *) i, 0)) == 0)
-      panic("copyuvm: pte should exist");
-    if(!(*pte & PTE_P))
-      panic("copyuvm: page not present");
-    pa = PTE_ADDR(*pte);
-    flags = PTE_FLAGS(*pte);
+// Finish batch b of changes to page table pgdir, normally the one
+// loaded: flush this CPU's TLB if the batch overflowed, and the
+// TLBs of other CPUs that have pgdir loaded.  Then no TLB can
+// reach the frames queued by tlbfree, so release them.  (The page
+// reclaimer changes page tables that aren't loaded here; then
+// only the other CPUs need flushing.)  b is left empty.
+void
+tlbflushdone(pde_t *pgdir, struct tlbbatch *b)
+{
+  int i;
+
+  if(b->n > TLBFLUSHMAX && rcr3() == V2P(pgdir))
+    lcr3(V2P(pgdir));
+  if(b->n > 0)
+    tlbshootdown(pgdir, b);
+  for(i = 0; i < b->nfree; i++){
+    if((uint)b->free[i] & 1)
+      khugefree(b->free[i] - 1);
+    else
+      kfree(b->free[i]);
+  }
+  b->n = b->nfree = 0;
+}
+
+// Drop a reference to frame v (a huge one if huge) once the
+// TLB entries in batch b are gone.  Call after the tlbinval
+// for the last page that mapped v.
+static void
+tlbfree(pde_t *pgdir, struct tlbbatch *b, char *v, int huge)
+{
+  b->free[b->nfree++] = huge ? v + 1 : v;
+  if(b->nfree == TLBFLUSHMAX)
+    tlbflushdone(pgdir, b);
+}
+
+// Replace the huge page mapping the 4MB chunk at a with a page
+// table of ordinary pages, copying the data of the pages outside
+// [start, end) (the rest is about to be unmapped).  Returns -1 if
+// out of memory, leaving the huge page in place.
+static int
+hugesplit(pde_t *pgdir, struct tlbbatch *b, uint a, uint start, uint end)
+{
+  pde_t *pde = &pgdir[PDX(a)];
+  char *huge = P2V(PTE_ADDR(*pde));
+  uint flags = PTE_FLAGS(*pde) & ~PTE_PS;
+  pte_t *pgtab;
+  char *mem;
+  uint va;
+  int i;
+
+  if((pgtab = (pte_t*)kalloc()) == 0)
+    return -1;
+  memset(pgtab, 0, PGSIZE);
+  for(i = 0; i < NPTENTRIES; i++){
+    va = a + i*PGSIZE;
+    if(va >= start && va < end)
+      continue;
     if((mem = kalloc()) == 0)
       goto bad;
-    memmove(mem, (char*)P2V(pa), PGSIZE);
-    if(mappages(d, (void*)i, PGSIZE, V2P(mem), flags) < 0) {
-      kfree(mem);
-      goto bad;
-    }
+    memmove(mem, huge + i*PGSIZE, PGSIZE);
+    pgtab[i] = V2P(mem) | flags;
   }
-  return d;
+  *pde = V2P(pgtab) | PTE_P | PTE_W | PTE_U;
+  tlbinval(b, a);
+  tlbfree(pgdir, b, huge, 1);
+  return 0;
 
 bad:
-  freevm(d);
+  for(i = 0; i < NPTENTRIES; i++)
+    if(pgtab[i] & PTE_P)
+      kfree(P2V(PTE_ADDR(pgtab[i])));
+  kfree((char*)pgtab);
+  return -1;
+}
+
+// Break the huge page containing va, if there is one, into
+// ordinary pages so that parts of it can be changed separately.
+// pgdir must be the running process's.  Returns -1 if out of memory.
+int
+unhuge(pde_t *pgdir, uint va)
+{
+  struct tlbbatch b;
+  int r = 0;
+
+  b.n = b.nfree = 0;
+  if(pgdir[PDX(va)] & PTE_PS)
+    r = hugesplit(pgdir, &b, HUGEPGROUNDDOWN(va), 0, 0);
+  tlbflushdone(pgdir, &b);
+  return r;
+}
+
+// Give the present user pages in [start, end) of the running
+// process's pgdir the PTE_U and PTE_W permissions in perm.  A page
+// that becomes writable while another page table may still share it
+// (cow: a private mapping, and more than one reference) gets PTE_COW
+// instead, so the first write copies it.  Huge pages cut by the
+// range are split first; returns -1 if that runs out of memory.
+int
+protectuvm(pde_t *pgdir, uint start, uint end, uint perm, int cow)
+{
+  struct tlbbatch b;
+  pte_t *pte;
+  uint a, size;
+
+  if((start % HUGEPGSIZE && unhuge(pgdir, start) < 0) ||
+     (end % HUGEPGSIZE && unhuge(pgdir, end) < 0))
+    return -1;
+
+  b.n = b.nfree = 0;
+  for(a = PGROUNDDOWN(start); a < end; a += size){
+    size = PGSIZE;
+    if((pte = walkpgdir(pgdir, (char*)a, 0)) == 0){
+      a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
+      continue;
+    }
+    if(*pte & PTE_PS)
+      size = HUGEPGSIZE;
+    if(!(*pte & PTE_P))
+      continue;
+    *pte = (*pte & ~(PTE_U | PTE_W)) | (perm & PTE_U);
+    if((perm & PTE_W) && !(*pte & PTE_COW)){
+      if(cow && krefcount(P2V(PTE_ADDR(*pte))) > 1)
+        *pte |= PTE_COW;
+      else
+        *pte |= PTE_W;
+    }
+    tlbinval(&b, a);
+  }
+  tlbflushdone(pgdir, &b);
   return 0;
 }
 
+// Unmap the user pages in [start, end) of pgdir, which must be
+// the running process's, dropping their frames' references, and
+// free page-table pages left empty.  A huge page only partly in
+// the range is first split into ordinary pages.  Returns -1 if
+// that runs out of memory.
+int
+unmapuvm(pde_t *pgdir, uint start, uint end)
+{
+  struct tlbbatch b;
+  pde_t *pde;
+  pte_t *pgtab;
+  uint a, next;
+  int i;
+
+  b.n = b.nfree = 0;
+  for(a = PGROUNDDOWN(start); a < end; a = next){
+    next = HUGEPGROUNDDOWN(a) + HUGEPGSIZE;
+    if(next > end || next < a)
+      next = end;
+    pde = &pgdir[PDX(a)];
+    if(!(*pde & PTE_P))
+      continue;
+    if(*pde & PDE_SHARED){
+      if(next - a == HUGEPGSIZE && ptdrop(pde)){
+        b.n += TLBFLUSHMAX + 1;  // too many pages to invalidate one by one
+        continue;
+      }
+      if(ptunshare(pgdir, pde) < 0){
+        tlbflushdone(pgdir, &b);
+        return -1;
+      }
+    }
+    if((*pde & PTE_PS) && (a % HUGEPGSIZE || next - a != HUGEPGSIZE) &&
+       hugesplit(pgdir, &b, HUGEPGROUNDDOWN(a), start, end) < 0){
+      tlbflushdone(pgdir, &b);
+      return -1;
+    }
+    if(*pde & PTE_PS){
+      pgtab = (pte_t*)P2V(PTE_ADDR(*pde));
+      *pde = 0;
+      tlbinval(&b, a);
+      tlbfree(pgdir, &b, (char*)pgtab, 1);
+      continue;
+    }
+
+    pgtab = (pte_t*)P2V(PTE_ADDR(*pde));
+    for(i = PTX(a); i < NPTENTRIES && PGADDR(PDX(a), i, 0) < next; i++){
+      if(pgtab[i] & PTE_P){
+        char *v = P2V(PTE_ADDR(pgtab[i]));
+        pgtab[i] = 0;
+        tlbinval(&b, PGADDR(PDX(a), i, 0));
+        tlbfree(pgdir, &b, v, 0);
+      } else if(pgtab[i] & PTE_SWAP){
+        swapfree(pgtab[i]);
+        pgtab[i] = 0;
+      }
+    }
+
+    for(i = 0; i < NPTENTRIES; i++)
+      if(pgtab[i] & (PTE_P|PTE_SWAP))
+        break;
+    if(i == NPTENTRIES){
+      *pde = 0;
+      tlbinval(&b, a);  // also drops cached directory entries
+      tlbfree(pgdir, &b, (char*)pgtab, 0);
+    }
+  }
+  tlbflushdone(pgdir, &b);
+  return 0;
+}
+
+// Does any MAP_SHARED mapping of mm reach into the 4MB that page
+// directory entry pdx covers?
+static int
+ptshared(struct mm *mm, uint pdx)
+{
+  struct mem_mapping *m;
+  uint lo = PGADDR(pdx, 0, 0), hi = lo + HUGEPGSIZE;
+
+  m = vma_floor(mm->memoryMappings, lo);
+  if(m == 0 || vma_end(m) <= lo)
+    m = vma_above(mm->memoryMappings, lo);
+  for(; m && m->addr < hi; m = vma_above(mm->memoryMappings, m->addr))
+    if(m->flags & MAP_SHARED)
+      return 1;
+  return 0;
+}
+
+// Given a parent's address space mm, create a page table for a
+// child.  The page tables of only private memory are shared, for
+// the first of the two to change one to copy (see ptunshare), so
+// fork costs a step per page table rather than per page.  In the
+// others the heap's pages (below sz) are shared copy-on-write:
+// writable pages lose PTE_W and gain PTE_COW in both tables, and
+// every shared page gets an extra reference so the first writer
+// copies it (see page_fault_handler) and the last one just takes
+// it over.  Pages out in swap share their slot the same way.  fork
+// does the same for the pages of private mappings.  mm must be the
+// running process's, and locked.
 pde_t*
-copyuvmprivate(pde_t *pgdir, uint sz)
+copyuvm(struct mm *mm)
 {
-  pde_t *d;
-  pte_t *pte;
+  pde_t *d, *pgdir = mm->pgdir;
+  pte_t *pte, *cpte;
   uint pa, i, flags;
+  struct tlbbatch b;
 
   if((d = setupkvm()) == 0)
     return 0;
+  b.n = b.nfree = 0;
+  acquire(&ptlock);
+  for(i = 0; i < PDX(KERNBASE); i++){
+    if((pgdir[i] & (PTE_P|PTE_PS)) != PTE_P || ptshared(mm, i))
+      continue;
+    if(!(pgdir[i] & PDE_SHARED)){
+      pgdir[i] = (pgdir[i] & ~PTE_W) | PDE_SHARED;
+      b.n = TLBFLUSHMAX + 1;  // the parent may no longer write through it
+    }
+    d[i] = pgdir[i];
+    kref(P2V(PTE_ADDR(pgdir[i])));
+  }
+  release(&ptlock);
 
-  for(i = 0; i < sz; i += PGSIZE) {
+  for(i = 0; i < mm->sz; i += PGSIZE){
+    if(d[PDX(i)] & PDE_SHARED){
+      i = PGADDR(PDX(i) + 1, 0, 0) - PGSIZE;
+      continue;
+    }
+    // pages of the program not faulted in yet are left to the
+    // child to fault in from its copy of the mappings
     if((pte = walkpgdir(pgdir, (void *) i, 0)) == 0)
-      panic("copyuvm: pte should exist");
+      continue;
+    if(*pte & PTE_SWAP){
+      if((cpte = walkpgdir(d, (void *) i, 1)) == 0)
+        goto bad;
+      *cpte = *pte;
+      swapdup(*pte);
+      continue;
+    }
     if(!(*pte & PTE_P))
-      panic("copyuvm: page not present");
+      continue;
+    if(*pte & PTE_W){
+      *pte = (*pte & ~PTE_W) | PTE_COW;
+      tlbinval(&b, i);
+    }
     pa = PTE_ADDR(*pte);
     flags = PTE_FLAGS(*pte);
-    flags &= ~PTE_W;
-    if(mappages(d, (void*)i, PGSIZE, pa, flags) < 0) {
+    if(mappages(d, (void*)i, PGSIZE, pa, flags) < 0)
       goto bad;
-    }
+    kref(P2V(pa));
   }
-
+  tlbflushdone(pgdir, &b);  // the parent's PTEs lost PTE_W
   return d;
 
 bad:
+  tlbflushdone(pgdir, &b);
   freevm(d);
   return 0;
 }
 
-
 //PAGEBREAK!
 // Map user virtual address to kernel address.
 char*
@@ -397,6 +781,8 @@ uva2ka(pde_t *pgdir, char *uva)
   pte_t *pte;
 
   pte = walkpgdir(pgdir, uva, 0);
+  if(pte == 0)
+    return 0;
   if((*pte & PTE_P) == 0)
     return 0;
   if((*pte & PTE_U) == 0)
@@ -405,14 +791,22 @@ uva2ka(pde_t *pgdir, char *uva)
 }
 
 // Copy len bytes from p to user address va in page table pgdir.
-// Most useful when pgdir is not the current page table.
-// uva2ka ensures this only works for PTE_U pages.
+// The current process's own memory is checked against its
+// mappings, faulted in and copied in one go; in another page
+// table (exec's new one) uva2ka ensures this only works for
+// PTE_U pages.
 int
 copyout(pde_t *pgdir, uint va, void *p, uint len)
 {
   char *buf, *pa0;
   uint n, va0;
 
+  if(myproc() && pgdir == myproc()->mm->pgdir){
+    if(uaccess(va, len, 1) < 0)
+      return -1;
+    memmove((char*)va, p, len);
+    return 0;
+  }
   buf = (char*)p;
   while(len > 0){
     va0 = (uint)PGROUNDDOWN(va);
@@ -430,6 +824,17 @@ copyout(pde_t *pgdir, uint va, void *p, uint len)
   return 0;
 }
 
+// Copy len bytes from user address va of the current process
+// to dst, checking va against its mappings and faulting it in.
+int
+copyin(void *dst, uint va, uint len)
+{
+  if(uaccess(va, len, 0) < 0)
+    return -1;
+  memmove(dst, (char*)va, len);
+  return 0;
+}
+
 //PAGEBREAK!
 // Blank page.
 //PAGEBREAK!
@@ -0,0 +1,482 @@
+//
+// Per-process index of memory mappings (VMAs).
+//
+// Each process keeps its mmap regions in an AVL tree keyed by
+// start address, so page faults, mmap and munmap find a mapping
+// in O(log n) instead of scanning an array.  Every node also
+// records the span of its subtree and the largest hole between
+// two mappings inside it, which lets vma_findgap() locate free
+// address space without visiting every mapping.
+//
+// Nodes come from a system-wide table, like struct file, so the
+// number of mappings per process is only limited by NVMA.  A file
+// mapping's node holds a reference to the file, taken with the
+// node (vma_split, vma_copy) and dropped by vma_free.
+//
+// The tree belongs to an address space (struct mm), which clone
+// threads share, so its mm->lock protects the tree (in mmap,
+// munmap, the page fault handler, fork and exit); vmatable.lock
+// protects node allocation.
+//
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "proc.h"
+#include "mmap.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+
+struct {
+  struct spinlock lock;
+  struct mem_mapping map[NVMA];
+  struct mem_mapping *freelist;
+} vmatable;
+
+void
+vmainit(void)
+{
+  struct mem_mapping *m;
+
+  initlock(&vmatable.lock, "vmatable");
+  for(m = vmatable.map; m < vmatable.map + NVMA; m++){
+    m->right = vmatable.freelist;
+    vmatable.freelist = m;
+  }
+}
+
+// Allocate a zeroed mapping node.  Returns 0 if the table is full.
+struct mem_mapping*
+vma_alloc(void)
+{
+  struct mem_mapping *m;
+
+  acquire(&vmatable.lock);
+  m = vmatable.freelist;
+  if(m)
+    vmatable.freelist = m->right;
+  release(&vmatable.lock);
+  if(m)
+    memset(m, 0, sizeof(*m));
+  return m;
+}
+
+void
+vma_free(struct mem_mapping *m)
+{
+  if(m->file){
+    fileclose(m->file);
+    m->file = 0;
+  }
+  acquire(&vmatable.lock);
+  m->right = vmatable.freelist;
+  vmatable.freelist = m;
+  release(&vmatable.lock);
+}
+
+// PTE permissions for the pages of mapping m.  PROT_NONE pages
+// are present but lack PTE_U, so only the kernel can reach them.
+uint
+vma_pteflags(struct mem_mapping *m)
+{
+  if(m->prot == PROT_NONE)
+    return 0;
+  return PTE_U | ((m->prot & PROT_WRITE) ? PTE_W : 0);
+}
+
+// First address past the end of mapping m.
+uint
+vma_end(struct mem_mapping *m)
+{
+  return PGROUNDUP(m->addr + m->length);
+}
+
+static int
+height(struct mem_mapping *m)
+{
+  return m ? m->height : 0;
+}
+
+static uint
+maxu(uint a, uint b)
+{
+  return a > b ? a : b;
+}
+
+// Recompute the height and the augmented fields of m
+// from its children.
+static void
+fixup(struct mem_mapping *m)
+{
+  struct mem_mapping *l = m->left, *r = m->right;
+
+  m->height = 1 + (height(l) > height(r) ? height(l) : height(r));
+  m->lo = l ? l->lo : m->addr;
+  m->hi = r ? r->hi : vma_end(m);
+  m->maxgap = 0;
+  if(l)
+    m->maxgap = maxu(l->maxgap, m->addr - l->hi);
+  if(r)
+    m->maxgap = maxu(m->maxgap, maxu(r->maxgap, r->lo - vma_end(m)));
+}
+
+static struct mem_mapping*
+rotateright(struct mem_mapping *m)
+{
+  struct mem_mapping *l = m->left;
+
+  m->left = l->right;
+  l->right = m;
+  fixup(m);
+  fixup(l);
+  return l;
+}
+
+static struct mem_mapping*
+rotateleft(struct mem_mapping *m)
+{
+  struct mem_mapping *r = m->right;
+
+  m->right = r->left;
+  r->left = m;
+  fixup(m);
+  fixup(r);
+  return r;
+}
+
+static struct mem_mapping*
+balance(struct mem_mapping *m)
+{
+  fixup(m);
+  if(height(m->left) > height(m->right) + 1){
+    if(height(m->left->right) > height(m->left->left))
+      m->left = rotateleft(m->left);
+    return rotateright(m);
+  }
+  if(height(m->right) > height(m->left) + 1){
+    if(height(m->right->left) > height(m->right->right))
+      m->right = rotateright(m->right);
+    return rotateleft(m);
+  }
+  return m;
+}
+
+static struct mem_mapping*
+insertnode(struct mem_mapping *t, struct mem_mapping *m)
+{
+  if(t == 0){
+    m->left = m->right = 0;
+    fixup(m);
+    return m;
+  }
+  if(m->addr < t->addr)
+    t->left = insertnode(t->left, m);
+  else
+    t->right = insertnode(t->right, m);
+  return balance(t);
+}
+
+// Detach the lowest node of tree t into *min.
+static struct mem_mapping*
+removemin(struct mem_mapping *t, struct mem_mapping **min)
+{
+  if(t->left == 0){
+    *min = t;
+    return t->right;
+  }
+  t->left = removemin(t->left, min);
+  return balance(t);
+}
+
+static struct mem_mapping*
+removenode(struct mem_mapping *t, struct mem_mapping *m)
+{
+  struct mem_mapping *s;
+
+  if(t == 0)
+    panic("vma_remove");
+  if(m->addr < t->addr)
+    t->left = removenode(t->left, m);
+  else if(m->addr > t->addr)
+    t->right = removenode(t->right, m);
+  else {
+    if(t != m)
+      panic("vma_remove dup");
+    if(t->right == 0)
+      return t->left;
+    t->right = removemin(t->right, &s);
+    s->left = t->left;
+    s->right = t->right;
+    return balance(s);
+  }
+  return balance(t);
+}
+
+// Recompute the augmented fields on the path to m,
+// after m's length changed in place.
+static void
+refresh(struct mem_mapping *t, struct mem_mapping *m)
+{
+  if(t == 0)
+    panic("vma_resized");
+  if(m->addr < t->addr)
+    refresh(t->left, m);
+  else if(m->addr > t->addr)
+    refresh(t->right, m);
+  fixup(t);
+}
+
+// Add m to the tree rooted at *root.  The caller must have
+// checked that m does not overlap an existing mapping.
+void
+vma_insert(struct mem_mapping **root, struct mem_mapping *m)
+{
+  *root = insertnode(*root, m);
+}
+
+void
+vma_remove(struct mem_mapping **root, struct mem_mapping *m)
+{
+  *root = removenode(*root, m);
+  m->left = m->right = 0;
+}
+
+void
+vma_resized(struct mem_mapping *root, struct mem_mapping *m)
+{
+  refresh(root, m);
+}
+
+// Return the mapping that contains va, or 0.
+struct mem_mapping*
+vma_lookup(struct mem_mapping *t, uint va)
+{
+  while(t){
+    if(va < t->addr)
+      t = t->left;
+    else if(va >= vma_end(t))
+      t = t->right;
+    else
+      return t;
+  }
+  return 0;
+}
+
+// Return the mapping with the highest start address <= va, or 0.
+struct mem_mapping*
+vma_floor(struct mem_mapping *t, uint va)
+{
+  struct mem_mapping *best = 0;
+
+  while(t){
+    if(t->addr <= va){
+      best = t;
+      t = t->right;
+    } else
+      t = t->left;
+  }
+  return best;
+}
+
+// Return the mapping with the lowest start address > va, or 0.
+struct mem_mapping*
+vma_above(struct mem_mapping *t, uint va)
+{
+  struct mem_mapping *best = 0;
+
+  while(t){
+    if(t->addr > va){
+      best = t;
+      t = t->left;
+    } else
+      t = t->right;
+  }
+  return best;
+}
+
+// Return the lowest mapping, or 0 if there are none.
+struct mem_mapping*
+vma_first(struct mem_mapping *t)
+{
+  if(t)
+    while(t->left)
+      t = t->left;
+  return t;
+}
+
+// Does any mapping intersect [start, end)?
+int
+vma_overlaps(struct mem_mapping *t, uint start, uint end)
+{
+  while(t){
+    if(end <= t->lo || start >= t->hi)
+      return 0;
+    if(start < vma_end(t) && end > t->addr)
+      return 1;
+    if(start < t->addr && vma_overlaps(t->left, start, end))
+      return 1;
+    t = t->right;
+  }
+  return 0;
+}
+
+// Lowest address a >= from in [lo, hi) such that [a, a+len)
+// misses every mapping in t, assuming none of t's mappings extend
+// outside [lo, hi).  Returns 0 if there is no such hole.
+// Subtrees that lie wholly above from are pruned by their maxgap,
+// so only the path towards from is walked without pruning.
+static uint
+findgap(struct mem_mapping *t, uint lo, uint hi, uint len, uint from)
+{
+  uint a, start;
+
+  start = lo > from ? lo : from;
+  if(hi < start || hi - start < len)
+    return 0;
+  if(t == 0)
+    return start;
+  if(lo >= from && t->lo - lo < len && t->maxgap < len && hi - t->hi < len)
+    return 0;
+  if(t->addr > start && (a = findgap(t->left, lo, t->addr, len, from)) != 0)
+    return a;
+  return findgap(t->right, vma_end(t), hi, len, from);
+}
+
+// Find the lowest page-aligned hole of len bytes in [lo, hi),
+// starting at or above from, that no mapping in the tree occupies.
+// Returns 0 on failure.
+uint
+vma_findgap(struct mem_mapping *root, uint len, uint lo, uint hi, uint from)
+{
+  return findgap(root, lo, hi, PGROUNDUP(len), PGROUNDUP(from));
+}
+
+// Split m at page-aligned addr, strictly inside it, into m, which
+// keeps [m->addr, addr), and a new node for the rest, which is
+// returned.  Returns 0 if the table is out of nodes.
+struct mem_mapping*
+vma_split(struct mem_mapping **root, struct mem_mapping *m, uint addr)
+{
+  struct mem_mapping *n;
+
+  if(addr <= m->addr || addr >= vma_end(m) || addr % PGSIZE)
+    panic("vma_split");
+  if((n = vma_alloc()) == 0)
+    return 0;
+  *n = *m;
+  if(n->file)
+    filedup(n->file);
+  n->addr = addr;
+  n->length = m->addr + m->length - addr;
+  n->offset = m->offset + (addr - m->addr);
+  n->filesz = m->filesz > addr - m->addr ? m->filesz - (addr - m->addr) : 0;
+  n->ra_next = 0;
+  n->ra_window = 0;
+  m->length = addr - m->addr;
+  vma_resized(*root, m);
+  vma_insert(root, n);
+  return n;
+}
+
+// Can b, which starts where a ends, be folded into a?
+static int
+mergeable(struct mem_mapping *a, struct mem_mapping *b)
+{
+  if(vma_end(a) != b->addr || a->flags != b->flags || a->prot != b->prot ||
+     a->advice != b->advice || (a->flags & (MAP_GROWSUP | MAP_IMAGE)))
+    return 0;
+  if(a->flags & MAP_ANONYMOUS)
+    return 1;
+  return a->file->ip == b->file->ip && a->offset + (b->addr - a->addr) == b->offset;
+}
+
+// Fold b into a, which it directly follows.
+static void
+absorb(struct mem_mapping **root, struct mem_mapping *a, struct mem_mapping *b)
+{
+  vma_remove(root, b);
+  a->length = b->addr + b->length - a->addr;
+  a->allocated |= b->allocated;
+  vma_resized(*root, a);
+  vma_free(b);
+}
+
+// Merge *m with the mappings directly below and above it if they
+// have the same flags, protection and advice (and the same file,
+// at the matching offset),
+// so runs of adjacent mmaps cost one node.  Sets *m to the merged
+// mapping and returns how many nodes went away.
+int
+vma_merge(struct mem_mapping **root, struct mem_mapping **m)
+{
+  struct mem_mapping *prev, *next;
+  int n = 0;
+
+  if((*m)->addr > 0 && (prev = vma_floor(*root, (*m)->addr - 1)) != 0 &&
+     mergeable(prev, *m)){
+    absorb(root, prev, *m);
+    *m = prev;
+    n++;
+  }
+  if((next = vma_above(*root, (*m)->addr)) != 0 && mergeable(*m, next)){
+    absorb(root, *m, next);
+    n++;
+  }
+  return n;
+}
+
+static struct mem_mapping*
+copytree(struct mem_mapping *t, int *err)
+{
+  struct mem_mapping *m;
+
+  if(t == 0 || *err)
+    return 0;
+  if((m = vma_alloc()) == 0){
+    *err = 1;
+    return 0;
+  }
+  *m = *t;
+  if(m->file)
+    filedup(m->file);
+  m->left = copytree(t->left, err);
+  m->right = copytree(t->right, err);
+  return m;
+}
+
+static void
+freetree(struct mem_mapping *t)
+{
+  if(t == 0)
+    return;
+  freetree(t->left);
+  freetree(t->right);
+  vma_free(t);
+}
+
+// Give *dst a copy of every mapping in src, keeping src's shape.
+// Returns -1, leaving *dst empty, if the table runs out of nodes.
+int
+vma_copy(struct mem_mapping **dst, struct mem_mapping *src)
+{
+  int err = 0;
+
+  *dst = copytree(src, &err);
+  if(err){
+    freetree(*dst);
+    *dst = 0;
+    return -1;
+  }
+  return 0;
+}
+
+// Release every mapping node in the tree.
+void
+vma_clear(struct mem_mapping **root)
+{
+  freetree(*root);
+  *root = 0;
+}
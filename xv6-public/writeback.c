@@ -0,0 +1,209 @@
+//
+// Writeback of MAP_SHARED file mappings.
+//
+// munmap and msync(MS_SYNC) write a mapping's dirty pages back
+// themselves; msync(MS_ASYNC) clears the dirty bits, queues the
+// pages and returns, and the "flusher" kernel thread writes them.
+// Either way the pages are written straight from their frames,
+// packed into as few log transactions as the per-operation block
+// budget allows.
+//
+// Only the part of a page inside the file is written, so that
+// unmapping a short file doesn't pad it out to whole pages.  A
+// MAP_GROWSUP mapping is how a file is grown through memory: its
+// pages are written whole, extending the file.
+//
+
+#include "types.h"
+#include "x86.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "mm.h"
+#include "mmap.h"
+
+#define WBPAGES 4  // pages one writeback transaction carries, log permitting
+
+#define NWBQ 64  // pages queued for the flusher
+
+// An open writeback transaction.
+struct wbtxn {
+  struct inode *ip;  // locked inode being written, or 0 if none open
+  int blocks;        // log blocks reserved for it
+  uint budget;       // bytes the transaction can still take
+};
+
+// A page handed to the flusher.  The queue holds a reference
+// on both the page and the inode.
+struct wbreq {
+  struct inode *ip;
+  char *page;
+  uint off;
+  int clamp;  // see wbpage
+};
+
+struct {
+  struct spinlock lock;
+  struct wbreq q[NWBQ];
+  uint r;  // next request to write
+  uint w;  // next free slot
+} wbq;
+
+static void
+wbend(struct wbtxn *t)
+{
+  if(t->ip){
+    iunlock(t->ip);
+    end_opn(t->blocks);
+    t->ip = 0;
+  }
+}
+
+// Write the page at page to ip at offset off, within the open
+// transaction if it has room, starting new ones as needed.  If
+// clamp, only as much of it as lies inside the file is written.
+static int
+wbpage(struct wbtxn *t, struct inode *ip, char *page, uint off, int clamp)
+{
+  uint o, n;
+
+  if(t->ip != ip)
+    wbend(t);
+  for(o = 0; o < PGSIZE; o += n){
+    // ip's size holds still while it is locked
+    if(clamp && t->ip == ip && off + o >= ip->size)
+      break;
+    if(t->ip == 0 || t->budget == 0){
+      wbend(t);
+      t->blocks = writeiblocks(WBPAGES*PGSIZE);
+      if(t->blocks > log_maxop())
+        t->blocks = log_maxop();
+      begin_opn(t->blocks);
+      ilock(ip);
+      t->ip = ip;
+      t->budget = writeimax(t->blocks);
+    }
+    n = PGSIZE - o < t->budget ? PGSIZE - o : t->budget;
+    if(clamp && off + o + n > ip->size){
+      if(off + o >= ip->size)
+        break;
+      n = ip->size - (off + o);
+    }
+    if(writei(ip, page + o, off + o, n) != n)
+      return -1;
+    t->budget -= n;
+  }
+  return 0;
+}
+
+// Queue a page for the flusher, waiting while the queue is full.
+static void
+wbqueue(struct inode *ip, char *page, uint off, int clamp)
+{
+  struct wbreq *q;
+
+  kref(page);
+  idup(ip);
+  acquire(&wbq.lock);
+  while(wbq.w - wbq.r == NWBQ)
+    sleep(&wbq.r, &wbq.lock);
+  q = &wbq.q[wbq.w++ % NWBQ];
+  q->ip = ip;
+  q->page = page;
+  q->off = off;
+  q->clamp = clamp;
+  wakeup(&wbq.w);
+  release(&wbq.lock);
+}
+
+// The flusher thread: write queued pages back in batches.
+static void
+flusher(void)
+{
+  struct wbreq batch[NWBQ];
+  struct wbtxn t;
+  int i, n;
+
+  for(;;){
+    acquire(&wbq.lock);
+    while(wbq.r == wbq.w)
+      sleep(&wbq.w, &wbq.lock);
+    for(n = 0; wbq.r != wbq.w; n++)
+      batch[n] = wbq.q[wbq.r++ % NWBQ];
+    wakeup(&wbq.r);
+    release(&wbq.lock);
+
+    // Nobody waits for these, so a page that cannot be written
+    // (e.g. it lies beyond a hole past the end of the file)
+    // is dropped.
+    t.ip = 0;
+    for(i = 0; i < n; i++)
+      if(wbpage(&t, batch[i].ip, batch[i].page, batch[i].off, batch[i].clamp) < 0)
+        wbend(&t);
+    wbend(&t);
+
+    begin_op();
+    for(i = 0; i < n; i++){
+      iput(batch[i].ip);
+      kfree(batch[i].page);
+    }
+    end_op();
+  }
+}
+
+void
+writebackinit(void)
+{
+  initlock(&wbq.lock, "wbq");
+  if(kthread("flusher", flusher) == 0)
+    panic("writebackinit");
+}
+
+// Write the modified pages of file mapping map in [start, end) back
+// to ip and clear their dirty bits.  Pages the process has not
+// written (PTE_D clear) are skipped, and so are pages past the end
+// of the file, except in a MAP_GROWSUP mapping, whose pages past
+// the end extend the file whether written or not.  If async, the
+// pages are queued for the flusher instead and this returns
+// without waiting.
+int
+mmap_writeback(struct proc *p, struct mem_mapping *map, struct inode *ip,
+               uint start, uint end, int async)
+{
+  struct wbtxn t;
+  pte_t *pte;
+  uint va, off;
+  struct tlbbatch cleared;
+  int grow, r = 0;
+
+  t.ip = 0;
+  cleared.n = cleared.nfree = 0;
+  grow = (map->flags & MAP_GROWSUP) != 0;
+  for(va = PGROUNDDOWN(start); va < end && r == 0; va += PGSIZE){
+    pte = walkpgdir(p->mm->pgdir, (void*)va, 0);
+    if(pte == 0 || !(*pte & PTE_P))
+      continue;
+    off = map->offset + (va - map->addr);
+    // An unlocked look at the size is enough here: at worst a page
+    // is written back needlessly, or clamped to nothing by wbpage.
+    if(grow ? !(*pte & PTE_D) && off < ip->size : !(*pte & PTE_D) || off >= ip->size)
+      continue;
+    if(*pte & PTE_D){
+      *pte &= ~PTE_D;
+      tlbinval(&cleared, va);  // or the CPU won't set PTE_D again
+    }
+    if(async)
+      wbqueue(ip, P2V(PTE_ADDR(*pte)), off, !grow);
+    else
+      r = wbpage(&t, ip, P2V(PTE_ADDR(*pte)), off, !grow);
+  }
+  wbend(&t);
+  tlbflushdone(p->mm->pgdir, &cleared);
+  return r;
+}